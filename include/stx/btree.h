@@ -41,11 +41,44 @@
 
 #include <algorithm>
 #include <functional>
+#include <iterator>
 #include <istream>
 #include <ostream>
 #include <memory>
+#include <string>
+#include <vector>
 #include <cstddef>
 #include <cassert>
+#include <new>
+
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif
+
+// *** Threads for Parallel Construction
+
+#if __cplusplus >= 201103L
+#include <exception>
+#include <thread>
+#endif
+
+// *** Vector Intrinsics for the In-Node Key Search
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// *** Memory Mapping for Huge Page Node Memory
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 // *** Debugging Macros
 
@@ -82,6 +115,41 @@
 /// STX - Some Template Extensions namespace
 namespace stx {
 
+/** Default aggregate of the traits, which disables subtree summaries. An
+ * aggregate is a monoid over the items of a tree: it declares enabled = true,
+ * a summary_type, the neutral identity(), an associative combine(a, b) and
+ * summarize(key, data) of one item. For sets, data is an empty placeholder.
+ * Inner nodes then cache the summary of each child, and btree::aggregate()
+ * combines the summaries of a key range in key order. verify() compares the
+ * cached summaries with operator==. */
+struct btree_no_aggregate
+{
+    /// True if inner nodes cache the summaries of their children.
+    static const bool enabled = false;
+
+    /// Type of the summaries.
+    typedef char summary_type;
+
+    /// Returns the summary of no items.
+    static inline summary_type identity()
+    {
+        return 0;
+    }
+
+    /// Returns the summary of the items of a followed by those of b.
+    static inline summary_type combine(const summary_type&, const summary_type&)
+    {
+        return 0;
+    }
+
+    /// Returns the summary of a single item.
+    template <typename _Key, typename _Data>
+    static inline summary_type summarize(const _Key&, const _Data&)
+    {
+        return 0;
+    }
+};
+
 /** Generates default traits for a B+ tree used as a set. It estimates leaf and
  * inner node sizes by assuming a cache line size of 256 bytes. */
 template <typename _Key>
@@ -111,6 +179,55 @@ public:
     /// than this threshold. See notes at
     /// http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
     static const size_t binsearch_threshold = 256;
+
+    /// If true, find_lower() and find_upper() compare a whole cache line of
+    /// keys at once using SSE2/AVX2 instructions, if the key type is integral
+    /// or floating-point and ordered by std::less. See btree_simd_search.
+    static const bool simd_search = true;
+
+    /// If true, key_compare must also provide a three-way comparison method
+    /// int compare(const _Key& a, const _Key& b) const, which returns a
+    /// negative, zero or positive value like memcmp(). The tree then decides
+    /// order and equality of two keys with a single comparison.
+    static const bool threeway_compare = false;
+
+    /// If true, the descent from the root prefetches all cache lines of the
+    /// child node's slotkey array as soon as the child slot is known, and
+    /// iterators prefetch the next leaf in their direction.
+    static const bool prefetch = false;
+
+    /// If true, leaf splits and bulk_load() put the shortest separator
+    /// between the two leaves into the parent instead of a copy of the left
+    /// leaf's largest key, see btree_separator. Saves memory and comparison
+    /// work for long string keys.
+    static const bool truncate_separators = false;
+
+    /// If true, each node caches an order-preserving 8-byte integer head of
+    /// each slot key, computed by btree_key_head. find_lower() and
+    /// find_upper() then compare the cached heads and call key_compare only
+    /// for keys with equal heads.
+    static const bool key_heads = false;
+
+    /// If true, leaf and inner nodes are carved out of large slabs by a
+    /// btree_pool_allocator on top of the tree's allocator, instead of
+    /// allocating each node separately. See btree_slab_pool. With trivially
+    /// destructible keys and data, clear() then releases the slabs at once.
+    static const bool node_pool = false;
+
+    /// If true, inner nodes store the number of items below each child. This
+    /// makes rank(), select(), distance() and count(lower, upper) run in
+    /// O(log n), but costs one size_type per child and some bookkeeping on
+    /// each insert and erase.
+    static const bool order_statistics = false;
+
+    /// Monoid whose summaries inner nodes cache for each child, which
+    /// aggregate() combines over key ranges. See btree_no_aggregate.
+    typedef btree_no_aggregate aggregate;
+
+    /// Number of threads the copy constructor and assignment operator use
+    /// to copy large trees, of which 0 means all hardware threads. Requires
+    /// C++11 threads.
+    static const unsigned int copy_threads = 1;
 };
 
 /** Generates default traits for a B+ tree used as a map. It estimates leaf and
@@ -142,2387 +259,6940 @@ public:
     /// than this threshold. See notes at
     /// http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
     static const size_t binsearch_threshold = 256;
+
+    /// If true, find_lower() and find_upper() compare a whole cache line of
+    /// keys at once using SSE2/AVX2 instructions, if the key type is integral
+    /// or floating-point and ordered by std::less. See btree_simd_search.
+    static const bool simd_search = true;
+
+    /// If true, key_compare must also provide a three-way comparison method
+    /// int compare(const _Key& a, const _Key& b) const, which returns a
+    /// negative, zero or positive value like memcmp(). The tree then decides
+    /// order and equality of two keys with a single comparison.
+    static const bool threeway_compare = false;
+
+    /// If true, the descent from the root prefetches all cache lines of the
+    /// child node's slotkey array as soon as the child slot is known, and
+    /// iterators prefetch the next leaf in their direction.
+    static const bool prefetch = false;
+
+    /// If true, leaf splits and bulk_load() put the shortest separator
+    /// between the two leaves into the parent instead of a copy of the left
+    /// leaf's largest key, see btree_separator. Saves memory and comparison
+    /// work for long string keys.
+    static const bool truncate_separators = false;
+
+    /// If true, each node caches an order-preserving 8-byte integer head of
+    /// each slot key, computed by btree_key_head. find_lower() and
+    /// find_upper() then compare the cached heads and call key_compare only
+    /// for keys with equal heads.
+    static const bool key_heads = false;
+
+    /// If true, leaf and inner nodes are carved out of large slabs by a
+    /// btree_pool_allocator on top of the tree's allocator, instead of
+    /// allocating each node separately. See btree_slab_pool. With trivially
+    /// destructible keys and data, clear() then releases the slabs at once.
+    static const bool node_pool = false;
+
+    /// If true, inner nodes store the number of items below each child. This
+    /// makes rank(), select(), distance() and count(lower, upper) run in
+    /// O(log n), but costs one size_type per child and some bookkeeping on
+    /// each insert and erase.
+    static const bool order_statistics = false;
+
+    /// Monoid whose summaries inner nodes cache for each child, which
+    /// aggregate() combines over key ranges. See btree_no_aggregate.
+    typedef btree_no_aggregate aggregate;
+
+    /// Number of threads the copy constructor and assignment operator use
+    /// to copy large trees, of which 0 means all hardware threads. Requires
+    /// C++11 threads.
+    static const unsigned int copy_threads = 1;
 };
 
-/** @brief Basic class implementing a base B+ tree data structure in memory.
- *
- * The base implementation of a memory B+ tree. It is based on the
- * implementation in Cormen's Introduction into Algorithms, Jan Jannink's paper
- * and other algorithm resources. Almost all STL-required function calls are
- * implemented. The asymptotic time requirements of the STL are not always
- * fulfilled in theory, however in practice this B+ tree performs better than a
- * red-black tree by using more memory. The insertion function splits the nodes
- * on the recursion unroll. Erase is largely based on Jannink's ideas.
- *
- * This class is specialized into btree_set, btree_multiset, btree_map and
- * btree_multimap using default template parameters and facade functions.
- */
-template <typename _Key, typename _Data,
-          typename _Value = std::pair<_Key, _Data>,
-          typename _Compare = std::less<_Key>,
-          typename _Traits = btree_default_map_traits<_Key, _Data>,
-          bool _Duplicates = false,
-          typename _Alloc = std::allocator<_Value>,
-          bool _UsedAsSet = false>
-class btree
-{
-public:
-    // *** Template Parameter Types
+// *** Vectorized In-Node Key Search
 
-    /// First template parameter: The key type of the B+ tree. This is stored
-    /// in inner nodes and leaves
-    typedef _Key key_type;
+/** Selects a vectorized in-node search for find_lower() and find_upper(). The
+ * generic template disables it: the B+ tree then falls back to the scalar
+ * search using the key_compare object. Specializations below enable it for
+ * integral and floating-point keys ordered by std::less, if the compiler
+ * targets the SSE2 (or AVX2) instruction set. */
+template <typename _Key, typename _Compare>
+struct btree_simd_search
+{
+    /// True if the specialization implements a vectorized search.
+    static const bool enabled = false;
 
-    /// Second template parameter: The data type associated with each
-    /// key. Stored in the B+ tree's leaves
-    typedef _Data data_type;
+    /// Returns the number of keys in keys[0,n) less than key.
+    static inline int find_lower(const _Key*, int, const _Key&)
+    {
+        return 0;
+    }
 
-    /// Third template parameter: Composition pair of key and data types, this
-    /// is required by the STL standard. The B+ tree does not store key and
-    /// data together. If value_type == key_type then the B+ tree implements a
-    /// set.
-    typedef _Value value_type;
+    /// Returns the number of keys in keys[0,n) less or equal to key.
+    static inline int find_upper(const _Key*, int, const _Key&)
+    {
+        return 0;
+    }
+};
 
-    /// Fourth template parameter: Key comparison function object
-    typedef _Compare key_compare;
+#if defined(__GNUC__) && defined(__SSE2__)
 
-    /// Fifth template parameter: Traits object used to define more parameters
-    /// of the B+ tree
-    typedef _Traits traits;
+/** Generic driver of the vectorized search: the _Ops class compares all keys
+ * of a 64 byte cache line against the broadcast search key and returns a bit
+ * mask with one bit per key. Because the keys are sorted, the number of set
+ * bits is the position of the result inside the line. The remaining keys
+ * after the last full line are compared using a plain loop. */
+template <typename _Ops>
+struct btree_simd_scan
+{
+    /// Key type compared by the _Ops class.
+    typedef typename _Ops::key_type key_type;
 
-    /// Sixth template parameter: Allow duplicate keys in the B+ tree. Used to
-    /// implement multiset and multimap.
-    static const bool allow_duplicates = _Duplicates;
+    /// Register type holding the broadcast search key.
+    typedef typename _Ops::vector_type vector_type;
 
-    /// Seventh template parameter: STL allocator for tree nodes
-    typedef _Alloc allocator_type;
+    /// Mask returned by _Ops if all keys of a line matched.
+    static const unsigned int line_full = (1u << _Ops::line_keys) - 1;
 
-    /// Eighth template parameter: boolean indicator whether the btree is used
-    /// as a set. In this case all operations on the data arrays are
-    /// omitted. This flag is kind of hacky, but required because
-    /// sizeof(empty_struct) = 1 due to the C standard. Without the flag, lots
-    /// of superfluous copying would occur.
-    static const bool used_as_set = _UsedAsSet;
+    /// True if the specialization implements a vectorized search.
+    static const bool enabled = true;
 
-    // The macro BTREE_FRIENDS can be used by outside class to access the B+
-    // tree internals. This was added for wxBTreeDemo to be able to draw the
-    // tree.
-    BTREE_FRIENDS
+    /// Returns the number of keys in keys[0,n) less than key.
+    static inline int find_lower(const key_type* keys, int n, const key_type& key)
+    {
+        vector_type vkey = _Ops::broadcast(key);
 
-public:
-    // *** Constructed Types
+        int lo = 0;
+        for ( ; lo + _Ops::line_keys <= n; lo += _Ops::line_keys)
+        {
+            unsigned int mask = _Ops::less_mask(keys + lo, vkey);
+            if (mask != line_full)
+                return lo + __builtin_popcount(mask);
+        }
 
-    /// Typedef of our own type
-    typedef btree<key_type, data_type, value_type, key_compare,
-                  traits, allow_duplicates, allocator_type, used_as_set> self_type;
+        while (lo < n && keys[lo] < key) ++lo;
+        return lo;
+    }
 
-    /// Size type used to count keys
-    typedef size_t size_type;
+    /// Returns the number of keys in keys[0,n) less or equal to key.
+    static inline int find_upper(const key_type* keys, int n, const key_type& key)
+    {
+        vector_type vkey = _Ops::broadcast(key);
 
-    /// The pair of key_type and data_type, this may be different from
-    /// value_type.
-    typedef std::pair<key_type, data_type> pair_type;
+        int lo = 0;
+        for ( ; lo + _Ops::line_keys <= n; lo += _Ops::line_keys)
+        {
+            unsigned int mask = _Ops::lessequal_mask(keys + lo, vkey);
+            if (mask != line_full)
+                return lo + __builtin_popcount(mask);
+        }
 
-public:
-    // *** Static Constant Options and Values of the B+ Tree
+        while (lo < n && !(key < keys[lo])) ++lo;
+        return lo;
+    }
+};
 
-    /// Base B+ tree parameter: The number of key/data slots in each leaf
-    static const unsigned short leafslotmax = traits::leafslots;
+/** Compares a cache line of 32-bit integers. Unsigned keys are biased by
+ * flipping the sign bit, because SSE2 and AVX2 only compare signed
+ * integers. */
+template <typename _Key, bool _Signed>
+struct btree_simd_ops_int32
+{
+    typedef _Key key_type;
 
-    /// Base B+ tree parameter: The number of key slots in each inner node,
-    /// this can differ from slots in each leaf.
-    static const unsigned short innerslotmax = traits::innerslots;
+    /// Number of keys in a 64 byte cache line.
+    static const int line_keys = 16;
 
-    /// Computed B+ tree parameter: The minimum number of key/data slots used
-    /// in a leaf. If fewer slots are used, the leaf will be merged or slots
-    /// shifted from it's siblings.
-    static const unsigned short minleafslots = (leafslotmax / 2);
+    /// Sign bit flipped for unsigned keys.
+    static inline int bias(const key_type& key)
+    {
+        return _Signed ? static_cast<int>(key)
+               : static_cast<int>(static_cast<unsigned int>(key) ^ 0x80000000u);
+    }
 
-    /// Computed B+ tree parameter: The minimum number of key slots used
-    /// in an inner node. If fewer slots are used, the inner node will be
-    /// merged or slots shifted from it's siblings.
-    static const unsigned short mininnerslots = (innerslotmax / 2);
+#if defined(__AVX2__)
+    typedef __m256i vector_type;
 
-    /// Debug parameter: Enables expensive and thorough checking of the B+ tree
-    /// invariants after each insert/erase operation.
-    static const bool selfverify = traits::selfverify;
+    static inline vector_type broadcast(const key_type& key)
+    {
+        return _mm256_set1_epi32(bias(key));
+    }
 
-    /// Debug parameter: Prints out lots of debug information about how the
-    /// algorithms change the tree. Requires the header file to be compiled
-    /// with BTREE_DEBUG and the key type must be std::ostream printable.
-    static const bool debug = traits::debug;
+    /// Loads eight keys at p and applies the bias for unsigned keys.
+    static inline vector_type load(const key_type* p)
+    {
+        vector_type v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        return _Signed ? v : _mm256_xor_si256(v, _mm256_set1_epi32(bias(0)));
+    }
 
-private:
-    // *** Node Classes for In-Memory Nodes
+    /// Bit mask of the eight keys at p greater than vkey.
+    static inline unsigned int greater8(const key_type* p, const vector_type& vkey)
+    {
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(load(p), vkey)));
+    }
 
-    /// The header structure of each node in-memory. This structure is extended
-    /// by inner_node or leaf_node.
-    struct node
+    /// Bit mask of the eight keys at p less than vkey.
+    static inline unsigned int less8(const key_type* p, const vector_type& vkey)
     {
-        /// Level in the b-tree, if level == 0 -> leaf node
-        unsigned short level;
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(vkey, load(p))));
+    }
 
-        /// Number of key slotuse use, so number of valid children or data
-        /// pointers
-        unsigned short slotuse;
+    static inline unsigned int less_mask(const key_type* p, const vector_type& vkey)
+    {
+        return less8(p, vkey) | (less8(p + 8, vkey) << 8);
+    }
 
-        /// Delayed initialisation of constructed node
-        inline node(const unsigned short l, const unsigned short s = 0)
-            : level(l), slotuse(s)
-        { }
+    static inline unsigned int lessequal_mask(const key_type* p, const vector_type& vkey)
+    {
+        return ~(greater8(p, vkey) | (greater8(p + 8, vkey) << 8)) & 0xFFFF;
+    }
+#else
+    typedef __m128i vector_type;
 
-        /// True if this is a leaf node
-        inline bool    isleafnode() const
-        {
-            return (level == 0);
-        }
-    };
+    static inline vector_type broadcast(const key_type& key)
+    {
+        return _mm_set1_epi32(bias(key));
+    }
 
-    /// Extended structure of a inner node in-memory. Contains only keys and no
-    /// data items.
-    struct inner_node : public node
+    /// Loads four keys at p and applies the bias for unsigned keys.
+    static inline vector_type load(const key_type* p)
     {
-        /// Define an related allocator for the inner_node structs.
-        typedef typename _Alloc::template rebind<inner_node>::other alloc_type;
+        vector_type v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        return _Signed ? v : _mm_xor_si128(v, _mm_set1_epi32(bias(0)));
+    }
 
-        /// Keys of children or data pointers
-        key_type slotkey[innerslotmax];
+    /// Bit mask of the four keys at p greater than vkey.
+    static inline unsigned int greater4(const key_type* p, const vector_type& vkey)
+    {
+        return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(load(p), vkey)));
+    }
 
-        /// Pointers to children
-        node     * childid[innerslotmax + 1];
+    /// Bit mask of the four keys at p less than vkey.
+    static inline unsigned int less4(const key_type* p, const vector_type& vkey)
+    {
+        return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(load(p), vkey)));
+    }
 
-        /// Set variables to initial values
-        inline inner_node(const unsigned short l)
-            : node(l)
-        { }
+    static inline unsigned int less_mask(const key_type* p, const vector_type& vkey)
+    {
+        return less4(p, vkey) | (less4(p + 4, vkey) << 4)
+               | (less4(p + 8, vkey) << 8) | (less4(p + 12, vkey) << 12);
+    }
 
-        /// Construction during restore from node top
-        inline inner_node(const node& top)
-            : node(top.level, top.slotuse)
-        { }
+    static inline unsigned int lessequal_mask(const key_type* p, const vector_type& vkey)
+    {
+        return ~(greater4(p, vkey) | (greater4(p + 4, vkey) << 4)
+                 | (greater4(p + 8, vkey) << 8) | (greater4(p + 12, vkey) << 12)) & 0xFFFF;
+    }
+#endif
+};
 
-        /// True if the node's slots are full
-        inline bool isfull() const
-        {
-            return (node::slotuse == innerslotmax);
-        }
+#if defined(__AVX2__) || defined(__SSE4_2__)
 
-        /// True if few used entries, less than half full
-        inline bool isfew() const
-        {
-            return (node::slotuse <= mininnerslots);
-        }
+/** Compares a cache line of 64-bit integers. The 64-bit compare instruction
+ * requires SSE4.2 or AVX2. Unsigned keys are biased by flipping the sign
+ * bit. */
+template <typename _Key, bool _Signed>
+struct btree_simd_ops_int64
+{
+    typedef _Key key_type;
 
-        /// True if node has too few entries
-        inline bool isunderflow() const
-        {
-            return (node::slotuse < mininnerslots);
-        }
-    };
+    /// Number of keys in a 64 byte cache line.
+    static const int line_keys = 8;
 
-    /// Extended structure of a leaf node in memory. Contains pairs of keys and
-    /// data items. Key and data slots are kept in separate arrays, because the
-    /// key array is traversed very often compared to accessing the data items.
-    struct leaf_node : public node
+    /// Sign bit flipped for unsigned keys.
+    static inline long long bias(const key_type& key)
     {
-        /// Define an related allocator for the leaf_node structs.
-        typedef typename _Alloc::template rebind<leaf_node>::other alloc_type;
+        return _Signed ? static_cast<long long>(key)
+               : static_cast<long long>(static_cast<unsigned long long>(key)
+                                        ^ (1ull << 63));
+    }
 
-        /// Double linked list pointers to traverse the leaves
-        leaf_node * prevleaf;
+#if defined(__AVX2__)
+    typedef __m256i vector_type;
 
-        /// Double linked list pointers to traverse the leaves
-        leaf_node * nextleaf;
+    static inline vector_type broadcast(const key_type& key)
+    {
+        return _mm256_set1_epi64x(bias(key));
+    }
 
-        /// Keys of children or data pointers
-        key_type  slotkey[leafslotmax];
+    /// Loads four keys at p and applies the bias for unsigned keys.
+    static inline vector_type load(const key_type* p)
+    {
+        vector_type v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        return _Signed ? v : _mm256_xor_si256(v, _mm256_set1_epi64x(bias(0)));
+    }
 
-        /// Array of data
-        data_type slotdata[used_as_set ? 1 : leafslotmax];
+    /// Bit mask of the four keys at p greater than vkey.
+    static inline unsigned int greater4(const key_type* p, const vector_type& vkey)
+    {
+        return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(load(p), vkey)));
+    }
 
-        /// Set variables to initial values
-        inline leaf_node()
-            : node(0), prevleaf(NULL), nextleaf(NULL)
-        { }
+    /// Bit mask of the four keys at p less than vkey.
+    static inline unsigned int less4(const key_type* p, const vector_type& vkey)
+    {
+        return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(vkey, load(p))));
+    }
 
-        /// Construction during restore from node top
-        inline leaf_node(const node& top)
-            : node(top.level, top.slotuse), prevleaf(NULL), nextleaf(NULL)
-        { }
+    static inline unsigned int less_mask(const key_type* p, const vector_type& vkey)
+    {
+        return less4(p, vkey) | (less4(p + 4, vkey) << 4);
+    }
 
-        /// True if the node's slots are full
-        inline bool isfull() const
-        {
-            return (node::slotuse == leafslotmax);
-        }
+    static inline unsigned int lessequal_mask(const key_type* p, const vector_type& vkey)
+    {
+        return ~(greater4(p, vkey) | (greater4(p + 4, vkey) << 4)) & 0xFF;
+    }
+#else
+    typedef __m128i vector_type;
 
-        /// True if few used entries, less than half full
-        inline bool isfew() const
-        {
-            return (node::slotuse <= minleafslots);
-        }
-
-        /// True if node has too few entries
-        inline bool isunderflow() const
-        {
-            return (node::slotuse < minleafslots);
-        }
+    static inline vector_type broadcast(const key_type& key)
+    {
+        return _mm_set1_epi64x(bias(key));
+    }
 
-        /// Set the (key,data) pair in slot. Overloaded function used by
-        /// bulk_load().
-        inline void set_slot(unsigned short slot, const pair_type& value)
-        {
-            BTREE_ASSERT(used_as_set == false);
-            BTREE_ASSERT(slot < node::slotuse);
-            slotkey[slot] = value.first;
-            slotdata[slot] = value.second;
-        }
+    /// Loads two keys at p and applies the bias for unsigned keys.
+    static inline vector_type load(const key_type* p)
+    {
+        vector_type v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        return _Signed ? v : _mm_xor_si128(v, _mm_set1_epi64x(bias(0)));
+    }
 
-        /// Set the key pair in slot. Overloaded function used by
-        /// bulk_load().
-        inline void set_slot(unsigned short slot, const key_type& key)
-        {
-            BTREE_ASSERT(used_as_set == true);
-            BTREE_ASSERT(slot < node::slotuse);
-            slotkey[slot] = key;
-        }
-    };
+    /// Bit mask of the two keys at p greater than vkey.
+    static inline unsigned int greater2(const key_type* p, const vector_type& vkey)
+    {
+        return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(load(p), vkey)));
+    }
 
-private:
-    // *** Template Magic to Convert a pair or key/data types to a value_type
+    /// Bit mask of the two keys at p less than vkey.
+    static inline unsigned int less2(const key_type* p, const vector_type& vkey)
+    {
+        return _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(vkey, load(p))));
+    }
 
-    /// For sets the second pair_type is an empty struct, so the value_type
-    /// should only be the first.
-    template <typename value_type, typename pair_type>
-    struct btree_pair_to_value
+    static inline unsigned int less_mask(const key_type* p, const vector_type& vkey)
     {
-        /// Convert a fake pair type to just the first component
-        inline value_type operator () (pair_type& p) const
-        {
-            return p.first;
-        }
-        /// Convert a fake pair type to just the first component
-        inline value_type operator () (const pair_type& p) const
-        {
-            return p.first;
-        }
-    };
+        return less2(p, vkey) | (less2(p + 2, vkey) << 2)
+               | (less2(p + 4, vkey) << 4) | (less2(p + 6, vkey) << 6);
+    }
 
-    /// For maps value_type is the same as the pair_type
-    template <typename value_type>
-    struct btree_pair_to_value<value_type, value_type>
+    static inline unsigned int lessequal_mask(const key_type* p, const vector_type& vkey)
     {
-        /// Identity "convert" a real pair type to just the first component
-        inline value_type operator () (pair_type& p) const
-        {
-            return p;
-        }
-        /// Identity "convert" a real pair type to just the first component
-        inline value_type operator () (const pair_type& p) const
-        {
-            return p;
-        }
-    };
+        return ~(greater2(p, vkey) | (greater2(p + 2, vkey) << 2)
+                 | (greater2(p + 4, vkey) << 4) | (greater2(p + 6, vkey) << 6)) & 0xFF;
+    }
+#endif
+};
 
-    /// Using template specialization select the correct converter used by the
-    /// iterators
-    typedef btree_pair_to_value<value_type, pair_type> pair_to_value_type;
+#endif // defined(__AVX2__) || defined(__SSE4_2__)
 
-public:
-    // *** Iterators and Reverse Iterators
+/** Compares a cache line of single precision floating-point keys. */
+struct btree_simd_ops_float
+{
+    typedef float key_type;
 
-    class iterator;
-    class const_iterator;
-    class reverse_iterator;
-    class const_reverse_iterator;
+    /// Number of keys in a 64 byte cache line.
+    static const int line_keys = 16;
 
-    /// STL-like iterator object for B+ tree items. The iterator points to a
-    /// specific slot number in a leaf.
-    class iterator
+#if defined(__AVX2__)
+    typedef __m256 vector_type;
+
+    static inline vector_type broadcast(const key_type& key)
     {
-    public:
-        // *** Types
+        return _mm256_set1_ps(key);
+    }
 
-        /// The key type of the btree. Returned by key().
-        typedef typename btree::key_type key_type;
+    static inline unsigned int less_mask(const key_type* p, const vector_type& vkey)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(p), vkey, _CMP_LT_OQ))
+               | (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(p + 8), vkey, _CMP_LT_OQ)) << 8);
+    }
 
-        /// The data type of the btree. Returned by data().
-        typedef typename btree::data_type data_type;
+    static inline unsigned int lessequal_mask(const key_type* p, const vector_type& vkey)
+    {
+        return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(p), vkey, _CMP_LE_OQ))
+               | (_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(p + 8), vkey, _CMP_LE_OQ)) << 8);
+    }
+#else
+    typedef __m128 vector_type;
 
-        /// The value type of the btree. Returned by operator*().
-        typedef typename btree::value_type value_type;
+    static inline vector_type broadcast(const key_type& key)
+    {
+        return _mm_set1_ps(key);
+    }
 
-        /// The pair type of the btree.
-        typedef typename btree::pair_type pair_type;
+    static inline unsigned int less_mask(const key_type* p, const vector_type& vkey)
+    {
+        return _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(p), vkey))
+               | (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(p + 4), vkey)) << 4)
+               | (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(p + 8), vkey)) << 8)
+               | (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(p + 12), vkey)) << 12);
+    }
 
-        /// Reference to the value_type. STL required.
-        typedef value_type& reference;
+    static inline unsigned int lessequal_mask(const key_type* p, const vector_type& vkey)
+    {
+        return _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(p), vkey))
+               | (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(p + 4), vkey)) << 4)
+               | (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(p + 8), vkey)) << 8)
+               | (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(p + 12), vkey)) << 12);
+    }
+#endif
+};
 
-        /// Pointer to the value_type. STL required.
-        typedef value_type* pointer;
+/** Compares a cache line of double precision floating-point keys. */
+struct btree_simd_ops_double
+{
+    typedef double key_type;
 
-        /// STL-magic iterator category
-        typedef std::bidirectional_iterator_tag iterator_category;
+    /// Number of keys in a 64 byte cache line.
+    static const int line_keys = 8;
 
-        /// STL-magic
-        typedef ptrdiff_t difference_type;
+#if defined(__AVX2__)
+    typedef __m256d vector_type;
 
-    private:
-        // *** Members
+    static inline vector_type broadcast(const key_type& key)
+    {
+        return _mm256_set1_pd(key);
+    }
 
-        /// The currently referenced leaf node of the tree
-        typename btree::leaf_node * currnode;
+    static inline unsigned int less_mask(const key_type* p, const vector_type& vkey)
+    {
+        return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p), vkey, _CMP_LT_OQ))
+               | (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p + 4), vkey, _CMP_LT_OQ)) << 4);
+    }
 
-        /// Current key/data slot referenced
-        unsigned short currslot;
+    static inline unsigned int lessequal_mask(const key_type* p, const vector_type& vkey)
+    {
+        return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p), vkey, _CMP_LE_OQ))
+               | (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p + 4), vkey, _CMP_LE_OQ)) << 4);
+    }
+#else
+    typedef __m128d vector_type;
 
-        /// Friendly to the const_iterator, so it may access the two data items
-        /// directly.
-        friend class const_iterator;
+    static inline vector_type broadcast(const key_type& key)
+    {
+        return _mm_set1_pd(key);
+    }
 
-        /// Also friendly to the reverse_iterator, so it may access the two
-        /// data items directly.
-        friend class reverse_iterator;
+    static inline unsigned int less_mask(const key_type* p, const vector_type& vkey)
+    {
+        return _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(p), vkey))
+               | (_mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(p + 2), vkey)) << 2)
+               | (_mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(p + 4), vkey)) << 4)
+               | (_mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(p + 6), vkey)) << 6);
+    }
 
-        /// Also friendly to the const_reverse_iterator, so it may access the
-        /// two data items directly.
-        friend class const_reverse_iterator;
+    static inline unsigned int lessequal_mask(const key_type* p, const vector_type& vkey)
+    {
+        return _mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(p), vkey))
+               | (_mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(p + 2), vkey)) << 2)
+               | (_mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(p + 4), vkey)) << 4)
+               | (_mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(p + 6), vkey)) << 6);
+    }
+#endif
+};
 
-        /// Also friendly to the base btree class, because erase_iter() needs
-        /// to read the currnode and currslot values directly.
-        friend class btree<key_type, data_type, value_type, key_compare,
-                           traits, allow_duplicates, allocator_type, used_as_set>;
+/** Maps integral key types to the vectorized compare of their width. Widths
+ * without a suitable compare instruction keep the scalar search. */
+template <typename _Key, bool _Signed, size_t _Size>
+struct btree_simd_integral : public btree_simd_search<_Key, void>
+{ };
+
+template <typename _Key, bool _Signed>
+struct btree_simd_integral<_Key, _Signed, 4>
+    : public btree_simd_scan<btree_simd_ops_int32<_Key, _Signed> >
+{ };
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+template <typename _Key, bool _Signed>
+struct btree_simd_integral<_Key, _Signed, 8>
+    : public btree_simd_scan<btree_simd_ops_int64<_Key, _Signed> >
+{ };
+#endif
 
-        /// Evil! A temporary value_type to STL-correctly deliver operator* and
-        /// operator->
-        mutable value_type temp_value;
+template <>
+struct btree_simd_search<int, std::less<int> >
+    : public btree_simd_integral<int, true, sizeof(int)>
+{ };
+
+template <>
+struct btree_simd_search<unsigned int, std::less<unsigned int> >
+    : public btree_simd_integral<unsigned int, false, sizeof(unsigned int)>
+{ };
+
+template <>
+struct btree_simd_search<long, std::less<long> >
+    : public btree_simd_integral<long, true, sizeof(long)>
+{ };
+
+template <>
+struct btree_simd_search<unsigned long, std::less<unsigned long> >
+    : public btree_simd_integral<unsigned long, false, sizeof(unsigned long)>
+{ };
+
+template <>
+struct btree_simd_search<long long, std::less<long long> >
+    : public btree_simd_integral<long long, true, sizeof(long long)>
+{ };
+
+template <>
+struct btree_simd_search<unsigned long long, std::less<unsigned long long> >
+    : public btree_simd_integral<unsigned long long, false, sizeof(unsigned long long)>
+{ };
+
+template <>
+struct btree_simd_search<float, std::less<float> >
+    : public btree_simd_scan<btree_simd_ops_float>
+{ };
+
+template <>
+struct btree_simd_search<double, std::less<double> >
+    : public btree_simd_scan<btree_simd_ops_double>
+{ };
+
+#endif // defined(__GNUC__) && defined(__SSE2__)
+
+// *** Three-Way Key Comparison
+
+/** Evaluates a three-way comparison of two keys. The generic version
+ * constructs it from two calls of the less-than key_compare object, the
+ * specialization for _ThreeWay = true calls key_compare::compare(). */
+template <typename _Key, typename _Compare, bool _ThreeWay>
+struct btree_three_way
+{
+    /// Returns a negative, zero or positive value if a < b, a == b or a > b.
+    static inline int compare(const _Compare& key_less, const _Key& a, const _Key& b)
+    {
+        return key_less(a, b) ? -1 : (key_less(b, a) ? +1 : 0);
+    }
+};
 
-        // The macro BTREE_FRIENDS can be used by outside class to access the B+
-        // tree internals. This was added for wxBTreeDemo to be able to draw the
-        // tree.
-        BTREE_FRIENDS
+/** Evaluates a three-way comparison of two keys by calling
+ * key_compare::compare(). */
+template <typename _Key, typename _Compare>
+struct btree_three_way<_Key, _Compare, true>
+{
+    /// Returns a negative, zero or positive value if a < b, a == b or a > b.
+    static inline int compare(const _Compare& key_cmp, const _Key& a, const _Key& b)
+    {
+        return key_cmp.compare(a, b);
+    }
+};
 
-    public:
-        // *** Methods
+// *** Truncated Separator Keys
 
-        /// Default-Constructor of a mutable iterator
-        inline iterator()
-            : currnode(NULL), currslot(0)
-        { }
+/** Computes separator keys for inner nodes if the traits enable
+ * truncate_separators. A separator s of two adjacent leaves must satisfy
+ * leftmax <= s < rightmin. The generic version returns leftmax, the
+ * specialization for std::string shortens it. Specialize this template to
+ * truncate separators of other key types. */
+template <typename _Key, typename _Compare>
+struct btree_separator
+{
+    /// Returns a separator of the largest key of the left leaf and the
+    /// smallest key of the right leaf.
+    static inline _Key shortest(const _Compare&, const _Key& leftmax, const _Key&)
+    {
+        return leftmax;
+    }
+};
 
-        /// Initializing-Constructor of a mutable iterator
-        inline iterator(typename btree::leaf_node* l, unsigned short s)
-            : currnode(l), currslot(s)
-        { }
+/** Truncates std::string separators to the shortest prefix of leftmax with
+ * its last character incremented, which still sorts before rightmin. */
+template <>
+struct btree_separator<std::string, std::less<std::string> >
+{
+    /// Returns a separator of the largest key of the left leaf and the
+    /// smallest key of the right leaf.
+    static inline std::string shortest(const std::less<std::string>&,
+                                       const std::string& leftmax,
+                                       const std::string& rightmin)
+    {
+        std::string::size_type n = std::min(leftmax.size(), rightmin.size());
+        std::string::size_type p = 0;
 
-        /// Copy-constructor from a reverse iterator
-        inline iterator(const reverse_iterator& it) // NOLINT
-            : currnode(it.currnode), currslot(it.currslot)
-        { }
+        while (p < n && leftmax[p] == rightmin[p]) ++p;
 
-        /// Dereference the iterator, this is not a value_type& because key and
-        /// value are not stored together
-        inline reference operator * () const
-        {
-            temp_value = pair_to_value_type()(pair_type(key(), data()));
-            return temp_value;
-        }
+        if (p == n) return leftmax;
 
-        /// Dereference the iterator. Do not use this if possible, use key()
-        /// and data() instead. The B+ tree does not stored key and data
-        /// together.
-        inline pointer operator -> () const
+        // std::string compares characters as unsigned char. Incrementing
+        // leftmax[p] must stay below rightmin[p], any later character of
+        // leftmax can be incremented freely.
+        for (std::string::size_type q = p; q + 1 < leftmax.size(); ++q)
         {
-            temp_value = pair_to_value_type()(pair_type(key(), data()));
-            return &temp_value;
-        }
+            unsigned char c = static_cast<unsigned char>(leftmax[q]);
 
-        /// Key of the current slot
-        inline const key_type & key() const
-        {
-            return currnode->slotkey[currslot];
+            if (c != 0xFF && (q != p || c + 1 < static_cast<unsigned char>(rightmin[p])))
+            {
+                std::string sep(leftmax, 0, q + 1);
+                sep[q] = static_cast<char>(c + 1);
+                return sep;
+            }
         }
 
-        /// Writable reference to the current data object
-        inline data_type & data() const
-        {
-            return currnode->slotdata[used_as_set ? 0 : currslot];
-        }
+        return leftmax;
+    }
+};
 
-        /// Prefix++ advance the iterator to the next slot
-        inline iterator& operator ++ ()
-        {
-            if (currslot + 1 < currnode->slotuse) {
-                ++currslot;
-            }
-            else if (currnode->nextleaf != NULL) {
-                currnode = currnode->nextleaf;
-                currslot = 0;
-            }
-            else {
-                // this is end()
-                currslot = currnode->slotuse;
-            }
+// *** Normalized Key Heads
 
-            return *this;
-        }
+/** Computes normalized key heads if the traits enable key_heads. The head of
+ * a key is an unsigned integer, such that a < b implies head(a) <= head(b) and
+ * head(a) < head(b) implies a < b. The generic template disables them,
+ * specialize it to provide the normalization for other key types. */
+template <typename _Key, typename _Compare>
+struct btree_key_head
+{
+    /// True if the specialization computes key heads.
+    static const bool enabled = false;
 
-        /// Postfix++ advance the iterator to the next slot
-        inline iterator operator ++ (int)
-        {
-            iterator tmp = *this;   // copy ourselves
+    /// Type of the normalized key head.
+    typedef unsigned long long head_type;
 
-            if (currslot + 1 < currnode->slotuse) {
-                ++currslot;
-            }
-            else if (currnode->nextleaf != NULL) {
-                currnode = currnode->nextleaf;
-                currslot = 0;
-            }
-            else {
-                // this is end()
-                currslot = currnode->slotuse;
-            }
+    /// Returns the normalized head of key.
+    static inline head_type head(const _Key&)
+    {
+        return 0;
+    }
+};
 
-            return tmp;
-        }
+/** Normalized heads of std::string keys: the first eight characters as big
+ * endian unsigned integer, padded with zeros. */
+template <>
+struct btree_key_head<std::string, std::less<std::string> >
+{
+    /// True if the specialization computes key heads.
+    static const bool enabled = true;
 
-        /// Prefix-- backstep the iterator to the last slot
-        inline iterator& operator -- ()
-        {
-            if (currslot > 0) {
-                --currslot;
-            }
-            else if (currnode->prevleaf != NULL) {
-                currnode = currnode->prevleaf;
-                currslot = currnode->slotuse - 1;
-            }
-            else {
-                // this is begin()
-                currslot = 0;
-            }
+    /// Type of the normalized key head.
+    typedef unsigned long long head_type;
 
-            return *this;
-        }
+    /// Returns the normalized head of key.
+    static inline head_type head(const std::string& key)
+    {
+        head_type h = 0;
 
-        /// Postfix-- backstep the iterator to the last slot
-        inline iterator operator -- (int)
-        {
-            iterator tmp = *this;   // copy ourselves
+        for (std::string::size_type i = 0; i < 8; ++i)
+            h = (h << 8) | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
 
-            if (currslot > 0) {
-                --currslot;
-            }
-            else if (currnode->prevleaf != NULL) {
-                currnode = currnode->prevleaf;
-                currslot = currnode->slotuse - 1;
-            }
-            else {
-                // this is begin()
-                currslot = 0;
-            }
+        return h;
+    }
+};
 
-            return tmp;
-        }
+// *** Slab Pool Allocator for Nodes
 
-        /// Equality of iterators
-        inline bool operator == (const iterator& x) const
-        {
-            return (x.currnode == currnode) && (x.currslot == currslot);
-        }
+/** Slab sizes used by btree_slab_pool on top of the base allocator _Alloc.
+ * Slabs start at min_size bytes and double up to max_size. Specialized for
+ * btree_huge_page_allocator, which maps whole huge pages. */
+template <typename _Alloc>
+struct btree_slab_size
+{
+    /// Size of the first slab of each object size.
+    static const size_t min_size = 4096;
 
-        /// Inequality of iterators
-        inline bool operator != (const iterator& x) const
-        {
-            return (x.currnode != currnode) || (x.currslot != currslot);
-        }
-    };
+    /// Maximum size of the slabs.
+    static const size_t max_size = 1024 * 1024;
+};
 
-    /// STL-like read-only iterator object for B+ tree items. The iterator
-    /// points to a specific slot number in a leaf.
-    class const_iterator
-    {
-    public:
-        // *** Types
+/** A memory pool, which carves fixed-size objects out of large slabs requested
+ * from the base allocator _Alloc. Each object size has its own slabs and free
+ * list, hence leaf_node and inner_node objects are packed densely and the base
+ * allocator is called only once per slab. Slabs start at min_slab_size bytes
+ * and double up to max_slab_size. Memory is returned to the base allocator only
+ * by the destructor or release(). The pool is not thread-safe. */
+template <typename _Alloc = std::allocator<char> >
+class btree_slab_pool
+{
+private:
+    /// Base allocator rebound to raw bytes.
+    typedef typename _Alloc::template rebind<char>::other char_alloc_type;
 
-        /// The key type of the btree. Returned by key().
-        typedef typename btree::key_type key_type;
+public:
+    /// Size of the first slab of each object size.
+    static const size_t min_slab_size = btree_slab_size<char_alloc_type>::min_size;
 
-        /// The data type of the btree. Returned by data().
-        typedef typename btree::data_type data_type;
+    /// Maximum size of the slabs, which grow geometrically.
+    static const size_t max_slab_size = btree_slab_size<char_alloc_type>::max_size;
 
-        /// The value type of the btree. Returned by operator*().
-        typedef typename btree::value_type value_type;
+    /// Number of different object sizes served from slabs. Other sizes are
+    /// passed through to the base allocator.
+    static const unsigned int max_sizes = 4;
 
-        /// The pair type of the btree.
-        typedef typename btree::pair_type pair_type;
+private:
 
-        /// Reference to the value_type. STL required.
-        typedef const value_type& reference;
+    /// Header at the beginning of each slab, linking all slabs together.
+    struct slab
+    {
+        /// Next slab in the list of all slabs
+        slab* next;
 
-        /// Pointer to the value_type. STL required.
-        typedef const value_type* pointer;
+        /// Total size of the slab in bytes
+        size_t bytes;
+    };
 
-        /// STL-magic iterator category
-        typedef std::bidirectional_iterator_tag iterator_category;
+    /// Size of the slab header, keeps objects 16 byte aligned.
+    static const size_t header_size = (sizeof(slab) + 15) & ~static_cast<size_t>(15);
 
-        /// STL-magic
-        typedef ptrdiff_t difference_type;
+    /// Entry of the free list, placed into unused objects.
+    struct free_object
+    {
+        /// Next unused object of the same size
+        free_object* next;
+    };
 
-    private:
-        // *** Members
+    /// Free list and unused part of the current slab for one object size.
+    struct size_class
+    {
+        /// Size of the objects
+        size_t size;
 
-        /// The currently referenced leaf node of the tree
-        const typename btree::leaf_node * currnode;
+        /// Head of the free list
+        free_object* freelist;
 
-        /// Current key/data slot referenced
-        unsigned short currslot;
+        /// Last object of the free list, if it is not empty
+        free_object* freetail;
 
-        /// Friendly to the reverse_const_iterator, so it may access the two
-        /// data items directly
-        friend class const_reverse_iterator;
+        /// Next unused object in the current slab
+        char* begin;
 
-        /// Evil! A temporary value_type to STL-correctly deliver operator* and
-        /// operator->
-        mutable value_type temp_value;
+        /// End of the objects in the current slab
+        char* end;
 
-        // The macro BTREE_FRIENDS can be used by outside class to access the B+
-        // tree internals. This was added for wxBTreeDemo to be able to draw the
-        // tree.
-        BTREE_FRIENDS
+        /// Size of the next slab
+        size_t slab_size;
+    };
 
-    public:
-        // *** Methods
+    /// Object sizes served from slabs
+    size_class m_class[max_sizes];
 
-        /// Default-Constructor of a const iterator
-        inline const_iterator()
-            : currnode(NULL), currslot(0)
-        { }
+    /// Number of used entries in m_class
+    unsigned int m_sizes;
 
-        /// Initializing-Constructor of a const iterator
-        inline const_iterator(const typename btree::leaf_node* l, unsigned short s)
-            : currnode(l), currslot(s)
-        { }
+    /// Single linked list of all slabs
+    slab* m_slabs;
 
-        /// Copy-constructor from a mutable iterator
-        inline const_iterator(const iterator& it) // NOLINT
-            : currnode(it.currnode), currslot(it.currslot)
-        { }
+    /// Number of slabs allocated
+    size_t m_numslabs;
 
-        /// Copy-constructor from a mutable reverse iterator
-        inline const_iterator(const reverse_iterator& it) // NOLINT
-            : currnode(it.currnode), currslot(it.currslot)
-        { }
+    /// Total bytes of all slabs
+    size_t m_slabbytes;
 
-        /// Copy-constructor from a const reverse iterator
-        inline const_iterator(const const_reverse_iterator& it) // NOLINT
-            : currnode(it.currnode), currslot(it.currslot)
-        { }
+    /// Number of allocator objects referencing this pool
+    size_t m_refs;
 
-        /// Dereference the iterator. Do not use this if possible, use key()
-        /// and data() instead. The B+ tree does not stored key and data
-        /// together.
-        inline reference operator * () const
-        {
-            temp_value = pair_to_value_type()(pair_type(key(), data()));
-            return temp_value;
-        }
+    /// Base allocator for slabs and pass-through objects
+    char_alloc_type m_alloc;
 
-        /// Dereference the iterator. Do not use this if possible, use key()
-        /// and data() instead. The B+ tree does not stored key and data
-        /// together.
-        inline pointer operator -> () const
-        {
-            temp_value = pair_to_value_type()(pair_type(key(), data()));
-            return &temp_value;
-        }
+public:
+    /// Constructs an empty pool using the given base allocator.
+    explicit btree_slab_pool(const _Alloc& alloc = _Alloc())
+        : m_sizes(0), m_slabs(NULL), m_numslabs(0), m_slabbytes(0), m_refs(0),
+          m_alloc(alloc)
+    { }
 
-        /// Key of the current slot
-        inline const key_type & key() const
+    /// Returns all slabs to the base allocator.
+    ~btree_slab_pool()
+    {
+        release();
+    }
+
+    /// Allocates an object of size bytes from the slabs of this size.
+    void * allocate(size_t size)
+    {
+        size_class* c = find_class(size);
+        if (c == NULL) return m_alloc.allocate(size);
+
+        if (c->freelist != NULL)
         {
-            return currnode->slotkey[currslot];
+            free_object* f = c->freelist;
+            c->freelist = f->next;
+            return f;
         }
 
-        /// Read-only reference to the current data object
-        inline const data_type & data() const
-        {
-            return currnode->slotdata[used_as_set ? 0 : currslot];
+        if (c->begin == c->end) grow(c);
+
+        void* p = c->begin;
+        c->begin += size;
+        return p;
+    }
+
+    /// Puts an object of size bytes back onto the free list of its size.
+    void deallocate(void* p, size_t size)
+    {
+        size_class* c = find_class(size);
+        if (c == NULL) {
+            m_alloc.deallocate(static_cast<char*>(p), size);
+            return;
         }
 
-        /// Prefix++ advance the iterator to the next slot
-        inline const_iterator& operator ++ ()
-        {
-            if (currslot + 1 < currnode->slotuse) {
-                ++currslot;
-            }
-            else if (currnode->nextleaf != NULL) {
-                currnode = currnode->nextleaf;
-                currslot = 0;
-            }
-            else {
-                // this is end()
-                currslot = currnode->slotuse;
-            }
+        free_object* f = static_cast<free_object*>(p);
+        if (c->freelist == NULL) c->freetail = f;
+        f->next = c->freelist;
+        c->freelist = f;
+    }
 
-            return *this;
+    /// Takes over all slabs of other, whose objects stay valid and are
+    /// returned to this pool afterwards, and leaves other empty. The free
+    /// lists are concatenated, and the larger unused rest of the two current
+    /// slabs of each size is kept. Returns false and changes nothing if the
+    /// base allocators differ or the object sizes of both pools do not fit
+    /// into max_sizes. Takes time in the number of slabs of other.
+    bool adopt(btree_slab_pool& other)
+    {
+        if (!(m_alloc == other.m_alloc)) return false;
+
+        unsigned int newsizes = m_sizes;
+        for (unsigned int i = 0; i < other.m_sizes; ++i)
+        {
+            if (find_size(other.m_class[i].size) == NULL) ++newsizes;
         }
+        if (newsizes > max_sizes) return false;
 
-        /// Postfix++ advance the iterator to the next slot
-        inline const_iterator operator ++ (int)
+        for (unsigned int i = 0; i < other.m_sizes; ++i)
         {
-            const_iterator tmp = *this;   // copy ourselves
+            size_class& oc = other.m_class[i];
+            size_class* c = find_class(oc.size);
 
-            if (currslot + 1 < currnode->slotuse) {
-                ++currslot;
-            }
-            else if (currnode->nextleaf != NULL) {
-                currnode = currnode->nextleaf;
-                currslot = 0;
+            if (oc.freelist != NULL) {
+                oc.freetail->next = c->freelist;
+                if (c->freelist == NULL) c->freetail = oc.freetail;
+                c->freelist = oc.freelist;
             }
-            else {
-                // this is end()
-                currslot = currnode->slotuse;
+
+            if (oc.end - oc.begin > c->end - c->begin) {
+                c->begin = oc.begin;
+                c->end = oc.end;
             }
 
-            return tmp;
+            c->slab_size = std::max(c->slab_size, oc.slab_size);
         }
 
-        /// Prefix-- backstep the iterator to the last slot
-        inline const_iterator& operator -- ()
+        if (other.m_slabs != NULL)
         {
-            if (currslot > 0) {
-                --currslot;
-            }
-            else if (currnode->prevleaf != NULL) {
-                currnode = currnode->prevleaf;
-                currslot = currnode->slotuse - 1;
-            }
-            else {
-                // this is begin()
-                currslot = 0;
-            }
+            slab* last = other.m_slabs;
+            while (last->next != NULL) last = last->next;
 
-            return *this;
+            last->next = m_slabs;
+            m_slabs = other.m_slabs;
         }
 
-        /// Postfix-- backstep the iterator to the last slot
-        inline const_iterator operator -- (int)
-        {
-            const_iterator tmp = *this;   // copy ourselves
+        m_numslabs += other.m_numslabs;
+        m_slabbytes += other.m_slabbytes;
 
-            if (currslot > 0) {
-                --currslot;
-            }
-            else if (currnode->prevleaf != NULL) {
-                currnode = currnode->prevleaf;
-                currslot = currnode->slotuse - 1;
-            }
-            else {
-                // this is begin()
-                currslot = 0;
-            }
+        other.m_slabs = NULL;
+        other.release();
 
-            return tmp;
-        }
+        return true;
+    }
 
-        /// Equality of iterators
-        inline bool operator == (const const_iterator& x) const
+    /// Returns all slabs to the base allocator at once. All objects allocated
+    /// from slabs become invalid without calling their destructors.
+    void release()
+    {
+        while (m_slabs != NULL)
         {
-            return (x.currnode == currnode) && (x.currslot == currslot);
+            slab* s = m_slabs;
+            m_slabs = s->next;
+            m_alloc.deallocate(reinterpret_cast<char*>(s), s->bytes);
         }
 
-        /// Inequality of iterators
-        inline bool operator != (const const_iterator& x) const
+        for (unsigned int i = 0; i < m_sizes; ++i)
         {
-            return (x.currnode != currnode) || (x.currslot != currslot);
+            m_class[i].freelist = NULL;
+            m_class[i].begin = m_class[i].end = NULL;
+            m_class[i].slab_size = min_slab_size;
         }
-    };
 
-    /// STL-like mutable reverse iterator object for B+ tree items. The
-    /// iterator points to a specific slot number in a leaf.
-    class reverse_iterator
+        m_numslabs = m_slabbytes = 0;
+    }
+
+    /// Returns the number of slabs allocated.
+    size_t slabs() const
     {
-    public:
-        // *** Types
+        return m_numslabs;
+    }
 
-        /// The key type of the btree. Returned by key().
-        typedef typename btree::key_type key_type;
+    /// Returns the total size of all slabs in bytes.
+    size_t slab_bytes() const
+    {
+        return m_slabbytes;
+    }
 
-        /// The data type of the btree. Returned by data().
-        typedef typename btree::data_type data_type;
+    /// Increments the reference count, called by btree_pool_allocator.
+    void ref()
+    {
+        ++m_refs;
+    }
 
-        /// The value type of the btree. Returned by operator*().
-        typedef typename btree::value_type value_type;
+    /// Decrements the reference count, returns true if it dropped to zero.
+    bool unref()
+    {
+        return (--m_refs == 0);
+    }
 
-        /// The pair type of the btree.
-        typedef typename btree::pair_type pair_type;
+    /// Returns true if more than one allocator object references the pool.
+    bool shared() const
+    {
+        return (m_refs > 1);
+    }
 
-        /// Reference to the value_type. STL required.
-        typedef value_type& reference;
+private:
+    /// Returns the existing size class of size bytes, or NULL.
+    size_class * find_size(size_t size)
+    {
+        for (unsigned int i = 0; i < m_sizes; ++i)
+        {
+            if (m_class[i].size == size) return &m_class[i];
+        }
 
-        /// Pointer to the value_type. STL required.
-        typedef value_type* pointer;
+        return NULL;
+    }
 
-        /// STL-magic iterator category
-        typedef std::bidirectional_iterator_tag iterator_category;
+    /// Returns the size class of size bytes, creates a new one if possible.
+    size_class * find_class(size_t size)
+    {
+        size_class* found = find_size(size);
+        if (found != NULL) return found;
 
-        /// STL-magic
-        typedef ptrdiff_t difference_type;
+        if (m_sizes == max_sizes || size < sizeof(free_object))
+            return NULL;
 
-    private:
-        // *** Members
+        size_class* c = &m_class[m_sizes++];
+        c->size = size;
+        c->freelist = NULL;
+        c->begin = c->end = NULL;
+        c->slab_size = min_slab_size;
+        return c;
+    }
 
-        /// The currently referenced leaf node of the tree
-        typename btree::leaf_node * currnode;
+    /// Allocates a new slab for the size class, the rest of the previous slab
+    /// is left unused.
+    void grow(size_class* c)
+    {
+        while (c->slab_size < header_size + c->size)
+            c->slab_size *= 2;
 
-        /// One slot past the current key/data slot referenced.
-        unsigned short currslot;
+        size_t bytes = c->slab_size;
+        if (c->slab_size < max_slab_size) c->slab_size *= 2;
 
-        /// Friendly to the const_iterator, so it may access the two data items
-        /// directly
-        friend class iterator;
+        char* mem = m_alloc.allocate(bytes);
 
-        /// Also friendly to the const_iterator, so it may access the two data
-        /// items directly
-        friend class const_iterator;
+        slab* s = reinterpret_cast<slab*>(mem);
+        s->next = m_slabs;
+        s->bytes = bytes;
+        m_slabs = s;
 
-        /// Also friendly to the const_iterator, so it may access the two data
-        /// items directly
-        friend class const_reverse_iterator;
+        ++m_numslabs;
+        m_slabbytes += bytes;
 
-        /// Evil! A temporary value_type to STL-correctly deliver operator* and
-        /// operator->
-        mutable value_type temp_value;
+        c->begin = mem + header_size;
+        c->end = c->begin + (bytes - header_size) / c->size * c->size;
+    }
 
-        // The macro BTREE_FRIENDS can be used by outside class to access the B+
-        // tree internals. This was added for wxBTreeDemo to be able to draw the
-        // tree.
-        BTREE_FRIENDS
+    /// Non-copyable: the slabs are owned by this pool.
+    btree_slab_pool(const btree_slab_pool&);
 
-    public:
-        // *** Methods
+    /// Non-assignable: the slabs are owned by this pool.
+    btree_slab_pool& operator = (const btree_slab_pool&);
+};
 
-        /// Default-Constructor of a reverse iterator
-        inline reverse_iterator()
-            : currnode(NULL), currslot(0)
-        { }
+/** STL allocator drawing its objects from a btree_slab_pool. Copies and
+ * rebound copies share the same pool by reference counting, so the leaf_node
+ * and inner_node allocators of one B+ tree use one pool. It can be given as
+ * _Alloc parameter to the B+ tree and other containers, or be enabled inside
+ * the B+ tree by the traits option node_pool. Not thread-safe. */
+template <typename _Tp, typename _Alloc = std::allocator<char> >
+class btree_pool_allocator
+{
+public:
+    // *** Types
 
-        /// Initializing-Constructor of a mutable reverse iterator
-        inline reverse_iterator(typename btree::leaf_node* l, unsigned short s)
-            : currnode(l), currslot(s)
-        { }
+    /// Allocated object type
+    typedef _Tp value_type;
 
-        /// Copy-constructor from a mutable iterator
-        inline reverse_iterator(const iterator& it) // NOLINT
-            : currnode(it.currnode), currslot(it.currslot)
-        { }
+    /// Pointer to the allocated object type
+    typedef _Tp* pointer;
 
-        /// Dereference the iterator, this is not a value_type& because key and
-        /// value are not stored together
-        inline reference operator * () const
-        {
-            BTREE_ASSERT(currslot > 0);
-            temp_value = pair_to_value_type()(pair_type(key(), data()));
-            return temp_value;
-        }
+    /// Constant pointer to the allocated object type
+    typedef const _Tp* const_pointer;
 
-        /// Dereference the iterator. Do not use this if possible, use key()
-        /// and data() instead. The B+ tree does not stored key and data
-        /// together.
-        inline pointer operator -> () const
-        {
-            BTREE_ASSERT(currslot > 0);
-            temp_value = pair_to_value_type()(pair_type(key(), data()));
-            return &temp_value;
-        }
+    /// Reference to the allocated object type
+    typedef _Tp& reference;
 
-        /// Key of the current slot
-        inline const key_type & key() const
-        {
-            BTREE_ASSERT(currslot > 0);
-            return currnode->slotkey[currslot - 1];
-        }
+    /// Constant reference to the allocated object type
+    typedef const _Tp& const_reference;
 
-        /// Writable reference to the current data object
-        inline data_type & data() const
-        {
-            BTREE_ASSERT(currslot > 0);
-            return currnode->slotdata[used_as_set ? 0 : currslot - 1];
-        }
+    /// Size type of allocations
+    typedef size_t size_type;
 
-        /// Prefix++ advance the iterator to the next slot
-        inline reverse_iterator& operator ++ ()
-        {
-            if (currslot > 1) {
-                --currslot;
-            }
-            else if (currnode->prevleaf != NULL) {
-                currnode = currnode->prevleaf;
-                currslot = currnode->slotuse;
-            }
-            else {
-                // this is begin() == rend()
-                currslot = 0;
-            }
+    /// Difference type of pointers
+    typedef ptrdiff_t difference_type;
 
-            return *this;
-        }
+    /// The pool shared by all copies
+    typedef btree_slab_pool<_Alloc> pool_type;
 
-        /// Postfix++ advance the iterator to the next slot
-        inline reverse_iterator operator ++ (int)
-        {
-            reverse_iterator tmp = *this;   // copy ourselves
+    /// Rebinds the allocator to another object type, sharing the pool.
+    template <typename _Up>
+    struct rebind
+    {
+        typedef btree_pool_allocator<_Up, _Alloc> other;
+    };
 
-            if (currslot > 1) {
-                --currslot;
-            }
-            else if (currnode->prevleaf != NULL) {
-                currnode = currnode->prevleaf;
-                currslot = currnode->slotuse;
-            }
-            else {
-                // this is begin() == rend()
-                currslot = 0;
-            }
+private:
+    /// The shared pool
+    pool_type* m_pool;
 
-            return tmp;
-        }
+public:
+    // *** Constructors and Destructor
 
-        /// Prefix-- backstep the iterator to the last slot
-        inline reverse_iterator& operator -- ()
-        {
-            if (currslot < currnode->slotuse) {
-                ++currslot;
-            }
-            else if (currnode->nextleaf != NULL) {
-                currnode = currnode->nextleaf;
-                currslot = 1;
-            }
-            else {
-                // this is end() == rbegin()
-                currslot = currnode->slotuse;
-            }
+    /// Constructs an allocator with a new pool.
+    btree_pool_allocator()
+        : m_pool(new pool_type())
+    {
+        m_pool->ref();
+    }
 
-            return *this;
-        }
+    /// Constructs an allocator with a new pool, whose slabs come from the
+    /// given base allocator.
+    explicit btree_pool_allocator(const _Alloc& alloc)
+        : m_pool(new pool_type(alloc))
+    {
+        m_pool->ref();
+    }
 
-        /// Postfix-- backstep the iterator to the last slot
-        inline reverse_iterator operator -- (int)
-        {
-            reverse_iterator tmp = *this;   // copy ourselves
+    /// Copy constructor sharing the pool.
+    btree_pool_allocator(const btree_pool_allocator& other)
+        : m_pool(other.m_pool)
+    {
+        m_pool->ref();
+    }
 
-            if (currslot < currnode->slotuse) {
-                ++currslot;
-            }
-            else if (currnode->nextleaf != NULL) {
-                currnode = currnode->nextleaf;
-                currslot = 1;
-            }
-            else {
-                // this is end() == rbegin()
-                currslot = currnode->slotuse;
-            }
+    /// Copy constructor from a rebound allocator sharing the pool.
+    template <typename _Up>
+    btree_pool_allocator(const btree_pool_allocator<_Up, _Alloc>& other)
+        : m_pool(other.pool())
+    {
+        m_pool->ref();
+    }
 
-            return tmp;
-        }
+    /// Assignment shares the pool of other.
+    btree_pool_allocator& operator = (const btree_pool_allocator& other)
+    {
+        other.m_pool->ref();
+        if (m_pool->unref()) delete m_pool;
+        m_pool = other.m_pool;
+        return *this;
+    }
 
-        /// Equality of iterators
-        inline bool operator == (const reverse_iterator& x) const
-        {
-            return (x.currnode == currnode) && (x.currslot == currslot);
-        }
+    /// Deletes the pool with the last allocator referencing it.
+    ~btree_pool_allocator()
+    {
+        if (m_pool->unref()) delete m_pool;
+    }
 
-        /// Inequality of iterators
-        inline bool operator != (const reverse_iterator& x) const
-        {
-            return (x.currnode != currnode) || (x.currslot != currslot);
-        }
-    };
+    // *** Allocation
 
-    /// STL-like read-only reverse iterator object for B+ tree items. The
-    /// iterator points to a specific slot number in a leaf.
-    class const_reverse_iterator
+    /// Returns the shared pool.
+    pool_type * pool() const
     {
-    public:
-        // *** Types
-
-        /// The key type of the btree. Returned by key().
-        typedef typename btree::key_type key_type;
+        return m_pool;
+    }
 
-        /// The data type of the btree. Returned by data().
-        typedef typename btree::data_type data_type;
+    /// Allocates n objects from the slabs of their total size.
+    pointer allocate(size_type n, const void* = NULL)
+    {
+        return static_cast<pointer>(m_pool->allocate(n * sizeof(_Tp)));
+    }
 
-        /// The value type of the btree. Returned by operator*().
-        typedef typename btree::value_type value_type;
+    /// Returns n objects to the pool.
+    void deallocate(pointer p, size_type n)
+    {
+        m_pool->deallocate(p, n * sizeof(_Tp));
+    }
 
-        /// The pair type of the btree.
-        typedef typename btree::pair_type pair_type;
+    /// Copy-constructs an object in place.
+    void construct(pointer p, const _Tp& value)
+    {
+        new (p)_Tp(value);
+    }
 
-        /// Reference to the value_type. STL required.
-        typedef const value_type& reference;
+    /// Destroys an object in place.
+    void destroy(pointer p)
+    {
+        p->~_Tp();
+    }
 
-        /// Pointer to the value_type. STL required.
-        typedef const value_type* pointer;
+    /// Returns the address of an object.
+    pointer address(reference x) const
+    {
+        return &x;
+    }
 
-        /// STL-magic iterator category
-        typedef std::bidirectional_iterator_tag iterator_category;
+    /// Returns the address of an object.
+    const_pointer address(const_reference x) const
+    {
+        return &x;
+    }
 
-        /// STL-magic
-        typedef ptrdiff_t difference_type;
+    /// Maximum number of objects in one allocation.
+    size_type max_size() const
+    {
+        return static_cast<size_type>(-1) / sizeof(_Tp);
+    }
 
-    private:
-        // *** Members
+    /// Allocators are equal if they share the pool.
+    template <typename _Up>
+    bool operator == (const btree_pool_allocator<_Up, _Alloc>& other) const
+    {
+        return m_pool == other.pool();
+    }
 
-        /// The currently referenced leaf node of the tree
-        const typename btree::leaf_node * currnode;
+    /// Allocators are equal if they share the pool.
+    template <typename _Up>
+    bool operator != (const btree_pool_allocator<_Up, _Alloc>& other) const
+    {
+        return m_pool != other.pool();
+    }
+};
 
-        /// One slot past the current key/data slot referenced.
-        unsigned short currslot;
+/** How btree_huge_page_allocator maps large allocations. */
+enum btree_page_mode
+{
+    btree_small_pages,              ///< base pages, huge pages advised against
+    btree_transparent_huge_pages,   ///< transparent huge pages advised by madvise()
+    btree_hugetlb_pages             ///< explicit hugetlbfs pages, else transparent
+};
 
-        /// Friendly to the const_iterator, so it may access the two data items
-        /// directly.
-        friend class reverse_iterator;
+/** STL allocator mapping large allocations directly from the kernel on huge
+ * pages, which reduces the TLB misses of descents in big trees. It is meant as
+ * base allocator of btree_slab_pool, which then takes whole huge pages as
+ * slabs: set the traits option node_pool and give this allocator as _Alloc to
+ * the B+ tree, or use btree_pool_allocator<T, btree_huge_page_allocator<char> >.
+ * Allocations smaller than a huge page are passed to operator new.
+ *
+ * The page mode _Mode selects how the pages are mapped. btree_hugetlb_pages
+ * takes explicit huge pages from the hugetlbfs pool, and falls back to
+ * btree_transparent_huge_pages if none are reserved, which advises the kernel
+ * to back the mapping with transparent huge pages. btree_small_pages advises
+ * against huge pages. Without mmap() all modes use operator new. */
+template <typename _Tp, btree_page_mode _Mode = btree_hugetlb_pages>
+class btree_huge_page_allocator
+{
+public:
+    // *** Types
 
-        /// Evil! A temporary value_type to STL-correctly deliver operator* and
-        /// operator->
-        mutable value_type temp_value;
+    /// Size of a huge page, allocations are rounded up to multiples of it.
+    static const size_t huge_page_size = 2 * 1024 * 1024;
 
-        // The macro BTREE_FRIENDS can be used by outside class to access the B+
-        // tree internals. This was added for wxBTreeDemo to be able to draw the
-        // tree.
-        BTREE_FRIENDS
+    /// Allocated object type
+    typedef _Tp value_type;
 
-    public:
-        // *** Methods
+    /// Pointer to the allocated object type
+    typedef _Tp* pointer;
 
-        /// Default-Constructor of a const reverse iterator
-        inline const_reverse_iterator()
-            : currnode(NULL), currslot(0)
-        { }
+    /// Constant pointer to the allocated object type
+    typedef const _Tp* const_pointer;
 
-        /// Initializing-Constructor of a const reverse iterator
-        inline const_reverse_iterator(const typename btree::leaf_node* l, unsigned short s)
-            : currnode(l), currslot(s)
-        { }
+    /// Reference to the allocated object type
+    typedef _Tp& reference;
 
-        /// Copy-constructor from a mutable iterator
-        inline const_reverse_iterator(const iterator& it) // NOLINT
-            : currnode(it.currnode), currslot(it.currslot)
-        { }
+    /// Constant reference to the allocated object type
+    typedef const _Tp& const_reference;
 
-        /// Copy-constructor from a const iterator
-        inline const_reverse_iterator(const const_iterator& it) // NOLINT
-            : currnode(it.currnode), currslot(it.currslot)
-        { }
+    /// Size type of allocations
+    typedef size_t size_type;
 
-        /// Copy-constructor from a mutable reverse iterator
-        inline const_reverse_iterator(const reverse_iterator& it) // NOLINT
-            : currnode(it.currnode), currslot(it.currslot)
-        { }
+    /// Difference type of pointers
+    typedef ptrdiff_t difference_type;
+
+    /// Rebinds the allocator to another object type.
+    template <typename _Up>
+    struct rebind
+    {
+        typedef btree_huge_page_allocator<_Up, _Mode> other;
+    };
+
+    // *** Constructors
+
+    /// Constructs a stateless allocator.
+    btree_huge_page_allocator()
+    { }
+
+    /// Copy constructor from a rebound allocator.
+    template <typename _Up>
+    btree_huge_page_allocator(const btree_huge_page_allocator<_Up, _Mode>&)
+    { }
+
+    // *** Allocation
+
+    /// Allocates n objects, on huge pages if they fill at least one.
+    pointer allocate(size_type n, const void* = NULL)
+    {
+        size_t bytes = n * sizeof(_Tp);
+        if (bytes < huge_page_size)
+            return static_cast<pointer>(::operator new (bytes));
+
+        return static_cast<pointer>(map_pages(round_up(bytes)));
+    }
+
+    /// Returns n objects, unmaps their pages if they were mapped.
+    void deallocate(pointer p, size_type n)
+    {
+        size_t bytes = n * sizeof(_Tp);
+        if (bytes < huge_page_size)
+            ::operator delete (p);
+        else
+            unmap_pages(p, round_up(bytes));
+    }
+
+    /// Copy-constructs an object in place.
+    void construct(pointer p, const _Tp& value)
+    {
+        new (p)_Tp(value);
+    }
+
+    /// Destroys an object in place.
+    void destroy(pointer p)
+    {
+        p->~_Tp();
+    }
+
+    /// Returns the address of an object.
+    pointer address(reference x) const
+    {
+        return &x;
+    }
+
+    /// Returns the address of an object.
+    const_pointer address(const_reference x) const
+    {
+        return &x;
+    }
+
+    /// Returns the largest number of objects which could be allocated.
+    size_type max_size() const
+    {
+        return static_cast<size_type>(-1) / sizeof(_Tp);
+    }
+
+    /// All allocators can free each other's objects.
+    template <typename _Up>
+    bool operator == (const btree_huge_page_allocator<_Up, _Mode>&) const
+    {
+        return true;
+    }
+
+    /// All allocators can free each other's objects.
+    template <typename _Up>
+    bool operator != (const btree_huge_page_allocator<_Up, _Mode>&) const
+    {
+        return false;
+    }
+
+private:
+    /// Rounds bytes up to a multiple of the huge page size.
+    static size_t round_up(size_t bytes)
+    {
+        return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+    }
+
+    /// Maps bytes of memory aligned to huge pages.
+    static void * map_pages(size_t bytes)
+    {
+#if defined(__linux__)
+#if defined(MAP_HUGETLB)
+        if (_Mode == btree_hugetlb_pages)
+        {
+            void* p = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) return p;
+        }
+#endif
+        // map one huge page more and cut the region to huge page boundaries,
+        // since the kernel backs only aligned regions with huge pages.
+        void* m = mmap(NULL, bytes + huge_page_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) throw std::bad_alloc();
+
+        char* p = static_cast<char*>(m);
+        size_t head = (huge_page_size - reinterpret_cast<size_t>(p) % huge_page_size)
+                      % huge_page_size;
+
+        if (head != 0) munmap(p, head);
+        munmap(p + head + bytes, huge_page_size - head);
+        p += head;
+
+#if defined(MADV_HUGEPAGE)
+        madvise(p, bytes, _Mode == btree_small_pages ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+#endif
+        return p;
+#else
+        return ::operator new (bytes);
+#endif
+    }
+
+    /// Unmaps memory returned by map_pages().
+    static void unmap_pages(void* p, size_t bytes)
+    {
+#if defined(__linux__)
+        munmap(p, bytes);
+#else
+        (void)bytes;
+        ::operator delete (p);
+#endif
+    }
+};
+
+/** Slabs on top of btree_huge_page_allocator are single huge pages. */
+template <typename _Tp, btree_page_mode _Mode>
+struct btree_slab_size<btree_huge_page_allocator<_Tp, _Mode> >
+{
+    /// Size of the first slab of each object size.
+    static const size_t min_size = btree_huge_page_allocator<_Tp, _Mode>::huge_page_size;
+
+    /// Maximum size of the slabs.
+    static const size_t max_size = btree_huge_page_allocator<_Tp, _Mode>::huge_page_size;
+};
+
+/** Selects the reference to the data of a pair handed out by iterators:
+ * writable, or read-only if the traits declare an aggregate, whose cached
+ * summaries would not see a write through it. */
+template <typename _Data, bool _Aggregates>
+struct btree_data_reference
+{
+    /// Type of the reference
+    typedef _Data& type;
+};
+
+template <typename _Data>
+struct btree_data_reference<_Data, true>
+{
+    /// Type of the reference
+    typedef const _Data& type;
+};
+
+/** Selects the allocator used for nodes: the base allocator, or a
+ * btree_pool_allocator drawing slabs from it if the traits enable node_pool. */
+template <typename _Alloc, bool _Pool>
+struct btree_node_allocator
+{
+    /// Type of the node allocator
+    typedef _Alloc type;
+
+    /// Nodes of the base allocator cannot be released at once.
+    static bool release(type&)
+    {
+        return false;
+    }
+
+    /// Nodes of unequal base allocators cannot be taken over.
+    static bool adopt(type&, type&)
+    {
+        return false;
+    }
+};
+
+/** Selects a btree_pool_allocator on top of the base allocator. */
+template <typename _Alloc>
+struct btree_node_allocator<_Alloc, true>
+{
+    /// Type of the node allocator
+    typedef btree_pool_allocator<typename _Alloc::value_type, _Alloc> type;
+
+    /// Returns all slabs of the tree's own pool to the base allocator, unless
+    /// the pool is shared with another tree after split_at().
+    static bool release(type& alloc)
+    {
+        if (alloc.pool()->shared()) return false;
+
+        alloc.pool()->release();
+        return true;
+    }
+
+    /// Moves the slabs of the pool of other into the pool of alloc, which
+    /// other shares afterwards, unless other's pool is shared with another
+    /// tree. Used by join() to take over the nodes of another tree.
+    static bool adopt(type& alloc, type& other)
+    {
+        if (other.pool()->shared() || !alloc.pool()->adopt(*other.pool()))
+            return false;
+
+        other = alloc;
+        return true;
+    }
+};
+
+/** Tells whether objects of type _Tp may be discarded without calling their
+ * destructor. This allows clear() to release the slabs of a node pool without
+ * visiting the nodes. Specialize it for types not detected by the compiler. */
+template <typename _Tp>
+struct btree_trivially_destructible
+{
+#if __cplusplus >= 201103L
+    static const bool value = std::is_trivially_destructible<_Tp>::value;
+#elif defined(__GNUC__)
+    static const bool value = __has_trivial_destructor(_Tp);
+#else
+    static const bool value = false;
+#endif
+};
+
+/** How merge_sorted() treats items whose key is already in the tree or
+ * earlier in the batch. */
+enum btree_merge_policy
+{
+    btree_merge_keep_existing,      ///< skip the item, like insert() in a map
+    btree_merge_overwrite,          ///< replace the data of the first equal item
+    btree_merge_duplicates          ///< insert a duplicate, like in a multimap
+};
+
+/** @brief Basic class implementing a base B+ tree data structure in memory.
+ *
+ * The base implementation of a memory B+ tree. It is based on the
+ * implementation in Cormen's Introduction into Algorithms, Jan Jannink's paper
+ * and other algorithm resources. Almost all STL-required function calls are
+ * implemented. The asymptotic time requirements of the STL are not always
+ * fulfilled in theory, however in practice this B+ tree performs better than a
+ * red-black tree by using more memory. The insertion function splits the nodes
+ * on the recursion unroll. Erase is largely based on Jannink's ideas.
+ *
+ * This class is specialized into btree_set, btree_multiset, btree_map and
+ * btree_multimap using default template parameters and facade functions.
+ */
+template <typename _Key, typename _Data,
+          typename _Value = std::pair<_Key, _Data>,
+          typename _Compare = std::less<_Key>,
+          typename _Traits = btree_default_map_traits<_Key, _Data>,
+          bool _Duplicates = false,
+          typename _Alloc = std::allocator<_Value>,
+          bool _UsedAsSet = false>
+class btree
+{
+public:
+    // *** Template Parameter Types
+
+    /// First template parameter: The key type of the B+ tree. This is stored
+    /// in inner nodes and leaves
+    typedef _Key key_type;
+
+    /// Second template parameter: The data type associated with each
+    /// key. Stored in the B+ tree's leaves
+    typedef _Data data_type;
+
+    /// Third template parameter: Composition pair of key and data types, this
+    /// is required by the STL standard. The B+ tree does not store key and
+    /// data together. If value_type == key_type then the B+ tree implements a
+    /// set.
+    typedef _Value value_type;
+
+    /// Fourth template parameter: Key comparison function object
+    typedef _Compare key_compare;
+
+    /// Fifth template parameter: Traits object used to define more parameters
+    /// of the B+ tree
+    typedef _Traits traits;
+
+    /// Sixth template parameter: Allow duplicate keys in the B+ tree. Used to
+    /// implement multiset and multimap.
+    static const bool allow_duplicates = _Duplicates;
+
+    /// Seventh template parameter: STL allocator for tree nodes
+    typedef _Alloc allocator_type;
+
+    /// Eighth template parameter: boolean indicator whether the btree is used
+    /// as a set. In this case all operations on the data arrays are
+    /// omitted. This flag is kind of hacky, but required because
+    /// sizeof(empty_struct) = 1 due to the C standard. Without the flag, lots
+    /// of superfluous copying would occur.
+    static const bool used_as_set = _UsedAsSet;
+
+    // The macro BTREE_FRIENDS can be used by outside class to access the B+
+    // tree internals. This was added for wxBTreeDemo to be able to draw the
+    // tree.
+    BTREE_FRIENDS
+
+public:
+    // *** Constructed Types
+
+    /// Typedef of our own type
+    typedef btree<key_type, data_type, value_type, key_compare,
+                  traits, allow_duplicates, allocator_type, used_as_set> self_type;
+
+    /// Size type used to count keys
+    typedef size_t size_type;
+
+    /// Signed type of distances between iterators
+    typedef ptrdiff_t difference_type;
+
+    /// The pair of key_type and data_type, this may be different from
+    /// value_type.
+    typedef std::pair<key_type, data_type> pair_type;
+
+    /// Normalized key head type, cached in the nodes if key_heads is set.
+    typedef typename btree_key_head<key_type, key_compare>::head_type head_type;
+
+public:
+    // *** Static Constant Options and Values of the B+ Tree
+
+    /// Base B+ tree parameter: The number of key/data slots in each leaf
+    static const unsigned short leafslotmax = traits::leafslots;
+
+    /// Base B+ tree parameter: The number of key slots in each inner node,
+    /// this can differ from slots in each leaf.
+    static const unsigned short innerslotmax = traits::innerslots;
+
+    /// Computed B+ tree parameter: The minimum number of key/data slots used
+    /// in a leaf. If fewer slots are used, the leaf will be merged or slots
+    /// shifted from it's siblings.
+    static const unsigned short minleafslots = (leafslotmax / 2);
+
+    /// Computed B+ tree parameter: The minimum number of key slots used
+    /// in an inner node. If fewer slots are used, the inner node will be
+    /// merged or slots shifted from it's siblings.
+    static const unsigned short mininnerslots = (innerslotmax / 2);
+
+    /// Debug parameter: Enables expensive and thorough checking of the B+ tree
+    /// invariants after each insert/erase operation.
+    static const bool selfverify = traits::selfverify;
+
+    /// Debug parameter: Prints out lots of debug information about how the
+    /// algorithms change the tree. Requires the header file to be compiled
+    /// with BTREE_DEBUG and the key type must be std::ostream printable.
+    static const bool debug = traits::debug;
+
+    /// Search parameter: Compare the keys of a node in find_lower() and
+    /// find_upper() using vector instructions, if btree_simd_search supports
+    /// key_type and key_compare.
+    static const bool simd_search =
+        traits::simd_search && btree_simd_search<key_type, key_compare>::enabled;
+
+    /// Search parameter: key_compare provides a three-way compare() method,
+    /// which is used to determine order and equality of keys at once.
+    static const bool threeway_compare = traits::threeway_compare;
+
+    /// Search parameter: Issue software prefetches for child nodes during the
+    /// descent and for sibling leaves during iteration.
+    static const bool prefetch = traits::prefetch;
+
+    /// Operational parameter: Inner nodes contain the shortest separators
+    /// computed by btree_separator instead of the largest key of each child.
+    static const bool truncate_separators = traits::truncate_separators;
+
+    /// Search parameter: Nodes cache the normalized key heads of all slots,
+    /// if btree_key_head supports key_type and key_compare.
+    static const bool key_heads =
+        traits::key_heads && btree_key_head<key_type, key_compare>::enabled;
+
+    /// Operational parameter: Allocate nodes from slabs using a
+    /// btree_pool_allocator on top of allocator_type.
+    static const bool node_pool = traits::node_pool;
+
+    /// Operational parameter: Inner nodes count the items below each child,
+    /// for O(log n) rank(), select() and distance().
+    static const bool order_statistics = traits::order_statistics;
+
+    /// The monoid of subtree summaries, cached by inner nodes if enabled.
+    typedef typename traits::aggregate aggregate_type;
+
+    /// Type of the summaries of aggregate_type.
+    typedef typename aggregate_type::summary_type summary_type;
+
+    /// Operational parameter: Inner nodes cache the summary of each child,
+    /// for O(log n) aggregate() over key ranges.
+    static const bool aggregates = aggregate_type::enabled;
+
+    /// Reference to the data of a pair returned by iterator::data(), which
+    /// is read-only with aggregates. Data is replaced by assign() then.
+    typedef typename btree_data_reference<data_type, aggregates>::type data_reference;
+
+    /// Operational parameter: Number of threads copying large trees in the
+    /// copy constructor and assignment operator, 0 for all hardware threads.
+    static const unsigned int copy_threads = traits::copy_threads;
+
+private:
+    // *** Node Classes for In-Memory Nodes
+
+    /// Allocator type which is rebound to the node types: allocator_type or
+    /// a btree_pool_allocator if node_pool is set.
+    typedef typename btree_node_allocator<allocator_type, node_pool>::type node_allocator_type;
+
+    /// True if nodes can be discarded without calling the destructors of
+    /// their keys and data.
+    static const bool trivial_nodes = btree_trivially_destructible<key_type>::value
+                                      && btree_trivially_destructible<data_type>::value;
+
+    /// The header structure of each node in-memory. This structure is extended
+    /// by inner_node or leaf_node.
+    struct node
+    {
+        /// Level in the b-tree, if level == 0 -> leaf node
+        unsigned short level;
+
+        /// Number of key slotuse use, so number of valid children or data
+        /// pointers
+        unsigned short slotuse;
+
+        /// Delayed initialisation of constructed node
+        inline node(const unsigned short l, const unsigned short s = 0)
+            : level(l), slotuse(s)
+        { }
+
+        /// True if this is a leaf node
+        inline bool    isleafnode() const
+        {
+            return (level == 0);
+        }
+    };
+
+    /// Extended structure of a inner node in-memory. Contains only keys and no
+    /// data items.
+    struct inner_node : public node
+    {
+        /// Define an related allocator for the inner_node structs.
+        typedef typename node_allocator_type::template rebind<inner_node>::other alloc_type;
+
+        /// Keys of children or data pointers
+        key_type slotkey[innerslotmax];
+
+        /// Normalized heads of the keys, if key_heads is set
+        head_type slothead[key_heads ? innerslotmax : 1];
+
+        /// Pointers to children
+        node     * childid[innerslotmax + 1];
+
+        /// Number of items below each child, if order_statistics is set
+        size_type childcount[order_statistics ? innerslotmax + 1 : 1];
+
+        /// Summaries of the items below each child, if aggregates is set
+        summary_type childsummary[aggregates ? innerslotmax + 1 : 1];
+
+        /// Set variables to initial values
+        inline inner_node(const unsigned short l)
+            : node(l)
+        { }
+
+        /// Construction during restore from node top
+        inline inner_node(const node& top)
+            : node(top.level, top.slotuse)
+        { }
+
+        /// True if the node's slots are full
+        inline bool isfull() const
+        {
+            return (node::slotuse == innerslotmax);
+        }
+
+        /// True if few used entries, less than half full
+        inline bool isfew() const
+        {
+            return (node::slotuse <= mininnerslots);
+        }
+
+        /// True if node has too few entries
+        inline bool isunderflow() const
+        {
+            return (node::slotuse < mininnerslots);
+        }
+
+        /// Recalculate the normalized head of slotkey[slot], if key_heads is
+        /// set.
+        inline void update_head(unsigned short slot)
+        {
+            if (key_heads)
+                slothead[slot] = btree_key_head<key_type, key_compare>::head(slotkey[slot]);
+        }
+
+        /// Number of items below this node, if order_statistics is set.
+        inline size_type subtree_size() const
+        {
+            size_type n = 0;
+            for (unsigned short slot = 0; slot <= node::slotuse; ++slot)
+                n += childcount[slot];
+            return n;
+        }
+
+        /// Summary of the items below this node, if aggregates is set.
+        inline summary_type subtree_summary() const
+        {
+            summary_type sum = childsummary[0];
+            for (unsigned short slot = 1; slot <= node::slotuse; ++slot)
+                sum = aggregate_type::combine(sum, childsummary[slot]);
+            return sum;
+        }
+
+        /// Recalculate childcount[slot] and childsummary[slot] from the
+        /// child, if order_statistics or aggregates are set.
+        inline void update_child(unsigned short slot)
+        {
+            const node* child = childid[slot];
+
+            if (order_statistics) {
+                childcount[slot] = child->isleafnode()
+                                   ? child->slotuse
+                                   : static_cast<const inner_node*>(child)->subtree_size();
+            }
+            if (aggregates) {
+                childsummary[slot] = child->isleafnode()
+                                     ? static_cast<const leaf_node*>(child)->subtree_summary()
+                                     : static_cast<const inner_node*>(child)->subtree_summary();
+            }
+        }
+
+        /// Account for one item inserted below childid[slot].
+        inline void update_inserted(unsigned short slot)
+        {
+            if (order_statistics) ++childcount[slot];
+            if (aggregates) update_child(slot);
+        }
+
+        /// Account for one item erased below childid[slot].
+        inline void update_erased(unsigned short slot)
+        {
+            if (order_statistics) --childcount[slot];
+            if (aggregates) update_child(slot);
+        }
+    };
+
+    /// Extended structure of a leaf node in memory. Contains pairs of keys and
+    /// data items. Key and data slots are kept in separate arrays, because the
+    /// key array is traversed very often compared to accessing the data items.
+    struct leaf_node : public node
+    {
+        /// Define an related allocator for the leaf_node structs.
+        typedef typename node_allocator_type::template rebind<leaf_node>::other alloc_type;
+
+        /// Double linked list pointers to traverse the leaves
+        leaf_node * prevleaf;
+
+        /// Double linked list pointers to traverse the leaves
+        leaf_node * nextleaf;
+
+        /// Keys of children or data pointers
+        key_type  slotkey[leafslotmax];
+
+        /// Normalized heads of the keys, if key_heads is set
+        head_type slothead[key_heads ? leafslotmax : 1];
+
+        /// Array of data
+        data_type slotdata[used_as_set ? 1 : leafslotmax];
+
+        /// Set variables to initial values
+        inline leaf_node()
+            : node(0), prevleaf(NULL), nextleaf(NULL)
+        { }
+
+        /// Construction during restore from node top
+        inline leaf_node(const node& top)
+            : node(top.level, top.slotuse), prevleaf(NULL), nextleaf(NULL)
+        { }
+
+        /// True if the node's slots are full
+        inline bool isfull() const
+        {
+            return (node::slotuse == leafslotmax);
+        }
+
+        /// True if few used entries, less than half full
+        inline bool isfew() const
+        {
+            return (node::slotuse <= minleafslots);
+        }
+
+        /// True if node has too few entries
+        inline bool isunderflow() const
+        {
+            return (node::slotuse < minleafslots);
+        }
+
+        /// Recalculate the normalized head of slotkey[slot], if key_heads is
+        /// set.
+        inline void update_head(unsigned short slot)
+        {
+            if (key_heads)
+                slothead[slot] = btree_key_head<key_type, key_compare>::head(slotkey[slot]);
+        }
+
+        /// Summary of the items in the slots [from,to).
+        inline summary_type range_summary(unsigned short from, unsigned short to) const
+        {
+            summary_type sum = aggregate_type::identity();
+            for (unsigned short slot = from; slot < to; ++slot)
+            {
+                sum = aggregate_type::combine(
+                    sum, aggregate_type::summarize(slotkey[slot], slotdata[used_as_set ? 0 : slot]));
+            }
+            return sum;
+        }
+
+        /// Summary of the items in this leaf, if aggregates is set.
+        inline summary_type subtree_summary() const
+        {
+            return range_summary(0, node::slotuse);
+        }
+
+        /// Set the (key,data) pair in slot. Overloaded function used by
+        /// bulk_load().
+        inline void set_slot(unsigned short slot, const pair_type& value)
+        {
+            BTREE_ASSERT(used_as_set == false);
+            BTREE_ASSERT(slot < node::slotuse);
+            slotkey[slot] = value.first;
+            update_head(slot);
+            slotdata[slot] = value.second;
+        }
+
+        /// Set the key pair in slot. Overloaded function used by
+        /// bulk_load().
+        inline void set_slot(unsigned short slot, const key_type& key)
+        {
+            BTREE_ASSERT(used_as_set == true);
+            BTREE_ASSERT(slot < node::slotuse);
+            slotkey[slot] = key;
+            update_head(slot);
+        }
+    };
+
+private:
+    // *** Template Magic to Convert a pair or key/data types to a value_type
+
+    /// For sets the second pair_type is an empty struct, so the value_type
+    /// should only be the first.
+    template <typename value_type, typename pair_type>
+    struct btree_pair_to_value
+    {
+        /// Convert a fake pair type to just the first component
+        inline value_type operator () (pair_type& p) const
+        {
+            return p.first;
+        }
+        /// Convert a fake pair type to just the first component
+        inline value_type operator () (const pair_type& p) const
+        {
+            return p.first;
+        }
+    };
+
+    /// For maps value_type is the same as the pair_type
+    template <typename value_type>
+    struct btree_pair_to_value<value_type, value_type>
+    {
+        /// Identity "convert" a real pair type to just the first component
+        inline value_type operator () (pair_type& p) const
+        {
+            return p;
+        }
+        /// Identity "convert" a real pair type to just the first component
+        inline value_type operator () (const pair_type& p) const
+        {
+            return p;
+        }
+    };
+
+    /// Using template specialization select the correct converter used by the
+    /// iterators
+    typedef btree_pair_to_value<value_type, pair_type> pair_to_value_type;
+
+public:
+    // *** Iterators and Reverse Iterators
+
+    class iterator;
+    class const_iterator;
+    class reverse_iterator;
+    class const_reverse_iterator;
+
+    /// STL-like iterator object for B+ tree items. The iterator points to a
+    /// specific slot number in a leaf.
+    class iterator
+    {
+    public:
+        // *** Types
+
+        /// The key type of the btree. Returned by key().
+        typedef typename btree::key_type key_type;
+
+        /// The data type of the btree. Returned by data().
+        typedef typename btree::data_type data_type;
+
+        /// The value type of the btree. Returned by operator*().
+        typedef typename btree::value_type value_type;
+
+        /// The pair type of the btree.
+        typedef typename btree::pair_type pair_type;
+
+        /// Reference to the value_type. STL required.
+        typedef value_type& reference;
+
+        /// Pointer to the value_type. STL required.
+        typedef value_type* pointer;
+
+        /// STL-magic iterator category
+        typedef std::bidirectional_iterator_tag iterator_category;
+
+        /// STL-magic
+        typedef ptrdiff_t difference_type;
+
+    private:
+        // *** Members
+
+        /// The currently referenced leaf node of the tree
+        typename btree::leaf_node * currnode;
+
+        /// Current key/data slot referenced
+        unsigned short currslot;
+
+        /// Friendly to the const_iterator, so it may access the two data items
+        /// directly.
+        friend class const_iterator;
+
+        /// Also friendly to the reverse_iterator, so it may access the two
+        /// data items directly.
+        friend class reverse_iterator;
+
+        /// Also friendly to the const_reverse_iterator, so it may access the
+        /// two data items directly.
+        friend class const_reverse_iterator;
+
+        /// Also friendly to the base btree class, because erase_iter() needs
+        /// to read the currnode and currslot values directly.
+        friend class btree<key_type, data_type, value_type, key_compare,
+                           traits, allow_duplicates, allocator_type, used_as_set>;
+
+        /// Evil! A temporary value_type to STL-correctly deliver operator* and
+        /// operator->
+        mutable value_type temp_value;
+
+        // The macro BTREE_FRIENDS can be used by outside class to access the B+
+        // tree internals. This was added for wxBTreeDemo to be able to draw the
+        // tree.
+        BTREE_FRIENDS
+
+    public:
+        // *** Methods
+
+        /// Default-Constructor of a mutable iterator
+        inline iterator()
+            : currnode(NULL), currslot(0)
+        { }
+
+        /// Initializing-Constructor of a mutable iterator
+        inline iterator(typename btree::leaf_node* l, unsigned short s)
+            : currnode(l), currslot(s)
+        { }
+
+        /// Copy-constructor from a reverse iterator
+        inline iterator(const reverse_iterator& it) // NOLINT
+            : currnode(it.currnode), currslot(it.currslot)
+        { }
+
+        /// Dereference the iterator, this is not a value_type& because key and
+        /// value are not stored together
+        inline reference operator * () const
+        {
+            temp_value = pair_to_value_type()(pair_type(key(), data()));
+            return temp_value;
+        }
+
+        /// Dereference the iterator. Do not use this if possible, use key()
+        /// and data() instead. The B+ tree does not stored key and data
+        /// together.
+        inline pointer operator -> () const
+        {
+            temp_value = pair_to_value_type()(pair_type(key(), data()));
+            return &temp_value;
+        }
+
+        /// Key of the current slot
+        inline const key_type & key() const
+        {
+            return currnode->slotkey[currslot];
+        }
+
+        /// Writable reference to the current data object, read-only with
+        /// aggregates, whose data is replaced by btree::assign().
+        inline data_reference data() const
+        {
+            return currnode->slotdata[used_as_set ? 0 : currslot];
+        }
+
+        /// Prefix++ advance the iterator to the next slot
+        inline iterator& operator ++ ()
+        {
+            if (currslot + 1 < currnode->slotuse) {
+                ++currslot;
+            }
+            else if (currnode->nextleaf != NULL) {
+                currnode = currnode->nextleaf;
+                prefetch_leaf(currnode->nextleaf);
+                currslot = 0;
+            }
+            else {
+                // this is end()
+                currslot = currnode->slotuse;
+            }
+
+            return *this;
+        }
+
+        /// Postfix++ advance the iterator to the next slot
+        inline iterator operator ++ (int)
+        {
+            iterator tmp = *this;   // copy ourselves
+
+            if (currslot + 1 < currnode->slotuse) {
+                ++currslot;
+            }
+            else if (currnode->nextleaf != NULL) {
+                currnode = currnode->nextleaf;
+                prefetch_leaf(currnode->nextleaf);
+                currslot = 0;
+            }
+            else {
+                // this is end()
+                currslot = currnode->slotuse;
+            }
+
+            return tmp;
+        }
+
+        /// Prefix-- backstep the iterator to the last slot
+        inline iterator& operator -- ()
+        {
+            if (currslot > 0) {
+                --currslot;
+            }
+            else if (currnode->prevleaf != NULL) {
+                currnode = currnode->prevleaf;
+                prefetch_leaf(currnode->prevleaf);
+                currslot = currnode->slotuse - 1;
+            }
+            else {
+                // this is begin()
+                currslot = 0;
+            }
+
+            return *this;
+        }
+
+        /// Postfix-- backstep the iterator to the last slot
+        inline iterator operator -- (int)
+        {
+            iterator tmp = *this;   // copy ourselves
+
+            if (currslot > 0) {
+                --currslot;
+            }
+            else if (currnode->prevleaf != NULL) {
+                currnode = currnode->prevleaf;
+                prefetch_leaf(currnode->prevleaf);
+                currslot = currnode->slotuse - 1;
+            }
+            else {
+                // this is begin()
+                currslot = 0;
+            }
+
+            return tmp;
+        }
+
+        /// Advance the iterator by n slots, skipping over whole leaves. Stops
+        /// at end().
+        inline iterator& operator += (difference_type n)
+        {
+            if (n < 0) return *this -= -n;
+
+            while (currslot + n >= currnode->slotuse && currnode->nextleaf != NULL)
+            {
+                n -= currnode->slotuse - currslot;
+                currnode = currnode->nextleaf;
+                currslot = 0;
+            }
+
+            currslot = static_cast<unsigned short>(
+                std::min<difference_type>(currslot + n, currnode->slotuse));
+
+            return *this;
+        }
+
+        /// Backstep the iterator by n slots, skipping over whole leaves. Stops
+        /// at begin().
+        inline iterator& operator -= (difference_type n)
+        {
+            if (n < 0) return *this += -n;
+
+            while (n > currslot && currnode->prevleaf != NULL)
+            {
+                n -= currslot + 1;
+                currnode = currnode->prevleaf;
+                currslot = currnode->slotuse - 1;
+            }
+
+            currslot = (n > currslot) ? 0 : static_cast<unsigned short>(currslot - n);
+
+            return *this;
+        }
+
+        /// Equality of iterators
+        inline bool operator == (const iterator& x) const
+        {
+            return (x.currnode == currnode) && (x.currslot == currslot);
+        }
+
+        /// Inequality of iterators
+        inline bool operator != (const iterator& x) const
+        {
+            return (x.currnode != currnode) || (x.currslot != currslot);
+        }
+    };
+
+    /// STL-like read-only iterator object for B+ tree items. The iterator
+    /// points to a specific slot number in a leaf.
+    class const_iterator
+    {
+    public:
+        // *** Types
+
+        /// The key type of the btree. Returned by key().
+        typedef typename btree::key_type key_type;
+
+        /// The data type of the btree. Returned by data().
+        typedef typename btree::data_type data_type;
+
+        /// The value type of the btree. Returned by operator*().
+        typedef typename btree::value_type value_type;
+
+        /// The pair type of the btree.
+        typedef typename btree::pair_type pair_type;
+
+        /// Reference to the value_type. STL required.
+        typedef const value_type& reference;
+
+        /// Pointer to the value_type. STL required.
+        typedef const value_type* pointer;
+
+        /// STL-magic iterator category
+        typedef std::bidirectional_iterator_tag iterator_category;
+
+        /// STL-magic
+        typedef ptrdiff_t difference_type;
+
+    private:
+        // *** Members
+
+        /// The currently referenced leaf node of the tree
+        const typename btree::leaf_node * currnode;
+
+        /// Current key/data slot referenced
+        unsigned short currslot;
+
+        /// Friendly to the reverse_const_iterator, so it may access the two
+        /// data items directly
+        friend class const_reverse_iterator;
+
+        /// Also friendly to the base btree class, because distance() needs to
+        /// read the currnode and currslot values directly.
+        friend class btree<key_type, data_type, value_type, key_compare,
+                           traits, allow_duplicates, allocator_type, used_as_set>;
+
+        /// Evil! A temporary value_type to STL-correctly deliver operator* and
+        /// operator->
+        mutable value_type temp_value;
+
+        // The macro BTREE_FRIENDS can be used by outside class to access the B+
+        // tree internals. This was added for wxBTreeDemo to be able to draw the
+        // tree.
+        BTREE_FRIENDS
+
+    public:
+        // *** Methods
+
+        /// Default-Constructor of a const iterator
+        inline const_iterator()
+            : currnode(NULL), currslot(0)
+        { }
+
+        /// Initializing-Constructor of a const iterator
+        inline const_iterator(const typename btree::leaf_node* l, unsigned short s)
+            : currnode(l), currslot(s)
+        { }
+
+        /// Copy-constructor from a mutable iterator
+        inline const_iterator(const iterator& it) // NOLINT
+            : currnode(it.currnode), currslot(it.currslot)
+        { }
+
+        /// Copy-constructor from a mutable reverse iterator
+        inline const_iterator(const reverse_iterator& it) // NOLINT
+            : currnode(it.currnode), currslot(it.currslot)
+        { }
+
+        /// Copy-constructor from a const reverse iterator
+        inline const_iterator(const const_reverse_iterator& it) // NOLINT
+            : currnode(it.currnode), currslot(it.currslot)
+        { }
+
+        /// Dereference the iterator. Do not use this if possible, use key()
+        /// and data() instead. The B+ tree does not stored key and data
+        /// together.
+        inline reference operator * () const
+        {
+            temp_value = pair_to_value_type()(pair_type(key(), data()));
+            return temp_value;
+        }
+
+        /// Dereference the iterator. Do not use this if possible, use key()
+        /// and data() instead. The B+ tree does not stored key and data
+        /// together.
+        inline pointer operator -> () const
+        {
+            temp_value = pair_to_value_type()(pair_type(key(), data()));
+            return &temp_value;
+        }
+
+        /// Key of the current slot
+        inline const key_type & key() const
+        {
+            return currnode->slotkey[currslot];
+        }
+
+        /// Read-only reference to the current data object
+        inline const data_type & data() const
+        {
+            return currnode->slotdata[used_as_set ? 0 : currslot];
+        }
+
+        /// Prefix++ advance the iterator to the next slot
+        inline const_iterator& operator ++ ()
+        {
+            if (currslot + 1 < currnode->slotuse) {
+                ++currslot;
+            }
+            else if (currnode->nextleaf != NULL) {
+                currnode = currnode->nextleaf;
+                prefetch_leaf(currnode->nextleaf);
+                currslot = 0;
+            }
+            else {
+                // this is end()
+                currslot = currnode->slotuse;
+            }
+
+            return *this;
+        }
+
+        /// Postfix++ advance the iterator to the next slot
+        inline const_iterator operator ++ (int)
+        {
+            const_iterator tmp = *this;   // copy ourselves
+
+            if (currslot + 1 < currnode->slotuse) {
+                ++currslot;
+            }
+            else if (currnode->nextleaf != NULL) {
+                currnode = currnode->nextleaf;
+                prefetch_leaf(currnode->nextleaf);
+                currslot = 0;
+            }
+            else {
+                // this is end()
+                currslot = currnode->slotuse;
+            }
+
+            return tmp;
+        }
+
+        /// Prefix-- backstep the iterator to the last slot
+        inline const_iterator& operator -- ()
+        {
+            if (currslot > 0) {
+                --currslot;
+            }
+            else if (currnode->prevleaf != NULL) {
+                currnode = currnode->prevleaf;
+                prefetch_leaf(currnode->prevleaf);
+                currslot = currnode->slotuse - 1;
+            }
+            else {
+                // this is begin()
+                currslot = 0;
+            }
+
+            return *this;
+        }
+
+        /// Postfix-- backstep the iterator to the last slot
+        inline const_iterator operator -- (int)
+        {
+            const_iterator tmp = *this;   // copy ourselves
+
+            if (currslot > 0) {
+                --currslot;
+            }
+            else if (currnode->prevleaf != NULL) {
+                currnode = currnode->prevleaf;
+                prefetch_leaf(currnode->prevleaf);
+                currslot = currnode->slotuse - 1;
+            }
+            else {
+                // this is begin()
+                currslot = 0;
+            }
+
+            return tmp;
+        }
+
+        /// Advance the iterator by n slots, skipping over whole leaves. Stops
+        /// at end().
+        inline const_iterator& operator += (difference_type n)
+        {
+            if (n < 0) return *this -= -n;
+
+            while (currslot + n >= currnode->slotuse && currnode->nextleaf != NULL)
+            {
+                n -= currnode->slotuse - currslot;
+                currnode = currnode->nextleaf;
+                currslot = 0;
+            }
+
+            currslot = static_cast<unsigned short>(
+                std::min<difference_type>(currslot + n, currnode->slotuse));
+
+            return *this;
+        }
+
+        /// Backstep the iterator by n slots, skipping over whole leaves. Stops
+        /// at begin().
+        inline const_iterator& operator -= (difference_type n)
+        {
+            if (n < 0) return *this += -n;
+
+            while (n > currslot && currnode->prevleaf != NULL)
+            {
+                n -= currslot + 1;
+                currnode = currnode->prevleaf;
+                currslot = currnode->slotuse - 1;
+            }
+
+            currslot = (n > currslot) ? 0 : static_cast<unsigned short>(currslot - n);
+
+            return *this;
+        }
+
+        /// Equality of iterators
+        inline bool operator == (const const_iterator& x) const
+        {
+            return (x.currnode == currnode) && (x.currslot == currslot);
+        }
+
+        /// Inequality of iterators
+        inline bool operator != (const const_iterator& x) const
+        {
+            return (x.currnode != currnode) || (x.currslot != currslot);
+        }
+    };
+
+    /// STL-like mutable reverse iterator object for B+ tree items. The
+    /// iterator points to a specific slot number in a leaf.
+    class reverse_iterator
+    {
+    public:
+        // *** Types
+
+        /// The key type of the btree. Returned by key().
+        typedef typename btree::key_type key_type;
+
+        /// The data type of the btree. Returned by data().
+        typedef typename btree::data_type data_type;
+
+        /// The value type of the btree. Returned by operator*().
+        typedef typename btree::value_type value_type;
+
+        /// The pair type of the btree.
+        typedef typename btree::pair_type pair_type;
+
+        /// Reference to the value_type. STL required.
+        typedef value_type& reference;
+
+        /// Pointer to the value_type. STL required.
+        typedef value_type* pointer;
+
+        /// STL-magic iterator category
+        typedef std::bidirectional_iterator_tag iterator_category;
+
+        /// STL-magic
+        typedef ptrdiff_t difference_type;
+
+    private:
+        // *** Members
+
+        /// The currently referenced leaf node of the tree
+        typename btree::leaf_node * currnode;
+
+        /// One slot past the current key/data slot referenced.
+        unsigned short currslot;
+
+        /// Friendly to the const_iterator, so it may access the two data items
+        /// directly
+        friend class iterator;
+
+        /// Also friendly to the const_iterator, so it may access the two data
+        /// items directly
+        friend class const_iterator;
+
+        /// Also friendly to the const_iterator, so it may access the two data
+        /// items directly
+        friend class const_reverse_iterator;
+
+        /// Evil! A temporary value_type to STL-correctly deliver operator* and
+        /// operator->
+        mutable value_type temp_value;
+
+        // The macro BTREE_FRIENDS can be used by outside class to access the B+
+        // tree internals. This was added for wxBTreeDemo to be able to draw the
+        // tree.
+        BTREE_FRIENDS
+
+    public:
+        // *** Methods
+
+        /// Default-Constructor of a reverse iterator
+        inline reverse_iterator()
+            : currnode(NULL), currslot(0)
+        { }
+
+        /// Initializing-Constructor of a mutable reverse iterator
+        inline reverse_iterator(typename btree::leaf_node* l, unsigned short s)
+            : currnode(l), currslot(s)
+        { }
+
+        /// Copy-constructor from a mutable iterator
+        inline reverse_iterator(const iterator& it) // NOLINT
+            : currnode(it.currnode), currslot(it.currslot)
+        { }
+
+        /// Dereference the iterator, this is not a value_type& because key and
+        /// value are not stored together
+        inline reference operator * () const
+        {
+            BTREE_ASSERT(currslot > 0);
+            temp_value = pair_to_value_type()(pair_type(key(), data()));
+            return temp_value;
+        }
+
+        /// Dereference the iterator. Do not use this if possible, use key()
+        /// and data() instead. The B+ tree does not stored key and data
+        /// together.
+        inline pointer operator -> () const
+        {
+            BTREE_ASSERT(currslot > 0);
+            temp_value = pair_to_value_type()(pair_type(key(), data()));
+            return &temp_value;
+        }
+
+        /// Key of the current slot
+        inline const key_type & key() const
+        {
+            BTREE_ASSERT(currslot > 0);
+            return currnode->slotkey[currslot - 1];
+        }
+
+        /// Writable reference to the current data object, read-only with
+        /// aggregates, whose data is replaced by btree::assign().
+        inline data_reference data() const
+        {
+            BTREE_ASSERT(currslot > 0);
+            return currnode->slotdata[used_as_set ? 0 : currslot - 1];
+        }
+
+        /// Prefix++ advance the iterator to the next slot
+        inline reverse_iterator& operator ++ ()
+        {
+            if (currslot > 1) {
+                --currslot;
+            }
+            else if (currnode->prevleaf != NULL) {
+                currnode = currnode->prevleaf;
+                prefetch_leaf(currnode->prevleaf);
+                currslot = currnode->slotuse;
+            }
+            else {
+                // this is begin() == rend()
+                currslot = 0;
+            }
+
+            return *this;
+        }
+
+        /// Postfix++ advance the iterator to the next slot
+        inline reverse_iterator operator ++ (int)
+        {
+            reverse_iterator tmp = *this;   // copy ourselves
+
+            if (currslot > 1) {
+                --currslot;
+            }
+            else if (currnode->prevleaf != NULL) {
+                currnode = currnode->prevleaf;
+                prefetch_leaf(currnode->prevleaf);
+                currslot = currnode->slotuse;
+            }
+            else {
+                // this is begin() == rend()
+                currslot = 0;
+            }
+
+            return tmp;
+        }
+
+        /// Prefix-- backstep the iterator to the last slot
+        inline reverse_iterator& operator -- ()
+        {
+            if (currslot < currnode->slotuse) {
+                ++currslot;
+            }
+            else if (currnode->nextleaf != NULL) {
+                currnode = currnode->nextleaf;
+                prefetch_leaf(currnode->nextleaf);
+                currslot = 1;
+            }
+            else {
+                // this is end() == rbegin()
+                currslot = currnode->slotuse;
+            }
+
+            return *this;
+        }
+
+        /// Postfix-- backstep the iterator to the last slot
+        inline reverse_iterator operator -- (int)
+        {
+            reverse_iterator tmp = *this;   // copy ourselves
+
+            if (currslot < currnode->slotuse) {
+                ++currslot;
+            }
+            else if (currnode->nextleaf != NULL) {
+                currnode = currnode->nextleaf;
+                prefetch_leaf(currnode->nextleaf);
+                currslot = 1;
+            }
+            else {
+                // this is end() == rbegin()
+                currslot = currnode->slotuse;
+            }
+
+            return tmp;
+        }
+
+        /// Equality of iterators
+        inline bool operator == (const reverse_iterator& x) const
+        {
+            return (x.currnode == currnode) && (x.currslot == currslot);
+        }
+
+        /// Inequality of iterators
+        inline bool operator != (const reverse_iterator& x) const
+        {
+            return (x.currnode != currnode) || (x.currslot != currslot);
+        }
+    };
+
+    /// STL-like read-only reverse iterator object for B+ tree items. The
+    /// iterator points to a specific slot number in a leaf.
+    class const_reverse_iterator
+    {
+    public:
+        // *** Types
+
+        /// The key type of the btree. Returned by key().
+        typedef typename btree::key_type key_type;
+
+        /// The data type of the btree. Returned by data().
+        typedef typename btree::data_type data_type;
+
+        /// The value type of the btree. Returned by operator*().
+        typedef typename btree::value_type value_type;
+
+        /// The pair type of the btree.
+        typedef typename btree::pair_type pair_type;
+
+        /// Reference to the value_type. STL required.
+        typedef const value_type& reference;
+
+        /// Pointer to the value_type. STL required.
+        typedef const value_type* pointer;
+
+        /// STL-magic iterator category
+        typedef std::bidirectional_iterator_tag iterator_category;
+
+        /// STL-magic
+        typedef ptrdiff_t difference_type;
+
+    private:
+        // *** Members
+
+        /// The currently referenced leaf node of the tree
+        const typename btree::leaf_node * currnode;
+
+        /// One slot past the current key/data slot referenced.
+        unsigned short currslot;
+
+        /// Friendly to the const_iterator, so it may access the two data items
+        /// directly.
+        friend class reverse_iterator;
+
+        /// Evil! A temporary value_type to STL-correctly deliver operator* and
+        /// operator->
+        mutable value_type temp_value;
+
+        // The macro BTREE_FRIENDS can be used by outside class to access the B+
+        // tree internals. This was added for wxBTreeDemo to be able to draw the
+        // tree.
+        BTREE_FRIENDS
+
+    public:
+        // *** Methods
+
+        /// Default-Constructor of a const reverse iterator
+        inline const_reverse_iterator()
+            : currnode(NULL), currslot(0)
+        { }
+
+        /// Initializing-Constructor of a const reverse iterator
+        inline const_reverse_iterator(const typename btree::leaf_node* l, unsigned short s)
+            : currnode(l), currslot(s)
+        { }
+
+        /// Copy-constructor from a mutable iterator
+        inline const_reverse_iterator(const iterator& it) // NOLINT
+            : currnode(it.currnode), currslot(it.currslot)
+        { }
+
+        /// Copy-constructor from a const iterator
+        inline const_reverse_iterator(const const_iterator& it) // NOLINT
+            : currnode(it.currnode), currslot(it.currslot)
+        { }
+
+        /// Copy-constructor from a mutable reverse iterator
+        inline const_reverse_iterator(const reverse_iterator& it) // NOLINT
+            : currnode(it.currnode), currslot(it.currslot)
+        { }
 
         /// Dereference the iterator. Do not use this if possible, use key()
         /// and data() instead. The B+ tree does not stored key and data
         /// together.
         inline reference operator * () const
         {
-            BTREE_ASSERT(currslot > 0);
-            temp_value = pair_to_value_type()(pair_type(key(), data()));
-            return temp_value;
+            BTREE_ASSERT(currslot > 0);
+            temp_value = pair_to_value_type()(pair_type(key(), data()));
+            return temp_value;
+        }
+
+        /// Dereference the iterator. Do not use this if possible, use key()
+        /// and data() instead. The B+ tree does not stored key and data
+        /// together.
+        inline pointer operator -> () const
+        {
+            BTREE_ASSERT(currslot > 0);
+            temp_value = pair_to_value_type()(pair_type(key(), data()));
+            return &temp_value;
+        }
+
+        /// Key of the current slot
+        inline const key_type & key() const
+        {
+            BTREE_ASSERT(currslot > 0);
+            return currnode->slotkey[currslot - 1];
+        }
+
+        /// Read-only reference to the current data object
+        inline const data_type & data() const
+        {
+            BTREE_ASSERT(currslot > 0);
+            return currnode->slotdata[used_as_set ? 0 : currslot - 1];
+        }
+
+        /// Prefix++ advance the iterator to the previous slot
+        inline const_reverse_iterator& operator ++ ()
+        {
+            if (currslot > 1) {
+                --currslot;
+            }
+            else if (currnode->prevleaf != NULL) {
+                currnode = currnode->prevleaf;
+                prefetch_leaf(currnode->prevleaf);
+                currslot = currnode->slotuse;
+            }
+            else {
+                // this is begin() == rend()
+                currslot = 0;
+            }
+
+            return *this;
+        }
+
+        /// Postfix++ advance the iterator to the previous slot
+        inline const_reverse_iterator operator ++ (int)
+        {
+            const_reverse_iterator tmp = *this;   // copy ourselves
+
+            if (currslot > 1) {
+                --currslot;
+            }
+            else if (currnode->prevleaf != NULL) {
+                currnode = currnode->prevleaf;
+                prefetch_leaf(currnode->prevleaf);
+                currslot = currnode->slotuse;
+            }
+            else {
+                // this is begin() == rend()
+                currslot = 0;
+            }
+
+            return tmp;
+        }
+
+        /// Prefix-- backstep the iterator to the next slot
+        inline const_reverse_iterator& operator -- ()
+        {
+            if (currslot < currnode->slotuse) {
+                ++currslot;
+            }
+            else if (currnode->nextleaf != NULL) {
+                currnode = currnode->nextleaf;
+                prefetch_leaf(currnode->nextleaf);
+                currslot = 1;
+            }
+            else {
+                // this is end() == rbegin()
+                currslot = currnode->slotuse;
+            }
+
+            return *this;
+        }
+
+        /// Postfix-- backstep the iterator to the next slot
+        inline const_reverse_iterator operator -- (int)
+        {
+            const_reverse_iterator tmp = *this;   // copy ourselves
+
+            if (currslot < currnode->slotuse) {
+                ++currslot;
+            }
+            else if (currnode->nextleaf != NULL) {
+                currnode = currnode->nextleaf;
+                prefetch_leaf(currnode->nextleaf);
+                currslot = 1;
+            }
+            else {
+                // this is end() == rbegin()
+                currslot = currnode->slotuse;
+            }
+
+            return tmp;
+        }
+
+        /// Equality of iterators
+        inline bool operator == (const const_reverse_iterator& x) const
+        {
+            return (x.currnode == currnode) && (x.currslot == currslot);
+        }
+
+        /// Inequality of iterators
+        inline bool operator != (const const_reverse_iterator& x) const
+        {
+            return (x.currnode != currnode) || (x.currslot != currslot);
+        }
+    };
+
+public:
+    // *** Small Statistics Structure
+
+    /** A small struct containing basic statistics about the B+ tree. It can be
+     * fetched using get_stats(). */
+    struct tree_stats
+    {
+        /// Number of items in the B+ tree
+        size_type                   itemcount;
+
+        /// Number of leaves in the B+ tree
+        size_type                   leaves;
+
+        /// Number of inner nodes in the B+ tree
+        size_type                   innernodes;
+
+        /// Number of node bytes freed by compact() and compact_step()
+        size_type                   reclaimed;
+
+        /// Base B+ tree parameter: The number of key/data slots in each leaf
+        static const unsigned short leafslots = self_type::leafslotmax;
+
+        /// Base B+ tree parameter: The number of key slots in each inner node.
+        static const unsigned short innerslots = self_type::innerslotmax;
+
+        /// Zero initialized
+        inline tree_stats()
+            : itemcount(0),
+              leaves(0), innernodes(0), reclaimed(0)
+        { }
+
+        /// Return the total number of nodes
+        inline size_type            nodes() const
+        {
+            return innernodes + leaves;
+        }
+
+        /// Return the average fill of leaves
+        inline double               avgfill_leaves() const
+        {
+            return static_cast<double>(itemcount) / (leaves * leafslots);
+        }
+
+        /// Return the total size of all nodes in bytes
+        inline size_type            bytes() const
+        {
+            return leaves * sizeof(leaf_node) + innernodes * sizeof(inner_node);
+        }
+    };
+
+private:
+    // *** Tree Object Data Members
+
+    /// Pointer to the B+ tree's root node, either leaf or inner node
+    node* m_root;
+
+    /// Pointer to first leaf in the double linked leaf chain
+    leaf_node* m_headleaf;
+
+    /// Pointer to last leaf in the double linked leaf chain
+    leaf_node* m_tailleaf;
+
+    /// Other small statistics about the B+ tree
+    tree_stats m_stats;
+
+    /// Key comparison object. More comparison functions are generated from
+    /// this < relation.
+    key_compare m_key_less;
+
+    /// Memory allocator.
+    allocator_type m_allocator;
+
+    /// Memory allocator for nodes, rebound to leaf_node and inner_node. This
+    /// is a copy of m_allocator or a slab pool on top of it.
+    node_allocator_type m_node_allocator;
+
+public:
+    // *** Constructors and Destructor
+
+    /// Default constructor initializing an empty B+ tree with the standard key
+    /// comparison function
+    explicit inline btree(const allocator_type& alloc = allocator_type())
+        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL), m_allocator(alloc),
+          m_node_allocator(alloc)
+    { }
+
+    /// Constructor initializing an empty B+ tree with a special key
+    /// comparison object
+    explicit inline btree(const key_compare& kcf,
+                          const allocator_type& alloc = allocator_type())
+        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL),
+          m_key_less(kcf), m_allocator(alloc), m_node_allocator(alloc)
+    { }
+
+    /// Constructor initializing a B+ tree with the range [first,last). The
+    /// range need not be sorted. To create a B+ tree from a sorted range, use
+    /// bulk_load().
+    template <class InputIterator>
+    inline btree(InputIterator first, InputIterator last,
+                 const allocator_type& alloc = allocator_type())
+        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL), m_allocator(alloc),
+          m_node_allocator(alloc)
+    {
+        insert(first, last);
+    }
+
+    /// Constructor initializing a B+ tree with the range [first,last) and a
+    /// special key comparison object.  The range need not be sorted. To create
+    /// a B+ tree from a sorted range, use bulk_load().
+    template <class InputIterator>
+    inline btree(InputIterator first, InputIterator last, const key_compare& kcf,
+                 const allocator_type& alloc = allocator_type())
+        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL),
+          m_key_less(kcf), m_allocator(alloc), m_node_allocator(alloc)
+    {
+        insert(first, last);
+    }
+
+    /// Frees up all used B+ tree memory pages
+    inline ~btree()
+    {
+        clear();
+    }
+
+    /// Fast swapping of two identical B+ tree objects.
+    void swap(self_type& from)
+    {
+        std::swap(m_root, from.m_root);
+        std::swap(m_headleaf, from.m_headleaf);
+        std::swap(m_tailleaf, from.m_tailleaf);
+        std::swap(m_stats, from.m_stats);
+        std::swap(m_key_less, from.m_key_less);
+        std::swap(m_allocator, from.m_allocator);
+        std::swap(m_node_allocator, from.m_node_allocator);
+    }
+
+public:
+    // *** Key and Value Comparison Function Objects
+
+    /// Function class to compare value_type objects. Required by the STL
+    class value_compare
+    {
+    protected:
+        /// Key comparison function from the template parameter
+        key_compare key_comp;
+
+        /// Constructor called from btree::value_comp()
+        inline explicit value_compare(key_compare kc)
+            : key_comp(kc)
+        { }
+
+        /// Friendly to the btree class so it may call the constructor
+        friend class btree<key_type, data_type, value_type, key_compare,
+                           traits, allow_duplicates, allocator_type, used_as_set>;
+
+    public:
+        /// Function call "less"-operator resulting in true if x < y.
+        inline bool operator () (const value_type& x, const value_type& y) const
+        {
+            return key_comp(x.first, y.first);
+        }
+    };
+
+    /// Constant access to the key comparison object sorting the B+ tree
+    inline key_compare key_comp() const
+    {
+        return m_key_less;
+    }
+
+    /// Constant access to a constructed value_type comparison object. Required
+    /// by the STL
+    inline value_compare value_comp() const
+    {
+        return value_compare(m_key_less);
+    }
+
+private:
+    // *** Convenient Key Comparison Functions Generated From key_less
+
+    /// True if a < b ? "constructed" from m_key_less()
+    inline bool key_less(const key_type& a, const key_type& b) const
+    {
+        return m_key_less(a, b);
+    }
+
+    /// True if a <= b ? constructed from key_less()
+    inline bool key_lessequal(const key_type& a, const key_type& b) const
+    {
+        return !m_key_less(b, a);
+    }
+
+    /// True if a > b ? constructed from key_less()
+    inline bool key_greater(const key_type& a, const key_type& b) const
+    {
+        return m_key_less(b, a);
+    }
+
+    /// True if a >= b ? constructed from key_less()
+    inline bool key_greaterequal(const key_type& a, const key_type& b) const
+    {
+        return !m_key_less(a, b);
+    }
+
+    /// Normalized key head of key, which is cached in the nodes if the
+    /// traits enable key_heads. See btree_key_head.
+    static inline head_type key_head(const key_type& key)
+    {
+        return btree_key_head<key_type, key_compare>::head(key);
+    }
+
+    /// Three-way comparison of a and b, calls key_compare::compare() if the
+    /// traits enable threeway_compare, otherwise it is constructed from
+    /// key_less().
+    inline int key_compare3(const key_type& a, const key_type& b) const
+    {
+        return btree_three_way<key_type, key_compare, threeway_compare>
+               ::compare(m_key_less, a, b);
+    }
+
+    /// True if a == b ? constructed from key_less() or key_compare3(). This
+    /// requires the < relation to be a total order, otherwise the B+ tree
+    /// cannot be sorted.
+    inline bool key_equal(const key_type& a, const key_type& b) const
+    {
+        if (threeway_compare)
+            return key_compare3(a, b) == 0;
+
+        return !m_key_less(a, b) && !m_key_less(b, a);
+    }
+
+public:
+    // *** Allocators
+
+    /// Return the base node allocator provided during construction.
+    allocator_type get_allocator() const
+    {
+        return m_allocator;
+    }
+
+private:
+    // *** Node Object Allocation and Deallocation Functions
+
+    /// Return an allocator for leaf_node objects
+    typename leaf_node::alloc_type leaf_node_allocator()
+    {
+        return typename leaf_node::alloc_type(m_node_allocator);
+    }
+
+    /// Return an allocator for inner_node objects
+    typename inner_node::alloc_type inner_node_allocator()
+    {
+        return typename inner_node::alloc_type(m_node_allocator);
+    }
+
+    /// Allocate and initialize a leaf node
+    inline leaf_node * allocate_leaf()
+    {
+        leaf_node* n = new (leaf_node_allocator().allocate(1))
+                       leaf_node();
+        m_stats.leaves++;
+        return n;
+    }
+
+    /// Allocate and initialize an inner node
+    inline inner_node * allocate_inner(unsigned short level)
+    {
+        inner_node* n = new (inner_node_allocator().allocate(1))
+                        inner_node(level);
+        m_stats.innernodes++;
+        return n;
+    }
+
+    /// Correctly free either inner or leaf node, destructs all contained key
+    /// and value objects
+    inline void free_node(node* n)
+    {
+        free_node(n, m_node_allocator);
+    }
+
+    /// Free either inner or leaf node with the given node allocator, which
+    /// allocated it. Used by compact() while the nodes are moved to a new one.
+    inline void free_node(node* n, const node_allocator_type& alloc)
+    {
+        if (n->isleafnode()) {
+            leaf_node* ln = static_cast<leaf_node*>(n);
+            typename leaf_node::alloc_type a(alloc);
+            a.destroy(ln);
+            a.deallocate(ln, 1);
+            m_stats.leaves--;
+        }
+        else {
+            inner_node* in = static_cast<inner_node*>(n);
+            typename inner_node::alloc_type a(alloc);
+            a.destroy(in);
+            a.deallocate(in, 1);
+            m_stats.innernodes--;
+        }
+    }
+
+    /// Convenient template function for conditional copying of slotdata. This
+    /// should be used instead of std::copy for all slotdata manipulations.
+    template <class InputIterator, class OutputIterator>
+    static OutputIterator data_copy(InputIterator first, InputIterator last,
+                                    OutputIterator result)
+    {
+        if (used_as_set) return result; // no operation
+        else return std::copy(first, last, result);
+    }
+
+    /// Convenient template function for conditional copying of slotdata. This
+    /// should be used instead of std::copy for all slotdata manipulations.
+    template <class InputIterator, class OutputIterator>
+    static OutputIterator data_copy_backward(InputIterator first, InputIterator last,
+                                             OutputIterator result)
+    {
+        if (used_as_set) return result; // no operation
+        else return std::copy_backward(first, last, result);
+    }
+
+    /// Convenient template function for conditional copying of slothead. This
+    /// should be used together with std::copy for all slotkey manipulations.
+    template <class InputIterator, class OutputIterator>
+    static OutputIterator head_copy(InputIterator first, InputIterator last,
+                                    OutputIterator result)
+    {
+        if (!key_heads) return result; // no operation
+        else return std::copy(first, last, result);
+    }
+
+    /// Convenient template function for conditional copying of slothead. This
+    /// should be used together with std::copy_backward for all slotkey
+    /// manipulations.
+    template <class InputIterator, class OutputIterator>
+    static OutputIterator head_copy_backward(InputIterator first, InputIterator last,
+                                             OutputIterator result)
+    {
+        if (!key_heads) return result; // no operation
+        else return std::copy_backward(first, last, result);
+    }
+
+    /// Convenient template function for conditional copying of childcount.
+    /// This should be used together with std::copy for all childid
+    /// manipulations.
+    template <class InputIterator, class OutputIterator>
+    static OutputIterator count_copy(InputIterator first, InputIterator last,
+                                     OutputIterator result)
+    {
+        if (!order_statistics) return result; // no operation
+        else return std::copy(first, last, result);
+    }
+
+    /// Convenient template function for conditional copying of childcount.
+    /// This should be used together with std::copy_backward for all childid
+    /// manipulations.
+    template <class InputIterator, class OutputIterator>
+    static OutputIterator count_copy_backward(InputIterator first, InputIterator last,
+                                              OutputIterator result)
+    {
+        if (!order_statistics) return result; // no operation
+        else return std::copy_backward(first, last, result);
+    }
+
+    /// Convenient template function for conditional copying of childsummary.
+    /// This should be used together with std::copy for all childid
+    /// manipulations.
+    template <class InputIterator, class OutputIterator>
+    static OutputIterator summary_copy(InputIterator first, InputIterator last,
+                                       OutputIterator result)
+    {
+        if (!aggregates) return result; // no operation
+        else return std::copy(first, last, result);
+    }
+
+    /// Convenient template function for conditional copying of childsummary.
+    /// This should be used together with std::copy_backward for all childid
+    /// manipulations.
+    template <class InputIterator, class OutputIterator>
+    static OutputIterator summary_copy_backward(InputIterator first, InputIterator last,
+                                                OutputIterator result)
+    {
+        if (!aggregates) return result; // no operation
+        else return std::copy_backward(first, last, result);
+    }
+
+public:
+    // *** Fast Destruction of the B+ Tree
+
+    /// Frees all key/data pairs and all nodes of the tree. If the nodes come
+    /// from the tree's own node pool and need no destructor calls, the slabs
+    /// are released at once. Otherwise the nodes are freed by a sweep.
+    void clear()
+    {
+        if (m_root)
+        {
+            if (!trivial_nodes ||
+                !btree_node_allocator<allocator_type, node_pool>::release(m_node_allocator))
+            {
+                clear_sweep();
+            }
+
+            m_root = NULL;
+            m_headleaf = m_tailleaf = NULL;
+
+            m_stats = tree_stats();
+        }
+
+        BTREE_ASSERT(m_stats.itemcount == 0);
+    }
+
+private:
+    /// Frees the leaves along the leaf chain, then the inner nodes.
+    void clear_sweep()
+    {
+        node* root = m_root;
+
+        leaf_node* leaf = m_headleaf;
+        while (leaf != NULL)
+        {
+            leaf_node* next = leaf->nextleaf;
+            if (leaf != root) free_node(leaf);
+            leaf = next;
+        }
+
+        if (root->isleafnode())
+            free_node(root);
+        else
+            free_inner_nodes(static_cast<inner_node*>(root), m_node_allocator);
+    }
+
+    /// Frees the inner nodes below and including root bottom-up by an
+    /// iterative depth-first walk indexed by the node levels. The leaves are
+    /// not touched, they must be freed separately.
+    void free_inner_nodes(inner_node* root, const node_allocator_type& alloc)
+    {
+        const unsigned short top = root->level;
+
+        BTREE_ASSERT(top < cursor_maxlevel);
+
+        inner_node* path[cursor_maxlevel];
+        unsigned short slot[cursor_maxlevel];
+
+        unsigned short level = top;
+        path[level] = root;
+        slot[level] = 0;
+
+        while (true)
+        {
+            inner_node* n = path[level];
+
+            if (level > 1 && slot[level] <= n->slotuse)
+            {
+                // descend into the next inner child, leaves are already freed
+                inner_node* child = static_cast<inner_node*>(n->childid[slot[level]++]);
+                --level;
+                path[level] = child;
+                slot[level] = 0;
+            }
+            else
+            {
+                free_node(n, alloc);
+                if (level == top) break;
+                ++level;
+            }
+        }
+    }
+
+public:
+    // *** STL Iterator Construction Functions
+
+    /// Constructs a read/data-write iterator that points to the first slot in
+    /// the first leaf of the B+ tree.
+    inline iterator begin()
+    {
+        return iterator(m_headleaf, 0);
+    }
+
+    /// Constructs a read/data-write iterator that points to the first invalid
+    /// slot in the last leaf of the B+ tree.
+    inline iterator end()
+    {
+        return iterator(m_tailleaf, m_tailleaf ? m_tailleaf->slotuse : 0);
+    }
+
+    /// Constructs a read-only constant iterator that points to the first slot
+    /// in the first leaf of the B+ tree.
+    inline const_iterator begin() const
+    {
+        return const_iterator(m_headleaf, 0);
+    }
+
+    /// Constructs a read-only constant iterator that points to the first
+    /// invalid slot in the last leaf of the B+ tree.
+    inline const_iterator end() const
+    {
+        return const_iterator(m_tailleaf, m_tailleaf ? m_tailleaf->slotuse : 0);
+    }
+
+    /// Constructs a read/data-write reverse iterator that points to the first
+    /// invalid slot in the last leaf of the B+ tree. Uses STL magic.
+    inline reverse_iterator rbegin()
+    {
+        return reverse_iterator(end());
+    }
+
+    /// Constructs a read/data-write reverse iterator that points to the first
+    /// slot in the first leaf of the B+ tree. Uses STL magic.
+    inline reverse_iterator rend()
+    {
+        return reverse_iterator(begin());
+    }
+
+    /// Constructs a read-only reverse iterator that points to the first
+    /// invalid slot in the last leaf of the B+ tree. Uses STL magic.
+    inline const_reverse_iterator rbegin() const
+    {
+        return const_reverse_iterator(end());
+    }
+
+    /// Constructs a read-only reverse iterator that points to the first slot
+    /// in the first leaf of the B+ tree. Uses STL magic.
+    inline const_reverse_iterator rend() const
+    {
+        return const_reverse_iterator(begin());
+    }
+
+private:
+    // *** B+ Tree Node Binary Search Functions
+
+    /// Searches for the first key in the node n greater or equal to key. Uses
+    /// vectorized or linear search for small nodes, and binary search with an
+    /// optional linear self-verification for large ones. This is a template
+    /// function, because the slotkey array is located at different places in
+    /// leaf_node and inner_node.
+    template <typename node_type>
+    inline int find_lower(const node_type* n, const key_type& key) const
+    {
+        if (key_heads)
+        {
+            return find_lower_head(n, key);
+        }
+        else if (sizeof(n->slotkey) > traits::binsearch_threshold)
+        {
+            if (n->slotuse == 0) return 0;
+
+            // branchless binary search: the answer is in [base, base + len],
+            // halve len and advance base with a conditional move.
+            const key_type* base = n->slotkey;
+            int len = n->slotuse;
+
+            while (len > 1)
+            {
+                int half = len >> 1;
+                base = key_less(base[half], key) ? base + half : base;
+                len -= half;
+            }
+
+            int lo = static_cast<int>(base - n->slotkey) + (key_less(*base, key) ? 1 : 0);
+
+            BTREE_PRINT("btree::find_lower: on " << n << " key " << key << " -> " << lo);
+
+            // verify result using simple linear search
+            if (selfverify)
+            {
+                int i = 0;
+                while (i < n->slotuse && key_less(n->slotkey[i], key)) ++i;
+
+                BTREE_PRINT("btree::find_lower: testfind: " << i);
+                BTREE_ASSERT(i == lo);
+            }
+
+            return lo;
+        }
+        else if (simd_search) // compare cache lines of keys at once.
+        {
+            int lo = btree_simd_search<key_type, key_compare>::find_lower(
+                n->slotkey, n->slotuse, key);
+
+            // verify result using simple linear search
+            if (selfverify)
+            {
+                int i = 0;
+                while (i < n->slotuse && key_less(n->slotkey[i], key)) ++i;
+
+                BTREE_PRINT("btree::find_lower: simd testfind: " << i);
+                BTREE_ASSERT(i == lo);
+            }
+
+            return lo;
+        }
+        else // for nodes <= binsearch_threshold do linear search.
+        {
+            int lo = 0;
+            while (lo < n->slotuse && key_less(n->slotkey[lo], key)) ++lo;
+            return lo;
+        }
+    }
+
+    /// Searches for the first key in the node n greater than key. Uses
+    /// vectorized or linear search for small nodes, and binary search with an
+    /// optional linear self-verification for large ones. This is a template
+    /// function, because the slotkey array is located at different places in
+    /// leaf_node and inner_node.
+    template <typename node_type>
+    inline int find_upper(const node_type* n, const key_type& key) const
+    {
+        if (key_heads)
+        {
+            return find_upper_head(n, key);
+        }
+        else if (sizeof(n->slotkey) > traits::binsearch_threshold)
+        {
+            if (n->slotuse == 0) return 0;
+
+            // branchless binary search: the answer is in [base, base + len],
+            // halve len and advance base with a conditional move.
+            const key_type* base = n->slotkey;
+            int len = n->slotuse;
+
+            while (len > 1)
+            {
+                int half = len >> 1;
+                base = key_lessequal(base[half], key) ? base + half : base;
+                len -= half;
+            }
+
+            int lo = static_cast<int>(base - n->slotkey) + (key_lessequal(*base, key) ? 1 : 0);
+
+            BTREE_PRINT("btree::find_upper: on " << n << " key " << key << " -> " << lo);
+
+            // verify result using simple linear search
+            if (selfverify)
+            {
+                int i = 0;
+                while (i < n->slotuse && key_lessequal(n->slotkey[i], key)) ++i;
+
+                BTREE_PRINT("btree::find_upper: testfind: " << i);
+                BTREE_ASSERT(i == lo);
+            }
+
+            return lo;
+        }
+        else if (simd_search) // compare cache lines of keys at once.
+        {
+            int lo = btree_simd_search<key_type, key_compare>::find_upper(
+                n->slotkey, n->slotuse, key);
+
+            // verify result using simple linear search
+            if (selfverify)
+            {
+                int i = 0;
+                while (i < n->slotuse && key_lessequal(n->slotkey[i], key)) ++i;
+
+                BTREE_PRINT("btree::find_upper: simd testfind: " << i);
+                BTREE_ASSERT(i == lo);
+            }
+
+            return lo;
+        }
+        else // for nodes <= binsearch_threshold do linear search.
+        {
+            int lo = 0;
+            while (lo < n->slotuse && key_lessequal(n->slotkey[lo], key)) ++lo;
+            return lo;
+        }
+    }
+
+    /// Searches for the first key in the node n greater or equal to key using
+    /// the cached normalized key heads: only keys whose head equals the head
+    /// of key are compared using key_compare.
+    template <typename node_type>
+    inline int find_lower_head(const node_type* n, const key_type& key) const
+    {
+        const head_type h = key_head(key);
+
+        const head_type* lo = std::lower_bound(n->slothead, n->slothead + n->slotuse, h);
+        const head_type* hi = std::upper_bound(lo, n->slothead + n->slotuse, h);
+
+        int slot = static_cast<int>(
+            std::lower_bound(n->slotkey + (lo - n->slothead), n->slotkey + (hi - n->slothead),
+                             key, m_key_less) - n->slotkey);
+
+        // verify result using simple linear search
+        if (selfverify)
+        {
+            int i = 0;
+            while (i < n->slotuse && key_less(n->slotkey[i], key)) ++i;
+
+            BTREE_PRINT("btree::find_lower: head testfind: " << i);
+            BTREE_ASSERT(i == slot);
+        }
+
+        return slot;
+    }
+
+    /// Searches for the first key in the node n greater than key using the
+    /// cached normalized key heads: only keys whose head equals the head of
+    /// key are compared using key_compare.
+    template <typename node_type>
+    inline int find_upper_head(const node_type* n, const key_type& key) const
+    {
+        const head_type h = key_head(key);
+
+        const head_type* lo = std::lower_bound(n->slothead, n->slothead + n->slotuse, h);
+        const head_type* hi = std::upper_bound(lo, n->slothead + n->slotuse, h);
+
+        int slot = static_cast<int>(
+            std::upper_bound(n->slotkey + (lo - n->slothead), n->slotkey + (hi - n->slothead),
+                             key, m_key_less) - n->slotkey);
+
+        // verify result using simple linear search
+        if (selfverify)
+        {
+            int i = 0;
+            while (i < n->slotuse && key_lessequal(n->slotkey[i], key)) ++i;
+
+            BTREE_PRINT("btree::find_upper: head testfind: " << i);
+            BTREE_ASSERT(i == slot);
+        }
+
+        return slot;
+    }
+
+    /// Searches for the first key in the node n greater or equal to key, like
+    /// find_lower(), and additionally sets equal if the key found is equal to
+    /// key. With a three-way key_compare each slot key is compared only once,
+    /// otherwise one more key_less() call is required.
+    template <typename node_type>
+    inline int find_lower(const node_type* n, const key_type& key, bool& equal) const
+    {
+        if (!threeway_compare || key_heads)
+        {
+            int lo = find_lower(n, key);
+            equal = (lo < n->slotuse && !key_less(key, n->slotkey[lo]));
+            return lo;
+        }
+
+        if (sizeof(n->slotkey) > traits::binsearch_threshold)
+        {
+            if (n->slotuse == 0) {
+                equal = false;
+                return 0;
+            }
+
+            // branchless binary search, as in find_lower().
+            const key_type* base = n->slotkey;
+            int len = n->slotuse;
+
+            while (len > 1)
+            {
+                int half = len >> 1;
+                base = (key_compare3(base[half], key) < 0) ? base + half : base;
+                len -= half;
+            }
+
+            int lo = static_cast<int>(base - n->slotkey);
+            int cmp = key_compare3(*base, key);
+
+            if (cmp < 0) {
+                // the successor's key was never compared in this branch
+                ++lo;
+                equal = (lo < n->slotuse && key_compare3(n->slotkey[lo], key) == 0);
+            }
+            else {
+                equal = (cmp == 0);
+            }
+
+            // verify result using simple linear search
+            if (selfverify)
+            {
+                int i = 0;
+                while (i < n->slotuse && key_less(n->slotkey[i], key)) ++i;
+
+                BTREE_PRINT("btree::find_lower: three-way testfind: " << i);
+                BTREE_ASSERT(i == lo);
+            }
+
+            return lo;
+        }
+        else
+        {
+            int lo = 0, cmp = -1;
+            while (lo < n->slotuse && (cmp = key_compare3(n->slotkey[lo], key)) < 0) ++lo;
+
+            equal = (lo < n->slotuse && cmp == 0);
+            return lo;
+        }
+    }
+
+private:
+    // *** Software Prefetching of Nodes
+
+    /// Issues a software prefetch for each cache line in [begin,end).
+    static inline void prefetch_range(const void* begin, const void* end)
+    {
+#if defined(__GNUC__)
+        const char* p = static_cast<const char*>(begin);
+        const char* e = static_cast<const char*>(end);
+
+        for ( ; p < e; p += 64)
+            __builtin_prefetch(p);
+
+        // the last line, in case begin is not aligned
+        __builtin_prefetch(e - 1);
+#else
+        (void)begin, (void)end;
+#endif
+    }
+
+    /// Prefetches the header and the slotkey array of the child at slot of an
+    /// inner node, if enabled by the traits.
+    static inline void prefetch_child(const inner_node* inner, int slot)
+    {
+        if (!prefetch) return;
+
+        prefetch_childkeys(inner, slot);
+    }
+
+    /// Prefetches the header and the slotkey array of the child at slot of an
+    /// inner node. The type of the child is known from the parent's level, so
+    /// the child itself is not touched.
+    static inline void prefetch_childkeys(const inner_node* inner, int slot)
+    {
+        // the cached key heads directly follow the slotkey array
+        if (inner->level == 1) {
+            const leaf_node* leaf = static_cast<const leaf_node*>(inner->childid[slot]);
+            if (key_heads)
+                prefetch_range(leaf, leaf->slothead + leafslotmax);
+            else
+                prefetch_range(leaf, leaf->slotkey + leafslotmax);
+        }
+        else {
+            const inner_node* child = static_cast<const inner_node*>(inner->childid[slot]);
+            if (key_heads)
+                prefetch_range(child, child->slothead + innerslotmax);
+            else
+                prefetch_range(child, child->slotkey + innerslotmax);
+        }
+    }
+
+    /// Prefetches a whole leaf node, if enabled by the traits. Used by the
+    /// iterators to load the next leaf in scan direction.
+    static inline void prefetch_leaf(const leaf_node* leaf)
+    {
+        if (!prefetch || leaf == NULL) return;
+
+        prefetch_range(leaf, leaf + 1);
+    }
+
+public:
+    // *** Access Functions to the Item Count
+
+    /// Return the number of key/data pairs in the B+ tree
+    inline size_type size() const
+    {
+        return m_stats.itemcount;
+    }
+
+    /// Returns true if there is at least one key/data pair in the B+ tree
+    inline bool empty() const
+    {
+        return (size() == size_type(0));
+    }
+
+    /// Returns the largest possible size of the B+ Tree. This is just a
+    /// function required by the STL standard, the B+ Tree can hold more items.
+    inline size_type max_size() const
+    {
+        return size_type(-1);
+    }
+
+    /// Return a const reference to the current statistics.
+    inline const struct tree_stats & get_stats() const
+    {
+        return m_stats;
+    }
+
+public:
+    // *** Standard Access Functions Querying the Tree by Descending to a Leaf
+
+    /// Non-STL function checking whether a key is in the B+ tree. The same as
+    /// (find(k) != end()) or (count() != 0).
+    bool exists(const key_type& key) const
+    {
+        const node* n = m_root;
+        if (!n) return false;
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+
+        bool equal;
+        find_lower(leaf, key, equal);
+        return equal;
+    }
+
+    /// Tries to locate a key in the B+ tree and returns an iterator to the
+    /// key/data slot if found. If unsuccessful it returns end().
+    iterator find(const key_type& key)
+    {
+        node* n = m_root;
+        if (!n) return end();
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        leaf_node* leaf = static_cast<leaf_node*>(n);
+
+        bool equal;
+        int slot = find_lower(leaf, key, equal);
+        return equal ? iterator(leaf, slot) : end();
+    }
+
+    /// Tries to locate a key in the B+ tree and returns an constant iterator
+    /// to the key/data slot if found. If unsuccessful it returns end().
+    const_iterator find(const key_type& key) const
+    {
+        const node* n = m_root;
+        if (!n) return end();
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+
+        bool equal;
+        int slot = find_lower(leaf, key, equal);
+        return equal ? const_iterator(leaf, slot) : end();
+    }
+
+private:
+    /// Number of lookups which find_batch() and exists_batch() walk down the
+    /// tree in lockstep.
+    static const unsigned int batch_group = 16;
+
+    /// Descends with a group of up to batch_group keys level by level, until
+    /// leaves[] holds the leaf of each key. Each lookup prefetches its child
+    /// node and proceeds with the next key, so the cache misses of the group
+    /// overlap instead of stalling the descent of each key in turn.
+    template <typename ForwardIterator>
+    void descend_batch(const ForwardIterator* keys, unsigned int num,
+                       const leaf_node** leaves) const
+    {
+        const node* nodes[batch_group];
+
+        for (unsigned int i = 0; i < num; ++i)
+            nodes[i] = m_root;
+
+        // all leaves are on the same level
+        for (unsigned short level = m_root->level; level > 0; --level)
+        {
+            for (unsigned int i = 0; i < num; ++i)
+            {
+                const inner_node* inner = static_cast<const inner_node*>(nodes[i]);
+                int slot = find_lower(inner, *keys[i]);
+                prefetch_childkeys(inner, slot);
+
+                nodes[i] = inner->childid[slot];
+            }
+        }
+
+        for (unsigned int i = 0; i < num; ++i)
+            leaves[i] = static_cast<const leaf_node*>(nodes[i]);
+    }
+
+    /// Looks up the keys in [keys_begin,keys_end) in groups, which descend
+    /// the tree together with descend_batch(), and calls action(leaf, slot,
+    /// equal) for each key in order with the result of find_lower() in its
+    /// leaf. The leaf is NULL if the tree is empty.
+    template <typename ForwardIterator, typename Action>
+    void lookup_batch(ForwardIterator keys_begin, ForwardIterator keys_end,
+                      Action& action) const
+    {
+        ForwardIterator keys[batch_group];
+        const leaf_node* leaves[batch_group];
+
+        while (keys_begin != keys_end)
+        {
+            unsigned int num = 0;
+            while (num < batch_group && keys_begin != keys_end)
+                keys[num++] = keys_begin++;
+
+            if (!m_root) {
+                for (unsigned int i = 0; i < num; ++i)
+                    action(NULL, 0, false);
+                continue;
+            }
+
+            descend_batch(keys, num, leaves);
+
+            for (unsigned int i = 0; i < num; ++i)
+            {
+                bool equal;
+                int slot = find_lower(leaves[i], *keys[i], equal);
+                action(leaves[i], slot, equal);
+            }
+        }
+    }
+
+    /// Action of find_batch(): writes an iterator to the key found, or end().
+    template <typename OutputIterator>
+    struct batch_find
+    {
+        OutputIterator out;
+        iterator       notfound;
+
+        batch_find(OutputIterator o, iterator e)
+            : out(o), notfound(e)
+        { }
+
+        void operator () (const leaf_node* leaf, int slot, bool equal)
+        {
+            if (equal)
+                *out++ = iterator(const_cast<leaf_node*>(leaf), static_cast<unsigned short>(slot));
+            else
+                *out++ = notfound;
+        }
+    };
+
+    /// Action of exists_batch(): writes whether the key was found.
+    template <typename OutputIterator>
+    struct batch_exists
+    {
+        OutputIterator out;
+
+        explicit batch_exists(OutputIterator o)
+            : out(o)
+        { }
+
+        void operator () (const leaf_node*, int, bool equal)
+        {
+            *out++ = equal;
+        }
+    };
+
+public:
+    /// Batched version of find(): looks up each key in [keys_begin,keys_end)
+    /// and writes an iterator to the key/data slot, or end() if the key was
+    /// not found, to out. Lookups are processed in groups which descend the
+    /// tree in lockstep with software prefetching. Returns the advanced
+    /// output iterator.
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator find_batch(ForwardIterator keys_begin, ForwardIterator keys_end,
+                              OutputIterator out)
+    {
+        batch_find<OutputIterator> action(out, end());
+        lookup_batch(keys_begin, keys_end, action);
+        return action.out;
+    }
+
+    /// Batched version of find(): looks up each key in [keys_begin,keys_end)
+    /// and writes a constant iterator to the key/data slot, or end() if the
+    /// key was not found, to out. Lookups are processed in groups which
+    /// descend the tree in lockstep with software prefetching. Returns the
+    /// advanced output iterator.
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator find_batch(ForwardIterator keys_begin, ForwardIterator keys_end,
+                              OutputIterator out) const
+    {
+        return const_cast<btree&>(*this).find_batch(keys_begin, keys_end, out);
+    }
+
+    /// Batched version of exists(): checks each key in [keys_begin,keys_end)
+    /// and writes true or false to out. Lookups are processed in groups which
+    /// descend the tree in lockstep with software prefetching. Returns the
+    /// advanced output iterator.
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator exists_batch(ForwardIterator keys_begin, ForwardIterator keys_end,
+                                OutputIterator out) const
+    {
+        batch_exists<OutputIterator> action(out);
+        lookup_batch(keys_begin, keys_end, action);
+        return action.out;
+    }
+
+    /// Tries to locate a key in the B+ tree and returns the number of
+    /// identical key entries found.
+    size_type count(const key_type& key) const
+    {
+        const node* n = m_root;
+        if (!n) return 0;
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+
+        int slot = find_lower(leaf, key);
+        size_type num = 0;
+
+        // all following keys are greater or equal to key
+        while (leaf && slot < leaf->slotuse && !key_less(key, leaf->slotkey[slot]))
+        {
+            ++num;
+            if (++slot >= leaf->slotuse)
+            {
+                leaf = leaf->nextleaf;
+                slot = 0;
+            }
+        }
+
+        return num;
+    }
+
+    /// Searches the B+ tree and returns an iterator to the first pair
+    /// equal to or greater than key, or end() if all keys are smaller.
+    iterator lower_bound(const key_type& key)
+    {
+        node* n = m_root;
+        if (!n) return end();
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        leaf_node* leaf = static_cast<leaf_node*>(n);
+
+        int slot = find_lower(leaf, key);
+        if (truncate_separators && slot == leaf->slotuse && leaf->nextleaf) {
+            // the key lies between the leaf's largest key and the separator
+            leaf = leaf->nextleaf;
+            slot = 0;
+        }
+        return iterator(leaf, slot);
+    }
+
+    /// Searches the B+ tree and returns a constant iterator to the
+    /// first pair equal to or greater than key, or end() if all keys
+    /// are smaller.
+    const_iterator lower_bound(const key_type& key) const
+    {
+        const node* n = m_root;
+        if (!n) return end();
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+
+        int slot = find_lower(leaf, key);
+        if (truncate_separators && slot == leaf->slotuse && leaf->nextleaf) {
+            // the key lies between the leaf's largest key and the separator
+            leaf = leaf->nextleaf;
+            slot = 0;
+        }
+        return const_iterator(leaf, slot);
+    }
+
+    /// Searches the B+ tree and returns an iterator to the first pair
+    /// greater than key, or end() if all keys are smaller or equal.
+    iterator upper_bound(const key_type& key)
+    {
+        node* n = m_root;
+        if (!n) return end();
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        leaf_node* leaf = static_cast<leaf_node*>(n);
+
+        int slot = find_upper(leaf, key);
+        if (truncate_separators && slot == leaf->slotuse && leaf->nextleaf) {
+            // the key lies between the leaf's largest key and the separator
+            leaf = leaf->nextleaf;
+            slot = 0;
+        }
+        return iterator(leaf, slot);
+    }
+
+    /// Searches the B+ tree and returns a constant iterator to the
+    /// first pair greater than key, or end() if all keys are smaller
+    /// or equal.
+    const_iterator upper_bound(const key_type& key) const
+    {
+        const node* n = m_root;
+        if (!n) return end();
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+
+        int slot = find_upper(leaf, key);
+        if (truncate_separators && slot == leaf->slotuse && leaf->nextleaf) {
+            // the key lies between the leaf's largest key and the separator
+            leaf = leaf->nextleaf;
+            slot = 0;
+        }
+        return const_iterator(leaf, slot);
+    }
+
+    /// Searches the B+ tree and returns both lower_bound() and upper_bound().
+    /// Only one descent is required if the key is not found or the tree
+    /// contains no duplicates.
+    std::pair<iterator, iterator> equal_range(const key_type& key)
+    {
+        node* n = m_root;
+        if (!n) return std::pair<iterator, iterator>(end(), end());
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        leaf_node* leaf = static_cast<leaf_node*>(n);
+
+        bool equal;
+        int slot = find_lower(leaf, key, equal);
+        if (truncate_separators && slot == leaf->slotuse && leaf->nextleaf) {
+            // the key lies between the leaf's largest key and the separator
+            leaf = leaf->nextleaf;
+            slot = 0;
+        }
+        iterator lower(leaf, slot);
+
+        if (!equal)
+            return std::pair<iterator, iterator>(lower, lower);
+
+        if (!allow_duplicates) {
+            iterator upper = lower;
+            return std::pair<iterator, iterator>(lower, ++upper);
+        }
+
+        return std::pair<iterator, iterator>(lower, upper_bound(key));
+    }
+
+    /// Searches the B+ tree and returns both lower_bound() and upper_bound().
+    /// Only one descent is required if the key is not found or the tree
+    /// contains no duplicates.
+    std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const
+    {
+        const node* n = m_root;
+        if (!n) return std::pair<const_iterator, const_iterator>(end(), end());
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+        }
+
+        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+
+        bool equal;
+        int slot = find_lower(leaf, key, equal);
+        if (truncate_separators && slot == leaf->slotuse && leaf->nextleaf) {
+            // the key lies between the leaf's largest key and the separator
+            leaf = leaf->nextleaf;
+            slot = 0;
+        }
+        const_iterator lower(leaf, slot);
+
+        if (!equal)
+            return std::pair<const_iterator, const_iterator>(lower, lower);
+
+        if (!allow_duplicates) {
+            const_iterator upper = lower;
+            return std::pair<const_iterator, const_iterator>(lower, ++upper);
+        }
+
+        return std::pair<const_iterator, const_iterator>(lower, upper_bound(key));
+    }
+
+public:
+    // *** Order Statistics
+
+    /// Returns the number of pairs with keys less than key, which is the
+    /// position of lower_bound(key). Runs in O(log n) if order_statistics is
+    /// set, and else walks the leaves in front of it.
+    size_type rank(const key_type& key) const
+    {
+        if (!order_statistics)
+            return static_cast<size_type>(distance(begin(), lower_bound(key)));
+
+        const node* n = m_root;
+        if (!n) return 0;
+
+        size_type pos = 0;
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+
+            for (int s = 0; s < slot; ++s)
+                pos += inner->childcount[s];
+
+            n = inner->childid[slot];
+        }
+
+        return pos + find_lower(static_cast<const leaf_node*>(n), key);
+    }
+
+    /// Returns an iterator to the k-th pair in key order, counting from
+    /// zero, or end() if k >= size(). Runs in O(log n) if order_statistics
+    /// is set, and else skips over the leaves in front of it.
+    iterator select(size_type k)
+    {
+        if (k >= size()) return end();
+
+        if (!order_statistics) {
+            iterator it = begin();
+            it += k;
+            return it;
+        }
+
+        node* n = m_root;
+
+        while (!n->isleafnode())
+        {
+            inner_node* inner = static_cast<inner_node*>(n);
+            unsigned short slot = 0;
+
+            while (k >= inner->childcount[slot])
+                k -= inner->childcount[slot++];
+
+            n = inner->childid[slot];
+        }
+
+        return iterator(static_cast<leaf_node*>(n), static_cast<unsigned short>(k));
+    }
+
+    /// Returns a constant iterator to the k-th pair in key order, counting
+    /// from zero, or end() if k >= size().
+    const_iterator select(size_type k) const
+    {
+        return const_cast<btree&>(*this).select(k);
+    }
+
+    /// Returns the number of pairs from first to last, which must be
+    /// reachable from first unless order_statistics is set. Runs in
+    /// O(log n) with order_statistics, else in O(n / leafslotmax). A leaf
+    /// filled with copies of one key adds the leaves to the nearer end of
+    /// that key's run, see leaf_path().
+    difference_type distance(const_iterator first, const_iterator last) const
+    {
+        if (order_statistics)
+            return static_cast<difference_type>(position(last.currnode, last.currslot))
+                   - static_cast<difference_type>(position(first.currnode, first.currslot));
+
+        difference_type n = 0;
+        const leaf_node* leaf = first.currnode;
+        unsigned short slot = first.currslot;
+
+        while (leaf != last.currnode)
+        {
+            n += leaf->slotuse - slot;
+            leaf = leaf->nextleaf;
+            slot = 0;
+        }
+
+        return n + last.currslot - slot;
+    }
+
+    /// Returns the number of pairs with lower <= key < upper.
+    size_type count(const key_type& lower, const key_type& upper) const
+    {
+        if (!key_less(lower, upper)) return 0;
+
+        return rank(upper) - rank(lower);
+    }
+
+private:
+    /// Returns the position of the slot in leaf among all pairs, from the
+    /// item counts of the children in front of the path to it.
+    size_type position(const leaf_node* leaf, unsigned short slot) const
+    {
+        if (leaf == NULL || m_root->isleafnode()) return slot;
+
+        unsigned short path[cursor_maxlevel];
+        leaf_path(leaf, path);
+
+        size_type pos = slot;
+        const node* n = m_root;
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+
+            for (unsigned short s = 0; s < path[inner->level]; ++s)
+                pos += inner->childcount[s];
+
+            n = inner->childid[path[inner->level]];
+        }
+
+        return pos;
+    }
+
+public:
+    // *** Aggregates over Key Ranges
+
+    /// Combines the summaries of all pairs with lower <= key < upper in key
+    /// order. If aggregates is set, only the two paths to lower and upper are
+    /// descended and the cached summaries of the children between them are
+    /// combined, in O(log n) nodes. Otherwise the pairs are summarized one by
+    /// one.
+    summary_type aggregate(const key_type& lower, const key_type& upper) const
+    {
+        if (m_root == NULL || !key_less(lower, upper))
+            return aggregate_type::identity();
+
+        if (!aggregates)
+            return aggregate_pairs(lower_bound(lower), lower_bound(upper));
+
+        return aggregate_descend(m_root, &lower, &upper);
+    }
+
+    /// Combines the summaries of all pairs of the tree.
+    summary_type aggregate() const
+    {
+        if (m_root == NULL)
+            return aggregate_type::identity();
+
+        if (!aggregates)
+            return aggregate_pairs(begin(), end());
+
+        if (m_root->isleafnode())
+            return static_cast<const leaf_node*>(m_root)->subtree_summary();
+        else
+            return static_cast<const inner_node*>(m_root)->subtree_summary();
+    }
+
+    /// Replaces the data of the pair at iter and recalculates the cached
+    /// summaries on the path above it, see update_aggregate().
+    void assign(iterator iter, const data_type& data)
+    {
+        iter.currnode->slotdata[used_as_set ? 0 : iter.currslot] = data;
+        update_aggregate(iter);
+    }
+
+    /// Recalculates the cached summaries on the path above the pair at iter,
+    /// after the data it summarizes was changed outside the tree. The leaf is
+    /// located by leaf_path(), which takes O(log n) nodes unless it is filled
+    /// with copies of one key.
+    void update_aggregate(const_iterator iter)
+    {
+        if (!aggregates || m_root == NULL || m_root->isleafnode()) return;
+
+        unsigned short path[cursor_maxlevel];
+        leaf_path(iter.currnode, path);
+
+        inner_node* nodes[cursor_maxlevel];
+        node* n = m_root;
+
+        while (!n->isleafnode())
+        {
+            inner_node* inner = static_cast<inner_node*>(n);
+            nodes[inner->level] = inner;
+            n = inner->childid[path[inner->level]];
+        }
+
+        for (unsigned short level = 1; level <= m_root->level; ++level)
+            nodes[level]->update_child(path[level]);
+    }
+
+private:
+    /// Combines the summaries of the pairs below n with keys not less than
+    /// *lower and less than *upper. A NULL bound is not checked, because the
+    /// range extends beyond n on that side.
+    summary_type aggregate_descend(const node* n, const key_type* lower,
+                                   const key_type* upper) const
+    {
+        if (n->isleafnode())
+        {
+            const leaf_node* leaf = static_cast<const leaf_node*>(n);
+
+            unsigned short from = lower ? find_lower(leaf, *lower) : 0;
+            unsigned short to = upper ? find_lower(leaf, *upper) : leaf->slotuse;
+
+            return leaf->range_summary(from, to);
+        }
+
+        const inner_node* inner = static_cast<const inner_node*>(n);
+
+        int ca = lower ? find_lower(inner, *lower) : 0;
+        int cb = upper ? find_lower(inner, *upper) : inner->slotuse;
+
+        if (ca == cb)
+            return aggregate_descend(inner->childid[ca], lower, upper);
+
+        // the children between the two paths are covered completely
+        summary_type sum = aggregate_descend(inner->childid[ca], lower, NULL);
+
+        for (int slot = ca + 1; slot < cb; ++slot)
+            sum = aggregate_type::combine(sum, inner->childsummary[slot]);
+
+        return aggregate_type::combine(sum, aggregate_descend(inner->childid[cb], NULL, upper));
+    }
+
+    /// Combines the summaries of the pairs [first,last) one by one.
+    static summary_type aggregate_pairs(const_iterator first, const_iterator last)
+    {
+        summary_type sum = aggregate_type::identity();
+
+        for ( ; first != last; ++first)
+        {
+            sum = aggregate_type::combine(
+                sum, aggregate_type::summarize(first.key(), first.data()));
+        }
+
+        return sum;
+    }
+
+private:
+    // *** Finger Search with Cursors
+
+    /// Maximum tree height for which a cursor remembers the path. Higher
+    /// trees are always searched from the root.
+    static const unsigned short cursor_maxlevel = 32;
+
+public:
+    class cursor;
+    class const_cursor;
+
+    /// A cursor remembers the root-to-leaf path of its last seek(). The next
+    /// seek() restarts the lower_bound() descent at the lowest node of this
+    /// path whose keys enclose the new key, or it steps to the successor leaf.
+    /// Probing k sorted keys that lie close together therefore costs O(log
+    /// distance) each instead of O(log n). Like iterators, a cursor is
+    /// invalidated by any modification of the tree.
+    class cursor
+    {
+    private:
+        // *** Members
+
+        /// The B+ tree searched by this cursor
+        btree* m_tree;
+
+        /// Nodes on the path of the last seek, indexed by their level
+        const typename btree::node* m_path[btree::cursor_maxlevel];
+
+        /// Friendly to the const_cursor, so it may copy the path.
+        friend class const_cursor;
+
+    public:
+        // *** Methods
+
+        /// Initialize a cursor without path for the given B+ tree.
+        explicit inline cursor(btree& tree)
+            : m_tree(&tree)
+        {
+            reset();
+        }
+
+        /// Forget the remembered path, the next seek() descends from the
+        /// root. Required after the tree was modified.
+        inline void reset()
+        {
+            std::fill(m_path, m_path + btree::cursor_maxlevel,
+                      static_cast<const typename btree::node*>(NULL));
+        }
+
+        /// Returns an iterator to the first pair equal to or greater than
+        /// key, or end() if all keys are smaller. Equivalent to
+        /// lower_bound(), but starts searching at the previous position.
+        inline iterator seek(const key_type& key)
+        {
+            const typename btree::leaf_node* leaf;
+            int slot = m_tree->seek_path(m_path, key, leaf);
+            return iterator(const_cast<typename btree::leaf_node*>(leaf), slot);
+        }
+    };
+
+    /// A read-only cursor over a constant B+ tree, see cursor.
+    class const_cursor
+    {
+    private:
+        // *** Members
+
+        /// The B+ tree searched by this cursor
+        const btree* m_tree;
+
+        /// Nodes on the path of the last seek, indexed by their level
+        const typename btree::node* m_path[btree::cursor_maxlevel];
+
+    public:
+        // *** Methods
+
+        /// Initialize a cursor without path for the given B+ tree.
+        explicit inline const_cursor(const btree& tree)
+            : m_tree(&tree)
+        {
+            reset();
+        }
+
+        /// Copy-constructor from a mutable cursor, including its path.
+        inline const_cursor(const cursor& c)
+            : m_tree(c.m_tree)
+        {
+            std::copy(c.m_path, c.m_path + btree::cursor_maxlevel, m_path);
+        }
+
+        /// Forget the remembered path, the next seek() descends from the
+        /// root. Required after the tree was modified.
+        inline void reset()
+        {
+            std::fill(m_path, m_path + btree::cursor_maxlevel,
+                      static_cast<const typename btree::node*>(NULL));
+        }
+
+        /// Returns a constant iterator to the first pair equal to or greater
+        /// than key, or end() if all keys are smaller. Equivalent to
+        /// lower_bound(), but starts searching at the previous position.
+        inline const_iterator seek(const key_type& key)
+        {
+            const typename btree::leaf_node* leaf;
+            int slot = m_tree->seek_path(m_path, key, leaf);
+            return const_iterator(leaf, slot);
+        }
+    };
+
+    /// Constructs a cursor for finger searches on this B+ tree.
+    inline cursor make_cursor()
+    {
+        return cursor(*this);
+    }
+
+    /// Constructs a read-only cursor for finger searches on this B+ tree.
+    inline const_cursor make_cursor() const
+    {
+        return const_cursor(*this);
+    }
+
+private:
+    /// Finger search for a lower_bound() using and updating the node path of
+    /// a cursor. Returns the slot and sets leafout to the leaf.
+    int seek_path(const node** path, const key_type& key,
+                  const leaf_node*& leafout) const
+    {
+        const node* n = m_root;
+        if (!n) {
+            leafout = m_tailleaf;
+            return 0;
+        }
+
+        if (n->level < cursor_maxlevel && path[n->level] == n && path[0] != NULL)
+        {
+            const leaf_node* leaf = static_cast<const leaf_node*>(path[0]);
+
+            if (key_lessequal(key, leaf->slotkey[leaf->slotuse - 1]))
+            {
+                // the key belongs into this leaf
+                if (key_less(leaf->slotkey[0], key) || leaf->prevleaf == NULL ||
+                    key_less(leaf->prevleaf->slotkey[leaf->prevleaf->slotuse - 1], key))
+                {
+                    leafout = leaf;
+                    return find_lower(leaf, key);
+                }
+            }
+            else if (leaf->nextleaf == NULL)
+            {
+                // the key is greater than all keys of the tree
+                leafout = leaf;
+                return leaf->slotuse;
+            }
+            else if (key_lessequal(key, leaf->nextleaf->slotkey[leaf->nextleaf->slotuse - 1]))
+            {
+                // step to the successor leaf, the inner nodes on the path
+                // are only used for their key ranges.
+                leaf = leaf->nextleaf;
+                path[0] = leaf;
+                leafout = leaf;
+                return find_lower(leaf, key);
+            }
+
+            // climb to the lowest inner node whose keys enclose the key. If
+            // its first key is smaller and its last key is greater or equal,
+            // then the descent from the root also passes through this node.
+            for (unsigned short level = 1; level < n->level; ++level)
+            {
+                const inner_node* inner = static_cast<const inner_node*>(path[level]);
+
+                if (key_less(inner->slotkey[0], key) &&
+                    key_lessequal(key, inner->slotkey[inner->slotuse - 1]))
+                {
+                    n = inner;
+                    break;
+                }
+            }
+        }
+        else if (n->level < cursor_maxlevel)
+        {
+            path[n->level] = n;
+        }
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->childid[slot];
+            if (n->level < cursor_maxlevel) path[n->level] = n;
+        }
+
+        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+
+        int slot = find_lower(leaf, key);
+        if (truncate_separators && slot == leaf->slotuse && leaf->nextleaf) {
+            // the key lies between the leaf's largest key and the separator
+            leaf = leaf->nextleaf;
+            slot = 0;
+        }
+
+        leafout = leaf;
+        return slot;
+    }
+
+public:
+    // *** B+ Tree Object Comparison Functions
+
+    /// Equality relation of B+ trees of the same type. B+ trees of the same
+    /// size and equal elements (both key and data) are considered
+    /// equal. Beware of the random ordering of duplicate keys.
+    inline bool operator == (const self_type& other) const
+    {
+        return (size() == other.size()) && std::equal(begin(), end(), other.begin());
+    }
+
+    /// Inequality relation. Based on operator==.
+    inline bool operator != (const self_type& other) const
+    {
+        return !(*this == other);
+    }
+
+    /// Total ordering relation of B+ trees of the same type. It uses
+    /// std::lexicographical_compare() for the actual comparison of elements.
+    inline bool operator < (const self_type& other) const
+    {
+        return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
+    }
+
+    /// Greater relation. Based on operator<.
+    inline bool operator > (const self_type& other) const
+    {
+        return other < *this;
+    }
+
+    /// Less-equal relation. Based on operator<.
+    inline bool operator <= (const self_type& other) const
+    {
+        return !(other < *this);
+    }
+
+    /// Greater-equal relation. Based on operator<.
+    inline bool operator >= (const self_type& other) const
+    {
+        return !(*this < other);
+    }
+
+public:
+    /// *** Fast Copy: Assign Operator and Copy Constructors
+
+    /// Assignment operator. All the key/data pairs are copied
+    inline self_type& operator = (const self_type& other)
+    {
+        if (this != &other)
+        {
+            clear();
+
+            m_key_less = other.key_comp();
+            m_allocator = other.get_allocator();
+            m_node_allocator = node_allocator_type(m_allocator);
+
+            if (other.size() != 0)
+            {
+                m_stats.leaves = m_stats.innernodes = 0;
+                if (other.m_root) {
+                    m_root = copy_tree(other.m_root, other.m_stats.leaves);
+                }
+                m_stats = other.m_stats;
+            }
+
+            if (selfverify) verify();
         }
+        return *this;
+    }
 
-        /// Dereference the iterator. Do not use this if possible, use key()
-        /// and data() instead. The B+ tree does not stored key and data
-        /// together.
-        inline pointer operator -> () const
+    /// Copy constructor. The newly initialized B+ tree object will contain a
+    /// copy of all key/data pairs.
+    inline btree(const btree& other)
+        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL),
+          m_stats(other.m_stats),
+          m_key_less(other.key_comp()),
+          m_allocator(other.get_allocator()),
+          m_node_allocator(m_allocator)
+    {
+        if (size() > 0)
         {
-            BTREE_ASSERT(currslot > 0);
-            temp_value = pair_to_value_type()(pair_type(key(), data()));
-            return &temp_value;
+            m_stats.leaves = m_stats.innernodes = 0;
+            if (other.m_root) {
+                m_root = copy_tree(other.m_root, other.m_stats.leaves);
+            }
+            if (selfverify) verify();
+        }
+    }
+
+private:
+    /// Copy the tree below root with num_leaves leaves from another B+ tree
+    /// object, on copy_threads threads if it is large enough.
+    node * copy_tree(const node* root, size_type num_leaves)
+    {
+        unsigned int num_threads = parallel_threads(num_leaves, copy_threads);
+
+        if (num_threads == 1)
+            return copy_recursive(root);
+
+        // collect the nodes of each level in key order, and for each inner
+        // node the index of its first child in the level below.
+        unsigned short height = root->level;
+        std::vector<std::vector<const node*> > src(height + 1);
+        std::vector<std::vector<size_type> > first_child(height + 1);
+
+        src[height].push_back(root);
+        src[0].reserve(num_leaves);
+
+        for (unsigned short level = height; level > 0; --level)
+        {
+            for (size_type i = 0; i < src[level].size(); ++i)
+            {
+                const inner_node* inner = static_cast<const inner_node*>(src[level][i]);
+
+                first_child[level].push_back(src[level - 1].size());
+                src[level - 1].insert(src[level - 1].end(), inner->childid,
+                                      inner->childid + inner->slotuse + 1);
+            }
+        }
+
+        // allocate the leaves and then each inner level in key order on this
+        // thread, and fill the nodes of each level in parallel.
+        std::vector<std::vector<node*> > dst(height + 1);
+
+        for (unsigned short level = 0; level <= height; ++level)
+        {
+            dst[level].resize(src[level].size());
+
+            for (size_type i = 0; i < src[level].size(); ++i)
+            {
+                dst[level][i] = (level == 0)
+                                ? static_cast<node*>(allocate_leaf())
+                                : static_cast<node*>(allocate_inner(level));
+            }
+        }
+
+        for (unsigned short level = 0; level <= height; ++level)
+        {
+            size_type num_nodes = src[level].size();
+
+            copy_nodes work = {
+                &src[level][0], &dst[level][0], num_nodes,
+                level ? &first_child[level][0] : NULL,
+                level ? &dst[level - 1][0] : NULL
+            };
+            run_parallel(num_nodes, parallel_threads(num_nodes, num_threads), work);
+        }
+
+        m_headleaf = static_cast<leaf_node*>(dst[0].front());
+        m_tailleaf = static_cast<leaf_node*>(dst[0].back());
+
+        return dst[height][0];
+    }
+
+    /// Copies the nodes [begin,end) of one level for copy_tree(). Leaves are
+    /// linked to their neighbours, inner nodes to the copies of their
+    /// children.
+    struct copy_nodes
+    {
+        const node* const* src;
+        node**             dst;
+        size_type          num_nodes;
+        const size_type*   first_child;
+        node**             children;
+
+        void operator () (size_type begin, size_type end) const
+        {
+            for (size_type i = begin; i < end; ++i)
+            {
+                if (src[i]->isleafnode())
+                {
+                    const leaf_node* leaf = static_cast<const leaf_node*>(src[i]);
+                    leaf_node* newleaf = static_cast<leaf_node*>(dst[i]);
+
+                    newleaf->slotuse = leaf->slotuse;
+                    std::copy(leaf->slotkey, leaf->slotkey + leaf->slotuse, newleaf->slotkey);
+                    head_copy(leaf->slothead, leaf->slothead + leaf->slotuse,
+                              newleaf->slothead);
+                    data_copy(leaf->slotdata, leaf->slotdata + leaf->slotuse, newleaf->slotdata);
+
+                    newleaf->prevleaf = (i > 0) ? static_cast<leaf_node*>(dst[i - 1]) : NULL;
+                    newleaf->nextleaf = (i + 1 < num_nodes) ? static_cast<leaf_node*>(dst[i + 1]) : NULL;
+                }
+                else
+                {
+                    const inner_node* inner = static_cast<const inner_node*>(src[i]);
+                    inner_node* newinner = static_cast<inner_node*>(dst[i]);
+
+                    newinner->slotuse = inner->slotuse;
+                    std::copy(inner->slotkey, inner->slotkey + inner->slotuse, newinner->slotkey);
+                    head_copy(inner->slothead, inner->slothead + inner->slotuse,
+                              newinner->slothead);
+                    std::copy(children + first_child[i],
+                              children + first_child[i] + inner->slotuse + 1,
+                              newinner->childid);
+                    count_copy(inner->childcount, inner->childcount + inner->slotuse + 1,
+                               newinner->childcount);
+                    summary_copy(inner->childsummary, inner->childsummary + inner->slotuse + 1,
+                                 newinner->childsummary);
+                }
+            }
+        }
+    };
+
+    /// Recursively copy nodes from another B+ tree object
+    struct node * copy_recursive(const node* n)
+    {
+        if (n->isleafnode())
+        {
+            const leaf_node* leaf = static_cast<const leaf_node*>(n);
+            leaf_node* newleaf = allocate_leaf();
+
+            newleaf->slotuse = leaf->slotuse;
+            std::copy(leaf->slotkey, leaf->slotkey + leaf->slotuse, newleaf->slotkey);
+            head_copy(leaf->slothead, leaf->slothead + leaf->slotuse,
+                      newleaf->slothead);
+            data_copy(leaf->slotdata, leaf->slotdata + leaf->slotuse, newleaf->slotdata);
+
+            if (m_headleaf == NULL)
+            {
+                m_headleaf = m_tailleaf = newleaf;
+                newleaf->prevleaf = newleaf->nextleaf = NULL;
+            }
+            else
+            {
+                newleaf->prevleaf = m_tailleaf;
+                m_tailleaf->nextleaf = newleaf;
+                m_tailleaf = newleaf;
+            }
+
+            return newleaf;
+        }
+        else
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            inner_node* newinner = allocate_inner(inner->level);
+
+            newinner->slotuse = inner->slotuse;
+            std::copy(inner->slotkey, inner->slotkey + inner->slotuse, newinner->slotkey);
+            head_copy(inner->slothead, inner->slothead + inner->slotuse,
+                      newinner->slothead);
+
+            for (unsigned short slot = 0; slot <= inner->slotuse; ++slot)
+            {
+                newinner->childid[slot] = copy_recursive(inner->childid[slot]);
+            }
+            count_copy(inner->childcount, inner->childcount + inner->slotuse + 1,
+                       newinner->childcount);
+            summary_copy(inner->childsummary, inner->childsummary + inner->slotuse + 1,
+                         newinner->childsummary);
+
+            return newinner;
+        }
+    }
+
+public:
+    // *** Public Insertion Functions
+
+    /// Attempt to insert a key/data pair into the B+ tree. If the tree does not
+    /// allow duplicate keys, then the insert may fail if it is already
+    /// present.
+    inline std::pair<iterator, bool> insert(const pair_type& x)
+    {
+        return insert_start(x.first, x.second);
+    }
+
+    /// Attempt to insert a key/data pair into the B+ tree. Beware that if
+    /// key_type == data_type, then the template iterator insert() is called
+    /// instead. If the tree does not allow duplicate keys, then the insert may
+    /// fail if it is already present.
+    inline std::pair<iterator, bool> insert(const key_type& key, const data_type& data)
+    {
+        return insert_start(key, data);
+    }
+
+    /// Attempt to insert a key/data pair into the B+ tree. This function is the
+    /// same as the other insert, however if key_type == data_type then the
+    /// non-template function cannot be called. If the tree does not allow
+    /// duplicate keys, then the insert may fail if it is already present.
+    inline std::pair<iterator, bool> insert2(const key_type& key, const data_type& data)
+    {
+        return insert_start(key, data);
+    }
+
+    /// Attempt to insert a key/data pair into the B+ tree. If the key belongs
+    /// into the leaf referenced by the iterator hint or its successor, then
+    /// the pair is put there directly without descending from the root. With
+    /// order_statistics or aggregates, the hint is ignored.
+    inline iterator insert(iterator hint, const pair_type& x)
+    {
+        return insert_hint(hint, x.first, x.second).first;
+    }
+
+    /// Attempt to insert a key/data pair into the B+ tree. If the key belongs
+    /// into the leaf referenced by the iterator hint or its successor, then
+    /// the pair is put there directly without descending from the root. With
+    /// order_statistics or aggregates, the hint is ignored.
+    inline iterator insert2(iterator hint, const key_type& key, const data_type& data)
+    {
+        return insert_hint(hint, key, data).first;
+    }
+
+    /// Attempt to insert the range [first,last) of value_type pairs into the
+    /// B+ tree. Each key/data pair is inserted individually; to bulk load the
+    /// tree, use a constructor with range.
+    template <typename InputIterator>
+    inline void insert(InputIterator first, InputIterator last)
+    {
+        InputIterator iter = first;
+        while (iter != last)
+        {
+            insert(*iter);
+            ++iter;
+        }
+    }
+
+private:
+    // *** Private Insertion Functions
+
+    /// Start the insertion descent at the current root and handle root
+    /// splits. Returns true if the item was inserted
+    std::pair<iterator, bool> insert_start(const key_type& key, const data_type& value)
+    {
+        node* newchild = NULL;
+        key_type newkey = key_type();
+
+        if (m_root == NULL) {
+            m_root = m_headleaf = m_tailleaf = allocate_leaf();
+        }
+        else if (!order_statistics && !aggregates && m_tailleaf->slotuse != 0 && !m_tailleaf->isfull() &&
+                 key_lessequal(m_tailleaf->slotkey[m_tailleaf->slotuse - 1], key))
+        {
+            // fast path for appending keys: the tail leaf is the last child of
+            // all its ancestors, hence no separator needs to be updated.
+            return insert_hint(end(), key, value);
+        }
+
+        std::pair<iterator, bool> r = insert_descend(m_root, key, value, &newkey, &newchild);
+
+        if (newchild)
+        {
+            inner_node* newroot = allocate_inner(m_root->level + 1);
+            newroot->slotkey[0] = newkey;
+            newroot->update_head(0);
+
+            newroot->childid[0] = m_root;
+            newroot->childid[1] = newchild;
+
+            newroot->slotuse = 1;
+            newroot->update_child(0);
+            newroot->update_child(1);
+
+            m_root = newroot;
         }
 
-        /// Key of the current slot
-        inline const key_type & key() const
-        {
-            BTREE_ASSERT(currslot > 0);
-            return currnode->slotkey[currslot - 1];
+        // increment itemcount if the item was inserted
+        if (r.second) ++m_stats.itemcount;
+
+#ifdef BTREE_DEBUG
+        if (debug) print(std::cout);
+#endif
+
+        if (selfverify) {
+            verify();
+            BTREE_ASSERT(exists(key));
         }
 
-        /// Read-only reference to the current data object
-        inline const data_type & data() const
+        return r;
+    }
+
+    /// Insert using the leaf referenced by the hint iterator: if the key
+    /// belongs into this leaf or its successor and the leaf has a free slot,
+    /// then the pair is put there directly. Because the largest key of a leaf
+    /// is the separator in its parent, the key must not be larger than the
+    /// leaf's largest key, except for the tail leaf. Otherwise and on splits,
+    /// this falls back to insert_start(). With order_statistics or
+    /// aggregates, the counts and summaries of all ancestors change, so it
+    /// always does.
+    std::pair<iterator, bool> insert_hint(iterator hint,
+                                          const key_type& key, const data_type& value)
+    {
+        leaf_node* leaf = hint.currnode;
+
+        if (order_statistics || aggregates || leaf == NULL || leaf->slotuse == 0)
+            return insert_start(key, value);
+
+        bool equal = false;
+        int slot;
+
+        if (leaf == m_tailleaf && key_lessequal(leaf->slotkey[leaf->slotuse - 1], key))
         {
-            BTREE_ASSERT(currslot > 0);
-            return currnode->slotdata[used_as_set ? 0 : currslot - 1];
+            if (!allow_duplicates && !key_less(leaf->slotkey[leaf->slotuse - 1], key))
+                return std::pair<iterator, bool>(iterator(leaf, leaf->slotuse - 1), false);
+
+            // append after the largest key of the tree
+            slot = leaf->slotuse;
         }
+        else if (key_less(leaf->slotkey[leaf->slotuse - 1], key))
+        {
+            // all keys of the successor are greater than this leaf's
+            leaf = leaf->nextleaf;
 
-        /// Prefix++ advance the iterator to the previous slot
-        inline const_reverse_iterator& operator ++ ()
+            if (key_less(leaf->slotkey[leaf->slotuse - 1], key))
+                return insert_start(key, value);
+
+            // a truncated separator may be greater than the key
+            if (truncate_separators && !key_less(leaf->slotkey[0], key))
+                return insert_start(key, value);
+
+            slot = allow_duplicates ? find_lower(leaf, key)
+                   : find_lower(leaf, key, equal);
+        }
+        else
         {
-            if (currslot > 1) {
-                --currslot;
-            }
-            else if (currnode->prevleaf != NULL) {
-                currnode = currnode->prevleaf;
-                currslot = currnode->slotuse;
+            if (truncate_separators && !key_less(leaf->slotkey[0], key))
+            {
+                // the truncated separator to the predecessor is unknown
+                return insert_start(key, value);
             }
-            else {
-                // this is begin() == rend()
-                currslot = 0;
+            else if (leaf->prevleaf != NULL && key_less(key, leaf->slotkey[0]))
+            {
+                // the key must not belong into the predecessor
+                const leaf_node* prev = leaf->prevleaf;
+                const key_type& prevkey = prev->slotkey[prev->slotuse - 1];
+
+                if (allow_duplicates ? key_less(key, prevkey) : !key_less(prevkey, key))
+                    return insert_start(key, value);
             }
 
-            return *this;
+            slot = allow_duplicates ? find_lower(leaf, key)
+                   : find_lower(leaf, key, equal);
         }
 
-        /// Postfix++ advance the iterator to the previous slot
-        inline const_reverse_iterator operator ++ (int)
-        {
-            const_reverse_iterator tmp = *this;   // copy ourselves
+        if (equal) {
+            return std::pair<iterator, bool>(iterator(leaf, slot), false);
+        }
 
-            if (currslot > 1) {
-                --currslot;
-            }
-            else if (currnode->prevleaf != NULL) {
-                currnode = currnode->prevleaf;
-                currslot = currnode->slotuse;
-            }
-            else {
-                // this is begin() == rend()
-                currslot = 0;
-            }
+        if (leaf->isfull())
+            return insert_start(key, value);
 
-            return tmp;
-        }
+        BTREE_PRINT("btree::insert_hint into leaf " << leaf << " at slot " << slot);
 
-        /// Prefix-- backstep the iterator to the next slot
-        inline const_reverse_iterator& operator -- ()
-        {
-            if (currslot < currnode->slotuse) {
-                ++currslot;
-            }
-            else if (currnode->nextleaf != NULL) {
-                currnode = currnode->nextleaf;
-                currslot = 1;
-            }
-            else {
-                // this is end() == rbegin()
-                currslot = currnode->slotuse;
-            }
+        std::copy_backward(leaf->slotkey + slot, leaf->slotkey + leaf->slotuse,
+                           leaf->slotkey + leaf->slotuse + 1);
+        head_copy_backward(leaf->slothead + slot, leaf->slothead + leaf->slotuse,
+                           leaf->slothead + leaf->slotuse + 1);
+        data_copy_backward(leaf->slotdata + slot, leaf->slotdata + leaf->slotuse,
+                           leaf->slotdata + leaf->slotuse + 1);
 
-            return *this;
+        leaf->slotkey[slot] = key;
+        leaf->update_head(slot);
+        if (!used_as_set) leaf->slotdata[slot] = value;
+        leaf->slotuse++;
+
+        ++m_stats.itemcount;
+
+#ifdef BTREE_DEBUG
+        if (debug) print(std::cout);
+#endif
+
+        if (selfverify) {
+            verify();
+            BTREE_ASSERT(exists(key));
         }
 
-        /// Postfix-- backstep the iterator to the next slot
-        inline const_reverse_iterator operator -- (int)
+        return std::pair<iterator, bool>(iterator(leaf, slot), true);
+    }
+
+    /**
+     * @brief Insert an item into the B+ tree.
+     *
+     * Descend down the nodes to a leaf, insert the key/data pair in a free
+     * slot. If the node overflows, then it must be split and the new split
+     * node inserted into the parent. Unroll / this splitting up to the root.
+    */
+    std::pair<iterator, bool> insert_descend(node* n,
+                                             const key_type& key, const data_type& value,
+                                             key_type* splitkey, node** splitnode)
+    {
+        if (!n->isleafnode())
         {
-            const_reverse_iterator tmp = *this;   // copy ourselves
+            inner_node* inner = static_cast<inner_node*>(n);
 
-            if (currslot < currnode->slotuse) {
-                ++currslot;
-            }
-            else if (currnode->nextleaf != NULL) {
-                currnode = currnode->nextleaf;
-                currslot = 1;
+            key_type newkey = key_type();
+            node* newchild = NULL;
+
+            int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            BTREE_PRINT("btree::insert_descend into " << inner->childid[slot]);
+
+            std::pair<iterator, bool> r = insert_descend(inner->childid[slot],
+                                                         key, value, &newkey, &newchild);
+
+            if (newchild)
+            {
+                BTREE_PRINT("btree::insert_descend newchild with key " << newkey << " node " << newchild << " at slot " << slot);
+
+                if (inner->isfull())
+                {
+                    split_inner_node(inner, splitkey, splitnode, slot);
+
+                    BTREE_PRINT("btree::insert_descend done split_inner: putslot: " << slot << " putkey: " << newkey << " upkey: " << *splitkey);
+
+#ifdef BTREE_DEBUG
+                    if (debug)
+                    {
+                        print_node(std::cout, inner);
+                        print_node(std::cout, *splitnode);
+                    }
+#endif
+
+                    // check if insert slot is in the split sibling node
+                    BTREE_PRINT("btree::insert_descend switch: " << slot << " > " << inner->slotuse + 1);
+
+                    if (slot == inner->slotuse + 1 && inner->slotuse < (*splitnode)->slotuse)
+                    {
+                        // special case when the insert slot matches the split
+                        // place between the two nodes, then the insert key
+                        // becomes the split key.
+
+                        BTREE_ASSERT(inner->slotuse + 1 < innerslotmax);
+
+                        inner_node* splitinner = static_cast<inner_node*>(*splitnode);
+
+                        // move the split key and it's datum into the left node
+                        inner->slotkey[inner->slotuse] = *splitkey;
+                        inner->update_head(inner->slotuse);
+                        inner->childid[inner->slotuse + 1] = splitinner->childid[0];
+                        inner->slotuse++;
+                        inner->update_child(inner->slotuse);
+
+                        // set new split key and move corresponding datum into right node
+                        splitinner->childid[0] = newchild;
+                        splitinner->update_child(0);
+                        *splitkey = newkey;
+
+                        return r;
+                    }
+                    else if (slot >= inner->slotuse + 1)
+                    {
+                        // in case the insert slot is in the newly create split
+                        // node, we reuse the code below.
+
+                        slot -= inner->slotuse + 1;
+                        inner = static_cast<inner_node*>(*splitnode);
+                        BTREE_PRINT("btree::insert_descend switching to splitted node " << inner << " slot " << slot);
+                    }
+                }
+
+                // move items and put pointer to child node into correct slot
+                BTREE_ASSERT(slot >= 0 && slot <= inner->slotuse);
+
+                std::copy_backward(inner->slotkey + slot, inner->slotkey + inner->slotuse,
+                                   inner->slotkey + inner->slotuse + 1);
+                head_copy_backward(inner->slothead + slot, inner->slothead + inner->slotuse,
+                                   inner->slothead + inner->slotuse + 1);
+                std::copy_backward(inner->childid + slot, inner->childid + inner->slotuse + 1,
+                                   inner->childid + inner->slotuse + 2);
+                count_copy_backward(inner->childcount + slot, inner->childcount + inner->slotuse + 1,
+                                    inner->childcount + inner->slotuse + 2);
+                summary_copy_backward(inner->childsummary + slot, inner->childsummary + inner->slotuse + 1,
+                                      inner->childsummary + inner->slotuse + 2);
+
+                inner->slotkey[slot] = newkey;
+                inner->update_head(slot);
+                inner->childid[slot + 1] = newchild;
+                inner->slotuse++;
+
+                inner->update_child(slot);
+                inner->update_child(slot + 1);
             }
-            else {
-                // this is end() == rbegin()
-                currslot = currnode->slotuse;
+            else if (r.second)
+            {
+                inner->update_inserted(slot);
             }
 
-            return tmp;
+            return r;
         }
-
-        /// Equality of iterators
-        inline bool operator == (const const_reverse_iterator& x) const
+        else // n->isleafnode() == true
         {
-            return (x.currnode == currnode) && (x.currslot == currslot);
-        }
+            leaf_node* leaf = static_cast<leaf_node*>(n);
 
-        /// Inequality of iterators
-        inline bool operator != (const const_reverse_iterator& x) const
-        {
-            return (x.currnode != currnode) || (x.currslot != currslot);
-        }
-    };
+            bool equal = false;
+            int slot = allow_duplicates ? find_lower(leaf, key)
+                       : find_lower(leaf, key, equal);
 
-public:
-    // *** Small Statistics Structure
+            if (equal) {
+                return std::pair<iterator, bool>(iterator(leaf, slot), false);
+            }
 
-    /** A small struct containing basic statistics about the B+ tree. It can be
-     * fetched using get_stats(). */
-    struct tree_stats
-    {
-        /// Number of items in the B+ tree
-        size_type                   itemcount;
+            if (allow_duplicates && leaf == m_tailleaf && leaf->slotuse != 0 &&
+                !key_less(key, leaf->slotkey[leaf->slotuse - 1]))
+            {
+                // append duplicates of the largest key after it, such that
+                // sequential inserts hit the sequential split below.
+                slot = leaf->slotuse;
+            }
 
-        /// Number of leaves in the B+ tree
-        size_type                   leaves;
+            if (leaf->isfull())
+            {
+                split_leaf_node(leaf, splitkey, splitnode, slot);
 
-        /// Number of inner nodes in the B+ tree
-        size_type                   innernodes;
+                // check if insert slot is in the split sibling node
+                if (slot >= leaf->slotuse)
+                {
+                    slot -= leaf->slotuse;
+                    leaf = static_cast<leaf_node*>(*splitnode);
+                }
+            }
 
-        /// Base B+ tree parameter: The number of key/data slots in each leaf
-        static const unsigned short leafslots = self_type::leafslotmax;
+            // move items and put data item into correct data slot
+            BTREE_ASSERT(slot >= 0 && slot <= leaf->slotuse);
 
-        /// Base B+ tree parameter: The number of key slots in each inner node.
-        static const unsigned short innerslots = self_type::innerslotmax;
+            std::copy_backward(leaf->slotkey + slot, leaf->slotkey + leaf->slotuse,
+                               leaf->slotkey + leaf->slotuse + 1);
+            head_copy_backward(leaf->slothead + slot, leaf->slothead + leaf->slotuse,
+                               leaf->slothead + leaf->slotuse + 1);
+            data_copy_backward(leaf->slotdata + slot, leaf->slotdata + leaf->slotuse,
+                               leaf->slotdata + leaf->slotuse + 1);
 
-        /// Zero initialized
-        inline tree_stats()
-            : itemcount(0),
-              leaves(0), innernodes(0)
-        { }
+            leaf->slotkey[slot] = key;
+            leaf->update_head(slot);
+            if (!used_as_set) leaf->slotdata[slot] = value;
+            leaf->slotuse++;
 
-        /// Return the total number of nodes
-        inline size_type            nodes() const
-        {
-            return innernodes + leaves;
-        }
+            if (splitnode && leaf != *splitnode && slot == leaf->slotuse - 1)
+            {
+                // special case: the node was split, and the insert is at the
+                // last slot of the old node. then the splitkey must be
+                // updated.
+                *splitkey = key;
+            }
 
-        /// Return the average fill of leaves
-        inline double               avgfill_leaves() const
-        {
-            return static_cast<double>(itemcount) / (leaves * leafslots);
+            if (truncate_separators && splitnode && *splitnode)
+            {
+                const leaf_node* newleaf = static_cast<const leaf_node*>(*splitnode);
+                set_separator(*splitkey, newleaf->prevleaf, newleaf);
+            }
+
+            return std::pair<iterator, bool>(iterator(leaf, slot), true);
         }
-    };
+    }
 
-private:
-    // *** Tree Object Data Members
+    /// Stores the separator of two adjacent leaves into key: the largest key
+    /// of the left leaf, or a shorter one if truncate_separators is set.
+    void set_separator(key_type& key, const leaf_node* left, const leaf_node* right) const
+    {
+        if (truncate_separators)
+            key = btree_separator<key_type, key_compare>::shortest(
+                m_key_less, left->slotkey[left->slotuse - 1], right->slotkey[0]);
+        else
+            key = left->slotkey[left->slotuse - 1];
+    }
 
-    /// Pointer to the B+ tree's root node, either leaf or inner node
-    node* m_root;
+    /// Split up a leaf node into two equally-filled sibling leaves. Returns
+    /// the new nodes and it's insertion key in the two parameters. Requires
+    /// the slot the item will be inserted: appending to the tail leaf does a
+    /// sequential split, which keeps all items in the old leaf. Hence leaves
+    /// filled by increasing keys are fully packed.
+    void split_leaf_node(leaf_node* leaf, key_type* _newkey, node** _newleaf,
+                         unsigned int addslot)
+    {
+        BTREE_ASSERT(leaf->isfull());
 
-    /// Pointer to first leaf in the double linked leaf chain
-    leaf_node* m_headleaf;
+        unsigned int mid = (leaf->slotuse >> 1);
 
-    /// Pointer to last leaf in the double linked leaf chain
-    leaf_node* m_tailleaf;
+        if (leaf == m_tailleaf && addslot == leaf->slotuse)
+            mid = leaf->slotuse;
 
-    /// Other small statistics about the B+ tree
-    tree_stats m_stats;
+        BTREE_PRINT("btree::split_leaf_node on " << leaf);
 
-    /// Key comparison object. More comparison functions are generated from
-    /// this < relation.
-    key_compare m_key_less;
+        leaf_node* newleaf = allocate_leaf();
 
-    /// Memory allocator.
-    allocator_type m_allocator;
+        newleaf->slotuse = leaf->slotuse - mid;
 
-public:
-    // *** Constructors and Destructor
+        newleaf->nextleaf = leaf->nextleaf;
+        if (newleaf->nextleaf == NULL) {
+            BTREE_ASSERT(leaf == m_tailleaf);
+            m_tailleaf = newleaf;
+        }
+        else {
+            newleaf->nextleaf->prevleaf = newleaf;
+        }
 
-    /// Default constructor initializing an empty B+ tree with the standard key
-    /// comparison function
-    explicit inline btree(const allocator_type& alloc = allocator_type())
-        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL), m_allocator(alloc)
-    { }
+        std::copy(leaf->slotkey + mid, leaf->slotkey + leaf->slotuse,
+                  newleaf->slotkey);
+        head_copy(leaf->slothead + mid, leaf->slothead + leaf->slotuse,
+                  newleaf->slothead);
+        data_copy(leaf->slotdata + mid, leaf->slotdata + leaf->slotuse,
+                  newleaf->slotdata);
 
-    /// Constructor initializing an empty B+ tree with a special key
-    /// comparison object
-    explicit inline btree(const key_compare& kcf,
-                          const allocator_type& alloc = allocator_type())
-        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL),
-          m_key_less(kcf), m_allocator(alloc)
-    { }
+        leaf->slotuse = mid;
+        leaf->nextleaf = newleaf;
+        newleaf->prevleaf = leaf;
 
-    /// Constructor initializing a B+ tree with the range [first,last). The
-    /// range need not be sorted. To create a B+ tree from a sorted range, use
-    /// bulk_load().
-    template <class InputIterator>
-    inline btree(InputIterator first, InputIterator last,
-                 const allocator_type& alloc = allocator_type())
-        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL), m_allocator(alloc)
-    {
-        insert(first, last);
+        *_newkey = leaf->slotkey[leaf->slotuse - 1];
+        *_newleaf = newleaf;
     }
 
-    /// Constructor initializing a B+ tree with the range [first,last) and a
-    /// special key comparison object.  The range need not be sorted. To create
-    /// a B+ tree from a sorted range, use bulk_load().
-    template <class InputIterator>
-    inline btree(InputIterator first, InputIterator last, const key_compare& kcf,
-                 const allocator_type& alloc = allocator_type())
-        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL),
-          m_key_less(kcf), m_allocator(alloc)
+    /// Split up an inner node into two equally-filled sibling nodes. Returns
+    /// the new nodes and it's insertion key in the two parameters. Requires
+    /// the slot of the item will be inserted, so the nodes will be the same
+    /// size after the insert.
+    void split_inner_node(inner_node* inner, key_type* _newkey, node** _newinner, unsigned int addslot)
     {
-        insert(first, last);
-    }
+        BTREE_ASSERT(inner->isfull());
 
-    /// Frees up all used B+ tree memory pages
-    inline ~btree()
-    {
-        clear();
-    }
+        unsigned int mid = (inner->slotuse >> 1);
 
-    /// Fast swapping of two identical B+ tree objects.
-    void swap(self_type& from)
-    {
-        std::swap(m_root, from.m_root);
-        std::swap(m_headleaf, from.m_headleaf);
-        std::swap(m_tailleaf, from.m_tailleaf);
-        std::swap(m_stats, from.m_stats);
-        std::swap(m_key_less, from.m_key_less);
-        std::swap(m_allocator, from.m_allocator);
-    }
+        BTREE_PRINT("btree::split_inner: mid " << mid << " addslot " << addslot);
 
-public:
-    // *** Key and Value Comparison Function Objects
+        // if the split is uneven and the overflowing item will be put into the
+        // larger node, then the smaller split node may underflow
+        if (addslot <= mid && mid > inner->slotuse - (mid + 1))
+            mid--;
 
-    /// Function class to compare value_type objects. Required by the STL
-    class value_compare
-    {
-    protected:
-        /// Key comparison function from the template parameter
-        key_compare key_comp;
+        BTREE_PRINT("btree::split_inner: mid " << mid << " addslot " << addslot);
 
-        /// Constructor called from btree::value_comp()
-        inline explicit value_compare(key_compare kc)
-            : key_comp(kc)
-        { }
+        BTREE_PRINT("btree::split_inner_node on " << inner << " into two nodes " << mid << " and " << inner->slotuse - (mid + 1) << " sized");
 
-        /// Friendly to the btree class so it may call the constructor
-        friend class btree<key_type, data_type, value_type, key_compare,
-                           traits, allow_duplicates, allocator_type, used_as_set>;
+        inner_node* newinner = allocate_inner(inner->level);
 
-    public:
-        /// Function call "less"-operator resulting in true if x < y.
-        inline bool operator () (const value_type& x, const value_type& y) const
-        {
-            return key_comp(x.first, y.first);
-        }
-    };
+        newinner->slotuse = inner->slotuse - (mid + 1);
 
-    /// Constant access to the key comparison object sorting the B+ tree
-    inline key_compare key_comp() const
-    {
-        return m_key_less;
-    }
+        std::copy(inner->slotkey + mid + 1, inner->slotkey + inner->slotuse,
+                  newinner->slotkey);
+        head_copy(inner->slothead + mid + 1, inner->slothead + inner->slotuse,
+                  newinner->slothead);
+        std::copy(inner->childid + mid + 1, inner->childid + inner->slotuse + 1,
+                  newinner->childid);
+        count_copy(inner->childcount + mid + 1, inner->childcount + inner->slotuse + 1,
+                   newinner->childcount);
+        summary_copy(inner->childsummary + mid + 1, inner->childsummary + inner->slotuse + 1,
+                     newinner->childsummary);
 
-    /// Constant access to a constructed value_type comparison object. Required
-    /// by the STL
-    inline value_compare value_comp() const
-    {
-        return value_compare(m_key_less);
+        inner->slotuse = mid;
+
+        *_newkey = inner->slotkey[mid];
+        *_newinner = newinner;
     }
 
 private:
-    // *** Convenient Key Comparison Functions Generated From key_less
+    // *** Parallel Execution over Node Ranges
 
-    /// True if a < b ? "constructed" from m_key_less()
-    inline bool key_less(const key_type& a, const key_type& b) const
-    {
-        return m_key_less(a, b);
-    }
+    /// Minimum number of nodes handed to each thread, below which starting
+    /// another thread costs more than it saves.
+    static const size_type parallel_grain = 256;
 
-    /// True if a <= b ? constructed from key_less()
-    inline bool key_lessequal(const key_type& a, const key_type& b) const
+    /// Number of threads to use for num_nodes nodes, given the requested
+    /// number of threads, of which 0 means all hardware threads. Without
+    /// C++11 threads everything runs on the calling thread.
+    static unsigned int parallel_threads(size_type num_nodes, unsigned int threads)
     {
-        return !m_key_less(b, a);
+#if __cplusplus >= 201103L
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+#else
+        threads = 1;
+#endif
+        size_type most = std::max<size_type>(1, num_nodes / parallel_grain);
+        return static_cast<unsigned int>(std::min<size_type>(threads, most));
     }
 
-    /// True if a > b ? constructed from key_less()
-    inline bool key_greater(const key_type& a, const key_type& b) const
+    /// Start of the i-th of parts even parts of n things. The parts differ
+    /// in size by at most one.
+    static size_type split_point(size_type n, size_type parts, size_type i)
     {
-        return m_key_less(b, a);
+        return n / parts * i + n % parts * i / parts;
     }
 
-    /// True if a >= b ? constructed from key_less()
-    inline bool key_greaterequal(const key_type& a, const key_type& b) const
+    /// Calls work(begin, end) on num_threads contiguous parts of
+    /// [0,num_nodes): the first part on the calling thread and the others on
+    /// worker threads. The work must only touch the nodes of its part. The
+    /// first exception thrown by a part is rethrown after all parts ended.
+    template <typename Work>
+    static void run_parallel(size_type num_nodes, unsigned int num_threads,
+                             const Work& work)
     {
-        return !m_key_less(a, b);
-    }
+#if __cplusplus >= 201103L
+        if (num_threads > 1)
+        {
+            std::vector<std::exception_ptr> errors(num_threads);
+            std::vector<std::thread> workers;
+            workers.reserve(num_threads - 1);
 
-    /// True if a == b ? constructed from key_less(). This requires the <
-    /// relation to be a total order, otherwise the B+ tree cannot be sorted.
-    inline bool key_equal(const key_type& a, const key_type& b) const
-    {
-        return !m_key_less(a, b) && !m_key_less(b, a);
-    }
+            try {
+                for (unsigned int t = 1; t < num_threads; ++t)
+                {
+                    size_type begin = split_point(num_nodes, num_threads, t);
+                    size_type end = split_point(num_nodes, num_threads, t + 1);
+                    std::exception_ptr* error = &errors[t];
+
+                    workers.push_back(std::thread([&work, begin, end, error]() {
+                        try {
+                            work(begin, end);
+                        }
+                        catch (...) {
+                            *error = std::current_exception();
+                        }
+                    }));
+                }
 
-public:
-    // *** Allocators
+                work(0, split_point(num_nodes, num_threads, 1));
+            }
+            catch (...) {
+                errors[0] = std::current_exception();
+            }
 
-    /// Return the base node allocator provided during construction.
-    allocator_type get_allocator() const
-    {
-        return m_allocator;
+            for (size_t t = 0; t < workers.size(); ++t)
+                workers[t].join();
+
+            for (unsigned int t = 0; t < num_threads; ++t)
+            {
+                if (errors[t]) std::rethrow_exception(errors[t]);
+            }
+            return;
+        }
+#else
+        BTREE_ASSERT(num_threads == 1);
+        (void)num_threads;
+#endif
+        work(0, num_nodes);
     }
 
-private:
-    // *** Node Object Allocation and Deallocation Functions
+public:
+    // *** Bulk Loader - Construct Tree from Sorted Sequence
 
-    /// Return an allocator for leaf_node objects
-    typename leaf_node::alloc_type leaf_node_allocator()
+    /// Bulk load a sorted range. Loads items into leaves and constructs a
+    /// B-tree above them. The tree must be empty when calling this function.
+    template <typename Iterator>
+    void bulk_load(Iterator ibegin, Iterator iend)
     {
-        return typename leaf_node::alloc_type(m_allocator);
+        return bulk_load(ibegin, iend, 1.0, 1.0);
     }
 
-    /// Return an allocator for inner_node objects
-    typename inner_node::alloc_type inner_node_allocator()
+    /// Bulk load a sorted range, leaving slack for later inserts. Leaves are
+    /// filled to leaf_fill of leafslotmax and inner nodes to inner_fill of
+    /// their children, but no node is filled below half. Full nodes are
+    /// ideal for read-only trees, while random inserts into them split
+    /// nearly every node once. The tree must be empty when calling this
+    /// function.
+    template <typename Iterator>
+    void bulk_load(Iterator ibegin, Iterator iend,
+                   double leaf_fill, double inner_fill)
     {
-        return typename inner_node::alloc_type(m_allocator);
-    }
+        BTREE_ASSERT(empty());
 
-    /// Allocate and initialize a leaf node
-    inline leaf_node * allocate_leaf()
-    {
-        leaf_node* n = new (leaf_node_allocator().allocate(1))
-                       leaf_node();
-        m_stats.leaves++;
-        return n;
-    }
+        m_stats.itemcount = iend - ibegin;
 
-    /// Allocate and initialize an inner node
-    inline inner_node * allocate_inner(unsigned short level)
-    {
-        inner_node* n = new (inner_node_allocator().allocate(1))
-                        inner_node(level);
-        m_stats.innernodes++;
-        return n;
-    }
+        // calculate number of leaves needed for the fill factor.
+        size_t num_items = iend - ibegin;
+        size_t num_leaves = (num_items == 0) ? 0 : fill_num_leaves(num_items, leaf_fill);
 
-    /// Correctly free either inner or leaf node, destructs all contained key
-    /// and value objects
-    inline void free_node(node* n)
-    {
-        if (n->isleafnode()) {
-            leaf_node* ln = static_cast<leaf_node*>(n);
-            typename leaf_node::alloc_type a(leaf_node_allocator());
-            a.destroy(ln);
-            a.deallocate(ln, 1);
-            m_stats.leaves--;
-        }
-        else {
-            inner_node* in = static_cast<inner_node*>(n);
-            typename inner_node::alloc_type a(inner_node_allocator());
-            a.destroy(in);
-            a.deallocate(in, 1);
-            m_stats.innernodes--;
+        BTREE_PRINT("btree::bulk_load, level 0: " << m_stats.itemcount << " items into " << num_leaves << " leaves with up to " << ((iend - ibegin + num_leaves - 1) / num_leaves) << " items per leaf.");
+
+        Iterator it = ibegin;
+        for (size_t i = 0; i < num_leaves; ++i)
+        {
+            // allocate new leaf node
+            leaf_node* leaf = allocate_leaf();
+
+            // copy keys or (key,value) pairs into leaf nodes, uses template
+            // switch leaf->set_slot().
+            leaf->slotuse = static_cast<int>(num_items / (num_leaves - i));
+            for (size_t s = 0; s < leaf->slotuse; ++s, ++it)
+                leaf->set_slot(s, *it);
+
+            if (m_tailleaf != NULL) {
+                m_tailleaf->nextleaf = leaf;
+                leaf->prevleaf = m_tailleaf;
+            }
+            else {
+                m_headleaf = leaf;
+            }
+            m_tailleaf = leaf;
+
+            num_items -= leaf->slotuse;
         }
+
+        BTREE_ASSERT(it == iend && num_items == 0);
+
+        bulk_load_inner(num_leaves, inner_fill);
+
+        if (selfverify) verify();
     }
 
-    /// Convenient template function for conditional copying of slotdata. This
-    /// should be used instead of std::copy for all slotdata manipulations.
-    template <class InputIterator, class OutputIterator>
-    static OutputIterator data_copy(InputIterator first, InputIterator last,
-                                    OutputIterator result)
+    /// Bulk load a sorted range like bulk_load(), filling the leaves and
+    /// the inner nodes of each level on up to threads threads, of which 0
+    /// means all hardware threads. The nodes are allocated in key order on
+    /// the calling thread, because node allocators need not be thread-safe.
+    /// Requires C++11 threads, and otherwise loads sequentially.
+    template <typename Iterator>
+    void parallel_bulk_load(Iterator ibegin, Iterator iend,
+                            unsigned int threads = 0)
     {
-        if (used_as_set) return result; // no operation
-        else return std::copy(first, last, result);
+        return parallel_bulk_load(ibegin, iend, 1.0, 1.0, threads);
     }
 
-    /// Convenient template function for conditional copying of slotdata. This
-    /// should be used instead of std::copy for all slotdata manipulations.
-    template <class InputIterator, class OutputIterator>
-    static OutputIterator data_copy_backward(InputIterator first, InputIterator last,
-                                             OutputIterator result)
+    /// Bulk load a sorted range in parallel, leaving slack for later inserts
+    /// like bulk_load(ibegin, iend, leaf_fill, inner_fill).
+    template <typename Iterator>
+    void parallel_bulk_load(Iterator ibegin, Iterator iend,
+                            double leaf_fill, double inner_fill,
+                            unsigned int threads = 0)
     {
-        if (used_as_set) return result; // no operation
-        else return std::copy_backward(first, last, result);
-    }
+        BTREE_ASSERT(empty());
 
-public:
-    // *** Fast Destruction of the B+ Tree
+        size_type num_items = iend - ibegin;
+        if (num_items == 0) return;
 
-    /// Frees all key/data pairs and all nodes of the tree
-    void clear()
-    {
-        if (m_root)
+        size_type num_leaves = fill_num_leaves(num_items, leaf_fill);
+
+        BTREE_PRINT("btree::parallel_bulk_load, level 0: " << num_items << " items into " << num_leaves << " leaves.");
+
+        // allocate all nodes of a level in key order, then fill them in
+        // parallel. The nodes of each level keep the last leaf below them
+        // for the separators of the next level.
+        node** level_nodes = new node*[num_leaves];
+        leaf_node** level_last = new leaf_node*[num_leaves];
+
+        for (size_type i = 0; i < num_leaves; ++i)
+            level_nodes[i] = level_last[i] = allocate_leaf();
+
+        bulk_load_leaves<Iterator> fill_leaves = {
+            level_last, num_leaves, ibegin, num_items
+        };
+        run_parallel(num_leaves, parallel_threads(num_leaves, threads),
+                     fill_leaves);
+
+        m_headleaf = level_last[0];
+        m_tailleaf = level_last[num_leaves - 1];
+        m_stats.itemcount = num_items;
+
+        // construct inner levels until a single root remains
+        size_type num_children = num_leaves;
+        for (unsigned short level = 1; num_children != 1; ++level)
         {
-            clear_recursive(m_root);
-            free_node(m_root);
+            size_type num_parents = fill_num_parents(num_children, inner_fill);
 
-            m_root = NULL;
-            m_headleaf = m_tailleaf = NULL;
+            BTREE_PRINT("btree::parallel_bulk_load, level " << level << ": " << num_children << " children in " << num_parents << " inner nodes.");
 
-            m_stats = tree_stats();
+            node** parents = new node*[num_parents];
+            leaf_node** parents_last = new leaf_node*[num_parents];
+
+            for (size_type i = 0; i < num_parents; ++i)
+                parents[i] = allocate_inner(level);
+
+            bulk_load_parents fill_parents = {
+                this, parents, parents_last, num_parents,
+                level_nodes, level_last, num_children
+            };
+            run_parallel(num_parents, parallel_threads(num_parents, threads),
+                         fill_parents);
+
+            delete[] level_nodes;
+            delete[] level_last;
+            level_nodes = parents;
+            level_last = parents_last;
+            num_children = num_parents;
         }
 
-        BTREE_ASSERT(m_stats.itemcount == 0);
+        m_root = level_nodes[0];
+        delete[] level_nodes;
+        delete[] level_last;
+
+        if (selfverify) verify();
     }
 
 private:
-    /// Recursively free up nodes
-    void clear_recursive(node* n)
+    /// Fills the leaves [begin,end) of a parallel bulk load with their even
+    /// share of the items and links them to their neighbours.
+    template <typename Iterator>
+    struct bulk_load_leaves
     {
-        if (n->isleafnode())
-        {
-            leaf_node* leafnode = static_cast<leaf_node*>(n);
+        leaf_node** leaves;
+        size_type   num_leaves;
+        Iterator    ibegin;
+        size_type   num_items;
 
-            for (unsigned int slot = 0; slot < leafnode->slotuse; ++slot)
+        void operator () (size_type begin, size_type end) const
+        {
+            for (size_type i = begin; i < end; ++i)
             {
-                // data objects are deleted by leaf_node's destructor
+                leaf_node* leaf = leaves[i];
+
+                size_type first = split_point(num_items, num_leaves, i);
+                leaf->slotuse = static_cast<unsigned short>(
+                    split_point(num_items, num_leaves, i + 1) - first);
+
+                Iterator it = ibegin + first;
+                for (unsigned short s = 0; s < leaf->slotuse; ++s, ++it)
+                    leaf->set_slot(s, *it);
+
+                leaf->prevleaf = (i > 0) ? leaves[i - 1] : NULL;
+                leaf->nextleaf = (i + 1 < num_leaves) ? leaves[i + 1] : NULL;
             }
         }
-        else
-        {
-            inner_node* innernode = static_cast<inner_node*>(n);
+    };
 
-            for (unsigned short slot = 0; slot < innernode->slotuse + 1; ++slot)
+    /// Fills the inner nodes [begin,end) of a level of a parallel bulk load
+    /// with their even share of the children of the level below.
+    struct bulk_load_parents
+    {
+        const btree* tree;
+        node**       parents;
+        leaf_node**  parents_last;
+        size_type    num_parents;
+        node**       children;
+        leaf_node**  children_last;
+        size_type    num_children;
+
+        void operator () (size_type begin, size_type end) const
+        {
+            for (size_type i = begin; i < end; ++i)
             {
-                clear_recursive(innernode->childid[slot]);
-                free_node(innernode->childid[slot]);
+                inner_node* n = static_cast<inner_node*>(parents[i]);
+
+                size_type first = split_point(num_children, num_parents, i);
+                size_type last = split_point(num_children, num_parents, i + 1) - 1;
+                n->slotuse = static_cast<unsigned short>(last - first);
+
+                for (unsigned short s = 0; s < n->slotuse; ++s)
+                {
+                    const leaf_node* leaf = children_last[first + s];
+                    tree->set_separator(n->slotkey[s], leaf, leaf->nextleaf);
+                    n->update_head(s);
+                    n->childid[s] = children[first + s];
+                    n->update_child(s);
+                }
+                n->childid[n->slotuse] = children[last];
+                n->update_child(n->slotuse);
+
+                parents_last[i] = children_last[last];
             }
         }
-    }
-
-public:
-    // *** STL Iterator Construction Functions
+    };
 
-    /// Constructs a read/data-write iterator that points to the first slot in
-    /// the first leaf of the B+ tree.
-    inline iterator begin()
+private:
+    /// Number of leaves holding num_items filled to about leaf_fill, such
+    /// that evenly distributed items neither overflow nor underflow a leaf.
+    static size_type fill_num_leaves(size_type num_items, double leaf_fill)
     {
-        return iterator(m_headleaf, 0);
-    }
+        size_type target = static_cast<size_type>(leaf_fill * leafslotmax + 0.5);
+        target = std::max<size_type>(minleafslots, std::min<size_type>(leafslotmax, target));
 
-    /// Constructs a read/data-write iterator that points to the first invalid
-    /// slot in the last leaf of the B+ tree.
-    inline iterator end()
-    {
-        return iterator(m_tailleaf, m_tailleaf ? m_tailleaf->slotuse : 0);
+        size_type num_leaves = (num_items + target - 1) / target;
+        return std::max<size_type>(1, std::min<size_type>(num_leaves, num_items / minleafslots));
     }
 
-    /// Constructs a read-only constant iterator that points to the first slot
-    /// in the first leaf of the B+ tree.
-    inline const_iterator begin() const
+    /// Number of inner nodes holding num_children filled to about
+    /// inner_fill, such that evenly distributed children neither overflow
+    /// nor underflow an inner node.
+    static size_type fill_num_parents(size_type num_children, double inner_fill)
     {
-        return const_iterator(m_headleaf, 0);
-    }
+        size_type target = static_cast<size_type>(inner_fill * (innerslotmax + 1) + 0.5);
+        target = std::max<size_type>(mininnerslots + 1, std::min<size_type>(innerslotmax + 1, target));
 
-    /// Constructs a read-only constant iterator that points to the first
-    /// invalid slot in the last leaf of the B+ tree.
-    inline const_iterator end() const
-    {
-        return const_iterator(m_tailleaf, m_tailleaf ? m_tailleaf->slotuse : 0);
+        size_type num_parents = (num_children + target - 1) / target;
+        return std::max<size_type>(1, std::min<size_type>(num_parents, num_children / (mininnerslots + 1)));
     }
 
-    /// Constructs a read/data-write reverse iterator that points to the first
-    /// invalid slot in the last leaf of the B+ tree. Uses STL magic.
-    inline reverse_iterator rbegin()
+    /// Constructs the inner nodes above the num_leaves leaves of the leaf
+    /// chain and sets the root. Used by bulk_load() and compact().
+    void bulk_load_inner(size_t num_leaves, double inner_fill = 1.0)
     {
-        return reverse_iterator(end());
-    }
+        // if the btree is so small to fit into one leaf, then we're done.
+        if (m_headleaf == m_tailleaf) {
+            m_root = m_headleaf;
+            return;
+        }
 
-    /// Constructs a read/data-write reverse iterator that points to the first
-    /// slot in the first leaf of the B+ tree. Uses STL magic.
-    inline reverse_iterator rend()
-    {
-        return reverse_iterator(begin());
-    }
+        BTREE_ASSERT(m_stats.leaves == num_leaves);
 
-    /// Constructs a read-only reverse iterator that points to the first
-    /// invalid slot in the last leaf of the B+ tree. Uses STL magic.
-    inline const_reverse_iterator rbegin() const
-    {
-        return const_reverse_iterator(end());
-    }
+        // create first level of inner nodes, pointing to the leaves.
+        size_t num_parents = fill_num_parents(num_leaves, inner_fill);
 
-    /// Constructs a read-only reverse iterator that points to the first slot
-    /// in the first leaf of the B+ tree. Uses STL magic.
-    inline const_reverse_iterator rend() const
-    {
-        return const_reverse_iterator(begin());
-    }
+        BTREE_PRINT("btree::bulk_load, level 1: " << num_leaves << " leaves in " << num_parents << " inner nodes with up to " << ((num_leaves + num_parents - 1) / num_parents) << " leaves per inner node.");
 
-private:
-    // *** B+ Tree Node Binary Search Functions
+        // save inner nodes and their last leaf for next level.
+        typedef std::pair<inner_node*, const leaf_node*> nextlevel_type;
+        nextlevel_type* nextlevel = new nextlevel_type[num_parents];
 
-    /// Searches for the first key in the node n greater or equal to key. Uses
-    /// binary search with an optional linear self-verification. This is a
-    /// template function, because the slotkey array is located at different
-    /// places in leaf_node and inner_node.
-    template <typename node_type>
-    inline int find_lower(const node_type* n, const key_type& key) const
-    {
-        if (0 && sizeof(n->slotkey) > traits::binsearch_threshold)
+        leaf_node* leaf = m_headleaf;
+        for (size_t i = 0; i < num_parents; ++i)
         {
-            if (n->slotuse == 0) return 0;
+            // allocate new inner node at level 1
+            inner_node* n = allocate_inner(1);
 
-            int lo = 0, hi = n->slotuse;
+            n->slotuse = static_cast<int>(num_leaves / (num_parents - i));
+            BTREE_ASSERT(n->slotuse > 0);
+            --n->slotuse; // this counts keys, but an inner node has keys+1 children.
 
-            while (lo < hi)
+            // separate each leaf from its successor and set child
+            for (unsigned short s = 0; s < n->slotuse; ++s)
             {
-                int mid = (lo + hi) >> 1;
-
-                if (key_lessequal(key, n->slotkey[mid])) {
-                    hi = mid;     // key <= mid
-                }
-                else {
-                    lo = mid + 1; // key > mid
-                }
+                set_separator(n->slotkey[s], leaf, leaf->nextleaf);
+                n->update_head(s);
+                n->childid[s] = leaf;
+                n->update_child(s);
+                leaf = leaf->nextleaf;
             }
+            n->childid[n->slotuse] = leaf;
+            n->update_child(n->slotuse);
 
-            BTREE_PRINT("btree::find_lower: on " << n << " key " << key << " -> " << lo << " / " << hi);
-
-            // verify result using simple linear search
-            if (selfverify)
-            {
-                int i = 0;
-                while (i < n->slotuse && key_less(n->slotkey[i], key)) ++i;
-
-                BTREE_PRINT("btree::find_lower: testfind: " << i);
-                BTREE_ASSERT(i == lo);
-            }
+            // track last leaf of any descendant.
+            nextlevel[i].first = n;
+            nextlevel[i].second = leaf;
 
-            return lo;
-        }
-        else // for nodes <= binsearch_threshold do linear search.
-        {
-            int lo = 0;
-            while (lo < n->slotuse && key_less(n->slotkey[lo], key)) ++lo;
-            return lo;
+            leaf = leaf->nextleaf;
+            num_leaves -= n->slotuse + 1;
         }
-    }
 
-    /// Searches for the first key in the node n greater than key. Uses binary
-    /// search with an optional linear self-verification. This is a template
-    /// function, because the slotkey array is located at different places in
-    /// leaf_node and inner_node.
-    template <typename node_type>
-    inline int find_upper(const node_type* n, const key_type& key) const
-    {
-        if (0 && sizeof(n->slotkey) > traits::binsearch_threshold)
+        BTREE_ASSERT(leaf == NULL && num_leaves == 0);
+
+        // recursively build inner nodes pointing to inner nodes.
+        for (int level = 2; num_parents != 1; ++level)
         {
-            if (n->slotuse == 0) return 0;
+            size_t num_children = num_parents;
+            num_parents = fill_num_parents(num_children, inner_fill);
 
-            int lo = 0, hi = n->slotuse;
+            BTREE_PRINT("btree::bulk_load, level " << level << ": " << num_children << " children in " << num_parents << " inner nodes with up to " << ((num_children + num_parents - 1) / num_parents) << " children per inner node.");
 
-            while (lo < hi)
+            size_t inner_index = 0;
+            for (size_t i = 0; i < num_parents; ++i)
             {
-                int mid = (lo + hi) >> 1;
+                // allocate new inner node at level
+                inner_node* n = allocate_inner(level);
 
-                if (key_less(key, n->slotkey[mid])) {
-                    hi = mid;     // key < mid
-                }
-                else {
-                    lo = mid + 1; // key >= mid
-                }
-            }
+                n->slotuse = static_cast<int>(num_children / (num_parents - i));
+                BTREE_ASSERT(n->slotuse > 0);
+                --n->slotuse; // this counts keys, but an inner node has keys+1 children.
 
-            BTREE_PRINT("btree::find_upper: on " << n << " key " << key << " -> " << lo << " / " << hi);
+                // copy children and separate their last leaves
+                for (unsigned short s = 0; s < n->slotuse; ++s)
+                {
+                    const leaf_node* last = nextlevel[inner_index].second;
+                    set_separator(n->slotkey[s], last, last->nextleaf);
+                    n->update_head(s);
+                    n->childid[s] = nextlevel[inner_index].first;
+                    n->update_child(s);
+                    ++inner_index;
+                }
+                n->childid[n->slotuse] = nextlevel[inner_index].first;
+                n->update_child(n->slotuse);
 
-            // verify result using simple linear search
-            if (selfverify)
-            {
-                int i = 0;
-                while (i < n->slotuse && key_lessequal(n->slotkey[i], key)) ++i;
+                // reuse nextlevel array for parents, because we can overwrite
+                // slots we've already consumed.
+                nextlevel[i].first = n;
+                nextlevel[i].second = nextlevel[inner_index].second;
 
-                BTREE_PRINT("btree::find_upper testfind: " << i);
-                BTREE_ASSERT(i == hi);
+                ++inner_index;
+                num_children -= n->slotuse + 1;
             }
 
-            return lo;
-        }
-        else // for nodes <= binsearch_threshold do linear search.
-        {
-            int lo = 0;
-            while (lo < n->slotuse && key_lessequal(n->slotkey[lo], key)) ++lo;
-            return lo;
+            BTREE_ASSERT(num_children == 0);
         }
-    }
-
-public:
-    // *** Access Functions to the Item Count
 
-    /// Return the number of key/data pairs in the B+ tree
-    inline size_type size() const
-    {
-        return m_stats.itemcount;
+        m_root = nextlevel[0].first;
+        delete[] nextlevel;
     }
 
-    /// Returns true if there is at least one key/data pair in the B+ tree
-    inline bool empty() const
+public:
+    // *** Construction from Unsorted Input
+
+    /// Fill the empty tree with the unsorted range [first,last) on up to
+    /// threads threads, of which 0 means all hardware threads. The items are
+    /// copied, sorted by a parallel stable merge sort and loaded with
+    /// parallel_bulk_load(). Without duplicates only the first item of each
+    /// key is kept, like insert() would. Needs memory for two copies of the
+    /// items besides the tree.
+    template <typename InputIterator>
+    void build_from_unsorted(InputIterator first, InputIterator last,
+                             unsigned int threads = 0)
     {
-        return (size() == size_type(0));
-    }
+        BTREE_ASSERT(empty());
 
-    /// Returns the largest possible size of the B+ Tree. This is just a
-    /// function required by the STL standard, the B+ Tree can hold more items.
-    inline size_type max_size() const
-    {
-        return size_type(-1);
-    }
+        std::vector<value_type> items(first, last);
+        if (items.empty()) return;
 
-    /// Return a const reference to the current statistics.
-    inline const struct tree_stats & get_stats() const
-    {
-        return m_stats;
-    }
+        size_type num_items = items.size();
+        std::vector<value_type> buffer(num_items);
 
-public:
-    // *** Standard Access Functions Querying the Tree by Descending to a Leaf
+        // each part is sorted by one thread, then pairs of adjacent runs are
+        // merged, each thread producing the part's range of the output.
+        unsigned int num_parts = parallel_threads(num_items / leafslotmax, threads);
+        value_type* src = &items[0];
+        value_type* dst = &buffer[0];
 
-    /// Non-STL function checking whether a key is in the B+ tree. The same as
-    /// (find(k) != end()) or (count() != 0).
-    bool exists(const key_type& key) const
-    {
-        const node* n = m_root;
-        if (!n) return false;
+        unsorted_sort sort_parts = { this, src, num_items, num_parts };
+        run_parallel(num_parts, num_parts, sort_parts);
 
-        while (!n->isleafnode())
+        for (unsigned int width = 1; width < num_parts; width *= 2)
         {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            int slot = find_lower(inner, key);
-
-            n = inner->childid[slot];
+            unsorted_merge merge_runs = { this, src, dst, num_items, num_parts, width };
+            run_parallel(num_parts, num_parts, merge_runs);
+            std::swap(src, dst);
         }
 
-        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+        if (!allow_duplicates)
+        {
+            std::vector<size_type> offsets(num_parts + 1);
 
-        int slot = find_lower(leaf, key);
-        return (slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot]));
-    }
+            unsorted_unique count_unique = { this, src, NULL, num_items, num_parts, &offsets[0] };
+            run_parallel(num_parts, num_parts, count_unique);
 
-    /// Tries to locate a key in the B+ tree and returns an iterator to the
-    /// key/data slot if found. If unsuccessful it returns end().
-    iterator find(const key_type& key)
-    {
-        node* n = m_root;
-        if (!n) return end();
+            // turn the counts of the parts into their output offsets
+            size_type sum = 0;
+            for (unsigned int t = 0; t <= num_parts; ++t)
+            {
+                size_type count = offsets[t];
+                offsets[t] = sum;
+                sum += count;
+            }
 
-        while (!n->isleafnode())
-        {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            int slot = find_lower(inner, key);
+            unsorted_unique copy_unique = { this, src, dst, num_items, num_parts, &offsets[0] };
+            run_parallel(num_parts, num_parts, copy_unique);
 
-            n = inner->childid[slot];
+            std::swap(src, dst);
+            num_items = offsets[num_parts];
         }
 
-        leaf_node* leaf = static_cast<leaf_node*>(n);
+        // release the other copy before loading
+        if (src == &items[0])
+            std::vector<value_type>().swap(buffer);
+        else
+            std::vector<value_type>().swap(items);
 
-        int slot = find_lower(leaf, key);
-        return (slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot]))
-               ? iterator(leaf, slot) : end();
+        parallel_bulk_load(src, src + num_items, threads);
     }
 
-    /// Tries to locate a key in the B+ tree and returns an constant iterator
-    /// to the key/data slot if found. If unsuccessful it returns end().
-    const_iterator find(const key_type& key) const
+private:
+    /// Stable sort of the parts [begin,end) of an unsorted input.
+    struct unsorted_sort
     {
-        const node* n = m_root;
-        if (!n) return end();
+        const btree* tree;
+        value_type*  items;
+        size_type    num_items;
+        size_type    num_parts;
 
-        while (!n->isleafnode())
+        void operator () (size_type begin, size_type end) const
         {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            int slot = find_lower(inner, key);
-
-            n = inner->childid[slot];
+            for (size_type t = begin; t < end; ++t)
+            {
+                std::stable_sort(items + split_point(num_items, num_parts, t),
+                                 items + split_point(num_items, num_parts, t + 1),
+                                 value_less(tree));
+            }
         }
+    };
 
-        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+    /// Merge step for the parts [begin,end) of the output: each pair of
+    /// adjacent runs of width parts is merged stably, and each part of the
+    /// output is cut from its pair's merge by co-ranking.
+    struct unsorted_merge
+    {
+        const btree*      tree;
+        const value_type* src;
+        value_type*       dst;
+        size_type         num_items;
+        size_type         num_parts;
+        size_type         width;
+
+        void operator () (size_type begin, size_type end) const
+        {
+            for (size_type t = begin; t < end; ++t)
+            {
+                size_type pair = t / (2 * width) * (2 * width);
+                size_type lo = split_point(num_items, num_parts, pair);
+                size_type mid = split_point(num_items, num_parts, std::min(pair + width, num_parts));
+                size_type hi = split_point(num_items, num_parts, std::min(pair + 2 * width, num_parts));
 
-        int slot = find_lower(leaf, key);
-        return (slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot]))
-               ? const_iterator(leaf, slot) : end();
-    }
+                size_type k1 = split_point(num_items, num_parts, t) - lo;
+                size_type k2 = split_point(num_items, num_parts, t + 1) - lo;
 
-    /// Tries to locate a key in the B+ tree and returns the number of
-    /// identical key entries found.
-    size_type count(const key_type& key) const
-    {
-        const node* n = m_root;
-        if (!n) return 0;
+                size_type i1 = merge_corank(k1, src + lo, mid - lo, src + mid, hi - mid);
+                size_type i2 = merge_corank(k2, src + lo, mid - lo, src + mid, hi - mid);
 
-        while (!n->isleafnode())
+                std::merge(src + lo + i1, src + lo + i2,
+                           src + mid + (k1 - i1), src + mid + (k2 - i2),
+                           dst + lo + k1, value_less(tree));
+            }
+        }
+
+        /// Number of items of the run a among the first k items of the
+        /// stable merge of the runs a and b.
+        size_type merge_corank(size_type k, const value_type* a, size_type na,
+                               const value_type* b, size_type nb) const
         {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            int slot = find_lower(inner, key);
+            size_type lo = (k > nb) ? k - nb : 0, hi = std::min(k, na);
 
-            n = inner->childid[slot];
-        }
+            while (lo < hi)
+            {
+                size_type i = (lo + hi) / 2;
 
-        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+                // a[i] precedes b[k-i-1] in the merge, unless it is greater
+                if (!tree->key_less(merge_key(b[k - i - 1]), merge_key(a[i])))
+                    lo = i + 1;
+                else
+                    hi = i;
+            }
 
-        int slot = find_lower(leaf, key);
-        size_type num = 0;
+            return lo;
+        }
+    };
 
-        while (leaf && slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot]))
+    /// Removal of duplicate keys for the parts [begin,end) of a sorted
+    /// input. Without dst, counts the first items of each key in each part
+    /// into counts[part]. With dst, copies them to dst + counts[part].
+    struct unsorted_unique
+    {
+        const btree*      tree;
+        const value_type* src;
+        value_type*       dst;
+        size_type         num_items;
+        size_type         num_parts;
+        size_type*        counts;
+
+        void operator () (size_type begin, size_type end) const
         {
-            ++num;
-            if (++slot >= leaf->slotuse)
+            for (size_type t = begin; t < end; ++t)
             {
-                leaf = leaf->nextleaf;
-                slot = 0;
+                size_type first = split_point(num_items, num_parts, t);
+                size_type last = split_point(num_items, num_parts, t + 1);
+
+                value_type* out = dst ? dst + counts[t] : NULL;
+                size_type n = 0;
+
+                for (size_type i = first; i < last; ++i)
+                {
+                    if (i != 0 && !tree->key_less(merge_key(src[i - 1]), merge_key(src[i])))
+                        continue;
+
+                    if (out) *out++ = src[i];
+                    ++n;
+                }
+
+                if (!dst) counts[t] = n;
             }
         }
+    };
 
-        return num;
-    }
-
-    /// Searches the B+ tree and returns an iterator to the first pair
-    /// equal to or greater than key, or end() if all keys are smaller.
-    iterator lower_bound(const key_type& key)
+    /// Orders items of a range to be loaded by their keys.
+    class value_less
     {
-        node* n = m_root;
-        if (!n) return end();
+        const btree* tree;
 
-        while (!n->isleafnode())
-        {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            int slot = find_lower(inner, key);
+    public:
+        explicit value_less(const btree* t)
+            : tree(t)
+        { }
 
-            n = inner->childid[slot];
+        bool operator () (const value_type& a, const value_type& b) const
+        {
+            return tree->key_less(merge_key(a), merge_key(b));
         }
+    };
 
-        leaf_node* leaf = static_cast<leaf_node*>(n);
+public:
+    // *** Parallel Traversal of the Leaves
+
+    /// Call f(key, data) for every pair of the tree on up to threads threads,
+    /// of which 0 means all hardware threads. Each thread visits a contiguous
+    /// range of leaves in key order with its own copy of f, and the ranges
+    /// are cut at inner node boundaries. The copies of f run concurrently.
+    /// Without C++11 threads all pairs are visited on the calling thread.
+    template <typename Function>
+    void parallel_for_each(Function f, unsigned int threads = 0) const
+    {
+        std::vector<node*> frontier;
+        unsigned int num_parts = parallel_frontier(frontier, threads);
 
-        int slot = find_lower(leaf, key);
-        return iterator(leaf, slot);
+        std::vector<leaf_for_each<Function> > parts(num_parts, leaf_for_each<Function>(f));
+
+        leaf_range_work<leaf_for_each<Function> > work = {
+            frontier.empty() ? NULL : &frontier[0], frontier.size(), num_parts, &parts[0]
+        };
+        run_parallel(num_parts, num_parts, work);
     }
 
-    /// Searches the B+ tree and returns a constant iterator to the
-    /// first pair equal to or greater than key, or end() if all keys
-    /// are smaller.
-    const_iterator lower_bound(const key_type& key) const
+    /// Reduce the pairs of the tree on up to threads threads, of which 0
+    /// means all hardware threads: each thread folds result =
+    /// combine(result, map(key, data)) over a contiguous range of leaves,
+    /// starting from init, and the results of the ranges are combined in key
+    /// order. Hence combine must be associative and init its identity, but
+    /// combine need not be commutative.
+    template <typename Result, typename Map, typename Combine>
+    Result parallel_reduce(const Result& init, Map map, Combine combine,
+                           unsigned int threads = 0) const
     {
-        const node* n = m_root;
-        if (!n) return end();
-
-        while (!n->isleafnode())
-        {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            int slot = find_lower(inner, key);
+        std::vector<node*> frontier;
+        unsigned int num_parts = parallel_frontier(frontier, threads);
 
-            n = inner->childid[slot];
-        }
+        typedef leaf_reduce<Result, Map, Combine> reduce_type;
+        std::vector<reduce_type> parts(num_parts, reduce_type(init, map, combine));
 
-        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+        leaf_range_work<reduce_type> work = {
+            frontier.empty() ? NULL : &frontier[0], frontier.size(), num_parts, &parts[0]
+        };
+        run_parallel(num_parts, num_parts, work);
 
-        int slot = find_lower(leaf, key);
-        return const_iterator(leaf, slot);
+        Result result = init;
+        for (unsigned int t = 0; t < num_parts; ++t)
+            result = combine(result, parts[t].result);
+        return result;
     }
 
-    /// Searches the B+ tree and returns an iterator to the first pair
-    /// greater than key, or end() if all keys are smaller or equal.
-    iterator upper_bound(const key_type& key)
+    /// Replace the data of every pair by f(key, data) on up to threads
+    /// threads, of which 0 means all hardware threads, like
+    /// parallel_for_each(). The cached summaries of aggregates are
+    /// recalculated afterwards, also in parallel.
+    template <typename Function>
+    void parallel_transform_values(Function f, unsigned int threads = 0)
     {
-        node* n = m_root;
-        if (!n) return end();
+        BTREE_ASSERT(!used_as_set);
 
-        while (!n->isleafnode())
+        std::vector<node*> frontier;
+        unsigned int num_parts = parallel_frontier(frontier, threads);
+
+        std::vector<leaf_transform<Function> > parts(num_parts, leaf_transform<Function>(f));
+
+        leaf_range_work<leaf_transform<Function> > work = {
+            frontier.empty() ? NULL : &frontier[0], frontier.size(), num_parts, &parts[0]
+        };
+        run_parallel(num_parts, num_parts, work);
+
+        if (aggregates && m_root && !m_root->isleafnode())
         {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            int slot = find_upper(inner, key);
+            // recalculate the subtrees of the frontier in parallel, then the
+            // inner nodes above them.
+            summary_work update = { &frontier[0], frontier.size(), num_parts };
+            run_parallel(num_parts, num_parts, update);
 
-            n = inner->childid[slot];
+            update_summaries(m_root, frontier[0]->level);
         }
 
-        leaf_node* leaf = static_cast<leaf_node*>(n);
-
-        int slot = find_upper(leaf, key);
-        return iterator(leaf, slot);
+        if (selfverify) verify();
     }
 
-    /// Searches the B+ tree and returns a constant iterator to the
-    /// first pair greater than key, or end() if all keys are smaller
-    /// or equal.
-    const_iterator upper_bound(const key_type& key) const
+private:
+    /// Number of subtrees each thread of a parallel traversal gets, so that
+    /// uneven subtrees even out.
+    static const size_type parallel_subtrees = 8;
+
+    /// Collects the nodes of the highest level holding at least
+    /// parallel_subtrees nodes for each thread of a traversal on threads
+    /// threads, in key order. Returns the number of threads to use.
+    unsigned int parallel_frontier(std::vector<node*>& frontier,
+                                   unsigned int threads) const
     {
-        const node* n = m_root;
-        if (!n) return end();
+        frontier.clear();
+        if (m_root == NULL) return 1;
 
-        while (!n->isleafnode())
-        {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            int slot = find_upper(inner, key);
+        unsigned int num_threads = parallel_threads(m_stats.leaves, threads);
 
-            n = inner->childid[slot];
-        }
+        frontier.push_back(m_root);
 
-        const leaf_node* leaf = static_cast<const leaf_node*>(n);
+        while (frontier.size() < num_threads * parallel_subtrees &&
+               !frontier[0]->isleafnode())
+        {
+            std::vector<node*> next;
+            for (size_type i = 0; i < frontier.size(); ++i)
+            {
+                const inner_node* inner = static_cast<const inner_node*>(frontier[i]);
+                next.insert(next.end(), inner->childid, inner->childid + inner->slotuse + 1);
+            }
+            frontier.swap(next);
+        }
 
-        int slot = find_upper(leaf, key);
-        return const_iterator(leaf, slot);
+        return num_threads;
     }
 
-    /// Searches the B+ tree and returns both lower_bound() and upper_bound().
-    inline std::pair<iterator, iterator> equal_range(const key_type& key)
+    /// Visits the leaves below the frontier nodes of the parts [begin,end)
+    /// of a parallel traversal with the part's action, in key order.
+    template <typename Action>
+    struct leaf_range_work
     {
-        return std::pair<iterator, iterator>(lower_bound(key), upper_bound(key));
-    }
+        node* const* frontier;
+        size_type    num_frontier;
+        size_type    num_parts;
+        Action*      actions;
 
-    /// Searches the B+ tree and returns both lower_bound() and upper_bound().
-    inline std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const
-    {
-        return std::pair<const_iterator, const_iterator>(lower_bound(key), upper_bound(key));
-    }
+        void operator () (size_type begin, size_type end) const
+        {
+            for (size_type t = begin; t < end; ++t)
+            {
+                size_type first = split_point(num_frontier, num_parts, t);
+                size_type last = split_point(num_frontier, num_parts, t + 1);
+                if (first == last) continue;
 
-public:
-    // *** B+ Tree Object Comparison Functions
+                node* n = frontier[first];
+                while (!n->isleafnode())
+                    n = static_cast<inner_node*>(n)->childid[0];
+                leaf_node* leaf = static_cast<leaf_node*>(n);
 
-    /// Equality relation of B+ trees of the same type. B+ trees of the same
-    /// size and equal elements (both key and data) are considered
-    /// equal. Beware of the random ordering of duplicate keys.
-    inline bool operator == (const self_type& other) const
-    {
-        return (size() == other.size()) && std::equal(begin(), end(), other.begin());
-    }
+                n = frontier[last - 1];
+                while (!n->isleafnode())
+                    n = static_cast<inner_node*>(n)->childid[n->slotuse];
+                const leaf_node* lastleaf = static_cast<const leaf_node*>(n);
 
-    /// Inequality relation. Based on operator==.
-    inline bool operator != (const self_type& other) const
+                for ( ; ; leaf = leaf->nextleaf)
+                {
+                    actions[t](leaf);
+                    if (leaf == lastleaf) break;
+                }
+            }
+        }
+    };
+
+    /// Action of parallel_for_each(): calls f on each pair of a leaf.
+    template <typename Function>
+    struct leaf_for_each
     {
-        return !(*this == other);
-    }
+        Function f;
 
-    /// Total ordering relation of B+ trees of the same type. It uses
-    /// std::lexicographical_compare() for the actual comparison of elements.
-    inline bool operator < (const self_type& other) const
+        explicit leaf_for_each(const Function& _f)
+            : f(_f)
+        { }
+
+        void operator () (const leaf_node* leaf)
+        {
+            for (unsigned short s = 0; s < leaf->slotuse; ++s)
+                f(leaf->slotkey[s], leaf->slotdata[used_as_set ? 0 : s]);
+        }
+    };
+
+    /// Action of parallel_reduce(): folds the pairs of a leaf into result.
+    template <typename Result, typename Map, typename Combine>
+    struct leaf_reduce
     {
-        return std::lexicographical_compare(begin(), end(), other.begin(), other.end());
-    }
+        Result  result;
+        Map     map;
+        Combine combine;
 
-    /// Greater relation. Based on operator<.
-    inline bool operator > (const self_type& other) const
+        leaf_reduce(const Result& init, const Map& _map, const Combine& _combine)
+            : result(init), map(_map), combine(_combine)
+        { }
+
+        void operator () (const leaf_node* leaf)
+        {
+            for (unsigned short s = 0; s < leaf->slotuse; ++s)
+                result = combine(result, map(leaf->slotkey[s], leaf->slotdata[used_as_set ? 0 : s]));
+        }
+    };
+
+    /// Action of parallel_transform_values(): replaces the data of a leaf.
+    template <typename Function>
+    struct leaf_transform
     {
-        return other < *this;
-    }
+        Function f;
 
-    /// Less-equal relation. Based on operator<.
-    inline bool operator <= (const self_type& other) const
+        explicit leaf_transform(const Function& _f)
+            : f(_f)
+        { }
+
+        void operator () (leaf_node* leaf)
+        {
+            for (unsigned short s = 0; s < leaf->slotuse; ++s)
+                leaf->slotdata[s] = f(leaf->slotkey[s], leaf->slotdata[s]);
+        }
+    };
+
+    /// Recalculates the summaries below the frontier nodes of the parts
+    /// [begin,end) after parallel_transform_values().
+    struct summary_work
     {
-        return !(other < *this);
-    }
+        node* const* frontier;
+        size_type    num_frontier;
+        size_type    num_parts;
 
-    /// Greater-equal relation. Based on operator<.
-    inline bool operator >= (const self_type& other) const
+        void operator () (size_type begin, size_type end) const
+        {
+            size_type first = split_point(num_frontier, num_parts, begin);
+            size_type last = split_point(num_frontier, num_parts, end);
+
+            for (size_type i = first; i < last; ++i)
+                update_summaries(frontier[i], 0);
+        }
+    };
+
+    /// Recalculates the cached summaries of the inner nodes below n down to
+    /// the given level.
+    static void update_summaries(node* n, unsigned short level)
     {
-        return !(*this < other);
+        if (n->level <= level) return;
+
+        inner_node* inner = static_cast<inner_node*>(n);
+
+        for (unsigned short slot = 0; slot <= inner->slotuse; ++slot)
+        {
+            update_summaries(inner->childid[slot], level);
+            inner->update_child(slot);
+        }
     }
 
 public:
-    /// *** Fast Copy: Assign Operator and Copy Constructors
+    // *** Compaction of Long-Lived Trees
 
-    /// Assignment operator. All the key/data pairs are copied
-    inline self_type& operator = (const self_type& other)
+    /// Position of an incremental compaction pass, see compact_step().
+    class compact_state
     {
-        if (this != &other)
-        {
-            clear();
+    private:
+        /// First key of the next leaf to compact
+        key_type m_key;
 
-            m_key_less = other.key_comp();
-            m_allocator = other.get_allocator();
+        /// False before the first step
+        bool m_started;
 
-            if (other.size() != 0)
-            {
-                m_stats.leaves = m_stats.innernodes = 0;
-                if (other.m_root) {
-                    m_root = copy_recursive(other.m_root);
-                }
-                m_stats = other.m_stats;
-            }
+        /// Resume behind the keys equal to m_key instead of at the first one
+        bool m_skip;
 
-            if (selfverify) verify();
-        }
-        return *this;
-    }
+        /// True if the pass reached the end of the tree
+        bool m_done;
+
+        /// Friendly to the btree class, which moves the position.
+        friend class btree<key_type, data_type, value_type, key_compare,
+                           traits, allow_duplicates, allocator_type, used_as_set>;
+
+    public:
+        /// Initialize a pass starting at the first leaf.
+        compact_state()
+            : m_key(), m_started(false), m_skip(false), m_done(false)
+        { }
 
-    /// Copy constructor. The newly initialized B+ tree object will contain a
-    /// copy of all key/data pairs.
-    inline btree(const btree& other)
-        : m_root(NULL), m_headleaf(NULL), m_tailleaf(NULL),
-          m_stats(other.m_stats),
-          m_key_less(other.key_comp()),
-          m_allocator(other.get_allocator())
-    {
-        if (size() > 0)
+        /// True if the pass reached the end of the tree.
+        bool done() const
         {
-            m_stats.leaves = m_stats.innernodes = 0;
-            if (other.m_root) {
-                m_root = copy_recursive(other.m_root);
-            }
-            if (selfverify) verify();
+            return m_done;
         }
-    }
+    };
 
-private:
-    /// Recursively copy nodes from another B+ tree object
-    struct node * copy_recursive(const node* n)
+    /// Rewrites the tree in key order into newly allocated, densely packed
+    /// nodes like bulk_load(). Leaves are filled to target_fill of
+    /// leafslotmax, but at least to minleafslots. The new nodes come from a
+    /// fresh node allocator, hence the slabs of a tree's own node pool are
+    /// released. Returns the node bytes reclaimed, which are also added to
+    /// tree_stats::reclaimed.
+    size_type compact(double target_fill = 1.0)
     {
-        if (n->isleafnode())
+        if (m_root == NULL) return 0;
+
+        size_type oldbytes = m_stats.bytes();
+        size_type num_items = m_stats.itemcount;
+        size_type num_leaves = fill_num_leaves(num_items, target_fill);
+
+        BTREE_PRINT("btree::compact, " << num_items << " items from " << m_stats.leaves << " into " << num_leaves << " leaves.");
+
+        // new nodes are allocated from a fresh allocator, the old nodes are
+        // returned to the old one, which is dropped at the end.
+        node_allocator_type oldalloc(m_allocator);
+        std::swap(m_node_allocator, oldalloc);
+
+        if (!m_root->isleafnode())
+            free_inner_nodes(static_cast<inner_node*>(m_root), oldalloc);
+
+        leaf_node* old = m_headleaf;
+        unsigned short oldslot = 0;
+
+        m_root = m_headleaf = m_tailleaf = NULL;
+
+        for (size_type i = 0; i < num_leaves; ++i)
         {
-            const leaf_node* leaf = static_cast<const leaf_node*>(n);
-            leaf_node* newleaf = allocate_leaf();
+            leaf_node* leaf = allocate_leaf();
+            leaf->slotuse = static_cast<unsigned short>(num_items / (num_leaves - i));
 
-            newleaf->slotuse = leaf->slotuse;
-            std::copy(leaf->slotkey, leaf->slotkey + leaf->slotuse, newleaf->slotkey);
-            data_copy(leaf->slotdata, leaf->slotdata + leaf->slotuse, newleaf->slotdata);
+            compact_fill(leaf, old, oldslot, oldalloc);
 
-            if (m_headleaf == NULL)
-            {
-                m_headleaf = m_tailleaf = newleaf;
-                newleaf->prevleaf = newleaf->nextleaf = NULL;
+            if (m_tailleaf != NULL) {
+                m_tailleaf->nextleaf = leaf;
+                leaf->prevleaf = m_tailleaf;
             }
-            else
-            {
-                newleaf->prevleaf = m_tailleaf;
-                m_tailleaf->nextleaf = newleaf;
-                m_tailleaf = newleaf;
+            else {
+                m_headleaf = leaf;
             }
+            m_tailleaf = leaf;
 
-            return newleaf;
+            num_items -= leaf->slotuse;
         }
-        else
-        {
-            const inner_node* inner = static_cast<const inner_node*>(n);
-            inner_node* newinner = allocate_inner(inner->level);
 
-            newinner->slotuse = inner->slotuse;
-            std::copy(inner->slotkey, inner->slotkey + inner->slotuse, newinner->slotkey);
+        BTREE_ASSERT(old->nextleaf == NULL && oldslot == old->slotuse);
+        free_node(old, oldalloc);
 
-            for (unsigned short slot = 0; slot <= inner->slotuse; ++slot)
-            {
-                newinner->childid[slot] = copy_recursive(inner->childid[slot]);
-            }
+        bulk_load_inner(num_leaves);
 
-            return newinner;
-        }
-    }
+        size_type reclaimed = oldbytes > m_stats.bytes() ? oldbytes - m_stats.bytes() : 0;
+        m_stats.reclaimed += reclaimed;
 
-public:
-    // *** Public Insertion Functions
+        if (selfverify) verify();
 
-    /// Attempt to insert a key/data pair into the B+ tree. If the tree does not
-    /// allow duplicate keys, then the insert may fail if it is already
-    /// present.
-    inline std::pair<iterator, bool> insert(const pair_type& x)
-    {
-        return insert_start(x.first, x.second);
+        return reclaimed;
     }
 
-    /// Attempt to insert a key/data pair into the B+ tree. Beware that if
-    /// key_type == data_type, then the template iterator insert() is called
-    /// instead. If the tree does not allow duplicate keys, then the insert may
-    /// fail if it is already present.
-    inline std::pair<iterator, bool> insert(const key_type& key, const data_type& data)
+    /// Runs one step of an incremental compaction pass in bounded time. At
+    /// the position saved in state, it takes consecutive children of one
+    /// inner node at level two, with at most max_leaves leaves below them,
+    /// and rebuilds their leaves and level one nodes in key order like
+    /// bulk_load(). The leaves are filled to target_fill, as far as the inner
+    /// node may lose children. More children are taken only to keep a run of
+    /// equal keys together. The tree may be modified between steps. Leaves
+    /// holding only a run of equal keys, which continues beyond the inner
+    /// node, are skipped. Returns true if the pass reached the end.
+    bool compact_step(compact_state& state, size_type max_leaves,
+                      double target_fill = 1.0)
     {
-        return insert_start(key, data);
-    }
+        if (state.m_done) return true;
 
-    /// Attempt to insert a key/data pair into the B+ tree. This function is the
-    /// same as the other insert, however if key_type == data_type then the
-    /// non-template function cannot be called. If the tree does not allow
-    /// duplicate keys, then the insert may fail if it is already present.
-    inline std::pair<iterator, bool> insert2(const key_type& key, const data_type& data)
-    {
-        return insert_start(key, data);
-    }
+        if (m_root == NULL || m_root->isleafnode()) {
+            state.m_done = true;
+            return true;
+        }
 
-    /// Attempt to insert a key/data pair into the B+ tree. The iterator hint
-    /// is currently ignored by the B+ tree insertion routine.
-    inline iterator insert(iterator /* hint */, const pair_type& x)
-    {
-        return insert_start(x.first, x.second).first;
-    }
+        // descend to the inner node at level two, or the root at level one,
+        // whose children are rebuilt.
+        const unsigned short height = std::min<unsigned short>(2, m_root->level);
 
-    /// Attempt to insert a key/data pair into the B+ tree. The iterator hint is
-    /// currently ignored by the B+ tree insertion routine.
-    inline iterator insert2(iterator /* hint */, const key_type& key, const data_type& data)
-    {
-        return insert_start(key, data).first;
-    }
+        inner_node* parent = static_cast<inner_node*>(m_root);
+        int slot;
 
-    /// Attempt to insert the range [first,last) of value_type pairs into the
-    /// B+ tree. Each key/data pair is inserted individually; to bulk load the
-    /// tree, use a constructor with range.
-    template <typename InputIterator>
-    inline void insert(InputIterator first, InputIterator last)
-    {
-        InputIterator iter = first;
-        while (iter != last)
+        while (true)
         {
-            insert(*iter);
-            ++iter;
-        }
-    }
+            if (!state.m_started)
+                slot = 0;
+            else if (state.m_skip)
+                slot = find_upper(parent, state.m_key);
+            else
+                slot = find_lower(parent, state.m_key);
 
-private:
-    // *** Private Insertion Functions
+            if (parent->level == height) break;
+            parent = static_cast<inner_node*>(parent->childid[slot]);
+        }
 
-    /// Start the insertion descent at the current root and handle root
-    /// splits. Returns true if the item was inserted
-    std::pair<iterator, bool> insert_start(const key_type& key, const data_type& value)
-    {
-        node* newchild = NULL;
-        key_type newkey = key_type();
+        // select the children by their number of leaves, keep runs of equal
+        // keys together, and leave an underflowing tail leaf to the last step
+        int last = slot;
+        size_type num_old_leaves = compact_child_leaves(parent->childid[slot]);
 
-        if (m_root == NULL) {
-            m_root = m_headleaf = m_tailleaf = allocate_leaf();
+        while (last < parent->slotuse &&
+               num_old_leaves + compact_child_leaves(parent->childid[last + 1]) <= max_leaves)
+        {
+            num_old_leaves += compact_child_leaves(parent->childid[++last]);
         }
 
-        std::pair<iterator, bool> r = insert_descend(m_root, key, value, &newkey, &newchild);
+        while (last < parent->slotuse)
+        {
+            const leaf_node* leaf = compact_last_leaf(parent->childid[last]);
+            if (!key_equal(leaf->slotkey[leaf->slotuse - 1], leaf->nextleaf->slotkey[0]))
+                break;
+            num_old_leaves += compact_child_leaves(parent->childid[++last]);
+        }
 
-        if (newchild)
+        if (last > slot && compact_last_leaf(parent->childid[last]) == m_tailleaf &&
+            m_tailleaf->isunderflow())
         {
-            inner_node* newroot = allocate_inner(m_root->level + 1);
-            newroot->slotkey[0] = newkey;
+            num_old_leaves -= compact_child_leaves(parent->childid[last--]);
+        }
 
-            newroot->childid[0] = m_root;
-            newroot->childid[1] = newchild;
+        leaf_node* first = compact_first_leaf(parent->childid[slot]);
+        leaf_node* lastleaf = compact_last_leaf(parent->childid[last]);
 
-            newroot->slotuse = 1;
+        size_type num_items = 0;
+        for (const leaf_node* leaf = first; leaf != lastleaf->nextleaf; leaf = leaf->nextleaf)
+            num_items += leaf->slotuse;
 
-            m_root = newroot;
-        }
+        // the inner node keeps enough children and its new children enough
+        // leaves. Compaction never spreads items.
+        int num_old = last - slot + 1;
+        int minkeys = (parent == m_root) ? 1 : mininnerslots;
+        size_type min_top = std::max(1, num_old - (parent->slotuse - minkeys));
+        size_type min_leaves = (height == 1) ? min_top : min_top * (mininnerslots + 1);
 
-        // increment itemcount if the item was inserted
-        if (r.second) ++m_stats.itemcount;
+        size_type num_leaves = std::min(num_old_leaves,
+                                        std::max(min_leaves, fill_num_leaves(num_items, target_fill)));
 
-#ifdef BTREE_DEBUG
-        if (debug) print(std::cout);
-#endif
+        size_type num_top = (height == 1) ? num_leaves :
+                            std::max(min_top, (num_leaves + innerslotmax) / (innerslotmax + 1));
 
-        if (selfverify) {
-            verify();
-            BTREE_ASSERT(exists(key));
+        if (num_leaves * minleafslots > num_items) {
+            // only the underflowing tail leaf remains, which is left alone
+            state.m_done = true;
+            return true;
         }
 
-        return r;
-    }
+        BTREE_PRINT("btree::compact_step, " << num_items << " items from " << num_old_leaves << " into " << num_leaves << " leaves.");
 
-    /**
-     * @brief Insert an item into the B+ tree.
-     *
-     * Descend down the nodes to a leaf, insert the key/data pair in a free
-     * slot. If the node overflows, then it must be split and the new split
-     * node inserted into the parent. Unroll / this splitting up to the root.
-    */
-    std::pair<iterator, bool> insert_descend(node* n,
-                                             const key_type& key, const data_type& value,
-                                             key_type* splitkey, node** splitnode)
-    {
-        if (!n->isleafnode())
+        // the old level one nodes are freed, the leaves are reached through
+        // the leaf chain.
+        if (height == 2) {
+            for (int i = slot; i <= last; ++i)
+                free_node(parent->childid[i]);
+        }
+
+        leaf_node* prev = first->prevleaf;
+        leaf_node* next = lastleaf->nextleaf;
+
+        leaf_node* old = first;
+        unsigned short oldslot = 0;
+        leaf_node* newfirst = NULL;
+
+        for (size_type i = 0; i < num_leaves; ++i)
         {
-            inner_node* inner = static_cast<inner_node*>(n);
+            leaf_node* leaf = allocate_leaf();
+            leaf->slotuse = static_cast<unsigned short>(num_items / (num_leaves - i));
 
-            key_type newkey = key_type();
-            node* newchild = NULL;
+            compact_fill(leaf, old, oldslot, m_node_allocator);
 
-            int slot = find_lower(inner, key);
+            leaf->prevleaf = prev;
+            if (prev != NULL) prev->nextleaf = leaf;
+            else m_headleaf = leaf;
 
-            BTREE_PRINT("btree::insert_descend into " << inner->childid[slot]);
+            if (newfirst == NULL) newfirst = leaf;
 
-            std::pair<iterator, bool> r = insert_descend(inner->childid[slot],
-                                                         key, value, &newkey, &newchild);
+            prev = leaf;
+            num_items -= leaf->slotuse;
+        }
 
-            if (newchild)
+        BTREE_ASSERT(old == lastleaf && oldslot == old->slotuse);
+        free_node(old);
+
+        prev->nextleaf = next;
+        if (next != NULL) next->prevleaf = prev;
+        else m_tailleaf = prev;
+
+        // construct the new children of the inner node above the leaves
+        node* top[innerslotmax + 1];
+        leaf_node* toplast[innerslotmax + 1];
+
+        leaf_node* leaf = newfirst;
+        size_type leaves_left = num_leaves;
+
+        for (size_type i = 0; i < num_top; ++i)
+        {
+            if (height == 1) {
+                top[i] = toplast[i] = leaf;
+                leaf = leaf->nextleaf;
+                continue;
+            }
+
+            inner_node* n = allocate_inner(1);
+
+            n->slotuse = static_cast<unsigned short>(leaves_left / (num_top - i));
+            BTREE_ASSERT(n->slotuse > 0);
+            --n->slotuse; // this counts keys, but an inner node has keys+1 children.
+
+            for (unsigned short s = 0; s < n->slotuse; ++s)
             {
-                BTREE_PRINT("btree::insert_descend newchild with key " << newkey << " node " << newchild << " at slot " << slot);
+                set_separator(n->slotkey[s], leaf, leaf->nextleaf);
+                n->update_head(s);
+                n->childid[s] = leaf;
+                n->update_child(s);
+                leaf = leaf->nextleaf;
+            }
+            n->childid[n->slotuse] = leaf;
+            n->update_child(n->slotuse);
 
-                if (inner->isfull())
-                {
-                    split_inner_node(inner, splitkey, splitnode, slot);
+            top[i] = n;
+            toplast[i] = leaf;
 
-                    BTREE_PRINT("btree::insert_descend done split_inner: putslot: " << slot << " putkey: " << newkey << " upkey: " << *splitkey);
+            leaf = leaf->nextleaf;
+            leaves_left -= n->slotuse + 1;
+        }
 
-#ifdef BTREE_DEBUG
-                    if (debug)
-                    {
-                        print_node(std::cout, inner);
-                        print_node(std::cout, *splitnode);
-                    }
-#endif
+        BTREE_ASSERT(leaf == next);
 
-                    // check if insert slot is in the split sibling node
-                    BTREE_PRINT("btree::insert_descend switch: " << slot << " > " << inner->slotuse + 1);
+        // replace the children in the inner node, closing the gap
+        size_type removed = num_old - num_top;
 
-                    if (slot == inner->slotuse + 1 && inner->slotuse < (*splitnode)->slotuse)
-                    {
-                        // special case when the insert slot matches the split
-                        // place between the two nodes, then the insert key
-                        // becomes the split key.
+        std::copy(parent->slotkey + last, parent->slotkey + parent->slotuse,
+                  parent->slotkey + last - removed);
+        head_copy(parent->slothead + last, parent->slothead + parent->slotuse,
+                  parent->slothead + last - removed);
+        std::copy(parent->childid + last + 1, parent->childid + parent->slotuse + 1,
+                  parent->childid + last + 1 - removed);
+        count_copy(parent->childcount + last + 1, parent->childcount + parent->slotuse + 1,
+                   parent->childcount + last + 1 - removed);
+        summary_copy(parent->childsummary + last + 1, parent->childsummary + parent->slotuse + 1,
+                     parent->childsummary + last + 1 - removed);
+        parent->slotuse -= static_cast<unsigned short>(removed);
 
-                        BTREE_ASSERT(inner->slotuse + 1 < innerslotmax);
+        for (size_type i = 0; i < num_top; ++i)
+        {
+            parent->childid[slot + i] = top[i];
+            parent->update_child(slot + i);
+            if (i != 0) {
+                set_separator(parent->slotkey[slot + i - 1], toplast[i - 1], toplast[i - 1]->nextleaf);
+                parent->update_head(slot + i - 1);
+            }
+        }
 
-                        inner_node* splitinner = static_cast<inner_node*>(*splitnode);
+        m_stats.reclaimed += (num_old_leaves - num_leaves) * sizeof(leaf_node);
+        if (height == 2) m_stats.reclaimed += removed * sizeof(inner_node);
 
-                        // move the split key and it's datum into the left node
-                        inner->slotkey[inner->slotuse] = *splitkey;
-                        inner->childid[inner->slotuse + 1] = splitinner->childid[0];
-                        inner->slotuse++;
+        // save the position of the next leaf
+        state.m_started = true;
 
-                        // set new split key and move corresponding datum into right node
-                        splitinner->childid[0] = newchild;
-                        *splitkey = newkey;
+        if (next == NULL) {
+            state.m_done = true;
+        }
+        else {
+            state.m_key = next->slotkey[0];
+            state.m_skip = key_equal(prev->slotkey[prev->slotuse - 1], state.m_key);
+        }
 
-                        return r;
-                    }
-                    else if (slot >= inner->slotuse + 1)
-                    {
-                        // in case the insert slot is in the newly create split
-                        // node, we reuse the code below.
+        if (selfverify) verify();
 
-                        slot -= inner->slotuse + 1;
-                        inner = static_cast<inner_node*>(*splitnode);
-                        BTREE_PRINT("btree::insert_descend switching to splitted node " << inner << " slot " << slot);
-                    }
-                }
+        return state.m_done;
+    }
+
+private:
+    /// Number of leaves below a child rebuilt by compact_step(): either a
+    /// leaf or an inner node at level one.
+    static size_type compact_child_leaves(const node* n)
+    {
+        return n->isleafnode() ? 1 : n->slotuse + 1;
+    }
+
+    /// First leaf below a child rebuilt by compact_step()
+    static leaf_node * compact_first_leaf(node* n)
+    {
+        if (n->isleafnode()) return static_cast<leaf_node*>(n);
+        return static_cast<leaf_node*>(static_cast<inner_node*>(n)->childid[0]);
+    }
+
+    /// Last leaf below a child rebuilt by compact_step()
+    static leaf_node * compact_last_leaf(node* n)
+    {
+        if (n->isleafnode()) return static_cast<leaf_node*>(n);
+        return static_cast<leaf_node*>(static_cast<inner_node*>(n)->childid[n->slotuse]);
+    }
+
+    /// Fills leaf->slotuse slots of the new leaf with the items following
+    /// (old,oldslot) in the leaf chain. Old leaves are freed with alloc once
+    /// they are consumed, except the last one.
+    void compact_fill(leaf_node* leaf, leaf_node*& old, unsigned short& oldslot,
+                      const node_allocator_type& alloc)
+    {
+        for (unsigned short s = 0; s < leaf->slotuse; )
+        {
+            if (oldslot == old->slotuse) {
+                leaf_node* next = old->nextleaf;
+                free_node(old, alloc);
+                old = next;
+                oldslot = 0;
+            }
+
+            unsigned short n = std::min<unsigned short>(leaf->slotuse - s, old->slotuse - oldslot);
+
+            std::copy(old->slotkey + oldslot, old->slotkey + oldslot + n,
+                      leaf->slotkey + s);
+            data_copy(old->slotdata + oldslot, old->slotdata + oldslot + n,
+                      leaf->slotdata + s);
+            head_copy(old->slothead + oldslot, old->slothead + oldslot + n,
+                      leaf->slothead + s);
+
+            s += n;
+            oldslot += n;
+        }
+    }
+
+public:
+    // *** Merging Sorted Batches
+
+    /// Merges the sorted range [first,last) into the tree, which may already
+    /// contain items. Items with a key present in the tree or earlier in the
+    /// range are handled by policy; in a tree without duplicates,
+    /// btree_merge_duplicates acts like btree_merge_keep_existing. The batch
+    /// is merged with the leaf chain in one descent: each leaf receiving
+    /// items is visited once and merged with its run of items, an
+    /// overflowing leaf is split into a run of leaves filled to leaf_fill of
+    /// leafslotmax, and the new separators are added to the parents bottom-up,
+    /// splitting them into runs filled to inner_fill like bulk_load(). Returns
+    /// the number of items inserted.
+    template <typename Iterator>
+    size_type merge_sorted(Iterator first, Iterator last,
+                           btree_merge_policy policy =
+                               allow_duplicates ? btree_merge_duplicates
+                               : btree_merge_keep_existing,
+                           double leaf_fill = 0.75, double inner_fill = 0.75)
+    {
+        if (!allow_duplicates && policy == btree_merge_duplicates)
+            policy = btree_merge_keep_existing;
 
-                // move items and put pointer to child node into correct slot
-                BTREE_ASSERT(slot >= 0 && slot <= inner->slotuse);
+        if (first == last) return 0;
 
-                std::copy_backward(inner->slotkey + slot, inner->slotkey + inner->slotuse,
-                                   inner->slotkey + inner->slotuse + 1);
-                std::copy_backward(inner->childid + slot, inner->childid + inner->slotuse + 1,
-                                   inner->childid + inner->slotuse + 2);
+        if (m_root == NULL)
+            m_root = m_headleaf = m_tailleaf = allocate_leaf();
 
-                inner->slotkey[slot] = newkey;
-                inner->childid[slot + 1] = newchild;
-                inner->slotuse++;
-            }
+        BTREE_PRINT("btree::merge_sorted, " << std::distance(first, last) << " items into " << m_stats.itemcount << " items in " << m_stats.leaves << " leaves.");
 
-            return r;
-        }
-        else // n->isleafnode() == true
-        {
-            leaf_node* leaf = static_cast<leaf_node*>(n);
+        leaf_node old;
 
-            int slot = find_lower(leaf, key);
+        merge_state state;
+        state.policy = policy;
+        state.leaf_fill = leaf_fill;
+        state.inner_fill = inner_fill;
+        state.inserted = 0;
+        state.old = &old;
+        state.children.resize(m_root->level + 1);
 
-            if (!allow_duplicates && slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot])) {
-                return std::pair<iterator, bool>(iterator(leaf, slot), false);
-            }
+        std::vector<merge_child> roots;
+        merge_descend(m_root, NULL, first, last, state, roots);
 
-            if (leaf->isfull())
-            {
-                split_leaf_node(leaf, splitkey, splitnode);
+        // the root was split into a run of nodes: add levels above them
+        while (roots.size() > 1)
+        {
+            std::vector<merge_child> parents;
+            merge_parents(NULL, roots[0].child->level + 1, roots, inner_fill, parents);
+            roots.swap(parents);
+        }
 
-                // check if insert slot is in the split sibling node
-                if (slot >= leaf->slotuse)
-                {
-                    slot -= leaf->slotuse;
-                    leaf = static_cast<leaf_node*>(*splitnode);
-                }
-            }
+        m_root = roots[0].child;
+        m_stats.itemcount += state.inserted;
 
-            // move items and put data item into correct data slot
-            BTREE_ASSERT(slot >= 0 && slot <= leaf->slotuse);
+        if (selfverify) verify();
 
-            std::copy_backward(leaf->slotkey + slot, leaf->slotkey + leaf->slotuse,
-                               leaf->slotkey + leaf->slotuse + 1);
-            data_copy_backward(leaf->slotdata + slot, leaf->slotdata + leaf->slotuse,
-                               leaf->slotdata + leaf->slotuse + 1);
+        return state.inserted;
+    }
 
-            leaf->slotkey[slot] = key;
-            if (!used_as_set) leaf->slotdata[slot] = value;
-            leaf->slotuse++;
+private:
+    /// Key of an item of a sorted range: the item itself for sets.
+    static const key_type & merge_key(const key_type& key)
+    {
+        return key;
+    }
 
-            if (splitnode && leaf != *splitnode && slot == leaf->slotuse - 1)
-            {
-                // special case: the node was split, and the insert is at the
-                // last slot of the old node. then the splitkey must be
-                // updated.
-                *splitkey = key;
-            }
+    /// Key of an item of a sorted range: the first component for maps.
+    template <typename Pair>
+    static const key_type & merge_key(const Pair& p)
+    {
+        return p.first;
+    }
 
-            return std::pair<iterator, bool>(iterator(leaf, slot), true);
-        }
+    /// Data of an item of a sorted range: empty for sets.
+    static data_type merge_data(const key_type&)
+    {
+        return data_type();
     }
 
-    /// Split up a leaf node into two equally-filled sibling leaves. Returns
-    /// the new nodes and it's insertion key in the two parameters.
-    void split_leaf_node(leaf_node* leaf, key_type* _newkey, node** _newleaf)
+    /// Data of an item of a sorted range: the second component for maps.
+    template <typename Pair>
+    static const data_type & merge_data(const Pair& p)
     {
-        BTREE_ASSERT(leaf->isfull());
+        return p.second;
+    }
 
-        unsigned int mid = (leaf->slotuse >> 1);
+    /// A child of an inner node rebuilt by merge_sorted(): the node, the
+    /// separator to its successor, and its item count and summary.
+    struct merge_child
+    {
+        node* child;
+        key_type key;
+        size_type count;
+        summary_type summary;
+    };
 
-        BTREE_PRINT("btree::split_leaf_node on " << leaf);
+    /// Parameters and scratch space of merge_sorted() passed down the
+    /// descent.
+    struct merge_state
+    {
+        btree_merge_policy policy;
+        double leaf_fill, inner_fill;
 
-        leaf_node* newleaf = allocate_leaf();
+        /// Number of items inserted so far
+        size_type inserted;
 
-        newleaf->slotuse = leaf->slotuse - mid;
+        /// Holds the items of the leaf being merged
+        leaf_node* old;
 
-        newleaf->nextleaf = leaf->nextleaf;
-        if (newleaf->nextleaf == NULL) {
-            BTREE_ASSERT(leaf == m_tailleaf);
-            m_tailleaf = newleaf;
-        }
-        else {
-            newleaf->nextleaf->prevleaf = newleaf;
+        /// Children of the inner node being rebuilt on each level
+        std::vector<std::vector<merge_child> > children;
+    };
+
+    /// Merges the items of [first,last) with keys not greater than upper
+    /// into the subtree n, or all items if upper is NULL, and advances first
+    /// past them. Appends the run of nodes replacing n to out.
+    template <typename Iterator>
+    void merge_descend(node* n, const key_type* upper,
+                       Iterator& first, Iterator last,
+                       merge_state& state, std::vector<merge_child>& out)
+    {
+        if (n->isleafnode()) {
+            merge_leaf(static_cast<leaf_node*>(n), upper, first, last, state, out);
+            return;
         }
 
-        std::copy(leaf->slotkey + mid, leaf->slotkey + leaf->slotuse,
-                  newleaf->slotkey);
-        data_copy(leaf->slotdata + mid, leaf->slotdata + leaf->slotuse,
-                  newleaf->slotdata);
+        inner_node* inner = static_cast<inner_node*>(n);
 
-        leaf->slotuse = mid;
-        leaf->nextleaf = newleaf;
-        newleaf->prevleaf = leaf;
+        std::vector<merge_child>& children = state.children[inner->level];
+        children.clear();
 
-        *_newkey = leaf->slotkey[leaf->slotuse - 1];
-        *_newleaf = newleaf;
+        unsigned short slot = 0;
+
+        while (first != last && (upper == NULL || key_lessequal(merge_key(*first), *upper)))
+        {
+            // the items of the previous children were consumed
+            unsigned short next = find_lower(inner, merge_key(*first));
+            BTREE_ASSERT(next >= slot);
+
+            for ( ; slot < next; ++slot)
+                merge_push_child(children, inner, slot, upper);
+
+            merge_descend(inner->childid[slot],
+                          slot < inner->slotuse ? &inner->slotkey[slot] : upper,
+                          first, last, state, children);
+            ++slot;
+        }
+
+        for ( ; slot <= inner->slotuse; ++slot)
+            merge_push_child(children, inner, slot, upper);
+
+        merge_parents(inner, inner->level, children, state.inner_fill, out);
     }
 
-    /// Split up an inner node into two equally-filled sibling nodes. Returns
-    /// the new nodes and it's insertion key in the two parameters. Requires
-    /// the slot of the item will be inserted, so the nodes will be the same
-    /// size after the insert.
-    void split_inner_node(inner_node* inner, key_type* _newkey, node** _newinner, unsigned int addslot)
+    /// Merges the run of items belonging into the leaf with its items. If
+    /// they fit, the leaf keeps them, otherwise they are spread over a run of
+    /// leaves following it, which are filled to leaf_fill. Items precede
+    /// equal keys of the tree, hence an item with a present key is compared
+    /// to the next item of the leaf, which is the first equal one because
+    /// the descent took the leftmost path, or to an equal item output
+    /// before from the batch.
+    template <typename Iterator>
+    void merge_leaf(leaf_node* leaf, const key_type* upper,
+                    Iterator& first, Iterator last,
+                    merge_state& state, std::vector<merge_child>& out)
     {
-        BTREE_ASSERT(inner->isfull());
+        size_type runsize = 0;
+        Iterator runend = merge_run_end(first, last, upper, runsize);
 
-        unsigned int mid = (inner->slotuse >> 1);
+        // move the leaf's items aside and merge them back with the run
+        leaf_node* old = state.old;
 
-        BTREE_PRINT("btree::split_inner: mid " << mid << " addslot " << addslot);
+        std::copy(leaf->slotkey, leaf->slotkey + leaf->slotuse, old->slotkey);
+        head_copy(leaf->slothead, leaf->slothead + leaf->slotuse, old->slothead);
+        data_copy(leaf->slotdata, leaf->slotdata + leaf->slotuse, old->slotdata);
+        old->slotuse = leaf->slotuse;
 
-        // if the split is uneven and the overflowing item will be put into the
-        // larger node, then the smaller split node may underflow
-        if (addslot <= mid && mid > inner->slotuse - (mid + 1))
-            mid--;
+        size_type total = old->slotuse + runsize;
+        unsigned short fill = leafslotmax;
 
-        BTREE_PRINT("btree::split_inner: mid " << mid << " addslot " << addslot);
+        if (total > leafslotmax) {
+            size_type num_leaves = fill_num_leaves(total, state.leaf_fill);
+            fill = static_cast<unsigned short>((total + num_leaves - 1) / num_leaves);
+        }
 
-        BTREE_PRINT("btree::split_inner_node on " << inner << " into two nodes " << mid << " and " << inner->slotuse - (mid + 1) << " sized");
+        BTREE_PRINT("btree::merge_leaf " << leaf << ": " << runsize << " items into " << old->slotuse << " items, " << fill << " per leaf.");
 
-        inner_node* newinner = allocate_inner(inner->level);
+        leaf_node* tail = leaf;
+        tail->slotuse = 0;
+        unsigned short oldslot = 0;
 
-        newinner->slotuse = inner->slotuse - (mid + 1);
+        while (oldslot < old->slotuse || first != runend)
+        {
+            if (first == runend ||
+                (oldslot < old->slotuse && key_less(old->slotkey[oldslot], merge_key(*first))))
+            {
+                tail = merge_next_leaf(tail, fill);
+                unsigned short slot = tail->slotuse++;
+
+                tail->slotkey[slot] = old->slotkey[oldslot];
+                head_copy(old->slothead + oldslot, old->slothead + oldslot + 1,
+                          tail->slothead + slot);
+                data_copy(old->slotdata + oldslot, old->slotdata + oldslot + 1,
+                          tail->slotdata + slot);
+                ++oldslot;
+            }
+            else
+            {
+                const key_type& key = merge_key(*first);
 
-        std::copy(inner->slotkey + mid + 1, inner->slotkey + inner->slotuse,
-                  newinner->slotkey);
-        std::copy(inner->childid + mid + 1, inner->childid + inner->slotuse + 1,
-                  newinner->childid);
+                if (state.policy != btree_merge_duplicates && oldslot < old->slotuse &&
+                    key_equal(old->slotkey[oldslot], key))
+                {
+                    if (state.policy == btree_merge_overwrite && !used_as_set)
+                        old->slotdata[oldslot] = merge_data(*first);
+                }
+                else if (state.policy != btree_merge_duplicates && tail->slotuse != 0 &&
+                         key_equal(tail->slotkey[tail->slotuse - 1], key))
+                {
+                    if (state.policy == btree_merge_overwrite && !used_as_set)
+                        tail->slotdata[tail->slotuse - 1] = merge_data(*first);
+                }
+                else
+                {
+                    tail = merge_next_leaf(tail, fill);
+                    unsigned short slot = tail->slotuse++;
 
-        inner->slotuse = mid;
+                    tail->slotkey[slot] = key;
+                    tail->update_head(slot);
+                    if (!used_as_set) tail->slotdata[slot] = merge_data(*first);
 
-        *_newkey = inner->slotkey[mid];
-        *_newinner = newinner;
-    }
+                    ++state.inserted;
+                }
 
-public:
-    // *** Bulk Loader - Construct Tree from Sorted Sequence
+                ++first;
+            }
+        }
 
-    /// Bulk load a sorted range. Loads items into leaves and constructs a
-    /// B-tree above them. The tree must be empty when calling this function.
+        // skipped items may leave the last leaf of the run underflowing
+        if (tail != leaf && tail->isunderflow())
+            tail = merge_balance_last(tail);
+
+        for (leaf_node* l = leaf; ; l = l->nextleaf)
+        {
+            merge_child c;
+            c.child = l;
+
+            if (l != tail)
+                set_separator(c.key, l, l->nextleaf);
+            else if (upper != NULL)
+                c.key = *upper;
+
+            c.count = l->slotuse;
+            c.summary = aggregates ? l->subtree_summary() : aggregate_type::identity();
+            out.push_back(c);
+
+            if (l == tail) break;
+        }
+    }
+
+    /// Returns the end of the run of items at first with keys not greater
+    /// than upper, or last if upper is NULL, and their number in count. The
+    /// run is searched exponentially and then binary, such that short runs
+    /// cost few key comparisons.
     template <typename Iterator>
-    void bulk_load(Iterator ibegin, Iterator iend)
+    Iterator merge_run_end(Iterator first, Iterator last, const key_type* upper,
+                           size_type& count) const
     {
-        BTREE_ASSERT(empty());
-
-        m_stats.itemcount = iend - ibegin;
+        typedef typename std::iterator_traits<Iterator>::difference_type distance_type;
 
-        // calculate number of leaves needed, round up.
-        size_t num_items = iend - ibegin;
-        size_t num_leaves = (num_items + leafslotmax - 1) / leafslotmax;
+        count = 0;
 
-        BTREE_PRINT("btree::bulk_load, level 0: " << m_stats.itemcount << " items into " << num_leaves << " leaves with up to " << ((iend - ibegin + num_leaves - 1) / num_leaves) << " items per leaf.");
+        if (upper == NULL) {
+            count = std::distance(first, last);
+            return last;
+        }
 
-        Iterator it = ibegin;
-        for (size_t i = 0; i < num_leaves; ++i)
+        for (size_type step = 1; first != last; step *= 2)
         {
-            // allocate new leaf node
-            leaf_node* leaf = allocate_leaf();
+            // advance over up to step items and probe the last of them
+            Iterator probe = first, next = first;
+            size_type num = 0;
 
-            // copy keys or (key,value) pairs into leaf nodes, uses template
-            // switch leaf->set_slot().
-            leaf->slotuse = static_cast<int>(num_items / (num_leaves - i));
-            for (size_t s = 0; s < leaf->slotuse; ++s, ++it)
-                leaf->set_slot(s, *it);
+            while (num < step && next != last) {
+                probe = next++;
+                ++num;
+            }
 
-            if (m_tailleaf != NULL) {
-                m_tailleaf->nextleaf = leaf;
-                leaf->prevleaf = m_tailleaf;
+            if (key_lessequal(merge_key(*probe), *upper)) {
+                first = next;
+                count += num;
+                continue;
             }
-            else {
-                m_headleaf = leaf;
+
+            // the run ends before the probe
+            size_type len = num - 1;
+
+            while (len > 0)
+            {
+                size_type half = len / 2;
+                Iterator mid = first;
+                std::advance(mid, static_cast<distance_type>(half));
+
+                if (key_lessequal(merge_key(*mid), *upper)) {
+                    first = ++mid;
+                    count += half + 1;
+                    len -= half + 1;
+                }
+                else {
+                    len = half;
+                }
             }
-            m_tailleaf = leaf;
 
-            num_items -= leaf->slotuse;
+            return first;
         }
 
-        BTREE_ASSERT(it == iend && num_items == 0);
+        return first;
+    }
 
-        // if the btree is so small to fit into one leaf, then we're done.
-        if (m_headleaf == m_tailleaf) {
-            m_root = m_headleaf;
-            return;
-        }
+    /// Returns the leaf if it holds fewer than fill items, else a new leaf
+    /// linked in after it.
+    leaf_node * merge_next_leaf(leaf_node* leaf, unsigned short fill)
+    {
+        if (leaf->slotuse < fill)
+            return leaf;
 
-        BTREE_ASSERT(m_stats.leaves == num_leaves);
+        leaf_node* newleaf = allocate_leaf();
 
-        // create first level of inner nodes, pointing to the leaves.
-        size_t num_parents = (num_leaves + (innerslotmax + 1) - 1) / (innerslotmax + 1);
+        newleaf->nextleaf = leaf->nextleaf;
+        if (newleaf->nextleaf == NULL) {
+            BTREE_ASSERT(leaf == m_tailleaf);
+            m_tailleaf = newleaf;
+        }
+        else {
+            newleaf->nextleaf->prevleaf = newleaf;
+        }
 
-        BTREE_PRINT("btree::bulk_load, level 1: " << num_leaves << " leaves in " << num_parents << " inner nodes with up to " << ((num_leaves + num_parents - 1) / num_parents) << " leaves per inner node.");
+        leaf->nextleaf = newleaf;
+        newleaf->prevleaf = leaf;
 
-        // save inner nodes and maxkey for next level.
-        typedef std::pair<inner_node*, const key_type*> nextlevel_type;
-        nextlevel_type* nextlevel = new nextlevel_type[num_parents];
+        return newleaf;
+    }
 
-        leaf_node* leaf = m_headleaf;
-        for (size_t i = 0; i < num_parents; ++i)
+    /// Fixes the underflowing last leaf of a run created by merge_leaf():
+    /// moves its items into the predecessor if they fit, and else shifts
+    /// items from the predecessor such that both are at least half full.
+    /// Returns the new last leaf.
+    leaf_node * merge_balance_last(leaf_node* leaf)
+    {
+        leaf_node* prev = leaf->prevleaf;
+
+        if (prev->slotuse + leaf->slotuse <= leafslotmax)
         {
-            // allocate new inner node at level 1
-            inner_node* n = allocate_inner(1);
+            std::copy(leaf->slotkey, leaf->slotkey + leaf->slotuse,
+                      prev->slotkey + prev->slotuse);
+            data_copy(leaf->slotdata, leaf->slotdata + leaf->slotuse,
+                      prev->slotdata + prev->slotuse);
+            head_copy(leaf->slothead, leaf->slothead + leaf->slotuse,
+                      prev->slothead + prev->slotuse);
+            prev->slotuse += leaf->slotuse;
+
+            prev->nextleaf = leaf->nextleaf;
+            if (prev->nextleaf == NULL)
+                m_tailleaf = prev;
+            else
+                prev->nextleaf->prevleaf = prev;
 
-            n->slotuse = static_cast<int>(num_leaves / (num_parents - i));
-            BTREE_ASSERT(n->slotuse > 0);
-            --n->slotuse; // this counts keys, but an inner node has keys+1 children.
+            free_node(leaf);
+            return prev;
+        }
 
-            // copy last key from each leaf and set child
-            for (unsigned short s = 0; s < n->slotuse; ++s)
-            {
-                n->slotkey[s] = leaf->slotkey[leaf->slotuse - 1];
-                n->childid[s] = leaf;
-                leaf = leaf->nextleaf;
-            }
-            n->childid[n->slotuse] = leaf;
+        unsigned short shiftnum = (prev->slotuse - leaf->slotuse) / 2;
 
-            // track max key of any descendant.
-            nextlevel[i].first = n;
-            nextlevel[i].second = &leaf->slotkey[leaf->slotuse - 1];
+        std::copy_backward(leaf->slotkey, leaf->slotkey + leaf->slotuse,
+                           leaf->slotkey + leaf->slotuse + shiftnum);
+        data_copy_backward(leaf->slotdata, leaf->slotdata + leaf->slotuse,
+                           leaf->slotdata + leaf->slotuse + shiftnum);
+        head_copy_backward(leaf->slothead, leaf->slothead + leaf->slotuse,
+                           leaf->slothead + leaf->slotuse + shiftnum);
 
-            leaf = leaf->nextleaf;
-            num_leaves -= n->slotuse + 1;
-        }
+        unsigned short from = prev->slotuse - shiftnum;
 
-        BTREE_ASSERT(leaf == NULL && num_leaves == 0);
+        std::copy(prev->slotkey + from, prev->slotkey + prev->slotuse,
+                  leaf->slotkey);
+        data_copy(prev->slotdata + from, prev->slotdata + prev->slotuse,
+                  leaf->slotdata);
+        head_copy(prev->slothead + from, prev->slothead + prev->slotuse,
+                  leaf->slothead);
 
-        // recursively build inner nodes pointing to inner nodes.
-        for (int level = 2; num_parents != 1; ++level)
-        {
-            size_t num_children = num_parents;
-            num_parents = (num_children + (innerslotmax + 1) - 1) / (innerslotmax + 1);
+        prev->slotuse = from;
+        leaf->slotuse += shiftnum;
 
-            BTREE_PRINT("btree::bulk_load, level " << level << ": " << num_children << " children in " << num_parents << " inner nodes with up to " << ((num_children + num_parents - 1) / num_parents) << " children per inner node.");
+        return leaf;
+    }
 
-            size_t inner_index = 0;
-            for (size_t i = 0; i < num_parents; ++i)
-            {
-                // allocate new inner node at level
-                inner_node* n = allocate_inner(level);
+    /// Appends childid[slot] of an inner node unchanged to children. The
+    /// last child's separator is upper, which is the parent's.
+    void merge_push_child(std::vector<merge_child>& children, const inner_node* inner,
+                          unsigned short slot, const key_type* upper) const
+    {
+        merge_child c;
+        c.child = inner->childid[slot];
 
-                n->slotuse = static_cast<int>(num_children / (num_parents - i));
-                BTREE_ASSERT(n->slotuse > 0);
-                --n->slotuse; // this counts keys, but an inner node has keys+1 children.
+        if (slot < inner->slotuse)
+            c.key = inner->slotkey[slot];
+        else if (upper != NULL)
+            c.key = *upper;
 
-                // copy children and maxkeys from nextlevel
-                for (unsigned short s = 0; s < n->slotuse; ++s)
-                {
-                    n->slotkey[s] = *nextlevel[inner_index].second;
-                    n->childid[s] = nextlevel[inner_index].first;
-                    ++inner_index;
-                }
-                n->childid[n->slotuse] = nextlevel[inner_index].first;
+        c.count = order_statistics ? inner->childcount[slot] : 0;
+        c.summary = aggregates ? inner->childsummary[slot] : aggregate_type::identity();
+        children.push_back(c);
+    }
 
-                // reuse nextlevel array for parents, because we can overwrite
-                // slots we've already consumed.
-                nextlevel[i].first = n;
-                nextlevel[i].second = nextlevel[inner_index].second;
+    /// Stores the children into the inner node, or if they overflow it into
+    /// a run of inner nodes at level filled to inner_fill, the first of which
+    /// is inner unless it is NULL. Appends the run to out.
+    void merge_parents(inner_node* inner, unsigned short level,
+                       const std::vector<merge_child>& children, double inner_fill,
+                       std::vector<merge_child>& out)
+    {
+        size_type num_children = children.size();
+        size_type num_parents = (num_children <= innerslotmax + 1u)
+                                ? 1 : fill_num_parents(num_children, inner_fill);
+
+        // unless a child was split, only the counts and summaries change
+        const bool relink = (inner == NULL || num_children != inner->slotuse + 1u);
+
+        size_type c = 0;
+        for (size_type i = 0; i < num_parents; ++i)
+        {
+            inner_node* n = (i == 0 && inner != NULL) ? inner : allocate_inner(level);
+
+            if (relink) {
+                n->slotuse = static_cast<unsigned short>((num_children - c) / (num_parents - i) - 1);
+                BTREE_ASSERT(n->slotuse > 0 || num_parents == 1);
+            }
 
-                ++inner_index;
-                num_children -= n->slotuse + 1;
+            merge_child p;
+            p.child = n;
+            p.count = 0;
+            p.summary = aggregate_type::identity();
+
+            for (unsigned short s = 0; s <= n->slotuse; ++s, ++c)
+            {
+                const merge_child& e = children[c];
+
+                if (relink) {
+                    n->childid[s] = e.child;
+                    if (s < n->slotuse) {
+                        n->slotkey[s] = e.key;
+                        n->update_head(s);
+                    }
+                }
+                if (order_statistics) {
+                    n->childcount[s] = e.count;
+                    p.count += e.count;
+                }
+                if (aggregates) {
+                    n->childsummary[s] = e.summary;
+                    p.summary = aggregate_type::combine(p.summary, e.summary);
+                }
             }
 
-            BTREE_ASSERT(num_children == 0);
+            p.key = children[c - 1].key;
+            out.push_back(p);
         }
 
-        m_root = nextlevel[0].first;
-        delete[] nextlevel;
-
-        if (selfverify) verify();
+        BTREE_ASSERT(c == num_children);
     }
 
 private:
@@ -2647,14 +7317,138 @@ public:
         if (selfverify) verify();
     }
 
-#ifdef BTREE_TODO
-    /// Erase all key/data pairs in the range [first,last). This function is
-    /// currently not implemented by the B+ Tree.
-    void erase(iterator /* first */, iterator /* last */)
+    /// Erase all key/data pairs in the range [first,last). Subtrees covered
+    /// by the range are freed as a whole, only the two leaves at its ends are
+    /// trimmed, and underflows are repaired along the two paths to them.
+    void erase(iterator first, iterator last)
+    {
+        BTREE_PRINT("btree::erase_range(" << first.currnode << "," << first.currslot << " - " << last.currnode << "," << last.currslot << ") on btree size " << size());
+
+        if (selfverify) verify();
+
+        if (first == last) return;
+
+        if (first == begin() && last == end()) {
+            clear();
+            return;
+        }
+
+        erase_range_t range;
+        range.leafA = first.currnode;
+        range.slotA = first.currslot;
+        range.leafB = (last == end()) ? NULL : last.currnode;
+        range.slotB = last.currslot;
+        range.removed = 0;
+
+        // the predecessor of the range becomes the largest key left of it
+        range.has_before = (range.slotA > 0 || range.leafA->prevleaf != NULL);
+        if (range.slotA > 0)
+            range.before = range.leafA->slotkey[range.slotA - 1];
+        else if (range.leafA->prevleaf != NULL)
+            range.before = range.leafA->prevleaf->slotkey[range.leafA->prevleaf->slotuse - 1];
+
+        if (!m_root->isleafnode())
+        {
+            leaf_path(range.leafA, range.pathA);
+            if (range.leafB)
+                leaf_path(range.leafB, range.pathB);
+        }
+
+        if (range.leafA != range.leafB)
+        {
+            // free the leaves between the ends and link the ends together
+            for (leaf_node* leaf = range.leafA->nextleaf; leaf != range.leafB; )
+            {
+                leaf_node* next = leaf->nextleaf;
+                range.removed += leaf->slotuse;
+                free_node(leaf);
+                leaf = next;
+            }
+
+            range.leafA->nextleaf = range.leafB;
+            if (range.leafB)
+                range.leafB->prevleaf = range.leafA;
+            else
+                m_tailleaf = range.leafA;
+        }
+
+        if (erase_range_descend(m_root, range, true, range.leafB != NULL))
+        {
+            free_node(m_root);
+            m_root = m_headleaf = m_tailleaf = NULL;
+        }
+        else
+        {
+            // cut off inner roots left with a single child
+            while (!m_root->isleafnode() && m_root->slotuse == 0)
+            {
+                inner_node* root = static_cast<inner_node*>(m_root);
+                m_root = root->childid[0];
+                free_node(root);
+            }
+        }
+
+        m_stats.itemcount -= range.removed;
+
+#ifdef BTREE_DEBUG
+        if (debug) print(std::cout);
+#endif
+        if (selfverify) verify();
+    }
+
+    /// Erase all key/data pairs with lower <= key < upper. Returns the number
+    /// of pairs erased.
+    size_type erase(const key_type& lower, const key_type& upper)
     {
-        abort();
+        if (!key_less(lower, upper)) return 0;
+
+        size_type size_before = size();
+        erase(lower_bound(lower), lower_bound(upper));
+        return size_before - size();
     }
+
+    /// Erases all key/data pairs whose key appears in the sorted range
+    /// [first,last). The batch is split among the children at each inner
+    /// node, so each affected leaf is visited once and compacted with one
+    /// block move per run of kept pairs. The tree is then rebalanced bottom-up
+    /// in the same pass. Keys not found are ignored. Returns the number of
+    /// pairs erased.
+    template <typename Iterator>
+    size_type erase_sorted(Iterator first, Iterator last)
+    {
+        BTREE_PRINT("btree::erase_sorted() on btree size " << size());
+
+        if (selfverify) verify();
+
+        if (!m_root || first == last) return 0;
+
+        size_type removed = 0;
+
+        if (erase_sorted_descend(m_root, first, last, removed).has(btree_fixmerge))
+        {
+            free_node(m_root);
+            m_root = m_headleaf = m_tailleaf = NULL;
+        }
+        else
+        {
+            // cut off inner roots left with a single child
+            while (!m_root->isleafnode() && m_root->slotuse == 0)
+            {
+                inner_node* root = static_cast<inner_node*>(m_root);
+                m_root = root->childid[0];
+                free_node(root);
+            }
+        }
+
+        m_stats.itemcount -= removed;
+
+#ifdef BTREE_DEBUG
+        if (debug) print(std::cout);
 #endif
+        if (selfverify) verify();
+
+        return removed;
+    }
 
 private:
     // *** Private Erase Functions
@@ -2680,9 +7474,10 @@ private:
             leaf_node* leftleaf = static_cast<leaf_node*>(left);
             leaf_node* rightleaf = static_cast<leaf_node*>(right);
 
-            int slot = find_lower(leaf, key);
+            bool equal;
+            int slot = find_lower(leaf, key, equal);
 
-            if (slot >= leaf->slotuse || !key_equal(key, leaf->slotkey[slot]))
+            if (!equal)
             {
                 BTREE_PRINT("Could not find key " << key << " to erase.");
 
@@ -2693,11 +7488,15 @@ private:
 
             std::copy(leaf->slotkey + slot + 1, leaf->slotkey + leaf->slotuse,
                       leaf->slotkey + slot);
+            head_copy(leaf->slothead + slot + 1, leaf->slothead + leaf->slotuse,
+                      leaf->slothead + slot);
             data_copy(leaf->slotdata + slot + 1, leaf->slotdata + leaf->slotuse,
                       leaf->slotdata + slot);
 
             leaf->slotuse--;
 
+            if (parent) parent->update_erased(parentslot);
+
             result_t myres = result_t(btree_ok);
 
             // if the last key of the leaf was changed, the parent is notified
@@ -2708,6 +7507,7 @@ private:
                 {
                     BTREE_ASSERT(parent->childid[parentslot] == curr);
                     parent->slotkey[parentslot] = leaf->slotkey[leaf->slotuse - 1];
+                    parent->update_head(parentslot);
                 }
                 else
                 {
@@ -2718,12 +7518,22 @@ private:
                     }
                     else
                     {
-                        BTREE_ASSERT(leaf == m_root);
+                        BTREE_ASSERT(leaf == m_root || leaf == m_tailleaf);
                     }
                 }
             }
 
-            if (leaf->isunderflow() && !(leaf == m_root && leaf->slotuse >= 1))
+            if (leaf == m_tailleaf && leaf != m_root)
+            {
+                // the tail leaf may underflow after a sequential split, it is
+                // merged into its left sibling once it runs empty.
+                if (leaf->slotuse == 0)
+                {
+                    BTREE_ASSERT(leftparent == parent);
+                    myres |= merge_leaves(leftleaf, leaf, leftparent);
+                }
+            }
+            else if (leaf->isunderflow() && !(leaf == m_root && leaf->slotuse >= 1))
             {
                 // determine what to do about the underflow
 
@@ -2802,6 +7612,7 @@ private:
             inner_node* myleftparent, * myrightparent;
 
             int slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             if (slot == 0) {
                 myleft = (left == NULL) ? NULL : (static_cast<inner_node*>(left))->childid[left->slotuse - 1];
@@ -2836,6 +7647,8 @@ private:
                 return result_t(result);
             }
 
+            if (parent) parent->update_erased(parentslot);
+
             if (result.has(btree_update_lastkey))
             {
                 if (parent && parentslot < parent->slotuse)
@@ -2844,6 +7657,7 @@ private:
 
                     BTREE_ASSERT(parent->childid[parentslot] == curr);
                     parent->slotkey[parentslot] = result.lastkey;
+                    parent->update_head(parentslot);
                 }
                 else
                 {
@@ -2865,10 +7679,17 @@ private:
 
                 std::copy(inner->slotkey + slot, inner->slotkey + inner->slotuse,
                           inner->slotkey + slot - 1);
+                head_copy(inner->slothead + slot, inner->slothead + inner->slotuse,
+                          inner->slothead + slot - 1);
                 std::copy(inner->childid + slot + 1, inner->childid + inner->slotuse + 1,
                           inner->childid + slot);
+                count_copy(inner->childcount + slot + 1, inner->childcount + inner->slotuse + 1,
+                           inner->childcount + slot);
+                summary_copy(inner->childsummary + slot + 1, inner->childsummary + inner->slotuse + 1,
+                             inner->childsummary + slot);
 
                 inner->slotuse--;
+                inner->update_child(slot - 1);
 
                 if (inner->level == 1)
                 {
@@ -2876,6 +7697,7 @@ private:
                     slot--;
                     leaf_node* child = static_cast<leaf_node*>(inner->childid[slot]);
                     inner->slotkey[slot] = child->slotkey[child->slotuse - 1];
+                    inner->update_head(slot);
                 }
             }
 
@@ -2989,11 +7811,15 @@ private:
 
             std::copy(leaf->slotkey + slot + 1, leaf->slotkey + leaf->slotuse,
                       leaf->slotkey + slot);
+            head_copy(leaf->slothead + slot + 1, leaf->slothead + leaf->slotuse,
+                      leaf->slothead + slot);
             data_copy(leaf->slotdata + slot + 1, leaf->slotdata + leaf->slotuse,
                       leaf->slotdata + slot);
 
             leaf->slotuse--;
 
+            if (parent) parent->update_erased(parentslot);
+
             result_t myres = result_t(btree_ok);
 
             // if the last key of the leaf was changed, the parent is notified
@@ -3004,6 +7830,7 @@ private:
                 {
                     BTREE_ASSERT(parent->childid[parentslot] == curr);
                     parent->slotkey[parentslot] = leaf->slotkey[leaf->slotuse - 1];
+                    parent->update_head(parentslot);
                 }
                 else
                 {
@@ -3014,12 +7841,22 @@ private:
                     }
                     else
                     {
-                        BTREE_ASSERT(leaf == m_root);
+                        BTREE_ASSERT(leaf == m_root || leaf == m_tailleaf);
                     }
                 }
             }
 
-            if (leaf->isunderflow() && !(leaf == m_root && leaf->slotuse >= 1))
+            if (leaf == m_tailleaf && leaf != m_root)
+            {
+                // the tail leaf may underflow after a sequential split, it is
+                // merged into its left sibling once it runs empty.
+                if (leaf->slotuse == 0)
+                {
+                    BTREE_ASSERT(leftparent == parent);
+                    myres |= merge_leaves(leftleaf, leaf, leftparent);
+                }
+            }
+            else if (leaf->isunderflow() && !(leaf == m_root && leaf->slotuse >= 1))
             {
                 // determine what to do about the underflow
 
@@ -3145,6 +7982,8 @@ private:
             if (slot > inner->slotuse)
                 return result_t(btree_not_found);
 
+            if (parent) parent->update_erased(parentslot);
+
             result_t myres = result_t(btree_ok);
 
             if (result.has(btree_update_lastkey))
@@ -3155,6 +7994,7 @@ private:
 
                     BTREE_ASSERT(parent->childid[parentslot] == curr);
                     parent->slotkey[parentslot] = result.lastkey;
+                    parent->update_head(parentslot);
                 }
                 else
                 {
@@ -3176,10 +8016,17 @@ private:
 
                 std::copy(inner->slotkey + slot, inner->slotkey + inner->slotuse,
                           inner->slotkey + slot - 1);
+                head_copy(inner->slothead + slot, inner->slothead + inner->slotuse,
+                          inner->slothead + slot - 1);
                 std::copy(inner->childid + slot + 1, inner->childid + inner->slotuse + 1,
                           inner->childid + slot);
+                count_copy(inner->childcount + slot + 1, inner->childcount + inner->slotuse + 1,
+                           inner->childcount + slot);
+                summary_copy(inner->childsummary + slot + 1, inner->childsummary + inner->slotuse + 1,
+                             inner->childsummary + slot);
 
                 inner->slotuse--;
+                inner->update_child(slot - 1);
 
                 if (inner->level == 1)
                 {
@@ -3187,6 +8034,7 @@ private:
                     slot--;
                     leaf_node* child = static_cast<leaf_node*>(inner->childid[slot]);
                     inner->slotkey[slot] = child->slotkey[child->slotuse - 1];
+                    inner->update_head(slot);
                 }
             }
 
@@ -3227,31 +8075,531 @@ private:
                 // case : the left leaf has extra data, so balance left with current
                 else if ((leftinner != NULL && !leftinner->isfew()) && (rightinner != NULL && rightinner->isfew()))
                 {
-                    if (leftparent == parent)
-                        shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
-                    else
-                        myres |= merge_inner(inner, rightinner, rightparent, parentslot);
+                    if (leftparent == parent)
+                        shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
+                    else
+                        myres |= merge_inner(inner, rightinner, rightparent, parentslot);
+                }
+                // case : both the leaf and right leaves have extra data and our
+                // parent, choose the leaf with more data
+                else if (leftparent == rightparent)
+                {
+                    if (leftinner->slotuse <= rightinner->slotuse)
+                        shift_left_inner(inner, rightinner, rightparent, parentslot);
+                    else
+                        shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
+                }
+                else
+                {
+                    if (leftparent == parent)
+                        shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
+                    else
+                        shift_left_inner(inner, rightinner, rightparent, parentslot);
+                }
+            }
+
+            return result_t(myres);
+        }
+    }
+
+    /// Ends of a range erase and the paths to them, passed down by
+    /// erase_range_descend().
+    struct erase_range_t
+    {
+        /// Leaf and slot of the first erased pair
+        leaf_node      * leafA;
+        unsigned short slotA;
+
+        /// Leaf and slot of the first pair behind the range, NULL for end()
+        leaf_node      * leafB;
+        unsigned short slotB;
+
+        /// Child slots leading to leafA and leafB, indexed by level
+        unsigned short pathA[cursor_maxlevel];
+        unsigned short pathB[cursor_maxlevel];
+
+        /// The largest key in front of the range, if there is one
+        key_type       before;
+        bool           has_before;
+
+        /// Number of pairs erased
+        size_type      removed;
+    };
+
+    /// Finds the child slots leading from the root, which must be an inner
+    /// node, to the given leaf. A leaf holding different keys is reached by
+    /// descending with its last key. A leaf filled with copies of one key may
+    /// lie below any child holding that key, so the leaf chain is walked in
+    /// both directions to the nearer end of the run of the key, whose path is
+    /// found by descent and then stepped back over the leaves walked. This
+    /// visits O(log n + d) nodes for d leaves to the nearer end of the run.
+    void leaf_path(const leaf_node* leaf, unsigned short* path) const
+    {
+        BTREE_ASSERT(!m_root->isleafnode());
+
+        const inner_node* nodes[cursor_maxlevel];
+        const key_type& key = leaf->slotkey[leaf->slotuse - 1];
+
+        if (key_less(leaf->slotkey[0], key))
+        {
+            const leaf_node* n = leaf_path_descend(key, false, nodes, path);
+            BTREE_ASSERT(n == leaf);
+            (void)n;
+            return;
+        }
+
+        const leaf_node* first = leaf, * last = leaf;
+        size_type steps = 0;
+
+        while (true)
+        {
+            if (first->prevleaf == NULL ||
+                key_less(first->prevleaf->slotkey[first->prevleaf->slotuse - 1], key))
+            {
+                // find_lower() leads to the first leaf holding key or to the
+                // one in front of it
+                const leaf_node* n = leaf_path_descend(key, false, nodes, path);
+                while (n != first) n = leaf_path_step(nodes, path, true);
+                for ( ; steps > 0; --steps) leaf_path_step(nodes, path, true);
+                return;
+            }
+            if (last->nextleaf == NULL || key_less(key, last->nextleaf->slotkey[0]))
+            {
+                // find_upper() leads to the last leaf holding key or to the
+                // one behind it
+                const leaf_node* n = leaf_path_descend(key, true, nodes, path);
+                while (n != last) n = leaf_path_step(nodes, path, false);
+                for ( ; steps > 0; --steps) leaf_path_step(nodes, path, false);
+                return;
+            }
+
+            first = first->prevleaf;
+            last = last->nextleaf;
+            ++steps;
+        }
+    }
+
+    /// Descends from the root with find_lower() or find_upper() of key and
+    /// stores the inner nodes and child slots on the way. Returns the leaf
+    /// reached.
+    const leaf_node * leaf_path_descend(const key_type& key, bool upper,
+                                        const inner_node** nodes,
+                                        unsigned short* path) const
+    {
+        const node* n = m_root;
+
+        while (!n->isleafnode())
+        {
+            const inner_node* inner = static_cast<const inner_node*>(n);
+            int slot = upper ? find_upper(inner, key) : find_lower(inner, key);
+
+            nodes[inner->level] = inner;
+            path[inner->level] = static_cast<unsigned short>(slot);
+            n = inner->childid[slot];
+        }
+
+        return static_cast<const leaf_node*>(n);
+    }
+
+    /// Moves the path stored by leaf_path_descend() to the next or previous
+    /// leaf, which must exist, and returns that leaf.
+    const leaf_node * leaf_path_step(const inner_node** nodes,
+                                     unsigned short* path, bool forward) const
+    {
+        unsigned short level = 1;
+
+        if (forward)
+        {
+            while (path[level] == nodes[level]->slotuse) ++level;
+            ++path[level];
+        }
+        else
+        {
+            while (path[level] == 0) ++level;
+            --path[level];
+        }
+
+        for ( ; level > 1; --level)
+        {
+            nodes[level - 1] = static_cast<const inner_node*>(nodes[level]->childid[path[level]]);
+            path[level - 1] = forward ? 0 : nodes[level - 1]->slotuse;
+        }
+
+        return static_cast<const leaf_node*>(nodes[1]->childid[path[1]]);
+    }
+
+    /// Erases the part of the range below n. hasA and hasB tell whether the
+    /// range starts or ends inside n, else it extends beyond n. Children
+    /// covered by the range are freed, except for their leaves, which were
+    /// already freed along the leaf chain. The two partially covered
+    /// children are descended into, and then the children of n are
+    /// rebalanced. Afterwards n itself may underflow. Returns true if n has
+    /// become empty, in which case the caller frees it.
+    bool erase_range_descend(node* n, erase_range_t& range, bool hasA, bool hasB)
+    {
+        if (n->isleafnode())
+        {
+            leaf_node* leaf = static_cast<leaf_node*>(n);
+
+            unsigned short from = hasA ? range.slotA : 0;
+            unsigned short to = hasB ? range.slotB : leaf->slotuse;
+
+            std::copy(leaf->slotkey + to, leaf->slotkey + leaf->slotuse,
+                      leaf->slotkey + from);
+            head_copy(leaf->slothead + to, leaf->slothead + leaf->slotuse,
+                      leaf->slothead + from);
+            data_copy(leaf->slotdata + to, leaf->slotdata + leaf->slotuse,
+                      leaf->slotdata + from);
+
+            leaf->slotuse -= to - from;
+            range.removed += to - from;
+
+            return (leaf->slotuse == 0);
+        }
+
+        inner_node* inner = static_cast<inner_node*>(n);
+        const int slotuse = inner->slotuse;
+
+        // the partially covered children, or one beyond the first and last
+        int ca = hasA ? range.pathA[inner->level] : -1;
+        int cb = hasB ? range.pathB[inner->level] : slotuse + 1;
+
+        if (ca == cb)
+        {
+            if (erase_range_descend(inner->childid[ca], range, true, true))
+            {
+                if (erase_range_remove(inner, ca)) return true;
+            }
+            else
+            {
+                inner->update_child(ca);
+            }
+        }
+        else
+        {
+            if (inner->level > 1)
+            {
+                for (int slot = ca + 1; slot < cb; ++slot)
+                    free_inner_nodes(static_cast<inner_node*>(inner->childid[slot]), m_node_allocator);
+            }
+
+            bool emptyA = hasA && erase_range_descend(inner->childid[ca], range, true, false);
+            bool emptyB = hasB && erase_range_descend(inner->childid[cb], range, false, true);
+
+            // remove the covered children and their keys: the key after ca
+            // now separates it from cb.
+            int numkeys = (hasA && hasB) ? ca + 1 : std::max(ca, 0);
+
+            if (hasB)
+            {
+                std::copy(inner->slotkey + cb, inner->slotkey + slotuse,
+                          inner->slotkey + numkeys);
+                head_copy(inner->slothead + cb, inner->slothead + slotuse,
+                          inner->slothead + numkeys);
+                std::copy(inner->childid + cb, inner->childid + slotuse + 1,
+                          inner->childid + ca + 1);
+                count_copy(inner->childcount + cb, inner->childcount + slotuse + 1,
+                           inner->childcount + ca + 1);
+                summary_copy(inner->childsummary + cb, inner->childsummary + slotuse + 1,
+                             inner->childsummary + ca + 1);
+
+                numkeys += slotuse - cb;
+            }
+
+            inner->slotuse = static_cast<unsigned short>(numkeys);
+
+            if (emptyB && erase_range_remove(inner, ca + 1)) return true;
+            if (emptyA && erase_range_remove(inner, ca)) return true;
+
+            // recount the partially covered children, which are left at ca
+            // and ca + 1.
+            for (int slot = std::max(ca, 0);
+                 slot <= std::min(ca + 1, static_cast<int>(inner->slotuse)); ++slot)
+            {
+                inner->update_child(static_cast<unsigned short>(slot));
+            }
+
+            if (!truncate_separators && hasA && !emptyA && ca < inner->slotuse)
+            {
+                // the largest key of ca was erased
+                inner->slotkey[ca] = range.before;
+                inner->update_head(ca);
+            }
+        }
+
+        erase_range_fix(inner);
+
+        return false;
+    }
+
+    /// Frees the empty child at slot of n and removes it with one of its
+    /// adjacent keys. Returns true if it was the only child of n.
+    bool erase_range_remove(inner_node* n, int slot)
+    {
+        node* child = n->childid[slot];
+
+        if (child->isleafnode())
+        {
+            leaf_node* leaf = static_cast<leaf_node*>(child);
+
+            if (leaf->prevleaf)
+                leaf->prevleaf->nextleaf = leaf->nextleaf;
+            else
+                m_headleaf = leaf->nextleaf;
+
+            if (leaf->nextleaf)
+                leaf->nextleaf->prevleaf = leaf->prevleaf;
+            else
+                m_tailleaf = leaf->prevleaf;
+        }
+
+        free_node(child);
+
+        if (n->slotuse == 0) return true;
+
+        int keyslot = (slot < n->slotuse) ? slot : slot - 1;
+
+        std::copy(n->slotkey + keyslot + 1, n->slotkey + n->slotuse,
+                  n->slotkey + keyslot);
+        head_copy(n->slothead + keyslot + 1, n->slothead + n->slotuse,
+                  n->slothead + keyslot);
+        std::copy(n->childid + slot + 1, n->childid + n->slotuse + 1,
+                  n->childid + slot);
+        count_copy(n->childcount + slot + 1, n->childcount + n->slotuse + 1,
+                   n->childcount + slot);
+        summary_copy(n->childsummary + slot + 1, n->childsummary + n->slotuse + 1,
+                     n->childsummary + slot);
+
+        n->slotuse--;
+
+        return false;
+    }
+
+    /// True if n has fewer slots than the minimum of its type. Unlike
+    /// verify(), this does not exempt the tail leaf.
+    static bool erase_range_underflow(const node* n)
+    {
+        if (n->isleafnode())
+            return static_cast<const leaf_node*>(n)->isunderflow();
+        else
+            return static_cast<const inner_node*>(n)->isunderflow();
+    }
+
+    /// Repairs underflowing children of n, which have valid children except
+    /// if they are left with a single one. Each is merged with an adjacent
+    /// sibling if both fit into one node, or else balanced with it, after
+    /// which the children of the two nodes are repaired likewise. Stops when
+    /// all children are valid or n has a single child, which then is left to
+    /// the caller.
+    void erase_range_fix(inner_node* n)
+    {
+        unsigned int slot = 0;
+
+        while (n->slotuse > 0 && slot <= n->slotuse)
+        {
+            if (!erase_range_underflow(n->childid[slot])) {
+                ++slot;
+                continue;
+            }
+
+            unsigned int left = (slot < n->slotuse) ? slot : slot - 1;
+
+            if (n->level == 1)
+            {
+                leaf_node* leftleaf = static_cast<leaf_node*>(n->childid[left]);
+                leaf_node* rightleaf = static_cast<leaf_node*>(n->childid[left + 1]);
+
+                if (leftleaf->slotuse + rightleaf->slotuse <= leafslotmax) {
+                    merge_leaves(leftleaf, rightleaf, n);
+                    erase_range_unlink(n, left);
+                }
+                else if (leftleaf->slotuse < rightleaf->slotuse) {
+                    shift_left_leaf(leftleaf, rightleaf, n, left);
+                }
+                else {
+                    shift_right_leaf(leftleaf, rightleaf, n, left);
+                }
+            }
+            else
+            {
+                inner_node* leftinner = static_cast<inner_node*>(n->childid[left]);
+                inner_node* rightinner = static_cast<inner_node*>(n->childid[left + 1]);
+
+                if (leftinner->slotuse + rightinner->slotuse < innerslotmax) {
+                    merge_inner(leftinner, rightinner, n, left);
+                    erase_range_unlink(n, left);
+                    erase_range_fix(leftinner);
+                }
+                else {
+                    if (leftinner->slotuse < rightinner->slotuse)
+                        shift_left_inner(leftinner, rightinner, n, left);
+                    else
+                        shift_right_inner(leftinner, rightinner, n, left);
+
+                    erase_range_fix(leftinner);
+                    erase_range_fix(rightinner);
+                }
+            }
+
+            // recheck the merged or balanced children
+            slot = left;
+        }
+    }
+
+    /// Frees the child at left + 1 of n, which was merged into the child at
+    /// left, and removes it with the key separating the two.
+    void erase_range_unlink(inner_node* n, unsigned int left)
+    {
+        free_node(n->childid[left + 1]);
+
+        std::copy(n->slotkey + left + 1, n->slotkey + n->slotuse,
+                  n->slotkey + left);
+        head_copy(n->slothead + left + 1, n->slothead + n->slotuse,
+                  n->slothead + left);
+        std::copy(n->childid + left + 2, n->childid + n->slotuse + 1,
+                  n->childid + left + 1);
+        count_copy(n->childcount + left + 2, n->childcount + n->slotuse + 1,
+                   n->childcount + left + 1);
+        summary_copy(n->childsummary + left + 2, n->childsummary + n->slotuse + 1,
+                     n->childsummary + left + 1);
+
+        n->slotuse--;
+        n->update_child(left);
+    }
+
+    /// Erases the pairs matching the sorted batch [first,last) below n, whose
+    /// keys all fall into n's key range. The batch is divided among the
+    /// children by the separator keys, with duplicate keys equal to a
+    /// separator handed to both children. Underflowing children are repaired
+    /// with erase_range_fix() afterwards. Returns btree_fixmerge if n has
+    /// become empty, and btree_update_lastkey if its largest key changed.
+    template <typename Iterator>
+    result_t erase_sorted_descend(node* n, Iterator first, Iterator last,
+                                  size_type& removed)
+    {
+        if (n->isleafnode())
+        {
+            leaf_node* leaf = static_cast<leaf_node*>(n);
+            const unsigned short slotuse = leaf->slotuse;
+
+            unsigned short slot = find_lower(leaf, *first);
+            unsigned short out = slot;
+
+            while (slot < slotuse)
+            {
+                while (first != last && key_less(*first, leaf->slotkey[slot]))
+                    ++first;
+                if (first == last) break;
+
+                // move the run of kept pairs in front of the key down
+                unsigned short run = slot;
+                while (run < slotuse && key_less(leaf->slotkey[run], *first))
+                    ++run;
+
+                if (out != slot)
+                {
+                    std::copy(leaf->slotkey + slot, leaf->slotkey + run,
+                              leaf->slotkey + out);
+                    head_copy(leaf->slothead + slot, leaf->slothead + run,
+                              leaf->slothead + out);
+                    data_copy(leaf->slotdata + slot, leaf->slotdata + run,
+                              leaf->slotdata + out);
                 }
-                // case : both the leaf and right leaves have extra data and our
-                // parent, choose the leaf with more data
-                else if (leftparent == rightparent)
+                out += run - slot;
+                slot = run;
+
+                // and skip the pairs matching it
+                while (slot < slotuse && !key_less(*first, leaf->slotkey[slot]))
+                    ++slot;
+            }
+
+            if (out == slot) return result_t(btree_ok);
+
+            std::copy(leaf->slotkey + slot, leaf->slotkey + slotuse,
+                      leaf->slotkey + out);
+            head_copy(leaf->slothead + slot, leaf->slothead + slotuse,
+                      leaf->slothead + out);
+            data_copy(leaf->slotdata + slot, leaf->slotdata + slotuse,
+                      leaf->slotdata + out);
+
+            leaf->slotuse -= slot - out;
+            removed += slot - out;
+
+            if (leaf->slotuse == 0)
+                return result_t(btree_fixmerge);
+            if (slot == slotuse)
+                return result_t(btree_update_lastkey, leaf->slotkey[leaf->slotuse - 1]);
+
+            return result_t(btree_ok);
+        }
+
+        inner_node* inner = static_cast<inner_node*>(n);
+        result_t myres = result_t(btree_ok);
+
+        int slot = find_lower(inner, *first);
+
+        while (first != last)
+        {
+            // the batch keys up to the separator belong to this child, with
+            // duplicates a key equal to it also to the next one.
+            Iterator end = first, equal = first;
+            bool has_equal = false;
+
+            if (slot < inner->slotuse)
+            {
+                while (end != last && !key_less(inner->slotkey[slot], *end))
                 {
-                    if (leftinner->slotuse <= rightinner->slotuse)
-                        shift_left_inner(inner, rightinner, rightparent, parentslot);
-                    else
-                        shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
+                    if (allow_duplicates && !has_equal && !key_less(*end, inner->slotkey[slot])) {
+                        equal = end;
+                        has_equal = true;
+                    }
+                    ++end;
                 }
-                else
+            }
+            else
+            {
+                end = last;
+            }
+
+            result_t result = erase_sorted_descend(inner->childid[slot], first, end, removed);
+
+            if (result.has(btree_fixmerge))
+            {
+                // the largest key of the next child to the left takes over
+                if (slot == inner->slotuse && slot > 0)
+                    myres |= result_t(btree_update_lastkey, inner->slotkey[slot - 1]);
+
+                if (erase_range_remove(inner, slot))
+                    return result_t(btree_fixmerge);
+            }
+            else
+            {
+                if (result.has(btree_update_lastkey))
                 {
-                    if (leftparent == parent)
-                        shift_right_inner(leftinner, inner, leftparent, parentslot - 1);
-                    else
-                        shift_left_inner(inner, rightinner, rightparent, parentslot);
+                    if (slot < inner->slotuse) {
+                        inner->slotkey[slot] = result.lastkey;
+                        inner->update_head(slot);
+                    }
+                    else {
+                        myres |= result;
+                    }
                 }
+                inner->update_child(slot);
+                ++slot;
             }
 
-            return result_t(myres);
+            if (has_equal) {
+                first = equal;
+            }
+            else {
+                first = end;
+                if (first != last) slot = find_lower(inner, *first);
+            }
         }
+
+        erase_range_fix(inner);
+
+        return myres;
     }
 
     /// Merge two leaf nodes. The function moves all key/data pairs from right
@@ -3265,10 +8613,12 @@ private:
         BTREE_ASSERT(left->isleafnode() && right->isleafnode());
         BTREE_ASSERT(parent->level == 1);
 
-        BTREE_ASSERT(left->slotuse + right->slotuse < leafslotmax);
+        BTREE_ASSERT(left->slotuse + right->slotuse <= leafslotmax);
 
         std::copy(right->slotkey, right->slotkey + right->slotuse,
                   left->slotkey + left->slotuse);
+        head_copy(right->slothead, right->slothead + right->slotuse,
+                  left->slothead + left->slotuse);
         data_copy(right->slotdata, right->slotdata + right->slotuse,
                   left->slotdata + left->slotuse);
 
@@ -3315,13 +8665,20 @@ private:
 
         // retrieve the decision key from parent
         left->slotkey[left->slotuse] = parent->slotkey[parentslot];
+        left->update_head(left->slotuse);
         left->slotuse++;
 
         // copy over keys and children from right
         std::copy(right->slotkey, right->slotkey + right->slotuse,
                   left->slotkey + left->slotuse);
+        head_copy(right->slothead, right->slothead + right->slotuse,
+                  left->slothead + left->slotuse);
         std::copy(right->childid, right->childid + right->slotuse + 1,
                   left->childid + left->slotuse);
+        count_copy(right->childcount, right->childcount + right->slotuse + 1,
+                   left->childcount + left->slotuse);
+        summary_copy(right->childsummary, right->childsummary + right->slotuse + 1,
+                     left->childsummary + left->slotuse);
 
         left->slotuse += right->slotuse;
         right->slotuse = 0;
@@ -3353,6 +8710,8 @@ private:
 
         std::copy(right->slotkey, right->slotkey + shiftnum,
                   left->slotkey + left->slotuse);
+        head_copy(right->slothead, right->slothead + shiftnum,
+                  left->slothead + left->slotuse);
         data_copy(right->slotdata, right->slotdata + shiftnum,
                   left->slotdata + left->slotuse);
 
@@ -3362,14 +8721,20 @@ private:
 
         std::copy(right->slotkey + shiftnum, right->slotkey + right->slotuse,
                   right->slotkey);
+        head_copy(right->slothead + shiftnum, right->slothead + right->slotuse,
+                  right->slothead);
         data_copy(right->slotdata + shiftnum, right->slotdata + right->slotuse,
                   right->slotdata);
 
         right->slotuse -= shiftnum;
 
+        parent->update_child(parentslot);
+        parent->update_child(parentslot + 1);
+
         // fixup parent
         if (parentslot < parent->slotuse) {
             parent->slotkey[parentslot] = left->slotkey[left->slotuse - 1];
+            parent->update_head(parentslot);
             return result_t(btree_ok);
         }
         else {  // the update is further up the tree
@@ -3411,28 +8776,45 @@ private:
 
         // copy the parent's decision slotkey and childid to the first new key on the left
         left->slotkey[left->slotuse] = parent->slotkey[parentslot];
+        left->update_head(left->slotuse);
         left->slotuse++;
 
         // copy the other items from the right node to the last slots in the left node.
 
         std::copy(right->slotkey, right->slotkey + shiftnum - 1,
                   left->slotkey + left->slotuse);
+        head_copy(right->slothead, right->slothead + shiftnum - 1,
+                  left->slothead + left->slotuse);
         std::copy(right->childid, right->childid + shiftnum,
                   left->childid + left->slotuse);
+        count_copy(right->childcount, right->childcount + shiftnum,
+                   left->childcount + left->slotuse);
+        summary_copy(right->childsummary, right->childsummary + shiftnum,
+                     left->childsummary + left->slotuse);
 
         left->slotuse += shiftnum - 1;
 
         // fixup parent
         parent->slotkey[parentslot] = right->slotkey[shiftnum - 1];
+        parent->update_head(parentslot);
 
         // shift all slots in the right node
 
         std::copy(right->slotkey + shiftnum, right->slotkey + right->slotuse,
                   right->slotkey);
+        head_copy(right->slothead + shiftnum, right->slothead + right->slotuse,
+                  right->slothead);
         std::copy(right->childid + shiftnum, right->childid + right->slotuse + 1,
                   right->childid);
+        count_copy(right->childcount + shiftnum, right->childcount + right->slotuse + 1,
+                   right->childcount);
+        summary_copy(right->childsummary + shiftnum, right->childsummary + right->slotuse + 1,
+                     right->childsummary);
 
         right->slotuse -= shiftnum;
+
+        parent->update_child(parentslot);
+        parent->update_child(parentslot + 1);
     }
 
     /// Balance two leaf nodes. The function moves key/data pairs from left to
@@ -3473,6 +8855,8 @@ private:
 
         std::copy_backward(right->slotkey, right->slotkey + right->slotuse,
                            right->slotkey + right->slotuse + shiftnum);
+        head_copy_backward(right->slothead, right->slothead + right->slotuse,
+                           right->slothead + right->slotuse + shiftnum);
         data_copy_backward(right->slotdata, right->slotdata + right->slotuse,
                            right->slotdata + right->slotuse + shiftnum);
 
@@ -3481,12 +8865,18 @@ private:
         // copy the last items from the left node to the first slot in the right node.
         std::copy(left->slotkey + left->slotuse - shiftnum, left->slotkey + left->slotuse,
                   right->slotkey);
+        head_copy(left->slothead + left->slotuse - shiftnum, left->slothead + left->slotuse,
+                  right->slothead);
         data_copy(left->slotdata + left->slotuse - shiftnum, left->slotdata + left->slotuse,
                   right->slotdata);
 
         left->slotuse -= shiftnum;
 
+        parent->update_child(parentslot);
+        parent->update_child(parentslot + 1);
+
         parent->slotkey[parentslot] = left->slotkey[left->slotuse - 1];
+        parent->update_head(parentslot);
     }
 
     /// Balance two inner nodes. The function moves key/data pairs from left to
@@ -3524,24 +8914,522 @@ private:
 
         std::copy_backward(right->slotkey, right->slotkey + right->slotuse,
                            right->slotkey + right->slotuse + shiftnum);
+        head_copy_backward(right->slothead, right->slothead + right->slotuse,
+                           right->slothead + right->slotuse + shiftnum);
         std::copy_backward(right->childid, right->childid + right->slotuse + 1,
                            right->childid + right->slotuse + 1 + shiftnum);
+        count_copy_backward(right->childcount, right->childcount + right->slotuse + 1,
+                            right->childcount + right->slotuse + 1 + shiftnum);
+        summary_copy_backward(right->childsummary, right->childsummary + right->slotuse + 1,
+                              right->childsummary + right->slotuse + 1 + shiftnum);
 
         right->slotuse += shiftnum;
 
         // copy the parent's decision slotkey and childid to the last new key on the right
         right->slotkey[shiftnum - 1] = parent->slotkey[parentslot];
+        right->update_head(shiftnum - 1);
 
         // copy the remaining last items from the left node to the first slot in the right node.
         std::copy(left->slotkey + left->slotuse - shiftnum + 1, left->slotkey + left->slotuse,
                   right->slotkey);
+        head_copy(left->slothead + left->slotuse - shiftnum + 1, left->slothead + left->slotuse,
+                  right->slothead);
         std::copy(left->childid + left->slotuse - shiftnum + 1, left->childid + left->slotuse + 1,
                   right->childid);
+        count_copy(left->childcount + left->slotuse - shiftnum + 1, left->childcount + left->slotuse + 1,
+                   right->childcount);
+        summary_copy(left->childsummary + left->slotuse - shiftnum + 1, left->childsummary + left->slotuse + 1,
+                     right->childsummary);
 
         // copy the first to-be-removed key from the left node to the parent's decision slot
         parent->slotkey[parentslot] = left->slotkey[left->slotuse - shiftnum];
+        parent->update_head(parentslot);
 
         left->slotuse -= shiftnum;
+
+        parent->update_child(parentslot);
+        parent->update_child(parentslot + 1);
+    }
+
+public:
+    // *** Splitting and Joining Trees
+
+    /// Moves all pairs with keys not less than key into right_out, whose
+    /// previous contents are cleared, and keeps those with smaller keys. The
+    /// nodes along the path to the first moved pair are cut in two, and
+    /// underflows on both sides of the cut are repaired on the way up. All
+    /// other nodes are relinked without copying. The node counts of the
+    /// smaller part are recounted by visiting its inner nodes. With
+    /// order_statistics the item counts are summed from the child counts of
+    /// the roots, otherwise they are counted along the leaves of the smaller
+    /// part. For m items in the smaller part and nodes of B slots, a split
+    /// visits O(log n + m/B^2) nodes with order_statistics and O(log n + m/B)
+    /// nodes without. right_out shares the node allocator of this tree
+    /// afterwards. With node_pool both trees allocate from one slab pool,
+    /// which is not thread-safe, so they must not be modified concurrently,
+    /// and its slabs are returned only when both trees are destroyed.
+    void split_at(const key_type& key, self_type& right_out)
+    {
+        BTREE_PRINT("btree::split_at(" << key << ") on btree size " << size());
+
+        if (selfverify) verify();
+
+        right_out.clear();
+        right_out.m_key_less = m_key_less;
+        right_out.m_allocator = m_allocator;
+        right_out.m_node_allocator = m_node_allocator;
+
+        if (m_root == NULL) return;
+
+        iterator first = lower_bound(key);
+
+        if (first == end()) return;
+
+        if (first == begin())
+        {
+            right_out.m_root = m_root;
+            right_out.m_headleaf = m_headleaf;
+            right_out.m_tailleaf = m_tailleaf;
+            split_move_stats(right_out, m_stats.itemcount, m_stats.leaves, m_stats.innernodes);
+
+            m_root = m_headleaf = m_tailleaf = NULL;
+            return;
+        }
+
+        node* left = NULL, * right = NULL;
+        split_descend(m_root, key, left, right);
+
+        BTREE_ASSERT(left != NULL && right != NULL);
+
+        split_collapse_root(left);
+        split_collapse_root(right);
+
+        // cut the leaf chain between the two trees
+        leaf_node* lastleaf = split_end_leaf(left, true);
+        leaf_node* firstleaf = split_end_leaf(right, false);
+
+        BTREE_ASSERT(lastleaf->nextleaf == firstleaf);
+
+        lastleaf->nextleaf = NULL;
+        firstleaf->prevleaf = NULL;
+
+        m_root = left;
+        right_out.m_root = right;
+        right_out.m_headleaf = firstleaf;
+        right_out.m_tailleaf = m_tailleaf;
+        m_tailleaf = lastleaf;
+
+        if (order_statistics)
+        {
+            // the item counts are cached in the roots, only the inner nodes
+            // of the smaller part are visited to count its nodes
+            size_type litems = split_count_items(m_root);
+            size_type ritems = m_stats.itemcount - litems;
+            size_type leaves = 0, innernodes = 0;
+
+            if (litems <= ritems)
+            {
+                split_count_nodes(m_root, leaves, innernodes);
+                split_move_stats(right_out, ritems, m_stats.leaves - leaves,
+                                 m_stats.innernodes - innernodes);
+            }
+            else
+            {
+                split_count_nodes(right_out.m_root, leaves, innernodes);
+                split_move_stats(right_out, ritems, leaves, innernodes);
+            }
+        }
+        else
+        {
+            // walk both leaf chains in lockstep until the shorter one ends
+            leaf_node* lleaf = m_headleaf, * rleaf = right_out.m_tailleaf;
+            size_type litems = 0, ritems = 0, numleaves = 0;
+
+            while (lleaf != NULL && rleaf != NULL)
+            {
+                litems += lleaf->slotuse;
+                ritems += rleaf->slotuse;
+                ++numleaves;
+
+                lleaf = lleaf->nextleaf;
+                rleaf = rleaf->prevleaf;
+            }
+
+            size_type leaves = 0, innernodes = 0;
+
+            if (lleaf == NULL)
+            {
+                // the left part was counted completely
+                split_count_nodes(m_root, leaves, innernodes);
+                split_move_stats(right_out, m_stats.itemcount - litems,
+                                 m_stats.leaves - numleaves,
+                                 m_stats.innernodes - innernodes);
+            }
+            else
+            {
+                split_count_nodes(right_out.m_root, leaves, innernodes);
+                split_move_stats(right_out, ritems, numleaves, innernodes);
+            }
+        }
+
+        if (selfverify) {
+            verify();
+            right_out.verify();
+        }
+    }
+
+    /// Appends all pairs of right, whose keys must not be less than those of
+    /// this tree, and leaves right empty. The root of the lower tree is hung
+    /// into the taller tree along its edge facing the other one, splitting
+    /// full nodes above it, and underflows are repaired along the path to the
+    /// seam. This takes time in the order of the heights if both trees use
+    /// the same node allocator, as after split_at(), or if right owns its
+    /// node pool alone, whose slabs this tree's pool takes over. Otherwise
+    /// the pairs of right are copied in like merge_sorted().
+    void join(self_type& right)
+    {
+        BTREE_PRINT("btree::join() on btree sizes " << size() << " and " << right.size());
+
+        if (selfverify) {
+            verify();
+            right.verify();
+        }
+
+        if (right.m_root == NULL) return;
+
+        if (m_root == NULL) {
+            swap(right);
+            return;
+        }
+
+        BTREE_ASSERT(allow_duplicates
+                     ? key_lessequal(m_tailleaf->slotkey[m_tailleaf->slotuse - 1], right.m_headleaf->slotkey[0])
+                     : key_less(m_tailleaf->slotkey[m_tailleaf->slotuse - 1], right.m_headleaf->slotkey[0]));
+
+        // the nodes of right are freed by this tree's allocator later, so
+        // they are copied unless its pool can take them over
+        if (!(m_node_allocator == right.m_node_allocator) &&
+            !btree_node_allocator<allocator_type, node_pool>::adopt(
+                m_node_allocator, right.m_node_allocator))
+        {
+            merge_sorted(right.begin(), right.end(),
+                         allow_duplicates ? btree_merge_duplicates : btree_merge_keep_existing);
+            right.clear();
+            return;
+        }
+
+        // the largest key on the left separates the two trees
+        leaf_node* seam = m_tailleaf;
+        key_type sepkey = seam->slotkey[seam->slotuse - 1];
+
+        m_tailleaf->nextleaf = right.m_headleaf;
+        right.m_headleaf->prevleaf = m_tailleaf;
+        m_tailleaf = right.m_tailleaf;
+
+        m_stats.itemcount += right.m_stats.itemcount;
+        m_stats.leaves += right.m_stats.leaves;
+        m_stats.innernodes += right.m_stats.innernodes;
+
+        node* sub = right.m_root;
+
+        right.m_root = right.m_headleaf = right.m_tailleaf = NULL;
+        right.m_stats.itemcount = right.m_stats.leaves = right.m_stats.innernodes = 0;
+
+        // hang the lower root into the taller tree
+        bool append = (m_root->level >= sub->level);
+        if (!append) std::swap(m_root, sub);
+
+        join_attach(sub, sepkey, append);
+
+        // repair the attached root and the former tail leaf, which may
+        // underflow, bottom-up along the path to the seam
+        if (!m_root->isleafnode())
+        {
+            unsigned short path[cursor_maxlevel];
+            leaf_path(seam, path);
+
+            inner_node* nodes[cursor_maxlevel];
+            node* n = m_root;
+
+            while (!n->isleafnode())
+            {
+                inner_node* inner = static_cast<inner_node*>(n);
+                nodes[inner->level] = inner;
+                n = inner->childid[path[inner->level]];
+            }
+
+            for (unsigned short level = 1; level <= m_root->level; ++level)
+                erase_range_fix(nodes[level]);
+
+            split_collapse_root(m_root);
+        }
+
+        if (selfverify) verify();
+    }
+
+private:
+    /// Splits the subtree n in front of the first pair not less than key. n
+    /// keeps the pairs before it and is returned as left, and a new node
+    /// receives the others and is returned as right. A side without pairs is
+    /// returned as NULL, and its node is freed or reused by the other side.
+    /// Both sides may be left with a single child, their children are
+    /// repaired.
+    void split_descend(node* n, const key_type& key, node*& left, node*& right)
+    {
+        if (n->isleafnode())
+        {
+            leaf_node* leaf = static_cast<leaf_node*>(n);
+            unsigned short slot = find_lower(leaf, key);
+
+            if (slot == 0) {
+                left = NULL;
+                right = leaf;
+                return;
+            }
+            if (slot == leaf->slotuse) {
+                left = leaf;
+                right = NULL;
+                return;
+            }
+
+            leaf_node* newleaf = allocate_leaf();
+            newleaf->slotuse = leaf->slotuse - slot;
+
+            std::copy(leaf->slotkey + slot, leaf->slotkey + leaf->slotuse,
+                      newleaf->slotkey);
+            head_copy(leaf->slothead + slot, leaf->slothead + leaf->slotuse,
+                      newleaf->slothead);
+            data_copy(leaf->slotdata + slot, leaf->slotdata + leaf->slotuse,
+                      newleaf->slotdata);
+
+            leaf->slotuse = slot;
+
+            newleaf->nextleaf = leaf->nextleaf;
+            if (newleaf->nextleaf)
+                newleaf->nextleaf->prevleaf = newleaf;
+            else
+                m_tailleaf = newleaf;
+
+            newleaf->prevleaf = leaf;
+            leaf->nextleaf = newleaf;
+
+            left = leaf;
+            right = newleaf;
+            return;
+        }
+
+        inner_node* inner = static_cast<inner_node*>(n);
+        const unsigned short slotuse = inner->slotuse;
+
+        int slot = find_lower(inner, key);
+
+        node* childleft = NULL, * childright = NULL;
+        split_descend(inner->childid[slot], key, childleft, childright);
+
+        // the right side gets the right part of the child and all children
+        // behind it, the key after the child separates the two.
+        unsigned short rfirst = (childright != NULL) ? slot : slot + 1;
+
+        if (rfirst <= slotuse)
+        {
+            inner_node* newinner = allocate_inner(inner->level);
+            newinner->slotuse = slotuse - rfirst;
+
+            std::copy(inner->slotkey + rfirst, inner->slotkey + slotuse,
+                      newinner->slotkey);
+            head_copy(inner->slothead + rfirst, inner->slothead + slotuse,
+                      newinner->slothead);
+            std::copy(inner->childid + slot + 1, inner->childid + slotuse + 1,
+                      newinner->childid + (childright != NULL));
+            count_copy(inner->childcount + slot + 1, inner->childcount + slotuse + 1,
+                       newinner->childcount + (childright != NULL));
+            summary_copy(inner->childsummary + slot + 1, inner->childsummary + slotuse + 1,
+                         newinner->childsummary + (childright != NULL));
+
+            if (childright != NULL) {
+                newinner->childid[0] = childright;
+                newinner->update_child(0);
+            }
+
+            erase_range_fix(newinner);
+            right = newinner;
+        }
+        else
+        {
+            right = NULL;
+        }
+
+        // the left side keeps the children in front and the left part of the
+        // child, which is the child itself.
+        if (childleft != NULL || slot > 0)
+        {
+            inner->slotuse = (childleft != NULL) ? slot : slot - 1;
+            if (childleft != NULL) inner->update_child(slot);
+
+            erase_range_fix(inner);
+            left = inner;
+        }
+        else
+        {
+            free_node(inner);
+            left = NULL;
+        }
+    }
+
+    /// Replaces an inner root node with a single child by its child, as long
+    /// as there is one.
+    void split_collapse_root(node*& root)
+    {
+        while (!root->isleafnode() && root->slotuse == 0)
+        {
+            inner_node* inner = static_cast<inner_node*>(root);
+            root = inner->childid[0];
+            free_node(inner);
+        }
+    }
+
+    /// Returns the last or first leaf below n.
+    static leaf_node * split_end_leaf(node* n, bool last)
+    {
+        while (!n->isleafnode())
+        {
+            inner_node* inner = static_cast<inner_node*>(n);
+            n = inner->childid[last ? inner->slotuse : 0];
+        }
+
+        return static_cast<leaf_node*>(n);
+    }
+
+    /// Returns the number of items below n from the cached child counts, if
+    /// order_statistics is set.
+    static size_type split_count_items(const node* n)
+    {
+        return n->isleafnode() ? n->slotuse
+               : static_cast<const inner_node*>(n)->subtree_size();
+    }
+
+    /// Adds the leaves and inner nodes of the subtree n to the counts
+    /// without visiting its leaves.
+    static void split_count_nodes(const node* n, size_type& leaves, size_type& innernodes)
+    {
+        if (n->isleafnode()) {
+            ++leaves;
+            return;
+        }
+
+        const inner_node* inner = static_cast<const inner_node*>(n);
+        ++innernodes;
+
+        if (inner->level == 1) {
+            leaves += inner->slotuse + 1;
+            return;
+        }
+
+        for (unsigned short slot = 0; slot <= inner->slotuse; ++slot)
+            split_count_nodes(inner->childid[slot], leaves, innernodes);
+    }
+
+    /// Moves the given item and node counts from this tree's statistics to
+    /// those of right_out.
+    void split_move_stats(self_type& right_out, size_type items,
+                          size_type leaves, size_type innernodes)
+    {
+        m_stats.itemcount -= items;
+        m_stats.leaves -= leaves;
+        m_stats.innernodes -= innernodes;
+
+        right_out.m_stats.itemcount = items;
+        right_out.m_stats.leaves = leaves;
+        right_out.m_stats.innernodes = innernodes;
+    }
+
+    /// Inserts the root sub into the inner node at level sub->level + 1 on the
+    /// right or left edge of the tree, which is the last or first child there,
+    /// with key separating it from its neighbour. A full node is split and the
+    /// new half inserted into the parent the same way, up to a new root.
+    void join_attach(node* sub, key_type key, bool append)
+    {
+        inner_node* path[cursor_maxlevel];
+
+        for (node* n = m_root; n->level > sub->level; )
+        {
+            inner_node* inner = static_cast<inner_node*>(n);
+            path[inner->level] = inner;
+            n = inner->childid[append ? inner->slotuse : 0];
+        }
+
+        unsigned short level = sub->level + 1;
+        node* child = sub;
+        bool childright = append;
+
+        while (level <= m_root->level)
+        {
+            inner_node* inner = path[level];
+            unsigned short keyslot = append ? inner->slotuse : 0;
+
+            key_type splitkey;
+            node* splitnode = NULL;
+
+            if (inner->isfull())
+            {
+                split_inner_node(inner, &splitkey, &splitnode, keyslot);
+
+                if (keyslot > inner->slotuse) {
+                    keyslot -= inner->slotuse + 1;
+                    inner = static_cast<inner_node*>(splitnode);
+                }
+            }
+
+            unsigned short childslot = keyslot + (childright ? 1 : 0);
+
+            std::copy_backward(inner->slotkey + keyslot, inner->slotkey + inner->slotuse,
+                               inner->slotkey + inner->slotuse + 1);
+            head_copy_backward(inner->slothead + keyslot, inner->slothead + inner->slotuse,
+                               inner->slothead + inner->slotuse + 1);
+            std::copy_backward(inner->childid + childslot, inner->childid + inner->slotuse + 1,
+                               inner->childid + inner->slotuse + 2);
+            count_copy_backward(inner->childcount + childslot, inner->childcount + inner->slotuse + 1,
+                                inner->childcount + inner->slotuse + 2);
+            summary_copy_backward(inner->childsummary + childslot, inner->childsummary + inner->slotuse + 1,
+                                  inner->childsummary + inner->slotuse + 2);
+
+            inner->slotkey[keyslot] = key;
+            inner->update_head(keyslot);
+            inner->childid[childslot] = child;
+            inner->slotuse++;
+
+            // recount the child and its neighbour on the edge, which grew or
+            // was split
+            inner->update_child(childslot);
+            inner->update_child(childright ? childslot - 1 : childslot + 1);
+
+            if (splitnode == NULL)
+            {
+                // the edge children of all ancestors grew by sub
+                for (++level; level <= m_root->level; ++level)
+                    path[level]->update_child(append ? path[level]->slotuse : 0);
+                return;
+            }
+
+            // the new right half goes behind the split node
+            key = splitkey;
+            child = splitnode;
+            childright = true;
+            ++level;
+        }
+
+        BTREE_ASSERT(childright);
+
+        inner_node* newroot = allocate_inner(level);
+        newroot->slotkey[0] = key;
+        newroot->update_head(0);
+        newroot->childid[0] = m_root;
+        newroot->childid[1] = child;
+        newroot->slotuse = 1;
+        newroot->update_child(0);
+        newroot->update_child(1);
+
+        m_root = newroot;
     }
 
 #ifdef BTREE_DEBUG
@@ -3652,7 +9540,8 @@ private:
         {
             const leaf_node* leaf = static_cast<const leaf_node*>(n);
 
-            assert(leaf == m_root || !leaf->isunderflow());
+            // the tail leaf may underflow after a sequential split
+            assert(leaf == m_root || leaf == m_tailleaf || !leaf->isunderflow());
             assert(leaf->slotuse > 0);
 
             for (unsigned short slot = 0; slot < leaf->slotuse - 1; ++slot)
@@ -3660,6 +9549,11 @@ private:
                 assert(key_lessequal(leaf->slotkey[slot], leaf->slotkey[slot + 1]));
             }
 
+            for (unsigned short slot = 0; key_heads && slot < leaf->slotuse; ++slot)
+            {
+                assert(leaf->slothead[slot] == key_head(leaf->slotkey[slot]));
+            }
+
             *minkey = leaf->slotkey[0];
             *maxkey = leaf->slotkey[leaf->slotuse - 1];
 
@@ -3679,6 +9573,11 @@ private:
                 assert(key_lessequal(inner->slotkey[slot], inner->slotkey[slot + 1]));
             }
 
+            for (unsigned short slot = 0; key_heads && slot < inner->slotuse; ++slot)
+            {
+                assert(inner->slothead[slot] == key_head(inner->slotkey[slot]));
+            }
+
             for (unsigned short slot = 0; slot <= inner->slotuse; ++slot)
             {
                 const node* subnode = inner->childid[slot];
@@ -3686,8 +9585,18 @@ private:
                 key_type submaxkey = key_type();
 
                 assert(subnode->level + 1 == inner->level);
+
+                size_type subitems = vstats.itemcount;
                 verify_node(subnode, &subminkey, &submaxkey, vstats);
 
+                assert(!order_statistics || inner->childcount[slot] == vstats.itemcount - subitems);
+                (void)subitems;
+
+                assert(!aggregates || inner->childsummary[slot] ==
+                       (subnode->isleafnode()
+                        ? static_cast<const leaf_node*>(subnode)->subtree_summary()
+                        : static_cast<const inner_node*>(subnode)->subtree_summary()));
+
                 BTREE_PRINT("verify subnode " << subnode << ": " << subminkey << " - " << submaxkey);
 
                 if (slot == 0)
@@ -3697,6 +9606,8 @@ private:
 
                 if (slot == inner->slotuse)
                     *maxkey = submaxkey;
+                else if (truncate_separators)
+                    assert(key_lessequal(submaxkey, inner->slotkey[slot]));
                 else
                     assert(key_equal(inner->slotkey[slot], submaxkey));
 
@@ -3980,6 +9891,9 @@ private:
             for (unsigned short slot = 0; slot <= newinner->slotuse; ++slot)
             {
                 newinner->childid[slot] = restore_node(is);
+                if (newinner->childid[slot] == NULL) return NULL;
+
+                newinner->update_child(slot);
             }
 
             return newinner;
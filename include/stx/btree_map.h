@@ -106,6 +106,17 @@ public:
     /// Size type used to count keys
     typedef typename btree_impl::size_type size_type;
 
+    /// Signed type of distances between iterators
+    typedef typename btree_impl::difference_type difference_type;
+
+    /// Type of the summaries of the traits' aggregate
+    typedef typename btree_impl::summary_type summary_type;
+
+    /// Reference to the data of a pair returned by iterator::data() and
+    /// operator[]. It is read-only if the traits declare an aggregate, as a
+    /// write through it would leave the cached summaries stale.
+    typedef typename btree_impl::data_reference data_reference;
+
     /// Small structure containing statistics about the tree
     typedef typename btree_impl::tree_stats tree_stats;
 
@@ -158,6 +169,12 @@ public:
     /// create constant reverse iterator by using STL magic
     typedef typename btree_impl::const_reverse_iterator const_reverse_iterator;
 
+    /// Cursor remembering the path of its last seek() for finger searches.
+    typedef typename btree_impl::cursor cursor;
+
+    /// Read-only cursor remembering the path of its last seek().
+    typedef typename btree_impl::const_cursor const_cursor;
+
 private:
     // *** Tree Implementation Object
 
@@ -202,7 +219,7 @@ public:
     /// Fast swapping of two identical B+ tree objects.
     void swap(self_type& from)
     {
-        std::swap(tree, from.tree);
+        tree.swap(from.tree);
     }
 
 public:
@@ -350,6 +367,36 @@ public:
         return tree.find(key);
     }
 
+    /// Batched version of find(): looks up each key in [keys_begin,keys_end)
+    /// and writes an iterator to the found slot, or end(), to out. Lookups
+    /// descend the tree in groups with software prefetching.
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator find_batch(ForwardIterator keys_begin, ForwardIterator keys_end,
+                              OutputIterator out)
+    {
+        return tree.find_batch(keys_begin, keys_end, out);
+    }
+
+    /// Batched version of find(): looks up each key in [keys_begin,keys_end)
+    /// and writes a constant iterator to the found slot, or end(), to out.
+    /// Lookups descend the tree in groups with software prefetching.
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator find_batch(ForwardIterator keys_begin, ForwardIterator keys_end,
+                              OutputIterator out) const
+    {
+        return tree.find_batch(keys_begin, keys_end, out);
+    }
+
+    /// Batched version of exists(): checks each key in [keys_begin,keys_end)
+    /// and writes true or false to out. Lookups descend the tree in groups
+    /// with software prefetching.
+    template <typename ForwardIterator, typename OutputIterator>
+    OutputIterator exists_batch(ForwardIterator keys_begin, ForwardIterator keys_end,
+                                OutputIterator out) const
+    {
+        return tree.exists_batch(keys_begin, keys_end, out);
+    }
+
     /// Tries to locate a key in the B+ tree and returns the number of
     /// identical key entries found. Since this is a unique map, count()
     /// returns either 0 or 1.
@@ -400,6 +447,19 @@ public:
         return tree.equal_range(key);
     }
 
+    /// Constructs a cursor for finger searches: cursor::seek() is a
+    /// lower_bound() which starts at the previously found position.
+    inline cursor make_cursor()
+    {
+        return tree.make_cursor();
+    }
+
+    /// Constructs a read-only cursor for finger searches.
+    inline const_cursor make_cursor() const
+    {
+        return tree.make_cursor();
+    }
+
 public:
     // *** B+ Tree Object Comparison Functions
 
@@ -488,15 +548,19 @@ public:
         return tree.insert2(key, data);
     }
 
-    /// Attempt to insert a key/data pair into the B+ tree. The iterator hint
-    /// is currently ignored by the B+ tree insertion routine.
+    /// Attempt to insert a key/data pair into the B+ tree. If the key belongs
+    /// into the leaf referenced by the iterator hint or its successor, then
+    /// the pair is put there directly without descending from the root. The
+    /// hint is ignored if the traits enable order_statistics or an aggregate.
     inline iterator insert(iterator hint, const value_type& x)
     {
         return tree.insert2(hint, x.first, x.second);
     }
 
-    /// Attempt to insert a key/data pair into the B+ tree. The iterator hint is
-    /// currently ignored by the B+ tree insertion routine.
+    /// Attempt to insert a key/data pair into the B+ tree. If the key belongs
+    /// into the leaf referenced by the iterator hint or its successor, then
+    /// the pair is put there directly without descending from the root. The
+    /// hint is ignored if the traits enable order_statistics or an aggregate.
     inline iterator insert2(iterator hint, const key_type& key, const data_type& data)
     {
         return tree.insert2(hint, key, data);
@@ -504,8 +568,9 @@ public:
 
     /// Returns a reference to the object that is associated with a particular
     /// key. If the map does not already contain such an object, operator[]
-    /// inserts the default object data_type().
-    inline data_type& operator [] (const key_type& key)
+    /// inserts the default object data_type(). With aggregates, the reference
+    /// is read-only and data is written by assign() instead.
+    inline data_reference operator [] (const key_type& key)
     {
         iterator i = insert(value_type(key, data_type())).first;
         return i.data();
@@ -528,6 +593,217 @@ public:
         return tree.bulk_load(first, last);
     }
 
+    /// Bulk load a sorted range [first,last), leaving slack for later
+    /// inserts. Leaves are filled to leaf_fill and inner nodes to inner_fill
+    /// of their capacity, but no node is filled below half. The tree must be
+    /// empty when calling this function.
+    template <typename Iterator>
+    inline void bulk_load(Iterator first, Iterator last,
+                          double leaf_fill, double inner_fill)
+    {
+        return tree.bulk_load(first, last, leaf_fill, inner_fill);
+    }
+
+    /// Bulk load a sorted range [first,last) like bulk_load(), filling the
+    /// nodes on up to threads threads, of which 0 means all hardware threads.
+    /// Loads sequentially without C++11 threads.
+    template <typename Iterator>
+    inline void parallel_bulk_load(Iterator first, Iterator last,
+                                   unsigned int threads = 0)
+    {
+        return tree.parallel_bulk_load(first, last, threads);
+    }
+
+    /// Bulk load a sorted range [first,last) in parallel, leaving slack for
+    /// later inserts like bulk_load(first, last, leaf_fill, inner_fill).
+    template <typename Iterator>
+    inline void parallel_bulk_load(Iterator first, Iterator last,
+                                   double leaf_fill, double inner_fill,
+                                   unsigned int threads = 0)
+    {
+        return tree.parallel_bulk_load(first, last, leaf_fill, inner_fill, threads);
+    }
+
+    /// Fill the empty tree with the unsorted range [first,last) by a
+    /// parallel sort and parallel_bulk_load() on up to threads threads, of
+    /// which 0 means all hardware threads. Only the first pair of each key
+    /// is kept, like insert() would.
+    template <typename InputIterator>
+    inline void build_from_unsorted(InputIterator first, InputIterator last,
+                                    unsigned int threads = 0)
+    {
+        return tree.build_from_unsorted(first, last, threads);
+    }
+
+public:
+    // *** Compaction of Long-Lived Trees
+
+    /// Position of an incremental compaction pass.
+    typedef typename btree_impl::compact_state compact_state;
+
+    /// Rewrites the tree in key order into newly allocated, densely packed
+    /// nodes with leaves filled to target_fill. Returns the node bytes
+    /// reclaimed.
+    size_type compact(double target_fill = 1.0)
+    {
+        return tree.compact(target_fill);
+    }
+
+    /// Runs one bounded step of an incremental compaction pass, which repacks
+    /// at most max_leaves leaves. Returns true if the pass reached the end.
+    bool compact_step(compact_state& state, size_type max_leaves,
+                      double target_fill = 1.0)
+    {
+        return tree.compact_step(state, max_leaves, target_fill);
+    }
+
+public:
+    // *** Merging Sorted Batches
+
+    /// Merges the sorted range [first,last) into the map, which need not be
+    /// empty. By default the data of keys already present is kept,
+    /// btree_merge_overwrite replaces it. Leaves and inner nodes split by the
+    /// merge are filled to leaf_fill and inner_fill. Returns the number of
+    /// items inserted.
+    template <typename Iterator>
+    inline size_type merge_sorted(Iterator first, Iterator last,
+                                  btree_merge_policy policy = btree_merge_keep_existing,
+                                  double leaf_fill = 0.75, double inner_fill = 0.75)
+    {
+        return tree.merge_sorted(first, last, policy, leaf_fill, inner_fill);
+    }
+
+public:
+    // *** Splitting and Joining
+
+    /// Moves all key/data pairs with keys not less than key into right_out,
+    /// whose previous contents are cleared. Only the nodes along one path are
+    /// cut, the others are relinked. Both maps share the node allocator
+    /// afterwards, whose node pool is not thread-safe, so they must not be
+    /// modified concurrently.
+    void split_at(const key_type& key, self_type& right_out)
+    {
+        tree.split_at(key, right_out.tree);
+    }
+
+    /// Appends all key/data pairs of right, whose keys must not be less than
+    /// those of this map, and leaves right empty. The two trees are linked
+    /// along one path if they share the node allocator, as after split_at(),
+    /// or if right owns its node pool alone, which this map takes over.
+    /// Otherwise the pairs of right are copied.
+    void join(self_type& right)
+    {
+        tree.join(right.tree);
+    }
+
+public:
+    // *** Order Statistics
+
+    /// Returns the number of pairs with keys less than key. Runs in O(log n)
+    /// if the traits set order_statistics.
+    size_type rank(const key_type& key) const
+    {
+        return tree.rank(key);
+    }
+
+    /// Returns an iterator to the k-th pair in order, or end() if k >= size().
+    iterator select(size_type k)
+    {
+        return tree.select(k);
+    }
+
+    /// Returns a constant iterator to the k-th pair in order, or end() if
+    /// k >= size().
+    const_iterator select(size_type k) const
+    {
+        return tree.select(k);
+    }
+
+    /// Returns the number of pairs from first to last. Runs in O(log n) if the
+    /// traits set order_statistics.
+    difference_type distance(const_iterator first, const_iterator last) const
+    {
+        return tree.distance(first, last);
+    }
+
+    /// Returns the number of pairs with lower <= key < upper.
+    size_type count(const key_type& lower, const key_type& upper) const
+    {
+        return tree.count(lower, upper);
+    }
+
+public:
+    // *** Aggregates over Key Ranges
+
+    /// Combines the summaries of all pairs with lower <= key < upper in key
+    /// order. Runs in O(log n) if the traits declare an aggregate.
+    summary_type aggregate(const key_type& lower, const key_type& upper) const
+    {
+        return tree.aggregate(lower, upper);
+    }
+
+    /// Combines the summaries of all pairs.
+    summary_type aggregate() const
+    {
+        return tree.aggregate();
+    }
+
+    /// Sets the data of the pair with key, which is inserted if it is not
+    /// present, and updates the cached summaries. Returns an iterator to the
+    /// pair. With aggregates, data is written this way and not through
+    /// operator[].
+    iterator assign(const key_type& key, const data_type& data)
+    {
+        std::pair<iterator, bool> r = tree.insert2(key, data);
+        if (!r.second) tree.assign(r.first, data);
+        return r.first;
+    }
+
+    /// Replaces the data of the pair at iter and updates the cached summaries
+    /// above it. With aggregates, data is written only this way, as
+    /// iterator::data() returns a read-only reference.
+    void assign(iterator iter, const data_type& data)
+    {
+        tree.assign(iter, data);
+    }
+
+    /// Recalculates the cached summaries above the pair at iter, after the
+    /// data it summarizes was changed outside the tree.
+    void update_aggregate(const_iterator iter)
+    {
+        tree.update_aggregate(iter);
+    }
+
+public:
+    // *** Parallel Traversal of the Leaves
+
+    /// Call f(key, data) for every pair on up to threads threads, of which 0
+    /// means all hardware threads. Each thread visits a contiguous range of
+    /// leaves in key order with its own copy of f.
+    template <typename Function>
+    void parallel_for_each(Function f, unsigned int threads = 0) const
+    {
+        return tree.parallel_for_each(f, threads);
+    }
+
+    /// Fold combine(result, map(key, data)) over the pairs on up to threads
+    /// threads, combining the results of the threads in key order. combine
+    /// must be associative with the identity init.
+    template <typename Result, typename Map, typename Combine>
+    Result parallel_reduce(const Result& init, Map map, Combine combine,
+                           unsigned int threads = 0) const
+    {
+        return tree.parallel_reduce(init, map, combine, threads);
+    }
+
+    /// Replace the data of every pair by f(key, data) on up to threads
+    /// threads, like parallel_for_each().
+    template <typename Function>
+    void parallel_transform_values(Function f, unsigned int threads = 0)
+    {
+        return tree.parallel_transform_values(f, threads);
+    }
+
 public:
     // *** Public Erase Functions
 
@@ -551,14 +827,28 @@ public:
         return tree.erase(iter);
     }
 
-#ifdef BTREE_TODO
-    /// Erase all key/data pairs in the range [first,last). This function is
-    /// currently not implemented by the B+ Tree.
-    void erase(iterator /* first */, iterator /* last */)
+    /// Erase all key/data pairs in the range [first,last). Subtrees covered by the
+    /// range are freed as a whole.
+    void erase(iterator first, iterator last)
     {
-        abort();
+        return tree.erase(first, last);
+    }
+
+    /// Erase all key/data pairs with lower <= key < upper. Returns the number of
+    /// key/data pairs erased.
+    size_type erase(const key_type& lower, const key_type& upper)
+    {
+        return tree.erase(lower, upper);
+    }
+
+    /// Erases all key/data pairs whose key appears in the sorted range
+    /// [first,last), visiting each affected leaf once. Returns the number of
+    /// key/data pairs erased.
+    template <typename Iterator>
+    size_type erase_sorted(Iterator first, Iterator last)
+    {
+        return tree.erase_sorted(first, last);
     }
-#endif
 
 #ifdef BTREE_DEBUG
 
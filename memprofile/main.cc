@@ -94,6 +94,18 @@ public:
     /// Test the B+ tree with a auto-detected leaf/inner slots
     typedef TestClass<stx::btree_multimap<unsigned int, unsigned int,
                                           std::less<unsigned int> > > BtreeMap;
+
+    /// Traits of the B+ tree drawing its nodes from a slab pool
+    struct btree_traits_pool
+        : stx::btree_default_map_traits<unsigned int, unsigned int>
+    {
+        static const bool node_pool = true;
+    };
+
+    /// Test the B+ tree with nodes allocated from a slab pool
+    typedef TestClass<stx::btree_multimap<unsigned int, unsigned int,
+                                          std::less<unsigned int>,
+                                          btree_traits_pool> > BtreeMapPool;
 };
 
 // -----------------------------------------------------------------------------
@@ -148,10 +160,13 @@ void write_memprofile(const char* filename)
             MemProfile mp(filename, 0.1, 16 * 1024);
             TestClass test(insertnum);  // initialize test structures
 
+            size_t allocs = malloc_count_num_allocs();
             double ts1 = timestamp();
             test.run(insertnum);        // run timed test procedure
             double ts2 = timestamp();
-            std::cout << "done, time=" << (ts2 - ts1) << std::endl;
+            std::cout << "done, time=" << (ts2 - ts1)
+                      << " allocs=" << (malloc_count_num_allocs() - allocs)
+                      << std::endl;
         }
         exit(0);
     }
@@ -169,6 +184,7 @@ int main()
     write_memprofile<testmap_type::HashMap>("memprofile-hashmap.txt");
     write_memprofile<testmap_type::UnorderedMap>("memprofile-unorderedmap.txt");
     write_memprofile<testmap_type::BtreeMap>("memprofile-btreemap.txt");
+    write_memprofile<testmap_type::BtreeMapPool>("memprofile-btreemap-pool.txt");
 
     typedef TestFactory_Array<Test_Array_Insert> testarray_type;
 
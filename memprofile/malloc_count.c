@@ -64,7 +64,7 @@ static const int log_operations_init_heap = 0;
 /* run-time memory allocation statistics */
 /*****************************************/
 
-static long long peak = 0, curr = 0, total = 0;
+static long long peak = 0, curr = 0, total = 0, num_allocs = 0;
 
 static malloc_count_callback_type callback = NULL;
 static void* callback_cookie = NULL;
@@ -76,10 +76,12 @@ static void inc_count(size_t inc)
     long long mycurr = __sync_add_and_fetch(&curr, inc);
     if (mycurr > peak) peak = mycurr;
     total += inc;
+    __sync_add_and_fetch(&num_allocs, 1);
     if (callback) callback(callback_cookie, mycurr);
 #else
     if ((curr += inc) > peak) peak = curr;
     total += inc;
+    ++num_allocs;
     if (callback) callback(callback_cookie, curr);
 #endif
 }
@@ -114,6 +116,12 @@ extern void malloc_count_reset_peak(void)
     peak = curr;
 }
 
+/* user function to return the number of allocation calls so far */
+extern size_t malloc_count_num_allocs(void)
+{
+    return num_allocs;
+}
+
 /* user function which prints current and peak allocation to stderr */
 extern void malloc_count_print_status(void)
 {
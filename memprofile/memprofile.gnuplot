@@ -6,6 +6,7 @@ set style line 3 linecolor rgbcolor "#0000FF" linewidth 1.6 pointsize 0.7
 set style line 4 linecolor rgbcolor "#E000E0" linewidth 1.6 pointsize 0.7
 set style line 5 linecolor rgbcolor "#00C0FF" linewidth 1.6 pointsize 0.7
 set style line 6 linecolor rgbcolor "#FFC000" linewidth 1.6 pointsize 0.7
+set style line 7 linecolor rgbcolor "#808080" linewidth 1.6 pointsize 0.7
 set style increment user
 
 set terminal pdf size 5, 3.5
@@ -24,5 +25,6 @@ plot "memprofile-stdmap.txt" using 1:($2 / 1024/1024) title "std::multimap" with
      "memprofile-hashmap.txt" using 1:($2 / 1024/1024) title "__gnu_cxx::hash_multimap" with lines, \
      "memprofile-unorderedmap.txt" using 1:($2 / 1024/1024) title "std::tr1::unordered_multimap" with lines, \
      "memprofile-btreemap.txt" using 1:($2 / 1024/1024) title "stx::btree_multimap" with lines, \
+     "memprofile-btreemap-pool.txt" using 1:($2 / 1024/1024) title "stx::btree_multimap (node pool)" with lines, \
      "memprofile-vector.txt" using 1:($2 / 1024/1024) title "std::vector" with lines, \
      "memprofile-deque.txt" using 1:($2 / 1024/1024) title "std::deque" with lines
\ No newline at end of file
@@ -147,6 +147,9 @@ public:
         char stack;
         m_stack_base = &stack;
         m_file = fopen(filepath, funcname ? "a" : "w");
+        // write an initial entry, which lets stdio allocate its buffer before
+        // the callback is installed and could recurse into it.
+        output(m_base_ts, 0);
         malloc_count_set_callback(MemProfile::static_callback, this);
     }
 
@@ -26,6 +26,7 @@
 #include <string>
 #include <cstdlib>
 #include <cassert>
+#include <vector>
 
 #include <set>
 #include <ext/hash_set>
@@ -51,6 +52,15 @@ static const int randseed = 34234235;
 static const int min_nodeslots = 4;
 static const int max_nodeslots = 256;
 
+/// b+ tree software prefetching of child nodes and sibling leaves
+static const bool btree_prefetch = false;
+
+/// b+ tree nodes carved out of slabs by the tree's node pool
+static const bool btree_node_pool = false;
+
+/// b+ tree slots for comparing node slabs on base and huge pages
+static const int page_nodeslots = 64;
+
 /// Time is measured using gettimeofday()
 static inline double timestamp()
 {
@@ -61,7 +71,7 @@ static inline double timestamp()
 
 /// Traits used for the speed tests, BTREE_DEBUG is not defined.
 template <int _innerslots, int _leafslots>
-class btree_traits_speed : stx::btree_default_set_traits<unsigned int>
+class btree_traits_speed : public stx::btree_default_set_traits<unsigned int>
 {
 public:
     static const bool selfverify = false;
@@ -71,6 +81,10 @@ public:
     static const int innerslots = _leafslots;
 
     static const size_t binsearch_threshold = 256 * 1024 * 1024; // never
+
+    static const bool prefetch = btree_prefetch;
+
+    static const bool node_pool = btree_node_pool;
 };
 
 // -----------------------------------------------------------------------------
@@ -260,6 +274,57 @@ public:
     }
 };
 
+/// Look up a batch of keys, using a loop of find() for generic maps
+template <typename MapType, typename Iterator>
+void map_find_batch(const MapType& map,
+                    const std::vector<unsigned int>& keys, Iterator out)
+{
+    for (unsigned int i = 0; i < keys.size(); i++)
+        *out++ = map.find(keys[i]);
+}
+
+/// Look up a batch of keys, using the B+ tree's find_batch()
+template <typename Key, typename Data, typename Compare, typename Traits,
+          typename Alloc, typename Iterator>
+void map_find_batch(const stx::btree_multimap<Key, Data, Compare, Traits, Alloc>& map,
+                    const std::vector<unsigned int>& keys, Iterator out)
+{
+    map.find_batch(keys.begin(), keys.end(), out);
+}
+
+/// Test a generic map type with batches of lookups
+template <typename MapType>
+class Test_Map_FindBatch
+{
+public:
+    MapType map;
+
+    std::vector<unsigned int> keys;
+
+    std::vector<typename MapType::const_iterator> found;
+
+    explicit Test_Map_FindBatch(unsigned int items)
+        : keys(items), found(items)
+    {
+        srand(randseed);
+        for (unsigned int i = 0; i < items; i++) {
+            unsigned int r = rand();
+            map.insert(std::make_pair(r, r));
+        }
+
+        assert(map.size() == items);
+
+        srand(randseed);
+        for (unsigned int i = 0; i < items; i++)
+            keys[i] = rand();
+    }
+
+    void run(unsigned int)
+    {
+        map_find_batch(map, keys, found.begin());
+    }
+};
+
 /// Construct different map types for a generic test class
 template <template <typename MapType> class TestClass>
 class TestFactory_Map
@@ -299,6 +364,46 @@ public:
 
 // -----------------------------------------------------------------------------
 
+/// Traits of the page size tests: nodes are carved out of slabs by the pool
+template <int _slots>
+class btree_traits_pages : public btree_traits_speed<_slots, _slots>
+{
+public:
+    static const bool node_pool = true;
+};
+
+/// Construct B+ trees whose node slabs are mapped on different page sizes
+template <template <typename MapType> class TestClass>
+class TestFactory_Pages
+{
+public:
+    /// Test the B+ tree with its slabs mapped in a specific page mode
+    template <stx::btree_page_mode Mode>
+    class BtreeMap
+        : public TestClass<
+              stx::btree_multimap<unsigned int, unsigned int,
+                                  std::less<unsigned int>,
+                                  btree_traits_pages<page_nodeslots>,
+                                  stx::btree_huge_page_allocator<
+                                      std::pair<unsigned int, unsigned int>, Mode> > >
+    {
+    public:
+        explicit BtreeMap(unsigned int n)
+            : TestClass<
+                  stx::btree_multimap<unsigned int, unsigned int,
+                                      std::less<unsigned int>,
+                                      btree_traits_pages<page_nodeslots>,
+                                      stx::btree_huge_page_allocator<
+                                          std::pair<unsigned int, unsigned int>, Mode> > >(n)
+        { }
+    };
+
+    /// Run tests on 4 KiB pages, transparent 2 MiB pages and hugetlbfs pages
+    void call_testrunner(std::ostream& os, unsigned int items);
+};
+
+// -----------------------------------------------------------------------------
+
 unsigned int repeatuntil;
 
 /// Repeat (short) tests until enough time elapsed and divide by the runs.
@@ -426,6 +531,19 @@ void TestFactory_Map<TestClass>::call_testrunner(
     os << "\n" << std::flush;
 }
 
+template <template <typename Type> class TestClass>
+void TestFactory_Pages<TestClass>::call_testrunner(
+    std::ostream& os, unsigned int items)
+{
+    os << items << " " << std::flush;
+
+    testrunner_loop<BtreeMap<stx::btree_small_pages> >(os, items);
+    testrunner_loop<BtreeMap<stx::btree_transparent_huge_pages> >(os, items);
+    testrunner_loop<BtreeMap<stx::btree_hugetlb_pages> >(os, items);
+
+    os << "\n" << std::flush;
+}
+
 /// Speed test them!
 int main()
 {
@@ -501,6 +619,30 @@ int main()
         }
     }
 
+    {   // Map - speed test batched find only
+        std::ofstream os("speed-map-findbatch.txt");
+
+        repeatuntil = minitems;
+
+        for (unsigned int items = minitems; items <= maxitems; items *= 2)
+        {
+            std::cerr << "map: find batch " << items << "\n";
+            TestFactory_Map<Test_Map_FindBatch>().call_testrunner(os, items);
+        }
+    }
+
+    {   // Map - speed test find only with node slabs on base or huge pages
+        std::ofstream os("speed-map-find-pages.txt");
+
+        repeatuntil = minitems;
+
+        for (unsigned int items = minitems; items <= maxitems; items *= 2)
+        {
+            std::cerr << "map: find on pages " << items << "\n";
+            TestFactory_Pages<Test_Map_Find>().call_testrunner(os, items);
+        }
+    }
+
     return 0;
 }
 
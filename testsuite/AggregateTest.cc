@@ -0,0 +1,411 @@
+/*******************************************************************************
+ * testsuite/AggregateTest.cc
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <stx/btree_multiset.h>
+#include <stx/btree_multimap.h>
+#include <stx/btree_map.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include "tpunit.h"
+#include "TestTraits.h"
+
+/// Sum and maximum of the data, and the first and last key, which detect
+/// summaries combined out of order.
+struct test_aggregate
+{
+    static const bool enabled = true;
+
+    struct summary_type
+    {
+        unsigned int count;
+        unsigned long long sum;
+        unsigned int max;
+        unsigned int first, last;
+        bool ordered;
+
+        bool operator == (const summary_type& o) const
+        {
+            return count == o.count && (count == 0 ||
+                                        (sum == o.sum && max == o.max &&
+                                         first == o.first && last == o.last &&
+                                         ordered == o.ordered));
+        }
+    };
+
+    static summary_type identity()
+    {
+        summary_type s;
+        s.count = 0;
+        s.sum = s.max = s.first = s.last = 0;
+        s.ordered = true;
+        return s;
+    }
+
+    static summary_type combine(const summary_type& a, const summary_type& b)
+    {
+        if (a.count == 0) return b;
+        if (b.count == 0) return a;
+
+        summary_type s;
+        s.count = a.count + b.count;
+        s.sum = a.sum + b.sum;
+        s.max = std::max(a.max, b.max);
+        s.first = a.first;
+        s.last = b.last;
+        s.ordered = a.ordered && b.ordered && a.last <= b.first;
+        return s;
+    }
+
+    static summary_type summarize(const unsigned int& key, const unsigned int& data)
+    {
+        summary_type s;
+        s.count = 1;
+        s.sum = s.max = data;
+        s.first = s.last = key;
+        s.ordered = true;
+        return s;
+    }
+
+    /// Sets have no data, the key counts instead.
+    template <typename Data>
+    static summary_type summarize(const unsigned int& key, const Data&)
+    {
+        return summarize(key, key);
+    }
+};
+
+struct AggregateTest : public tpunit::TestFixture
+{
+    AggregateTest() : tpunit::TestFixture(
+                          TEST(AggregateTest::test_map_random),
+                          TEST(AggregateTest::test_batch_operations),
+                          TEST(AggregateTest::test_assign),
+                          TEST(AggregateTest::test_set)
+                          )
+    { }
+
+    template <typename KeyType, bool Special, int Slots, bool Counts = false>
+    struct traits_aggregate : traits_special<KeyType, Special, Slots>
+    {
+        static const bool order_statistics = Counts;
+
+        typedef test_aggregate aggregate;
+    };
+
+    typedef test_aggregate::summary_type summary_type;
+
+    /// Summarizes the pairs of the std::multimap in [lower,upper).
+    template <typename MapType>
+    static summary_type reference(const MapType& map, unsigned int lower, unsigned int upper)
+    {
+        summary_type s = test_aggregate::identity();
+
+        for (typename MapType::const_iterator it = map.lower_bound(lower);
+             it != map.end() && it->first < upper; ++it)
+        {
+            s = test_aggregate::combine(s, test_aggregate::summarize(it->first, it->second));
+        }
+
+        return s;
+    }
+
+    /// Verifies the cached summaries and compares aggregate() over random
+    /// key ranges.
+    template <typename BtreeType, typename MapType>
+    void check_aggregate(const BtreeType& bt, const MapType& map, unsigned int mod)
+    {
+        bt.verify();
+        ASSERT(bt.size() == map.size());
+
+        ASSERT(bt.aggregate() == reference(map, 0, mod + 1));
+        ASSERT(bt.aggregate().ordered);
+
+        for (unsigned int i = 0; i < 20; ++i)
+        {
+            unsigned int lower = rand() % (mod + 1);
+            unsigned int upper = lower + rand() % (i < 10 ? 50 : mod);
+
+            summary_type s = bt.aggregate(lower, upper);
+            ASSERT(s == reference(map, lower, upper));
+            ASSERT(s.ordered);
+        }
+
+        ASSERT(bt.aggregate(7, 7).count == 0);
+    }
+
+    /// Random inserts, erases and data updates in a multimap. Pairs with
+    /// equal keys carry equal data, so their order does not matter.
+    template <bool Special, int Slots, bool Counts>
+    void test_map_random_instance(unsigned int numkeys, unsigned int mod)
+    {
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_aggregate<unsigned int, Special, Slots, Counts> > btree_type;
+
+        btree_type bt;
+        std::multimap<unsigned int, unsigned int> map;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+        {
+            unsigned int k = rand() % mod, d = rand() % 1000;
+            if (map.find(k) != map.end()) d = map.find(k)->second;
+            bt.insert2(k, d);
+            map.insert(std::make_pair(k, d));
+
+            if (i % 200 == 0) check_aggregate(bt, map, mod);
+        }
+
+        // sequential inserts at the end take the append path
+        for (unsigned int i = 0; i < numkeys / 4; i++)
+        {
+            bt.insert2(mod + i, i);
+            map.insert(std::make_pair(mod + i, i));
+        }
+        mod += numkeys / 4;
+        check_aggregate(bt, map, mod);
+
+        while (!map.empty())
+        {
+            unsigned int k = rand() % mod;
+
+            switch (rand() % 3)
+            {
+            case 0:
+                // erase the last pair with the key
+                if (map.find(k) != map.end()) {
+                    typename btree_type::iterator bi = bt.upper_bound(k);
+                    bt.erase(--bi);
+                    map.erase(map.find(k));
+                }
+                break;
+            case 1:
+                if (map.find(k) != map.end()) {
+                    ASSERT(bt.erase_one(k));
+                    map.erase(map.find(k));
+                }
+                break;
+            case 2:
+                if (map.find(k) != map.end()) {
+                    unsigned int d = rand() % 1000;
+                    for (typename btree_type::iterator bi = bt.lower_bound(k);
+                         bi != bt.upper_bound(k); ++bi)
+                    {
+                        bt.assign(bi, d);
+                    }
+                    for (std::multimap<unsigned int, unsigned int>::iterator mi = map.lower_bound(k);
+                         mi != map.upper_bound(k); ++mi)
+                        mi->second = d;
+                }
+                break;
+            }
+
+            if (map.size() % 200 == 0) check_aggregate(bt, map, mod);
+        }
+
+        check_aggregate(bt, map, mod);
+    }
+
+    void test_map_random()
+    {
+        test_map_random_instance<false, 4, false>(3200, 1000);
+        test_map_random_instance<true, 4, true>(3200, 100000);
+        test_map_random_instance<false, 8, true>(3200, 300);
+        test_map_random_instance<true, 5, false>(3200, 100000);
+    }
+
+    /// Range erase, sorted batches, merging, bulk loading, compaction,
+    /// splitting and joining, copying and restoring.
+    template <bool Special, int Slots>
+    void test_batch_operations_instance()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_aggregate<unsigned int, Special, Slots> > btree_type;
+
+        const unsigned int mod = 20000;
+
+        btree_type bt;
+        std::map<unsigned int, unsigned int> map;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 5000; i++)
+        {
+            unsigned int k = rand() % mod;
+            map.insert(std::make_pair(k, rand() % 1000));
+        }
+
+        std::vector<std::pair<unsigned int, unsigned int> > pairs(map.begin(), map.end());
+        bt.bulk_load(pairs.begin(), pairs.end(), 0.8, 0.8);
+        check_aggregate(bt, map, mod);
+
+        for (unsigned int round = 0; round < 20; ++round)
+        {
+            // erase a key range
+            unsigned int lower = rand() % mod, upper = lower + rand() % 1000;
+            map.erase(map.lower_bound(lower), map.lower_bound(upper));
+            bt.erase(lower, upper);
+            check_aggregate(bt, map, mod);
+
+            // erase a sorted batch
+            std::vector<unsigned int> batch;
+            for (unsigned int k = rand() % 10; k < mod; k += 1 + rand() % 60)
+                batch.push_back(k);
+            for (unsigned int i = 0; i < batch.size(); ++i)
+                map.erase(batch[i]);
+            bt.erase_sorted(batch.begin(), batch.end());
+            check_aggregate(bt, map, mod);
+
+            // merge a sorted batch, overwriting the data of existing keys
+            std::map<unsigned int, unsigned int> merge;
+            for (unsigned int n = 10 + rand() % 500; n > 0; --n)
+                merge[rand() % mod] = rand() % 1000;
+            bt.merge_sorted(merge.begin(), merge.end(), stx::btree_merge_overwrite);
+            for (std::map<unsigned int, unsigned int>::const_iterator it = merge.begin();
+                 it != merge.end(); ++it)
+                map[it->first] = it->second;
+            check_aggregate(bt, map, mod);
+
+            // split and join again
+            btree_type right;
+            unsigned int key = rand() % mod;
+            bt.split_at(key, right);
+            ASSERT(bt.aggregate() == reference(map, 0, key));
+            ASSERT(right.aggregate() == reference(map, key, mod));
+            right.verify();
+            bt.join(right);
+            check_aggregate(bt, map, mod);
+        }
+
+        typename btree_type::compact_state state;
+        while (!bt.compact_step(state, 4)) { }
+        check_aggregate(bt, map, mod);
+
+        bt.compact(0.7);
+        check_aggregate(bt, map, mod);
+
+        btree_type copy(bt);
+        check_aggregate(copy, map, mod);
+
+        std::ostringstream os;
+        bt.dump(os);
+        btree_type restored;
+        std::istringstream is(os.str());
+        ASSERT(restored.restore(is));
+        check_aggregate(restored, map, mod);
+    }
+
+    void test_batch_operations()
+    {
+        test_batch_operations_instance<false, 4>();
+        test_batch_operations_instance<true, 4>();
+        test_batch_operations_instance<true, 8>();
+    }
+
+    /// Assigns data by key in a map and by iterator inside a run of
+    /// thousands of equal keys in a multimap.
+    template <bool Special, int Slots>
+    void test_assign_instance()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_aggregate<unsigned int, Special, Slots> > map_type;
+
+        map_type bt;
+        std::map<unsigned int, unsigned int> map;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 3000; i++)
+        {
+            unsigned int k = rand() % 2000, d = rand() % 1000;
+            typename map_type::iterator it = bt.assign(k, d);
+            ASSERT(it.key() == k && it.data() == d);
+            map[k] = d;
+        }
+        check_aggregate(bt, map, 2000);
+
+        // operator[] reads data, and inserts missing keys with summaries
+        for (unsigned int k = 0; k < 2100; k += 7)
+        {
+            unsigned int d = bt[k];
+            ASSERT(d == map[k]);
+        }
+        check_aggregate(bt, map, 2100);
+
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_aggregate<unsigned int, Special, Slots, true> > multimap_type;
+
+        std::vector<std::pair<unsigned int, unsigned int> > pairs;
+        std::multimap<unsigned int, unsigned int> multimap;
+        for (unsigned int i = 0; i < 5200; i++)
+        {
+            unsigned int k = (i < 100) ? 3 : (i < 5100) ? 7 : 9;
+            pairs.push_back(std::make_pair(k, i));
+            multimap.insert(pairs.back());
+        }
+
+        multimap_type mbt;
+        mbt.bulk_load(pairs.begin(), pairs.end());
+
+        for (unsigned int i = 0; i < 500; i++)
+        {
+            unsigned int k = rand() % pairs.size(), d = rand() % 1000;
+            mbt.assign(mbt.select(k), d);
+
+            std::multimap<unsigned int, unsigned int>::iterator mi = multimap.begin();
+            std::advance(mi, k);
+            mi->second = d;
+        }
+        check_aggregate(mbt, multimap, 10);
+    }
+
+    void test_assign()
+    {
+        test_assign_instance<false, 4>();
+        test_assign_instance<true, 5>();
+        test_assign_instance<true, 16>();
+    }
+
+    /// Sets summarize their keys.
+    void test_set()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_aggregate<unsigned int, false, 6> > btree_type;
+
+        btree_type bt;
+
+        for (unsigned int i = 0; i < 10000; i++)
+            bt.insert(i / 2);
+
+        summary_type s = bt.aggregate(1000, 3000);
+        ASSERT(s.count == 4000 && s.sum == 2 * (3000ULL * 2999 / 2 - 1000ULL * 999 / 2));
+        ASSERT(s.first == 1000 && s.last == 2999 && s.max == 2999 && s.ordered);
+
+        bt.erase(1500, 2500);
+        bt.verify();
+
+        s = bt.aggregate(1000, 3000);
+        ASSERT(s.count == 2000 && s.first == 1000 && s.last == 2999 && s.ordered);
+    }
+} _AggregateTest;
+
+/******************************************************************************/
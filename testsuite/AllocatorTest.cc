@@ -0,0 +1,492 @@
+/*******************************************************************************
+ * testsuite/AllocatorTest.cc
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <stx/btree_multimap.h>
+
+#include <cstdlib>
+#include <map>
+#include <ostream>
+#include <vector>
+
+#include "tpunit.h"
+
+struct AllocatorTest : public tpunit::TestFixture
+{
+    AllocatorTest() : tpunit::TestFixture(
+                          TEST(AllocatorTest::test_slab_pool),
+                          TEST(AllocatorTest::test_pool_allocator),
+                          TEST(AllocatorTest::test_node_pool),
+                          TEST(AllocatorTest::test_parallel_copy),
+                          TEST(AllocatorTest::test_clear),
+                          TEST(AllocatorTest::test_huge_page)
+                          )
+    { }
+
+    template <typename KeyType, typename DataType, bool NodePool>
+    struct traits_nodebug : stx::btree_default_map_traits<KeyType, DataType>
+    {
+        static const bool selfverify = true;
+        static const bool debug = false;
+
+        static const int  leafslots = 8;
+        static const int  innerslots = 8;
+
+        static const bool node_pool = NodePool;
+    };
+
+    template <bool NodePool, unsigned int CopyThreads>
+    struct traits_copy : stx::btree_default_map_traits<unsigned int, unsigned int>
+    {
+        static const bool selfverify = false;
+        static const bool debug = false;
+
+        static const int  leafslots = 8;
+        static const int  innerslots = 8;
+
+        static const bool node_pool = NodePool;
+        static const bool order_statistics = true;
+
+        static const unsigned int copy_threads = CopyThreads;
+    };
+
+    /// Number of live allocations of counting_allocator
+    static long alloc_live;
+
+    /// Base allocator counting its live allocations
+    template <typename Type>
+    struct counting_allocator : public std::allocator<Type>
+    {
+        template <typename Other>
+        struct rebind
+        {
+            typedef counting_allocator<Other> other;
+        };
+
+        counting_allocator()
+        { }
+
+        template <typename Other>
+        counting_allocator(const counting_allocator<Other>&)
+        { }
+
+        Type * allocate(size_t n, const void* = NULL)
+        {
+            ++alloc_live;
+            return std::allocator<Type>::allocate(n);
+        }
+
+        void deallocate(Type* p, size_t n)
+        {
+            --alloc_live;
+            std::allocator<Type>::deallocate(p, n);
+        }
+    };
+
+    /// Key type counting its live instances
+    struct counted_key
+    {
+        static long live;
+
+        unsigned int x;
+
+        counted_key(unsigned int _x = 0) : x(_x)
+        {
+            ++live;
+        }
+
+        counted_key(const counted_key& o) : x(o.x)
+        {
+            ++live;
+        }
+
+        ~counted_key()
+        {
+            --live;
+        }
+
+        counted_key& operator = (const counted_key& o)
+        {
+            x = o.x;
+            return *this;
+        }
+
+        bool operator < (const counted_key& b) const
+        {
+            return x < b.x;
+        }
+
+        friend std::ostream& operator << (std::ostream& os, const counted_key& k)
+        {
+            return os << k.x;
+        }
+    };
+
+    void test_slab_pool()
+    {
+        typedef stx::btree_slab_pool<> pool_type;
+
+        pool_type pool;
+        std::vector<char*> small, large;
+
+        for (unsigned int i = 0; i < 1000; ++i)
+        {
+            small.push_back(static_cast<char*>(pool.allocate(48)));
+            large.push_back(static_cast<char*>(pool.allocate(400)));
+
+            // objects are aligned and do not overlap
+            ASSERT(reinterpret_cast<size_t>(small.back()) % 16 == 0);
+            ASSERT(reinterpret_cast<size_t>(large.back()) % 16 == 0);
+            std::fill(small.back(), small.back() + 48, 1);
+            std::fill(large.back(), large.back() + 400, 2);
+        }
+
+        for (unsigned int i = 0; i < 1000; ++i)
+        {
+            ASSERT(std::count(small[i], small[i] + 48, 1) == 48);
+            ASSERT(std::count(large[i], large[i] + 400, 2) == 400);
+        }
+
+        // slabs grow geometrically, so only few are needed
+        size_t slabs = pool.slabs();
+        ASSERT(slabs < 20);
+        ASSERT(pool.slab_bytes() >= 1000 * (48 + 400));
+
+        // freed objects are reused
+        for (unsigned int i = 0; i < 1000; ++i)
+            pool.deallocate(large[i], 400);
+
+        for (unsigned int i = 0; i < 1000; ++i)
+            ASSERT(pool.allocate(400) == large[999 - i]);
+
+        ASSERT(pool.slabs() == slabs);
+
+        // other sizes pass through to the base allocator
+        void* odd[4];
+        for (unsigned int i = 0; i < 4; ++i)
+            odd[i] = pool.allocate(100 + i);
+        for (unsigned int i = 0; i < 4; ++i)
+            pool.deallocate(odd[i], 100 + i);
+
+        pool.release();
+        ASSERT(pool.slabs() == 0 && pool.slab_bytes() == 0);
+
+        // adopting the slabs of another pool keeps its objects valid
+        pool_type other;
+        for (unsigned int i = 0; i < 1000; ++i)
+        {
+            small[i] = static_cast<char*>(other.allocate(48));
+            std::fill(small[i], small[i] + 48, 3);
+        }
+        other.deallocate(small[0], 48);
+
+        slabs = other.slabs();
+        ASSERT(pool.adopt(other));
+        ASSERT(pool.slabs() == slabs && other.slabs() == 0);
+
+        ASSERT(pool.allocate(48) == small[0]);
+        for (unsigned int i = 1; i < 1000; ++i)
+        {
+            ASSERT(std::count(small[i], small[i] + 48, 3) == 48);
+            pool.deallocate(small[i], 48);
+        }
+        ASSERT(pool.allocate(48) == small[999]);
+    }
+
+    /// Fills a map with random items, erases half of them and compares it
+    /// to std::multimap.
+    template <typename MapType>
+    void test_map(MapType& bt, unsigned int num)
+    {
+        std::multimap<unsigned int, unsigned int> map;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < num; i++)
+        {
+            unsigned int k = rand() % 1000;
+            bt.insert2(k, i);
+            map.insert(std::make_pair(k, i));
+        }
+
+        srand(34234235);
+        for (unsigned int i = 0; i < num / 2; i++)
+        {
+            unsigned int k = rand() % 1000;
+            ASSERT(bt.erase_one(k));
+            map.erase(map.find(k));
+        }
+
+        ASSERT(bt.size() == map.size());
+
+        typename MapType::const_iterator bi = bt.begin();
+        for (std::multimap<unsigned int, unsigned int>::const_iterator mi = map.begin();
+             mi != map.end(); ++mi, ++bi)
+        {
+            ASSERT(bi.key() == mi->first);
+        }
+    }
+
+    void test_pool_allocator()
+    {
+        typedef stx::btree_pool_allocator<std::pair<unsigned int, unsigned int> > alloc_type;
+
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_nodebug<unsigned int, unsigned int, false>,
+                                    alloc_type> btree_type;
+
+        btree_type bt;
+        test_map(bt, 3200);
+
+        // all nodes of the tree come from few slabs
+        alloc_type alloc = bt.get_allocator();
+        ASSERT(alloc.pool()->slabs() > 0);
+        ASSERT(alloc.pool()->slabs() < 10);
+        ASSERT(alloc == bt.get_allocator());
+
+        // copies share the pool
+        btree_type bt2 = bt;
+        ASSERT(bt2 == bt);
+        ASSERT(bt2.get_allocator() == alloc);
+
+        btree_type bt3;
+        ASSERT(bt3.get_allocator() != alloc);
+        bt3 = bt;
+        bt3.swap(bt2);
+        bt3.clear();
+        ASSERT(bt2 == bt);
+
+        // the allocator also works for arrays in other containers
+        std::vector<unsigned int, stx::btree_pool_allocator<unsigned int> > vec;
+        for (unsigned int i = 0; i < 10000; ++i)
+            vec.push_back(i);
+        ASSERT(vec[9999] == 9999);
+    }
+
+    void test_node_pool()
+    {
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_nodebug<unsigned int, unsigned int, true> > btree_type;
+
+        btree_type bt;
+        test_map(bt, 3200);
+
+        btree_type bt2 = bt, bt3;
+        ASSERT(bt2 == bt);
+
+        bt3 = bt2;
+        bt2.clear();
+        bt3.swap(bt2);
+        ASSERT(bt2 == bt && bt3.empty());
+
+        test_map(bt3, 3200);
+
+        // join() takes over the pool of the appended tree, whose nodes stay
+        // valid after it is destroyed
+        size_t size = bt3.size();
+        {
+            btree_type right;
+            for (unsigned int i = 0; i < 2000; i++)
+                right.insert2(1000 + i, i);
+
+            bt3.join(right);
+            ASSERT(right.empty());
+        }
+
+        ASSERT(bt3.size() == size + 2000);
+        ASSERT(bt3.erase(1000, 2000) == 1000);
+        bt3.verify();
+        ASSERT(bt3.size() == size + 1000);
+    }
+
+    /// Copies trees on several threads, by the copy constructor and the
+    /// assignment operator.
+    template <bool NodePool, unsigned int CopyThreads>
+    void test_parallel_copy_instance(unsigned int num)
+    {
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_copy<NodePool, CopyThreads> > btree_type;
+
+        btree_type bt;
+        test_map(bt, num);
+
+        btree_type bt2 = bt;
+        bt2.verify();
+        ASSERT(bt2 == bt);
+        ASSERT(bt2.get_stats().leaves == bt.get_stats().leaves);
+        ASSERT(bt2.get_stats().innernodes == bt.get_stats().innernodes);
+
+        // the leaf chain of the copy runs across the parts of the threads
+        typename btree_type::const_reverse_iterator ri = bt2.rbegin();
+        for (typename btree_type::const_reverse_iterator oi = bt.rbegin();
+             oi != bt.rend(); ++oi, ++ri)
+        {
+            ASSERT(ri.key() == oi.key() && ri.data() == oi.data());
+        }
+        ASSERT(ri == bt2.rend());
+
+        btree_type bt3;
+        bt3.insert2(1, 2);
+        bt3 = bt;
+        bt3.verify();
+        ASSERT(bt3 == bt);
+
+        // the copies are independent of the original
+        bt.clear();
+        bt2.insert2(5, 5);
+        bt3.erase(100, 900);
+        bt2.verify();
+        bt3.verify();
+        ASSERT(bt2.size() == num / 2 + 1);
+        ASSERT(bt3.size() < num / 2);
+    }
+
+    void test_parallel_copy()
+    {
+        test_parallel_copy_instance<false, 4>(100);
+        test_parallel_copy_instance<false, 4>(100000);
+        test_parallel_copy_instance<true, 3>(100000);
+        test_parallel_copy_instance<false, 0>(50000);
+
+        // all nodes are freed again
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_copy<false, 4>,
+                                    counting_allocator<std::pair<unsigned int, unsigned int> > >
+            btree_type;
+
+        alloc_live = 0;
+        {
+            btree_type bt;
+            test_map(bt, 50000);
+
+            btree_type bt2 = bt;
+            ASSERT(bt2 == bt);
+        }
+        ASSERT(alloc_live == 0);
+    }
+
+    /// Fills a tree with counted keys, clears it and checks that all keys
+    /// were destroyed, then reuses it.
+    template <bool NodePool>
+    void test_clear_counted()
+    {
+        typedef stx::btree_multimap<counted_key, unsigned int, std::less<counted_key>,
+                                    traits_nodebug<counted_key, unsigned int, NodePool> >
+            btree_type;
+
+        {
+            btree_type bt;
+            long live = counted_key::live;
+
+            for (unsigned int i = 0; i < 20000; ++i)
+                bt.insert2(counted_key(rand() % 1000), i);
+
+            ASSERT(bt.get_stats().innernodes > 100);
+
+            bt.clear();
+            ASSERT(counted_key::live == live);
+            ASSERT(bt.empty() && bt.get_stats().nodes() == 0);
+
+            for (unsigned int i = 0; i < 1000; ++i)
+                bt.insert2(counted_key(i), i);
+
+            ASSERT(bt.size() == 1000 && bt.begin().key().x == 0);
+        }
+
+        ASSERT(counted_key::live == 0);
+    }
+
+    void test_clear()
+    {
+        // trivial keys in the tree's node pool: clear() releases the slabs
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_nodebug<unsigned int, unsigned int, true>,
+                                    counting_allocator<std::pair<unsigned int, unsigned int> > >
+            btree_type;
+
+        {
+            btree_type bt;
+            test_map(bt, 20000);
+
+            ASSERT(alloc_live > 0);
+            ASSERT(static_cast<size_t>(alloc_live) < bt.get_stats().nodes() / 10);
+
+            bt.clear();
+            ASSERT(alloc_live == 0);
+            ASSERT(bt.empty() && bt.get_stats().nodes() == 0);
+
+            test_map(bt, 3200);
+        }
+
+        ASSERT(alloc_live == 0);
+
+        // non-trivial keys are destroyed by the sweep
+        test_clear_counted<true>();
+        test_clear_counted<false>();
+    }
+
+    /// Maps huge pages in one mode and builds a tree with its nodes on them.
+    template <stx::btree_page_mode Mode>
+    void test_huge_page_mode()
+    {
+        typedef stx::btree_huge_page_allocator<char, Mode> alloc_type;
+        alloc_type alloc;
+
+        // large allocations are aligned to huge pages
+        size_t bytes = 3 * alloc_type::huge_page_size;
+        char* p = alloc.allocate(bytes);
+        ASSERT(reinterpret_cast<size_t>(p) % alloc_type::huge_page_size == 0);
+        std::fill(p, p + bytes, 1);
+        ASSERT(std::count(p, p + bytes, 1) == static_cast<long>(bytes));
+        alloc.deallocate(p, bytes);
+
+        // small ones are passed to operator new
+        p = alloc.allocate(100);
+        std::fill(p, p + 100, 2);
+        alloc.deallocate(p, 100);
+
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_nodebug<unsigned int, unsigned int, true>,
+                                    stx::btree_huge_page_allocator<
+                                        std::pair<unsigned int, unsigned int>, Mode> >
+            btree_type;
+
+        btree_type bt;
+        test_map(bt, 20000);
+
+        btree_type bt2 = bt;
+        ASSERT(bt2 == bt);
+    }
+
+    void test_huge_page()
+    {
+        // slabs are single huge pages
+        ASSERT(stx::btree_slab_pool<stx::btree_huge_page_allocator<char> >::min_slab_size
+               == stx::btree_huge_page_allocator<char>::huge_page_size);
+
+        test_huge_page_mode<stx::btree_small_pages>();
+        test_huge_page_mode<stx::btree_transparent_huge_pages>();
+        test_huge_page_mode<stx::btree_hugetlb_pages>();
+    }
+} _AllocatorTest;
+
+long AllocatorTest::alloc_live = 0;
+
+long AllocatorTest::counted_key::live = 0;
+
+/******************************************************************************/
@@ -19,19 +19,30 @@
  ******************************************************************************/
 
 #include <stx/btree_multiset.h>
+#include <stx/btree_set.h>
 #include <stx/btree_multimap.h>
 #include <stx/btree_map.h>
 
 #include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
 #include <vector>
 
 #include "tpunit.h"
+#include "TestTraits.h"
 
 struct BulkLoadTest : public tpunit::TestFixture
 {
     BulkLoadTest() : tpunit::TestFixture(
                          TEST(BulkLoadTest::test_set),
-                         TEST(BulkLoadTest::test_map)
+                         TEST(BulkLoadTest::test_map),
+                         TEST(BulkLoadTest::test_fill),
+                         TEST(BulkLoadTest::test_parallel),
+                         TEST(BulkLoadTest::test_unsorted),
+                         TEST(BulkLoadTest::test_merge),
+                         TEST(BulkLoadTest::test_compact),
+                         TEST(BulkLoadTest::test_compact_step)
                          )
     { }
 
@@ -117,6 +128,526 @@ struct BulkLoadTest : public tpunit::TestFixture
         test_map_instance(32000, 10000);
         test_map_instance(117649, 100000);
     }
+
+    template <bool Special>
+    void test_fill_instance(unsigned int numkeys, double leaf_fill,
+                            double inner_fill)
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, Special, 8> > btree_type;
+
+        std::vector<unsigned int> keys(numkeys);
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+            keys[i] = rand() % 1000000;
+
+        std::sort(keys.begin(), keys.end());
+
+        btree_type full, bt;
+        full.bulk_load(keys.begin(), keys.end());
+        bt.bulk_load(keys.begin(), keys.end(), leaf_fill, inner_fill);
+        bt.verify();
+
+        ASSERT(bt.size() == numkeys);
+        ASSERT(std::equal(keys.begin(), keys.end(), bt.begin()));
+
+        if (numkeys < 1000) return;
+
+        const typename btree_type::tree_stats& bt_stats = bt.get_stats();
+        ASSERT(bt_stats.avgfill_leaves() > leaf_fill - 0.05);
+        ASSERT(bt_stats.avgfill_leaves() < leaf_fill + 0.05);
+
+        // random inserts split far fewer leaves than in a full tree
+        size_t full_leaves = full.get_stats().leaves;
+        size_t bt_leaves = bt_stats.leaves;
+
+        for (unsigned int i = 0; i < numkeys / 16; i++)
+        {
+            unsigned int k = rand() % 1000000;
+            full.insert(k);
+            bt.insert(k);
+        }
+        bt.verify();
+
+        ASSERT(full.size() == bt.size());
+        ASSERT((bt_stats.leaves - bt_leaves) * 4 < full.get_stats().leaves - full_leaves);
+    }
+
+    void test_fill()
+    {
+        for (unsigned int n = 0; n < 1000; ++n) {
+            test_fill_instance<false>(n, 0.5, 0.5);
+            test_fill_instance<true>(n, 0.7, 0.0);
+        }
+
+        test_fill_instance<false>(32000, 0.5, 0.5);
+        test_fill_instance<false>(32000, 0.75, 1.0);
+        test_fill_instance<true>(32000, 0.625, 0.75);
+    }
+
+    /// Loads sorted keys on several threads and compares with the
+    /// sequential bulk_load().
+    template <typename KeyType, bool Special>
+    void test_parallel_instance(unsigned int numkeys, unsigned int mod,
+                                double fill, unsigned int threads)
+    {
+        typedef stx::btree_multiset<KeyType, std::less<KeyType>,
+                                    traits_special<KeyType, Special, 8> > btree_type;
+
+        std::vector<KeyType> keys(numkeys);
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+            keys[i] = make_test_key<KeyType>(rand() % mod);
+
+        std::sort(keys.begin(), keys.end());
+
+        btree_type seq, bt;
+        seq.bulk_load(keys.begin(), keys.end(), fill, fill);
+        bt.parallel_bulk_load(keys.begin(), keys.end(), fill, fill, threads);
+        bt.verify();
+
+        ASSERT(bt.size() == numkeys);
+        ASSERT(std::equal(keys.begin(), keys.end(), bt.begin()));
+        ASSERT(bt.get_stats().leaves == seq.get_stats().leaves);
+
+        // the leaf chain runs across the parts of the threads
+        if (numkeys > 0) {
+            typename btree_type::const_reverse_iterator ri = bt.rbegin();
+            for (unsigned int i = numkeys; i > 0; --i, ++ri)
+                ASSERT(*ri == keys[i - 1]);
+        }
+
+        for (unsigned int i = 0; i < numkeys / 16; i++)
+            bt.insert(make_test_key<KeyType>(rand() % mod));
+        bt.verify();
+    }
+
+    void test_parallel()
+    {
+        for (unsigned int n = 0; n < 300; ++n)
+            test_parallel_instance<unsigned int, false>(n, 1000, 1.0, 4);
+
+        test_parallel_instance<unsigned int, false>(100000, 1000000, 1.0, 4);
+        test_parallel_instance<unsigned int, true>(100000, 100, 0.7, 3);
+        test_parallel_instance<unsigned int, false>(50000, 1000000, 0.5, 0);
+        test_parallel_instance<std::string, true>(50000, 1000000, 0.8, 5);
+
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_special<unsigned int, true, 8> > btree_type;
+
+        std::vector<std::pair<unsigned int, unsigned int> > pairs;
+        for (unsigned int i = 0; i < 50000; i++)
+            pairs.push_back(std::make_pair(2 * i, i));
+
+        btree_type bt;
+        bt.parallel_bulk_load(pairs.begin(), pairs.end(), 2);
+        bt.verify();
+
+        ASSERT(bt.size() == pairs.size());
+        for (unsigned int i = 0; i < 50000; i += 7)
+            ASSERT(bt.find(2 * i) != bt.end() && bt.find(2 * i).data() == i);
+    }
+
+    /// Builds all four containers from unsorted pairs and compares them with
+    /// the trees inserting the pairs one by one.
+    template <bool Special>
+    void test_unsorted_instance(unsigned int numkeys, unsigned int mod,
+                                unsigned int threads)
+    {
+        typedef traits_special<unsigned int, Special, 8> traits_type;
+
+        std::vector<std::pair<unsigned int, unsigned int> > pairs(numkeys);
+        std::vector<unsigned int> keys(numkeys);
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+        {
+            pairs[i] = std::make_pair(rand() % mod, i);
+            keys[i] = pairs[i].first;
+        }
+
+        {
+            typedef stx::btree_set<unsigned int, std::less<unsigned int>,
+                                   traits_type> btree_type;
+            btree_type bt;
+            bt.build_from_unsorted(keys.begin(), keys.end(), threads);
+            bt.verify();
+            ASSERT(bt == btree_type(keys.begin(), keys.end()));
+        }
+        {
+            typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                        traits_type> btree_type;
+            btree_type bt;
+            bt.build_from_unsorted(keys.begin(), keys.end(), threads);
+            bt.verify();
+            ASSERT(bt.size() == numkeys);
+            ASSERT(bt == btree_type(keys.begin(), keys.end()));
+        }
+        {
+            typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                                   traits_type> btree_type;
+            btree_type bt;
+            bt.build_from_unsorted(pairs.begin(), pairs.end(), threads);
+            bt.verify();
+            ASSERT(bt == btree_type(pairs.begin(), pairs.end()));
+        }
+        {
+            // pairs with equal keys stay in input order
+            typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                        traits_type> btree_type;
+            btree_type bt;
+            bt.build_from_unsorted(pairs.begin(), pairs.end(), threads);
+            bt.verify();
+
+            std::stable_sort(pairs.begin(), pairs.end(), pair_less_first);
+            ASSERT(bt.size() == numkeys);
+            ASSERT(std::equal(pairs.begin(), pairs.end(), bt.begin()));
+        }
+    }
+
+    void test_unsorted()
+    {
+        for (unsigned int n = 0; n < 200; ++n)
+            test_unsorted_instance<false>(n, 100, 2);
+
+        test_unsorted_instance<false>(100000, 1000000, 4);
+        test_unsorted_instance<true>(100000, 1000, 7);
+        test_unsorted_instance<false>(100000, 10, 3);
+        test_unsorted_instance<true>(50000, 100000, 0);
+    }
+
+    static bool pair_less_first(const std::pair<unsigned int, unsigned int>& a,
+                                const std::pair<unsigned int, unsigned int>& b)
+    {
+        return a.first < b.first;
+    }
+
+    /// Merges a sorted batch with equal keys into a tree of unique keys and
+    /// checks the result against a std::map or std::multimap.
+    template <typename BtreeType, typename MapType>
+    void test_merge_instance(unsigned int numkeys, unsigned int numitems,
+                             unsigned int mod, stx::btree_merge_policy policy)
+    {
+        typedef std::pair<unsigned int, unsigned int> pair_type;
+
+        BtreeType bt;
+        MapType map;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+        {
+            unsigned int k = rand() % mod;
+            if (map.find(k) != map.end()) continue;
+            bt.insert2(k, i);
+            map.insert(pair_type(k, i));
+        }
+
+        std::vector<pair_type> batch(numitems);
+        for (unsigned int i = 0; i < numitems; i++)
+            batch[i] = pair_type(rand() % mod, numkeys + i);
+
+        std::stable_sort(batch.begin(), batch.end(), pair_less_first);
+
+        size_t inserted = 0;
+        for (unsigned int i = 0; i < numitems; i++)
+        {
+            typename MapType::iterator it = map.find(batch[i].first);
+
+            if (policy == stx::btree_merge_duplicates || it == map.end()) {
+                map.insert(batch[i]);
+                ++inserted;
+            }
+            else if (policy == stx::btree_merge_overwrite) {
+                it->second = batch[i].second;
+            }
+        }
+
+        ASSERT(bt.merge_sorted(batch.begin(), batch.end(), policy) == inserted);
+        bt.verify();
+
+        ASSERT(bt.size() == map.size());
+
+        // leaves split by the merge keep the default slack of 1/4
+        if (numkeys == 0 && numitems != 0)
+            ASSERT(bt.get_stats().avgfill_leaves() <= 0.75);
+
+        std::vector<pair_type> result(bt.begin(), bt.end());
+        std::vector<pair_type> expect(map.begin(), map.end());
+        std::sort(result.begin(), result.end());
+        std::sort(expect.begin(), expect.end());
+        ASSERT(result == expect);
+    }
+
+    template <typename BtreeType, typename MapType>
+    void test_merge_sizes(stx::btree_merge_policy policy)
+    {
+        // empty trees, single leaves, and batches much smaller and larger
+        // than the tree, which split leaves into long runs.
+        test_merge_instance<BtreeType, MapType>(0, 0, 100, policy);
+        test_merge_instance<BtreeType, MapType>(0, 1000, 100, policy);
+        test_merge_instance<BtreeType, MapType>(5, 3, 10, policy);
+        test_merge_instance<BtreeType, MapType>(1000, 1, 100000, policy);
+        test_merge_instance<BtreeType, MapType>(32000, 100, 100000, policy);
+        test_merge_instance<BtreeType, MapType>(32000, 1000, 1000000, policy);
+        test_merge_instance<BtreeType, MapType>(32000, 5000, 100000, policy);
+        test_merge_instance<BtreeType, MapType>(10000, 30000, 10000, policy);
+    }
+
+    void test_merge()
+    {
+        typedef std::map<unsigned int, unsigned int> map_type;
+        typedef std::multimap<unsigned int, unsigned int> multimap_type;
+
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_special<unsigned int, false, 8> > btree_map_type;
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_special<unsigned int, true, 8> > btree_map_special;
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, false, 8> > btree_multimap_type;
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, true, 8> > btree_multimap_special;
+
+        test_merge_sizes<btree_map_type, map_type>(stx::btree_merge_keep_existing);
+        test_merge_sizes<btree_map_type, map_type>(stx::btree_merge_overwrite);
+        test_merge_sizes<btree_map_special, map_type>(stx::btree_merge_keep_existing);
+        test_merge_sizes<btree_map_special, map_type>(stx::btree_merge_overwrite);
+
+        test_merge_sizes<btree_multimap_type, multimap_type>(stx::btree_merge_duplicates);
+        test_merge_sizes<btree_multimap_type, multimap_type>(stx::btree_merge_keep_existing);
+        test_merge_sizes<btree_multimap_type, multimap_type>(stx::btree_merge_overwrite);
+        test_merge_sizes<btree_multimap_special, multimap_type>(stx::btree_merge_duplicates);
+
+        test_merge_set<std::string>();
+        test_merge_equal_run();
+    }
+
+    /// Merges into a long run of equal keys spanning many leaves: duplicates
+    /// precede the run, and overwriting replaces the data of its first pair.
+    void test_merge_equal_run()
+    {
+        typedef std::pair<unsigned int, unsigned int> pair_type;
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, false, 8> > btree_type;
+
+        btree_type bt;
+        for (unsigned int i = 0; i < 1000; i++)
+            bt.insert2(i < 500 ? i : 500, i);
+
+        std::vector<pair_type> batch;
+        batch.push_back(pair_type(500, 2000));
+        batch.push_back(pair_type(500, 2001));
+
+        unsigned int second = (++bt.lower_bound(500)).data();
+
+        ASSERT(bt.merge_sorted(batch.begin(), batch.end(), stx::btree_merge_overwrite) == 0);
+        bt.verify();
+        ASSERT(bt.lower_bound(500).data() == 2001);
+        ASSERT((++bt.lower_bound(500)).data() == second);
+
+        ASSERT(bt.merge_sorted(batch.begin(), batch.end()) == 2);
+        bt.verify();
+        ASSERT(bt.count(500) == 502);
+        ASSERT(bt.lower_bound(500).data() == 2000);
+        ASSERT((++bt.lower_bound(500)).data() == 2001);
+    }
+
+    /// Merges keys into a set and a multiset with the default policies.
+    template <typename KeyType>
+    void test_merge_set()
+    {
+        typedef stx::btree_set<KeyType, std::less<KeyType>,
+                               traits_special<KeyType, true, 8> > btree_set_type;
+        typedef stx::btree_multiset<KeyType, std::less<KeyType>,
+                                    traits_special<KeyType, true, 8> > btree_multiset_type;
+
+        std::vector<KeyType> keys, batch;
+        for (unsigned int i = 0; i < 20000; i++)
+            keys.push_back(make_test_key<KeyType>(rand() % 100000));
+        for (unsigned int i = 0; i < 500; i++)
+            batch.push_back(make_test_key<KeyType>(rand() % 100000));
+
+        std::sort(keys.begin(), keys.end());
+        std::sort(batch.begin(), batch.end());
+
+        std::set<KeyType> set(keys.begin(), keys.end());
+        std::multiset<KeyType> multiset(keys.begin(), keys.end());
+
+        btree_set_type bs(set.begin(), set.end());
+        btree_multiset_type bm(multiset.begin(), multiset.end());
+
+        size_t before = set.size();
+        set.insert(batch.begin(), batch.end());
+        multiset.insert(batch.begin(), batch.end());
+
+        ASSERT(bs.merge_sorted(batch.begin(), batch.end()) == set.size() - before);
+        ASSERT(bm.merge_sorted(batch.begin(), batch.end()) == batch.size());
+
+        bs.verify();
+        bm.verify();
+        check_equal(bs, set);
+        check_equal(bm, multiset);
+
+        // a batch as large as the tree splits nearly every leaf
+        ASSERT(bm.merge_sorted(keys.begin(), keys.end()) == keys.size());
+        multiset.insert(keys.begin(), keys.end());
+        bm.verify();
+        check_equal(bm, multiset);
+    }
+
+    /// Fills a tree with random keys, erases three quarters of them, and
+    /// checks its contents against a std::multiset.
+    template <typename BtreeType, typename SetType>
+    void fill_sparse(BtreeType& bt, SetType& set, unsigned int numkeys,
+                     unsigned int mod)
+    {
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+        {
+            unsigned int k = rand() % mod;
+            bt.insert(make_test_key<typename BtreeType::key_type>(k));
+            set.insert(make_test_key<typename BtreeType::key_type>(k));
+        }
+
+        for (unsigned int i = 0; i < numkeys * 3 / 4; i++)
+        {
+            unsigned int k = rand() % mod;
+            if (bt.erase_one(make_test_key<typename BtreeType::key_type>(k)))
+                set.erase(set.find(make_test_key<typename BtreeType::key_type>(k)));
+        }
+
+        ASSERT(bt.size() == set.size());
+    }
+
+    template <typename BtreeType, typename SetType>
+    void check_equal(const BtreeType& bt, const SetType& set)
+    {
+        ASSERT(bt.size() == set.size());
+        ASSERT(std::equal(set.begin(), set.end(), bt.begin()));
+    }
+
+    template <typename KeyType, bool Special>
+    void test_compact_instance(unsigned int numkeys, unsigned int mod)
+    {
+        typedef stx::btree_multiset<KeyType, std::less<KeyType>,
+                                    traits_special<KeyType, Special, 8> > btree_type;
+
+        btree_type bt;
+        std::multiset<KeyType> set;
+        fill_sparse(bt, set, numkeys, mod);
+
+        typename btree_type::tree_stats before = bt.get_stats();
+        ASSERT(before.avgfill_leaves() < 0.75);
+
+        size_t reclaimed = bt.compact();
+        bt.verify();
+        check_equal(bt, set);
+
+        typename btree_type::tree_stats after = bt.get_stats();
+        ASSERT(reclaimed == before.bytes() - after.bytes());
+        ASSERT(after.reclaimed == reclaimed);
+        ASSERT(after.avgfill_leaves() > 0.9);
+        ASSERT(after.leaves < before.leaves);
+
+        // a lower fill spreads the items again
+        bt.compact(0.5);
+        bt.verify();
+        check_equal(bt, set);
+        ASSERT(bt.get_stats().leaves > after.leaves);
+
+        // the tree keeps working after compaction
+        for (unsigned int i = 0; i < numkeys / 4; i++)
+        {
+            bt.insert(make_test_key<KeyType>(i % mod));
+            set.insert(make_test_key<KeyType>(i % mod));
+        }
+        bt.verify();
+        check_equal(bt, set);
+
+        bt.clear();
+        ASSERT(bt.compact() == 0);
+    }
+
+    void test_compact()
+    {
+        test_compact_instance<unsigned int, false>(3200, 1000);
+        test_compact_instance<unsigned int, false>(32000, 10000);
+        test_compact_instance<unsigned int, true>(32000, 10000);
+        test_compact_instance<std::string, false>(20000, 1000000);
+        test_compact_instance<std::string, true>(20000, 1000000);
+
+        // a map and a single leaf
+        typedef stx::btree_map<unsigned int, unsigned int> map_type;
+        map_type bt;
+        std::map<unsigned int, unsigned int> map;
+        for (unsigned int i = 0; i < 5; i++)
+        {
+            bt.insert2(i, i * i);
+            map.insert(std::make_pair(i, i * i));
+        }
+        bt.compact();
+        ASSERT(bt.size() == map.size());
+
+        map_type::const_iterator bi = bt.begin();
+        for (std::map<unsigned int, unsigned int>::const_iterator mi = map.begin();
+             mi != map.end(); ++mi, ++bi)
+        {
+            ASSERT(bi.key() == mi->first && bi.data() == mi->second);
+        }
+    }
+
+    template <typename KeyType, bool Special>
+    void test_compact_step_instance(unsigned int numkeys, unsigned int mod,
+                                    unsigned int max_leaves)
+    {
+        typedef stx::btree_multiset<KeyType, std::less<KeyType>,
+                                    traits_special<KeyType, Special, 8> > btree_type;
+
+        btree_type bt;
+        std::multiset<KeyType> set;
+        fill_sparse(bt, set, numkeys, mod);
+
+        size_t leaves = bt.get_stats().leaves;
+
+        // modify the tree between the steps
+        typename btree_type::compact_state state;
+        unsigned int steps = 0;
+        while (!bt.compact_step(state, max_leaves))
+        {
+            bt.verify();
+
+            unsigned int k = rand() % mod;
+            bt.insert(make_test_key<KeyType>(k));
+            set.insert(make_test_key<KeyType>(k));
+
+            k = rand() % mod;
+            if (bt.erase_one(make_test_key<KeyType>(k)))
+                set.erase(set.find(make_test_key<KeyType>(k)));
+
+            ASSERT(++steps < numkeys);
+        }
+
+        ASSERT(state.done());
+        bt.verify();
+        check_equal(bt, set);
+
+        ASSERT(bt.get_stats().leaves < leaves);
+        ASSERT(bt.get_stats().reclaimed > 0);
+    }
+
+    void test_compact_step()
+    {
+        test_compact_step_instance<unsigned int, false>(240, 1000, 4);
+        test_compact_step_instance<unsigned int, false>(32000, 10000, 1);
+        test_compact_step_instance<unsigned int, false>(32000, 10000, 4);
+        test_compact_step_instance<unsigned int, true>(32000, 10000, 16);
+        test_compact_step_instance<unsigned int, false>(32000, 10000, 100);
+        test_compact_step_instance<std::string, true>(20000, 1000000, 4);
+
+        // long runs of equal keys
+        test_compact_step_instance<unsigned int, false>(32000, 3, 4);
+    }
 } _BulkLoadTest;
 
 /******************************************************************************/
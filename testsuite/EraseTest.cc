@@ -0,0 +1,332 @@
+/*******************************************************************************
+ * testsuite/EraseTest.cc
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <stx/btree_multiset.h>
+#include <stx/btree_map.h>
+
+#include <cstdlib>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "tpunit.h"
+#include "TestTraits.h"
+
+struct EraseTest : public tpunit::TestFixture
+{
+    EraseTest() : tpunit::TestFixture(
+                      TEST(EraseTest::test_range_all),
+                      TEST(EraseTest::test_range_random),
+                      TEST(EraseTest::test_range_keys),
+                      TEST(EraseTest::test_range_map),
+                      TEST(EraseTest::test_sorted),
+                      TEST(EraseTest::test_sorted_map)
+                      )
+    { }
+
+    template <typename BtreeType, typename SetType>
+    void check_equal(const BtreeType& bt, const SetType& set)
+    {
+        bt.verify();
+        ASSERT(bt.size() == set.size());
+        ASSERT(std::equal(set.begin(), set.end(), bt.begin()));
+    }
+
+    /// Erases every range [i,j) from trees with numkeys keys.
+    template <bool Special, int Slots>
+    void test_range_all_instance(unsigned int numkeys, unsigned int mod)
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, Special, Slots> > btree_type;
+
+        std::multiset<unsigned int> keys;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+            keys.insert(rand() % mod);
+
+        for (unsigned int i = 0; i <= numkeys; i++)
+        {
+            for (unsigned int j = i; j <= numkeys; j++)
+            {
+                btree_type bt;
+                std::multiset<unsigned int> set = keys;
+
+                // build by insertion to get unevenly filled nodes
+                for (std::multiset<unsigned int>::const_iterator it = keys.begin();
+                     it != keys.end(); ++it)
+                    bt.insert(*it);
+
+                typename btree_type::iterator bi = bt.begin(), bj = bt.begin();
+                std::advance(bi, i);
+                std::advance(bj, j);
+
+                std::multiset<unsigned int>::iterator si = set.begin(), sj = set.begin();
+                std::advance(si, i);
+                std::advance(sj, j);
+
+                bt.erase(bi, bj);
+                set.erase(si, sj);
+
+                check_equal(bt, set);
+            }
+        }
+    }
+
+    void test_range_all()
+    {
+        test_range_all_instance<false, 4>(150, 1000);
+        test_range_all_instance<true, 4>(150, 1000);
+        test_range_all_instance<false, 5>(120, 10);
+        test_range_all_instance<true, 8>(120, 10);
+    }
+
+    /// Erases random ranges until the tree is empty.
+    template <typename KeyType, bool Special, int Slots>
+    void test_range_random_instance(unsigned int numkeys, unsigned int mod)
+    {
+        typedef stx::btree_multiset<KeyType, std::less<KeyType>,
+                                    traits_special<KeyType, Special, Slots> > btree_type;
+
+        btree_type bt;
+        std::multiset<KeyType> set;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+        {
+            KeyType k = make_test_key<KeyType>(rand() % mod);
+            bt.insert(k);
+            set.insert(k);
+        }
+
+        while (!set.empty())
+        {
+            unsigned int i = rand() % set.size();
+            unsigned int n = rand() % (set.size() - i + 1);
+            if (rand() % 4 != 0) n = std::min<unsigned int>(n, rand() % 100);
+
+            typename btree_type::iterator bi = bt.begin();
+            std::advance(bi, i);
+            typename btree_type::iterator bj = bi;
+            std::advance(bj, n);
+
+            typename std::multiset<KeyType>::iterator si = set.begin();
+            std::advance(si, i);
+            typename std::multiset<KeyType>::iterator sj = si;
+            std::advance(sj, n);
+
+            bt.erase(bi, bj);
+            set.erase(si, sj);
+
+            check_equal(bt, set);
+
+            // insert some keys again to mix the node fill
+            for (unsigned int r = rand() % 20; r > 0; --r)
+            {
+                KeyType k = make_test_key<KeyType>(rand() % mod);
+                bt.insert(k);
+                set.insert(k);
+            }
+        }
+    }
+
+    void test_range_random()
+    {
+        test_range_random_instance<unsigned int, false, 4>(10000, 100000);
+        test_range_random_instance<unsigned int, true, 4>(10000, 100000);
+        test_range_random_instance<unsigned int, false, 16>(32000, 1000);
+        test_range_random_instance<std::string, true, 8>(10000, 100000);
+    }
+
+    /// Erases key ranges [lower,upper) with many duplicates.
+    void test_range_keys()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, true, 6> > btree_type;
+
+        btree_type bt;
+        std::multiset<unsigned int> set;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 20000; i++)
+        {
+            unsigned int k = rand() % 500;
+            bt.insert(k);
+            set.insert(k);
+        }
+
+        ASSERT(bt.erase(300, 300) == 0);
+        ASSERT(bt.erase(300, 200) == 0);
+
+        for (unsigned int lower = 0; lower < 520; lower += 13)
+        {
+            unsigned int upper = lower + rand() % 40;
+
+            size_t n = std::distance(set.lower_bound(lower), set.lower_bound(upper));
+            set.erase(set.lower_bound(lower), set.lower_bound(upper));
+
+            ASSERT(bt.erase(lower, upper) == n);
+            check_equal(bt, set);
+        }
+
+        ASSERT(bt.erase(0, 1000) == set.size());
+        ASSERT(bt.empty());
+        bt.verify();
+    }
+
+    /// Erases from a map, whose data must move along with the keys.
+    void test_range_map()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_special<unsigned int, false, 8> > btree_type;
+
+        btree_type bt;
+        std::map<unsigned int, unsigned int> map;
+
+        for (unsigned int i = 0; i < 10000; i++)
+        {
+            bt.insert2(i, i * i);
+            map.insert(std::make_pair(i, i * i));
+        }
+
+        ASSERT(bt.erase(17, 9000) == 9000 - 17);
+        map.erase(map.lower_bound(17), map.lower_bound(9000));
+
+        bt.erase(bt.find(9500), bt.end());
+        map.erase(map.find(9500), map.end());
+
+        bt.verify();
+        ASSERT(bt.size() == map.size());
+
+        btree_type::const_iterator bi = bt.begin();
+        for (std::map<unsigned int, unsigned int>::const_iterator mi = map.begin();
+             mi != map.end(); ++mi, ++bi)
+        {
+            ASSERT(bi.key() == mi->first && bi.data() == mi->second);
+        }
+
+        bt.erase(bt.begin(), bt.end());
+        ASSERT(bt.empty());
+    }
+
+    /// Erases sorted batches of keys of varying density, some of which are
+    /// not in the tree, and finally all remaining keys.
+    template <typename KeyType, bool Special, int Slots>
+    void test_sorted_instance(unsigned int numkeys, unsigned int mod)
+    {
+        typedef stx::btree_multiset<KeyType, std::less<KeyType>,
+                                    traits_special<KeyType, Special, Slots> > btree_type;
+
+        btree_type bt;
+        std::multiset<KeyType> set;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+        {
+            KeyType k = make_test_key<KeyType>(rand() % mod);
+            bt.insert(k);
+            set.insert(k);
+        }
+
+        for (unsigned int round = 0; round < 500; ++round)
+        {
+            // pick keys from a random key range, with a random density
+            unsigned int lower = rand() % mod;
+            unsigned int upper = lower + rand() % (mod - lower + 1);
+            unsigned int step = 1 + rand() % 50;
+
+            std::multiset<KeyType> batch;
+            for (unsigned int k = lower; k < upper; k += 1 + rand() % step)
+            {
+                batch.insert(make_test_key<KeyType>(k));
+                if (rand() % 8 == 0) batch.insert(make_test_key<KeyType>(k));
+            }
+
+            size_t n = 0;
+            for (typename std::multiset<KeyType>::const_iterator it = batch.begin();
+                 it != batch.end(); ++it)
+                n += set.erase(*it);
+
+            ASSERT(bt.erase_sorted(batch.begin(), batch.end()) == n);
+            check_equal(bt, set);
+
+            for (unsigned int r = rand() % 20; r > 0; --r)
+            {
+                KeyType k = make_test_key<KeyType>(rand() % mod);
+                bt.insert(k);
+                set.insert(k);
+            }
+        }
+
+        std::vector<KeyType> rest(set.begin(), set.end());
+        ASSERT(bt.erase_sorted(rest.begin(), rest.end()) == set.size());
+        ASSERT(bt.empty());
+        bt.verify();
+    }
+
+    void test_sorted()
+    {
+        test_sorted_instance<unsigned int, false, 4>(10000, 100000);
+        test_sorted_instance<unsigned int, true, 4>(10000, 100000);
+        test_sorted_instance<unsigned int, false, 5>(10000, 300);
+        test_sorted_instance<unsigned int, true, 16>(32000, 1000);
+        test_sorted_instance<std::string, true, 8>(10000, 100000);
+    }
+
+    /// Erases every third key of a map at once.
+    void test_sorted_map()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_special<unsigned int, false, 8> > btree_type;
+
+        btree_type bt;
+        std::map<unsigned int, unsigned int> map;
+        std::vector<unsigned int> batch;
+
+        for (unsigned int i = 0; i < 10000; i++)
+        {
+            bt.insert2(i, i * i);
+            map.insert(std::make_pair(i, i * i));
+
+            if (i % 3 == 0) {
+                batch.push_back(i);
+                map.erase(i);
+            }
+        }
+
+        ASSERT(bt.erase_sorted(batch.begin(), batch.end()) == batch.size());
+
+        bt.verify();
+        ASSERT(bt.size() == map.size());
+
+        btree_type::const_iterator bi = bt.begin();
+        for (std::map<unsigned int, unsigned int>::const_iterator mi = map.begin();
+             mi != map.end(); ++mi, ++bi)
+        {
+            ASSERT(bi.key() == mi->first && bi.data() == mi->second);
+        }
+
+        ASSERT(bt.erase_sorted(batch.begin(), batch.end()) == 0);
+    }
+} _EraseTest;
+
+/******************************************************************************/
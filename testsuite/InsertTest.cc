@@ -0,0 +1,324 @@
+/*******************************************************************************
+ * testsuite/InsertTest.cc
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <stx/btree_map.h>
+#include <stx/btree_multimap.h>
+#include <stx/btree_set.h>
+#include <stx/btree_multiset.h>
+
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "tpunit.h"
+
+/// Less-than comparison counting the number of calls.
+struct CountingLess
+{
+    static unsigned int calls;
+
+    bool operator () (const unsigned int& a, const unsigned int& b) const
+    {
+        ++calls;
+        return a < b;
+    }
+};
+
+unsigned int CountingLess::calls = 0;
+
+struct InsertTest : public tpunit::TestFixture
+{
+    InsertTest() : tpunit::TestFixture(
+                       TEST(InsertTest::test_hint_inserter),
+                       TEST(InsertTest::test_hint_sorted_multi),
+                       TEST(InsertTest::test_hint_random),
+                       TEST(InsertTest::test_hint_comparisons),
+                       TEST(InsertTest::test_append_multi),
+                       TEST(InsertTest::test_append_erase)
+                       )
+    { }
+
+    template <typename KeyType, bool SelfVerify>
+    struct traits_nodebug : stx::btree_default_set_traits<KeyType>
+    {
+        static const bool selfverify = SelfVerify;
+        static const bool debug = false;
+
+        static const int  leafslots = 8;
+        static const int  innerslots = 8;
+    };
+
+    /// Compares the key/data pairs of the tree and the STL map.
+    template <typename BtreeType, typename MapType>
+    static bool equal_pairs(const BtreeType& bt, const MapType& map)
+    {
+        if (bt.size() != map.size()) return false;
+
+        typename BtreeType::const_iterator bi = bt.begin();
+        for (typename MapType::const_iterator mi = map.begin(); mi != map.end(); ++mi, ++bi)
+        {
+            if (bi.key() != mi->first || bi.data() != mi->second)
+                return false;
+        }
+
+        return true;
+    }
+
+    void test_hint_inserter()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_nodebug<unsigned int, true> > btree_type;
+
+        std::map<unsigned int, unsigned int> map;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 3200; i++)
+        {
+            unsigned int k = rand() % 10000;
+            map.insert(std::make_pair(k, i));
+        }
+
+        // copy sorted pairs using std::inserter into an empty tree
+        btree_type bt;
+        std::copy(map.begin(), map.end(), std::inserter(bt, bt.end()));
+
+        bt.verify();
+        ASSERT(bt.size() == map.size());
+        ASSERT(equal_pairs(bt, map));
+
+        // and again into a filled tree: all keys already exist
+        std::copy(map.begin(), map.end(), std::inserter(bt, bt.begin()));
+        ASSERT(bt.size() == map.size());
+
+        // copy even keys into a tree containing the odd keys
+        btree_type bt2;
+        for (unsigned int k = 1; k < 10000; k += 2)
+            bt2.insert2(k, k);
+
+        std::map<unsigned int, unsigned int> map2;
+        for (unsigned int k = 0; k < 10000; k++)
+            map2.insert(std::make_pair(k, k));
+
+        std::copy(map2.begin(), map2.end(), std::inserter(bt2, bt2.begin()));
+
+        bt2.verify();
+        ASSERT(bt2.size() == map2.size());
+
+        // odd keys keep their data, even keys were inserted
+        for (btree_type::const_iterator bi = bt2.begin(); bi != bt2.end(); ++bi)
+            ASSERT(bi.data() == bi.key());
+
+        ASSERT(bt2.begin().key() == 0 && bt2.rbegin().key() == 9999);
+    }
+
+    void test_hint_sorted_multi()
+    {
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_nodebug<unsigned int, true> > btree_type;
+
+        btree_type bt;
+        std::multiset<unsigned int> set;
+
+        // mostly sorted keys with duplicates, using the previous iterator as
+        // hint
+        btree_type::iterator hint = bt.end();
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 3200; i++)
+        {
+            unsigned int k = i / 3 + rand() % 8;
+
+            hint = bt.insert(hint, std::make_pair(k, i));
+            ASSERT(hint.key() == k);
+
+            set.insert(k);
+        }
+
+        bt.verify();
+        ASSERT(bt.size() == set.size());
+
+        btree_type::const_iterator bi = bt.begin();
+        for (std::multiset<unsigned int>::const_iterator si = set.begin();
+             si != set.end(); ++si, ++bi)
+        {
+            ASSERT(bi.key() == *si);
+        }
+    }
+
+    void test_hint_random()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_nodebug<unsigned int, true> > multiset_type;
+        typedef stx::btree_set<unsigned int, std::less<unsigned int>,
+                               traits_nodebug<unsigned int, true> > set_type;
+
+        multiset_type bms;
+        set_type bs;
+        std::multiset<unsigned int> ms;
+        std::set<unsigned int> ss;
+
+        // hints pointing anywhere must still produce a correct tree
+        srand(34234235);
+        for (unsigned int i = 0; i < 3200; i++)
+        {
+            unsigned int k = rand() % 1000;
+            unsigned int h = rand() % 1000;
+
+            multiset_type::iterator mi = bms.insert(bms.lower_bound(h), k);
+            ASSERT(*mi == k);
+            ms.insert(k);
+
+            set_type::iterator si = bs.insert(bs.upper_bound(h), k);
+            ASSERT(*si == k);
+            ss.insert(k);
+
+            ASSERT(bms.size() == ms.size());
+            ASSERT(bs.size() == ss.size());
+        }
+
+        ASSERT(std::equal(bms.begin(), bms.end(), ms.begin()));
+        ASSERT(std::equal(bs.begin(), bs.end(), ss.begin()));
+    }
+
+    void test_hint_comparisons()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, CountingLess,
+                               traits_nodebug<unsigned int, false> > btree_type;
+
+        std::map<unsigned int, unsigned int> map;
+        for (unsigned int k = 0; k < 100000; k++)
+            map.insert(std::make_pair(2 * k, k));
+
+        // append sorted keys with and without hint
+        btree_type bt, bt2;
+
+        CountingLess::calls = 0;
+        std::copy(map.begin(), map.end(), std::inserter(bt, bt.end()));
+        unsigned int calls_hint = CountingLess::calls;
+
+        CountingLess::calls = 0;
+        bt2.insert(map.begin(), map.end());
+        unsigned int calls_plain = CountingLess::calls;
+
+        // both append at the tail leaf without descending from the root
+        ASSERT(bt.size() == map.size() && bt2.size() == map.size());
+        ASSERT(calls_hint < 8 * map.size());
+        ASSERT(calls_plain < 8 * map.size());
+
+        // fill in all odd keys: each key belongs into the hint's leaf
+        std::map<unsigned int, unsigned int> map2;
+        for (unsigned int k = 0; k < 100000; k++)
+            map2.insert(std::make_pair(2 * k + 1, k));
+
+        CountingLess::calls = 0;
+        std::copy(map2.begin(), map2.end(), std::inserter(bt, bt.begin()));
+        calls_hint = CountingLess::calls;
+
+        CountingLess::calls = 0;
+        bt2.insert(map2.begin(), map2.end());
+        calls_plain = CountingLess::calls;
+
+        ASSERT(bt.size() == 200000 && bt2.size() == 200000);
+        ASSERT(2 * calls_hint < calls_plain);
+
+        bt.verify();
+        ASSERT(bt == bt2);
+    }
+
+    void test_append_multi()
+    {
+        typedef stx::btree_multimap<unsigned int, unsigned int, std::less<unsigned int>,
+                                    traits_nodebug<unsigned int, true> > btree_type;
+
+        btree_type bt;
+
+        // increasing keys with duplicates fill the leaves completely
+        for (unsigned int i = 0; i < 3200; i++)
+            bt.insert2(i / 4, i);
+
+        bt.verify();
+        ASSERT(bt.size() == 3200);
+        ASSERT(bt.get_stats().leaves == 3200 / btree_type::leafslotmax);
+
+        unsigned int i = 0;
+        for (btree_type::const_iterator bi = bt.begin(); bi != bt.end(); ++bi, ++i)
+        {
+            ASSERT(bi.key() == i / 4);
+            ASSERT(bi.data() == i);
+        }
+
+        // a unique map rejects duplicates appended to the tail
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_nodebug<unsigned int, true> > map_type;
+
+        map_type bm;
+        for (unsigned int j = 0; j < 3200; j++)
+            ASSERT(bm.insert2(j / 2, j).second == (j % 2 == 0));
+
+        ASSERT(bm.size() == 1600);
+        ASSERT(bm.get_stats().leaves == 1600 / map_type::leafslotmax);
+    }
+
+    void test_append_erase()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_nodebug<unsigned int, true> > btree_type;
+
+        btree_type bt;
+
+        // appended trees end with an underfull tail leaf, which erase() must
+        // handle
+        srand(34234235);
+        for (unsigned int n = 1; n < 60; n++)
+        {
+            std::vector<unsigned int> keys;
+            for (unsigned int k = 0; k < n; k++) {
+                bt.insert(k);
+                keys.push_back(k);
+            }
+
+            std::random_shuffle(keys.begin(), keys.end());
+
+            // erase in random order and append some keys in between
+            std::vector<unsigned int> appended;
+            for (unsigned int i = 0; i < keys.size(); i++)
+            {
+                ASSERT(bt.erase_one(keys[i]));
+
+                if (i % 3 == 0) {
+                    bt.insert(n + i);
+                    appended.push_back(n + i);
+                }
+            }
+
+            ASSERT(bt.size() == appended.size());
+
+            for (unsigned int i = 0; i < appended.size(); i++)
+                ASSERT(bt.erase_one(appended[i]));
+
+            ASSERT(bt.empty());
+        }
+    }
+} _InsertTest;
+
+/******************************************************************************/
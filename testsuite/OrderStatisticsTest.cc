@@ -0,0 +1,355 @@
+/*******************************************************************************
+ * testsuite/OrderStatisticsTest.cc
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <stx/btree_multiset.h>
+#include <stx/btree_map.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include "tpunit.h"
+#include "TestTraits.h"
+
+struct OrderStatisticsTest : public tpunit::TestFixture
+{
+    OrderStatisticsTest() : tpunit::TestFixture(
+                                TEST(OrderStatisticsTest::test_insert_erase),
+                                TEST(OrderStatisticsTest::test_batch_operations),
+                                TEST(OrderStatisticsTest::test_iterator_advance),
+                                TEST(OrderStatisticsTest::test_equal_run),
+                                TEST(OrderStatisticsTest::test_map)
+                                )
+    { }
+
+    template <typename KeyType, bool Special, int Slots, bool Counts = true>
+    struct traits_stats : traits_special<KeyType, Special, Slots>
+    {
+        static const bool order_statistics = Counts;
+    };
+
+    /// Compares rank(), select(), distance() and count() at some keys and
+    /// positions with the multiset, after verifying the counts.
+    template <typename BtreeType>
+    void check_stats(const BtreeType& bt, const std::multiset<unsigned int>& set,
+                     unsigned int mod)
+    {
+        bt.verify();
+        ASSERT(bt.size() == set.size());
+
+        for (unsigned int i = 0; i < 20; ++i)
+        {
+            unsigned int key = rand() % (mod + 1);
+            size_t r = std::distance(set.begin(), set.lower_bound(key));
+
+            ASSERT(bt.rank(key) == r);
+            ASSERT(bt.distance(bt.begin(), bt.lower_bound(key)) == static_cast<ptrdiff_t>(r));
+            ASSERT(bt.distance(bt.lower_bound(key), bt.end()) == static_cast<ptrdiff_t>(set.size() - r));
+
+            unsigned int upper = key + rand() % 100;
+            ASSERT(bt.count(key, upper) ==
+                   static_cast<size_t>(std::distance(set.lower_bound(key), set.lower_bound(upper))));
+        }
+
+        if (set.empty()) {
+            ASSERT(bt.select(0) == bt.end());
+            return;
+        }
+
+        for (unsigned int i = 0; i < 20; ++i)
+        {
+            size_t k = rand() % set.size();
+            std::multiset<unsigned int>::const_iterator si = set.begin();
+            std::advance(si, k);
+
+            ASSERT(*bt.select(k) == *si);
+            ASSERT(bt.rank(*si) <= k);
+        }
+
+        ASSERT(bt.select(set.size()) == bt.end());
+    }
+
+    /// Random inserts and erases by key and by iterator.
+    template <bool Special, int Slots>
+    void test_insert_erase_instance(unsigned int numkeys, unsigned int mod)
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_stats<unsigned int, Special, Slots> > btree_type;
+
+        btree_type bt;
+        std::multiset<unsigned int> set;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+        {
+            unsigned int k = rand() % mod;
+            bt.insert(k);
+            set.insert(k);
+
+            if (i % 100 == 0) check_stats(bt, set, mod);
+        }
+
+        // sequential inserts at the end take the append path
+        for (unsigned int i = 0; i < numkeys / 4; i++)
+        {
+            bt.insert(mod + i);
+            set.insert(mod + i);
+        }
+        check_stats(bt, set, mod);
+
+        while (!set.empty())
+        {
+            unsigned int k = rand() % mod;
+
+            if (rand() % 2 == 0) {
+                ASSERT(bt.erase_one(k) == (set.find(k) != set.end()));
+                if (set.find(k) != set.end()) set.erase(set.find(k));
+            }
+            else {
+                size_t pos = rand() % set.size();
+                typename btree_type::iterator bi = bt.select(pos);
+                std::multiset<unsigned int>::iterator si = set.begin();
+                std::advance(si, pos);
+
+                ASSERT(*bi == *si);
+                bt.erase(bi);
+                set.erase(si);
+            }
+
+            if (set.size() % 100 == 0) check_stats(bt, set, mod + numkeys / 4);
+        }
+
+        check_stats(bt, set, mod);
+    }
+
+    void test_insert_erase()
+    {
+        test_insert_erase_instance<false, 4>(3200, 1000);
+        test_insert_erase_instance<true, 4>(3200, 100000);
+        test_insert_erase_instance<false, 8>(3200, 100000);
+        test_insert_erase_instance<true, 5>(3200, 300);
+    }
+
+    /// Range erase, sorted batches, merging, bulk loading, compaction,
+    /// splitting and joining, copying and restoring.
+    template <bool Special, int Slots>
+    void test_batch_operations_instance()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_stats<unsigned int, Special, Slots> > btree_type;
+
+        const unsigned int mod = 10000;
+
+        btree_type bt;
+        std::multiset<unsigned int> set;
+
+        srand(34234235);
+        std::vector<unsigned int> keys;
+        for (unsigned int i = 0; i < 5000; i++)
+            keys.push_back(rand() % mod);
+        std::sort(keys.begin(), keys.end());
+
+        bt.bulk_load(keys.begin(), keys.end(), 0.8, 0.8);
+        set.insert(keys.begin(), keys.end());
+        check_stats(bt, set, mod);
+
+        for (unsigned int round = 0; round < 20; ++round)
+        {
+            // erase a key range
+            unsigned int lower = rand() % mod, upper = lower + rand() % 500;
+            set.erase(set.lower_bound(lower), set.lower_bound(upper));
+            bt.erase(lower, upper);
+            check_stats(bt, set, mod);
+
+            // erase a sorted batch
+            std::vector<unsigned int> batch;
+            for (unsigned int k = rand() % 10; k < mod; k += 1 + rand() % 30)
+                batch.push_back(k);
+            for (unsigned int i = 0; i < batch.size(); ++i)
+                set.erase(batch[i]);
+            bt.erase_sorted(batch.begin(), batch.end());
+            check_stats(bt, set, mod);
+
+            // merge a sorted batch
+            batch.clear();
+            for (unsigned int n = 100 + rand() % 1000; n > 0; --n)
+                batch.push_back(rand() % mod);
+            std::sort(batch.begin(), batch.end());
+            bt.merge_sorted(batch.begin(), batch.end());
+            set.insert(batch.begin(), batch.end());
+            check_stats(bt, set, mod);
+
+            // split and join again
+            btree_type right;
+            unsigned int key = rand() % mod;
+            bt.split_at(key, right);
+            ASSERT(bt.size() == bt.rank(key));
+            ASSERT(right.rank(key) == 0);
+            right.verify();
+            bt.join(right);
+            check_stats(bt, set, mod);
+        }
+
+        typename btree_type::compact_state state;
+        while (!bt.compact_step(state, 4)) { }
+        check_stats(bt, set, mod);
+
+        bt.compact(0.7);
+        check_stats(bt, set, mod);
+
+        btree_type copy(bt);
+        check_stats(copy, set, mod);
+
+        std::ostringstream os;
+        bt.dump(os);
+        btree_type restored;
+        std::istringstream is(os.str());
+        ASSERT(restored.restore(is));
+        check_stats(restored, set, mod);
+    }
+
+    void test_batch_operations()
+    {
+        test_batch_operations_instance<false, 4>();
+        test_batch_operations_instance<true, 4>();
+        test_batch_operations_instance<true, 8>();
+    }
+
+    /// Advances iterators by whole leaves, with and without counts.
+    template <bool Counts>
+    void test_iterator_advance_instance()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_stats<unsigned int, false, 5, Counts> > btree_type;
+
+        btree_type bt;
+        for (unsigned int i = 0; i < 1000; i++)
+            bt.insert(i / 2);
+
+        for (unsigned int i = 0; i <= 1000; i += 7)
+        {
+            typename btree_type::iterator it = bt.begin();
+            it += i;
+            ASSERT(bt.distance(bt.begin(), it) == static_cast<ptrdiff_t>(i));
+            ASSERT(it == bt.end() || *it == i / 2);
+            ASSERT(it == bt.select(i));
+
+            for (unsigned int j = 0; j <= i; j += 13)
+            {
+                typename btree_type::const_iterator ci = it;
+                ci -= j;
+                ASSERT(bt.distance(ci, it) == static_cast<ptrdiff_t>(j));
+                ci += -static_cast<ptrdiff_t>(j);
+                ASSERT(bt.distance(bt.begin(), ci) == static_cast<ptrdiff_t>(2 * j >= i ? 0 : i - 2 * j));
+            }
+        }
+
+        typename btree_type::iterator it = bt.begin();
+        it += 5000;
+        ASSERT(it == bt.end());
+        it -= 5000;
+        ASSERT(it == bt.begin());
+
+        ASSERT(bt.rank(250) == 500);
+        ASSERT(bt.count(100, 200) == 200);
+        ASSERT(bt.count(200, 100) == 0);
+    }
+
+    void test_iterator_advance()
+    {
+        test_iterator_advance_instance<true>();
+        test_iterator_advance_instance<false>();
+    }
+
+    /// Positions inside a run of thousands of equal keys, which spans many
+    /// leaves and whole subtrees.
+    template <bool Special, int Slots>
+    void test_equal_run_instance()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_stats<unsigned int, Special, Slots> > btree_type;
+
+        std::vector<unsigned int> keys(5000, 7);
+        keys.insert(keys.begin(), 100, 3);
+        keys.insert(keys.end(), 100, 9);
+
+        btree_type bulk, bt;
+        bulk.bulk_load(keys.begin(), keys.end());
+        for (unsigned int i = 0; i < keys.size(); ++i)
+            bt.insert(keys[(i * 7919) % keys.size()]);
+
+        for (unsigned int t = 0; t < 2; ++t)
+        {
+            const btree_type& b = t ? bt : bulk;
+            b.verify();
+
+            ASSERT(b.rank(7) == 100 && b.rank(8) == 5100);
+            ASSERT(b.distance(b.lower_bound(7), b.upper_bound(7)) == 5000);
+
+            for (unsigned int k = 0; k <= keys.size(); k += 37)
+            {
+                typename btree_type::const_iterator it = b.select(k);
+                ASSERT(it == b.end() || *it == keys[k]);
+                ASSERT(b.distance(b.begin(), it) == static_cast<ptrdiff_t>(k));
+                ASSERT(b.distance(it, b.end()) == static_cast<ptrdiff_t>(keys.size() - k));
+
+                unsigned int j = (k * 13) % (keys.size() + 1);
+                ASSERT(b.distance(it, b.select(j)) ==
+                       static_cast<ptrdiff_t>(j) - static_cast<ptrdiff_t>(k));
+            }
+        }
+    }
+
+    void test_equal_run()
+    {
+        test_equal_run_instance<false, 4>();
+        test_equal_run_instance<true, 4>();
+        test_equal_run_instance<true, 16>();
+    }
+
+    /// Percentiles of a map's keys.
+    void test_map()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_stats<unsigned int, true, 16> > btree_type;
+
+        btree_type bt;
+
+        for (unsigned int i = 0; i < 10000; i++)
+            bt.insert2(3 * i, i);
+
+        for (unsigned int p = 0; p < 100; ++p)
+        {
+            btree_type::const_iterator it = bt.select(p * bt.size() / 100);
+            ASSERT(it.key() == 3 * 100 * p && it.data() == 100 * p);
+        }
+
+        ASSERT(bt.rank(3 * 5000) == 5000);
+        ASSERT(bt.rank(3 * 5000 + 1) == 5001);
+        ASSERT(bt.count(0, 3 * 10000) == 10000);
+        ASSERT(bt.distance(bt.find(30), bt.find(3000)) == 990);
+        ASSERT(bt.distance(bt.find(3000), bt.find(30)) == -990);
+    }
+} _OrderStatisticsTest;
+
+/******************************************************************************/
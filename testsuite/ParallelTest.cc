@@ -0,0 +1,290 @@
+/*******************************************************************************
+ * testsuite/ParallelTest.cc
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <stx/btree_multiset.h>
+#include <stx/btree_map.h>
+
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "tpunit.h"
+#include "TestTraits.h"
+
+/// Sum of the data, for checking the summaries after a transform.
+struct sum_aggregate
+{
+    static const bool enabled = true;
+
+    typedef unsigned long long summary_type;
+
+    static summary_type identity()
+    {
+        return 0;
+    }
+
+    static summary_type combine(const summary_type& a, const summary_type& b)
+    {
+        return a + b;
+    }
+
+    static summary_type summarize(const unsigned int&, const unsigned int& data)
+    {
+        return data;
+    }
+
+    /// Sets sum their keys.
+    template <typename Data>
+    static summary_type summarize(const unsigned int& key, const Data&)
+    {
+        return key;
+    }
+};
+
+struct ParallelTest : public tpunit::TestFixture
+{
+    ParallelTest() : tpunit::TestFixture(
+                         TEST(ParallelTest::test_for_each),
+                         TEST(ParallelTest::test_reduce),
+                         TEST(ParallelTest::test_transform),
+                         TEST(ParallelTest::test_set)
+                         )
+    { }
+
+    template <bool Special, int Slots>
+    struct traits_parallel : traits_special<unsigned int, Special, Slots>
+    {
+        typedef sum_aggregate aggregate;
+    };
+
+    typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                           traits_parallel<true, 8> > map_type;
+
+    /// Fills a map with numkeys random pairs.
+    static void fill_map(map_type& bt, std::map<unsigned int, unsigned int>& map,
+                         unsigned int numkeys)
+    {
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+        {
+            unsigned int k = rand() % (4 * numkeys + 1);
+            bt.insert2(k, i);
+            map.insert(std::make_pair(k, i));
+        }
+    }
+
+    /// Counts the visits of each key, which are distinct elements for each
+    /// thread.
+    struct count_visits
+    {
+        std::vector<unsigned int>* visits;
+
+        void operator () (const unsigned int& key, const unsigned int&) const
+        {
+            ++(*visits)[key];
+        }
+
+        void operator () (const unsigned int& key) const
+        {
+            ++(*visits)[key];
+        }
+    };
+
+    /// Visits each pair exactly once.
+    void test_for_each_instance(unsigned int numkeys, unsigned int threads)
+    {
+        map_type bt;
+        std::map<unsigned int, unsigned int> map;
+        fill_map(bt, map, numkeys);
+
+        std::vector<unsigned int> visits(4 * numkeys + 1);
+        count_visits f = { &visits };
+        bt.parallel_for_each(f, threads);
+
+        for (unsigned int k = 0; k < visits.size(); ++k)
+            ASSERT(visits[k] == map.count(k));
+    }
+
+    void test_for_each()
+    {
+        for (unsigned int n = 0; n < 100; n += 7)
+            test_for_each_instance(n, 4);
+
+        test_for_each_instance(100000, 1);
+        test_for_each_instance(100000, 4);
+        test_for_each_instance(100000, 0);
+        test_for_each_instance(200000, 7);
+    }
+
+    /// First and last key of a range and whether its keys were ascending,
+    /// which is associative but not commutative.
+    struct key_run
+    {
+        unsigned int count, first, last;
+        bool ordered;
+    };
+
+    static key_run map_key_run(const unsigned int& key, const unsigned int&)
+    {
+        key_run r = { 1, key, key, true };
+        return r;
+    }
+
+    static key_run combine_key_run(const key_run& a, const key_run& b)
+    {
+        if (a.count == 0) return b;
+        if (b.count == 0) return a;
+
+        key_run r = { a.count + b.count, a.first, b.last,
+                      a.ordered && b.ordered && a.last < b.first };
+        return r;
+    }
+
+    static unsigned long long map_data(const unsigned int&, const unsigned int& data)
+    {
+        return data;
+    }
+
+    static unsigned long long add(const unsigned long long& a, const unsigned long long& b)
+    {
+        return a + b;
+    }
+
+    /// Sums and reduces in key order.
+    void test_reduce_instance(unsigned int numkeys, unsigned int threads)
+    {
+        map_type bt;
+        std::map<unsigned int, unsigned int> map;
+        fill_map(bt, map, numkeys);
+
+        unsigned long long sum = 0;
+        for (std::map<unsigned int, unsigned int>::const_iterator it = map.begin();
+             it != map.end(); ++it)
+            sum += it->second;
+
+        ASSERT(bt.parallel_reduce(0ULL, map_data, add, threads) == sum);
+
+        key_run empty = { 0, 0, 0, true };
+        key_run r = bt.parallel_reduce(empty, map_key_run, combine_key_run, threads);
+
+        ASSERT(r.count == map.size());
+        ASSERT(r.ordered);
+        if (!map.empty()) {
+            ASSERT(r.first == map.begin()->first);
+            ASSERT(r.last == map.rbegin()->first);
+        }
+    }
+
+    void test_reduce()
+    {
+        for (unsigned int n = 0; n < 100; n += 7)
+            test_reduce_instance(n, 3);
+
+        test_reduce_instance(100000, 1);
+        test_reduce_instance(100000, 3);
+        test_reduce_instance(200000, 8);
+    }
+
+    static unsigned int scale_data(const unsigned int& key, const unsigned int& data)
+    {
+        return 3 * data + key % 7;
+    }
+
+    /// Replaces all data, and the cached sums with it.
+    void test_transform_instance(unsigned int numkeys, unsigned int threads)
+    {
+        map_type bt;
+        std::map<unsigned int, unsigned int> map;
+        fill_map(bt, map, numkeys);
+
+        bt.parallel_transform_values(scale_data, threads);
+        bt.verify();
+
+        unsigned long long sum = 0;
+        map_type::const_iterator bi = bt.begin();
+        for (std::map<unsigned int, unsigned int>::const_iterator mi = map.begin();
+             mi != map.end(); ++mi, ++bi)
+        {
+            ASSERT(bi.key() == mi->first && bi.data() == scale_data(mi->first, mi->second));
+            sum += bi.data();
+        }
+
+        ASSERT(bt.aggregate() == sum);
+    }
+
+    void test_transform()
+    {
+        for (unsigned int n = 0; n < 100; n += 7)
+            test_transform_instance(n, 2);
+
+        test_transform_instance(100000, 1);
+        test_transform_instance(100000, 4);
+        test_transform_instance(200000, 0);
+    }
+
+    static unsigned long long map_key(const unsigned int& key)
+    {
+        return key;
+    }
+
+    /// Sets visit and reduce their keys.
+    void test_set()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_parallel<false, 6> > btree_type;
+
+        btree_type bt;
+        std::multiset<unsigned int> set;
+
+        // distinct keys, so no two threads count the same key
+        srand(34234235);
+        for (unsigned int i = 0; i < 100000; i++)
+        {
+            bt.insert(3 * i);
+            set.insert(3 * i);
+        }
+
+        std::vector<unsigned int> visits(300000);
+        count_visits f = { &visits };
+        bt.parallel_for_each(f, 4);
+
+        for (unsigned int k = 0; k < visits.size(); ++k)
+            ASSERT(visits[k] == set.count(k));
+
+        // equal keys
+        for (unsigned int i = 0; i < 100000; i++)
+        {
+            unsigned int k = rand() % 1000;
+            bt.insert(k);
+            set.insert(k);
+        }
+
+        unsigned long long sum = 0;
+        for (std::multiset<unsigned int>::const_iterator it = set.begin();
+             it != set.end(); ++it)
+            sum += *it;
+
+        ASSERT(bt.parallel_reduce(0ULL, map_key, add, 5) == sum);
+        ASSERT(bt.aggregate() == sum);
+    }
+} _ParallelTest;
+
+/******************************************************************************/
@@ -0,0 +1,669 @@
+/*******************************************************************************
+ * testsuite/SearchTest.cc
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <stx/btree_set.h>
+#include <stx/btree_multiset.h>
+#include <stx/btree_map.h>
+#include <stx/btree_multimap.h>
+
+#include <cstdlib>
+#include <set>
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iterator>
+
+#include "tpunit.h"
+
+/// String comparison providing the three-way compare() method and counting
+/// the number of comparisons.
+struct StringCompare3
+{
+    static unsigned int calls;
+
+    bool operator () (const std::string& a, const std::string& b) const
+    {
+        ++calls;
+        return a < b;
+    }
+
+    int compare(const std::string& a, const std::string& b) const
+    {
+        ++calls;
+        return a.compare(b);
+    }
+};
+
+unsigned int StringCompare3::calls = 0;
+
+/// String less relation counting the number of comparisons.
+struct StringLess
+{
+    static unsigned int calls;
+
+    bool operator () (const std::string& a, const std::string& b) const
+    {
+        ++calls;
+        return a < b;
+    }
+};
+
+unsigned int StringLess::calls = 0;
+
+namespace stx {
+
+/// StringLess orders like std::less, hence it can use the same key heads.
+template <>
+struct btree_key_head<std::string, StringLess>
+    : public btree_key_head<std::string, std::less<std::string> >
+{ };
+
+} // namespace stx
+
+/// Integer less relation counting the number of comparisons.
+struct CountingSearchLess
+{
+    static unsigned int calls;
+
+    bool operator () (unsigned int a, unsigned int b) const
+    {
+        ++calls;
+        return a < b;
+    }
+};
+
+unsigned int CountingSearchLess::calls = 0;
+
+struct SearchTest : public tpunit::TestFixture
+{
+    SearchTest() : tpunit::TestFixture(
+                       TEST(SearchTest::test_int),
+                       TEST(SearchTest::test_unsigned_int),
+                       TEST(SearchTest::test_long_long),
+                       TEST(SearchTest::test_unsigned_long_long),
+                       TEST(SearchTest::test_float),
+                       TEST(SearchTest::test_double),
+                       TEST(SearchTest::test_greater),
+                       TEST(SearchTest::test_binsearch),
+                       TEST(SearchTest::test_threeway),
+                       TEST(SearchTest::test_key_head),
+                       TEST(SearchTest::test_key_heads),
+                       TEST(SearchTest::test_prefetch),
+                       TEST(SearchTest::test_batch_set),
+                       TEST(SearchTest::test_batch_map),
+                       TEST(SearchTest::test_cursor_set),
+                       TEST(SearchTest::test_cursor_map)
+                       )
+    { }
+
+    template <typename KeyType, int Slots, size_t Threshold>
+    struct traits_nodebug : stx::btree_default_set_traits<KeyType>
+    {
+        static const bool selfverify = true;
+        static const bool debug = false;
+
+        static const int  leafslots = Slots;
+        static const int  innerslots = Slots;
+
+        static const size_t binsearch_threshold = Threshold;
+    };
+
+    template <typename KeyType, int Slots>
+    struct traits_prefetch : traits_nodebug<KeyType, Slots, 256>
+    {
+        static const bool prefetch = true;
+    };
+
+    template <int Slots, size_t Threshold, bool ThreeWay>
+    struct traits_threeway : traits_nodebug<std::string, Slots, Threshold>
+    {
+        static const bool threeway_compare = ThreeWay;
+    };
+
+    template <int Slots, size_t Threshold, bool KeyHeads>
+    struct traits_heads : traits_nodebug<std::string, Slots, Threshold>
+    {
+        // the linear self-verification of find_lower() would count too
+        static const bool selfverify = false;
+        static const bool key_heads = KeyHeads;
+    };
+
+    /// Generates numeric keys by casting, negative values wrap around for
+    /// unsigned key types.
+    template <typename KeyType>
+    static void make_key(long long v, KeyType& key)
+    {
+        key = static_cast<KeyType>(v);
+    }
+
+    /// Generates string keys with a common prefix.
+    static void make_key(long long v, std::string& key)
+    {
+        std::ostringstream oss;
+        oss << "key-" << v;
+        key = oss.str();
+    }
+
+    /// Compares lower_bound() and upper_bound() of a B+ tree with duplicate
+    /// keys against std::multiset. Keys are spread by scale. Nodes larger
+    /// than Threshold bytes are searched using binary search.
+    template <typename KeyType, typename Compare, int Slots, size_t Threshold>
+    void test_bounds(const unsigned int insnum, const long long scale)
+    {
+        typedef stx::btree_multiset<KeyType, Compare,
+                                    traits_nodebug<KeyType, Slots, Threshold> > btree_type;
+
+        typedef std::multiset<KeyType, Compare> multiset_type;
+
+        btree_type bt;
+        multiset_type set;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < insnum; i++)
+        {
+            KeyType k;
+            make_key((rand() % 2001 - 1000) * scale, k);
+
+            bt.insert(k);
+            set.insert(k);
+        }
+
+        ASSERT(bt.size() == set.size());
+        bt.verify();
+
+        for (long long r = -1010; r <= 1010; ++r)
+        {
+            KeyType k;
+            make_key(r * scale, k);
+
+            typename multiset_type::const_iterator si = set.lower_bound(k);
+            typename btree_type::const_iterator bi = bt.lower_bound(k);
+
+            if (si == set.end())
+                ASSERT(bi == bt.end());
+            else
+                ASSERT(bi != bt.end() && *si == *bi);
+
+            si = set.upper_bound(k);
+            bi = bt.upper_bound(k);
+
+            if (si == set.end())
+                ASSERT(bi == bt.end());
+            else
+                ASSERT(bi != bt.end() && *si == *bi);
+
+            ASSERT(bt.count(k) == set.count(k));
+        }
+    }
+
+    /// Runs test_bounds() with node sizes below, at and above the number of
+    /// keys in a cache line.
+    template <typename KeyType>
+    void test_type(const long long scale)
+    {
+        test_bounds<KeyType, std::less<KeyType>, 8, 256>(3000, scale);
+        test_bounds<KeyType, std::less<KeyType>, 17, 256>(3000, scale);
+        test_bounds<KeyType, std::less<KeyType>, 64, 256>(3000, scale);
+    }
+
+    void test_int()
+    {
+        test_type<int>(1);
+    }
+
+    void test_unsigned_int()
+    {
+        test_type<unsigned int>(1);
+    }
+
+    void test_long_long()
+    {
+        test_type<long long>(1ll << 40);
+    }
+
+    void test_unsigned_long_long()
+    {
+        test_type<unsigned long long>(1ll << 40);
+    }
+
+    void test_float()
+    {
+        test_type<float>(1);
+    }
+
+    void test_double()
+    {
+        test_type<double>(1ll << 40);
+    }
+
+    void test_greater()
+    {
+        // no vectorized search for other comparison functions
+        ASSERT(!(stx::btree_simd_search<int, std::greater<int> >::enabled));
+
+        test_bounds<int, std::greater<int>, 17, 256>(3000, 1);
+    }
+
+    void test_binsearch()
+    {
+        // threshold zero selects the binary search for all nodes
+        test_bounds<int, std::less<int>, 8, 0>(3000, 1);
+        test_bounds<int, std::less<int>, 17, 0>(3000, 1);
+        test_bounds<double, std::less<double>, 64, 0>(3000, 1);
+        test_bounds<std::string, std::less<std::string>, 5, 0>(3000, 1);
+        test_bounds<std::string, std::less<std::string>, 32, 0>(3000, 1);
+    }
+
+    /// Checks find(), count() and equal_range() of a set and a multiset with
+    /// three-way comparison against the STL containers and counts the
+    /// number of comparisons used by the find() calls.
+    template <int Slots, size_t Threshold, bool ThreeWay>
+    void test_threeway_find(const unsigned int insnum, unsigned int& calls)
+    {
+        typedef traits_threeway<Slots, Threshold, ThreeWay> traits_type;
+
+        typedef stx::btree_set<std::string, StringCompare3, traits_type> set_type;
+        typedef stx::btree_multiset<std::string, StringCompare3, traits_type> multiset_type;
+
+        set_type bs;
+        multiset_type bms;
+        std::multiset<std::string> ms;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < insnum; i++)
+        {
+            std::string k;
+            make_key(rand() % 1000, k);
+
+            bs.insert(k);
+            bms.insert(k);
+            ms.insert(k);
+        }
+
+        ASSERT(bms.size() == ms.size());
+        bs.verify();
+        bms.verify();
+
+        calls = 0;
+
+        for (long long r = -10; r < 1010; ++r)
+        {
+            std::string k;
+            make_key(r, k);
+
+            StringCompare3::calls = 0;
+            bool found = (bs.find(k) != bs.end());
+            calls += StringCompare3::calls;
+
+            ASSERT(found == (ms.count(k) != 0));
+            ASSERT(bs.exists(k) == found);
+            ASSERT(bms.count(k) == ms.count(k));
+
+            std::pair<typename set_type::iterator, typename set_type::iterator>
+            sr = bs.equal_range(k);
+            ASSERT(static_cast<size_t>(std::distance(sr.first, sr.second)) == (found ? 1u : 0u));
+            ASSERT(sr.first == bs.lower_bound(k) && sr.second == bs.upper_bound(k));
+
+            std::pair<typename multiset_type::iterator, typename multiset_type::iterator>
+            mr = bms.equal_range(k);
+            ASSERT(static_cast<size_t>(std::distance(mr.first, mr.second)) == ms.count(k));
+            ASSERT(mr.first == bms.lower_bound(k) && mr.second == bms.upper_bound(k));
+        }
+
+        // erase all keys again
+        for (long long r = 0; r < 1000; ++r)
+        {
+            std::string k;
+            make_key(r, k);
+
+            ASSERT(bs.erase(k) == (ms.count(k) != 0 ? 1u : 0u));
+            ASSERT(bms.erase(k) == ms.count(k));
+        }
+
+        ASSERT(bs.empty() && bms.empty());
+    }
+
+    void test_threeway()
+    {
+        unsigned int calls2, calls3;
+        test_threeway_find<8, 256, false>(3000, calls2);
+        test_threeway_find<8, 256, true>(3000, calls3);
+
+        ASSERT(calls3 < calls2);
+
+        test_threeway_find<32, 0, true>(3000, calls3);
+        test_threeway_find<5, 0, true>(3000, calls3);
+    }
+
+    void test_key_head()
+    {
+        typedef stx::btree_key_head<std::string, std::less<std::string> > head_type;
+
+        std::vector<std::string> keys;
+        keys.push_back("");
+        keys.push_back(std::string(1, '\0'));
+        keys.push_back("a");
+        keys.push_back(std::string("a\0", 2));
+        keys.push_back("abcdefgh");
+        keys.push_back("abcdefgh0");
+        keys.push_back("abcdefgi");
+        keys.push_back("abcdefh");
+        keys.push_back("\x7f");
+        keys.push_back("\x80");
+        keys.push_back("\xff\xff\xff\xff\xff\xff\xff\xff\xff");
+
+        ASSERT(head_type::head("") == 0);
+        ASSERT(head_type::head("a") == 0x6100000000000000ULL);
+        ASSERT(head_type::head("abcdefgh0") == 0x6162636465666768ULL);
+
+        for (unsigned int i = 0; i < keys.size(); ++i)
+        {
+            for (unsigned int j = 0; j < keys.size(); ++j)
+            {
+                if (keys[i] < keys[j])
+                    ASSERT(head_type::head(keys[i]) <= head_type::head(keys[j]));
+                if (head_type::head(keys[i]) < head_type::head(keys[j]))
+                    ASSERT(keys[i] < keys[j]);
+            }
+        }
+    }
+
+    /// Checks lower_bound() and upper_bound() of a multiset with cached key
+    /// heads against std::multiset and counts the number of comparisons.
+    template <int Slots, size_t Threshold, bool KeyHeads>
+    void test_key_heads_bounds(const unsigned int insnum, unsigned int& calls)
+    {
+        typedef stx::btree_multiset<std::string, StringLess,
+                                    traits_heads<Slots, Threshold, KeyHeads> > btree_type;
+
+        btree_type bt;
+        std::multiset<std::string> ms;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < insnum; i++)
+        {
+            // keys with equal and different heads
+            std::string k;
+            make_key(rand() % 1000, k);
+            if (i % 3 == 0) k = k.substr(4) + k;
+
+            bt.insert(k);
+            ms.insert(k);
+        }
+
+        ASSERT(bt.size() == ms.size());
+        bt.verify();
+
+        calls = 0;
+
+        for (long long r = -10; r < 1010; ++r)
+        {
+            std::string k;
+            make_key(r, k);
+            if (r % 2 == 0) k = k.substr(4) + k;
+
+            StringLess::calls = 0;
+            typename btree_type::iterator lo = bt.lower_bound(k), hi = bt.upper_bound(k);
+            calls += StringLess::calls;
+
+            ASSERT((lo == bt.end()) == (ms.lower_bound(k) == ms.end()));
+            ASSERT(lo == bt.end() || *lo == *ms.lower_bound(k));
+            ASSERT((hi == bt.end()) == (ms.upper_bound(k) == ms.end()));
+            ASSERT(hi == bt.end() || *hi == *ms.upper_bound(k));
+            ASSERT(bt.count(k) == ms.count(k));
+        }
+
+        srand(34234235);
+        for (unsigned int i = 0; i < insnum / 2; i++)
+        {
+            std::string k;
+            make_key(rand() % 1000, k);
+            if (i % 3 == 0) k = k.substr(4) + k;
+
+            ASSERT(bt.erase_one(k));
+        }
+
+        ASSERT(bt.size() == insnum - insnum / 2);
+        bt.verify();
+    }
+
+    void test_key_heads()
+    {
+        unsigned int calls_plain, calls_heads;
+        test_key_heads_bounds<8, 256, false>(3000, calls_plain);
+        test_key_heads_bounds<8, 256, true>(3000, calls_heads);
+
+        ASSERT(2 * calls_heads < calls_plain);
+
+        test_key_heads_bounds<32, 0, true>(3000, calls_heads);
+        test_key_heads_bounds<5, 0, true>(3000, calls_heads);
+    }
+
+    void test_prefetch()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_prefetch<unsigned int, 9> > btree_type;
+
+        btree_type bt;
+        std::multiset<unsigned int> set;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 3200; i++)
+        {
+            unsigned int k = rand() % 1000;
+            bt.insert(k);
+            set.insert(k);
+        }
+
+        bt.verify();
+        ASSERT(bt.size() == set.size());
+
+        ASSERT(std::equal(bt.begin(), bt.end(), set.begin()));
+        ASSERT(std::equal(bt.rbegin(), bt.rend(), set.rbegin()));
+
+        // iterate backwards using operator--
+        {
+            btree_type::const_iterator bi = bt.end();
+            std::multiset<unsigned int>::const_iterator si = set.end();
+            while (bi != bt.begin())
+                ASSERT(*--bi == *--si);
+        }
+
+        for (unsigned int k = 0; k < 1000; k++)
+        {
+            ASSERT(bt.count(k) == set.count(k));
+            ASSERT(bt.lower_bound(k) == bt.equal_range(k).first);
+            ASSERT(bt.upper_bound(k) == bt.equal_range(k).second);
+        }
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 3200; i++)
+        {
+            unsigned int k = rand() % 1000;
+            ASSERT(bt.erase_one(k));
+        }
+
+        ASSERT(bt.empty());
+    }
+
+    /// Compares find_batch() and exists_batch() with find() for a container
+    /// filled with keys of rand() % modulo.
+    template <typename ContainerType>
+    void test_batch(ContainerType& bt, unsigned int modulo)
+    {
+        std::vector<unsigned int> keys;
+        for (unsigned int k = 0; k < modulo + 10; ++k)
+            keys.push_back(k);
+        std::random_shuffle(keys.begin(), keys.end());
+
+        std::vector<typename ContainerType::iterator> iters;
+        bt.find_batch(keys.begin(), keys.end(), std::back_inserter(iters));
+        ASSERT(iters.size() == keys.size());
+
+        std::vector<typename ContainerType::const_iterator> citers;
+        const ContainerType& cbt = bt;
+        cbt.find_batch(keys.begin(), keys.end(), std::back_inserter(citers));
+        ASSERT(citers.size() == keys.size());
+
+        std::vector<bool> exists;
+        bt.exists_batch(keys.begin(), keys.end(), std::back_inserter(exists));
+        ASSERT(exists.size() == keys.size());
+
+        for (unsigned int i = 0; i < keys.size(); ++i)
+        {
+            ASSERT(iters[i] == bt.find(keys[i]));
+            ASSERT(citers[i] == cbt.find(keys[i]));
+            ASSERT(exists[i] == bt.exists(keys[i]));
+        }
+    }
+
+    void test_batch_set()
+    {
+        typedef traits_nodebug<unsigned int, 8, 256> traits_type;
+
+        stx::btree_set<unsigned int, std::less<unsigned int>, traits_type> bs;
+        stx::btree_multiset<unsigned int, std::less<unsigned int>, traits_type> bms;
+
+        test_batch(bs, 1000);
+        test_batch(bms, 1000);
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 3200; i++)
+        {
+            unsigned int k = rand() % 1000;
+            bs.insert(k);
+            bms.insert(k);
+        }
+
+        test_batch(bs, 1000);
+        test_batch(bms, 1000);
+    }
+
+    void test_batch_map()
+    {
+        typedef traits_nodebug<unsigned int, 13, 256> traits_type;
+
+        stx::btree_map<unsigned int, unsigned int,
+                       std::less<unsigned int>, traits_type> bm;
+        stx::btree_multimap<unsigned int, unsigned int,
+                            std::less<unsigned int>, traits_type> bmm;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 32000; i++)
+        {
+            unsigned int k = rand() % 10000;
+            bm.insert(std::make_pair(k, i));
+            bmm.insert(std::make_pair(k, i));
+        }
+
+        test_batch(bm, 10000);
+        test_batch(bmm, 10000);
+    }
+
+    /// Compares cursor seeks in increasing, decreasing and random order with
+    /// lower_bound() for a container filled with keys of rand() % modulo.
+    template <typename ContainerType>
+    void test_cursor(ContainerType& bt, unsigned int modulo)
+    {
+        typename ContainerType::cursor c = bt.make_cursor();
+
+        for (unsigned int k = 0; k < modulo + 10; ++k)
+            ASSERT(c.seek(k) == bt.lower_bound(k));
+
+        for (unsigned int k = modulo + 10; k > 0; --k)
+            ASSERT(c.seek(k - 1) == bt.lower_bound(k - 1));
+
+        const ContainerType& cbt = bt;
+        typename ContainerType::const_cursor cc = cbt.make_cursor();
+
+        for (unsigned int i = 0; i < 10000; ++i)
+        {
+            unsigned int k = rand() % (modulo + 10);
+            ASSERT(c.seek(k) == bt.lower_bound(k));
+            ASSERT(cc.seek(k) == cbt.lower_bound(k));
+        }
+
+        // the cursor must be reset after modifications
+        bt.insert(bt.end(), *bt.begin());
+        c.reset();
+        ASSERT(c.seek(modulo / 2) == bt.lower_bound(modulo / 2));
+    }
+
+    void test_cursor_set()
+    {
+        typedef traits_nodebug<unsigned int, 8, 256> traits_type;
+
+        stx::btree_set<unsigned int, std::less<unsigned int>, traits_type> bs;
+        stx::btree_multiset<unsigned int, std::less<unsigned int>, traits_type> bms;
+
+        ASSERT(bs.make_cursor().seek(1) == bs.end());
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 3200; i++)
+        {
+            unsigned int k = rand() % 1000;
+            bs.insert(k);
+            bms.insert(k);
+        }
+
+        test_cursor(bs, 1000);
+        test_cursor(bms, 1000);
+    }
+
+    void test_cursor_map()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, CountingSearchLess,
+                               traits_nodebug<unsigned int, 8, 256> > btree_type;
+
+        btree_type bm;
+        stx::btree_multimap<unsigned int, unsigned int, CountingSearchLess,
+                            traits_nodebug<unsigned int, 13, 256> > bmm;
+
+        for (unsigned int i = 0; i < 100000; i++)
+        {
+            bm.insert2(2 * i, i);
+            bmm.insert2(i / 5, i);
+        }
+
+        test_cursor(bmm, 20000);
+
+        // probing sorted nearby keys is cheaper than descending from the root
+        CountingSearchLess::calls = 0;
+        for (unsigned int k = 0; k < 200000; k += 3)
+            bm.lower_bound(k);
+        unsigned int calls_plain = CountingSearchLess::calls;
+
+        btree_type::cursor c = bm.make_cursor();
+
+        CountingSearchLess::calls = 0;
+        for (unsigned int k = 0; k < 200000; k += 3)
+        {
+            btree_type::iterator it = c.seek(k);
+            ASSERT(it.key() == k + (k % 2));
+        }
+        unsigned int calls_cursor = CountingSearchLess::calls;
+
+        ASSERT(2 * calls_cursor < calls_plain);
+    }
+} _SearchTest;
+
+/******************************************************************************/
@@ -0,0 +1,252 @@
+/*******************************************************************************
+ * testsuite/SplitJoinTest.cc
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#include <stx/btree_multiset.h>
+#include <stx/btree_map.h>
+
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "tpunit.h"
+#include "TestTraits.h"
+
+struct SplitJoinTest : public tpunit::TestFixture
+{
+    SplitJoinTest() : tpunit::TestFixture(
+                          TEST(SplitJoinTest::test_split_join_all),
+                          TEST(SplitJoinTest::test_join_sizes),
+                          TEST(SplitJoinTest::test_join_foreign),
+                          TEST(SplitJoinTest::test_split_duplicates),
+                          TEST(SplitJoinTest::test_map)
+                          )
+    { }
+
+    template <typename BtreeType, typename Iterator>
+    void check_equal(const BtreeType& bt, Iterator first, Iterator last)
+    {
+        bt.verify();
+        ASSERT(bt.size() == static_cast<size_t>(std::distance(first, last)));
+        ASSERT(std::equal(first, last, bt.begin()));
+    }
+
+    /// Splits a tree at every key and joins the parts again.
+    template <bool Special, int Slots>
+    void test_split_join_all_instance(unsigned int numkeys, unsigned int mod)
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, Special, Slots> > btree_type;
+
+        std::multiset<unsigned int> set;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < numkeys; i++)
+            set.insert(rand() % mod);
+
+        for (unsigned int k = 0; k <= mod; ++k)
+        {
+            btree_type bt, right;
+
+            // build by insertion to get unevenly filled nodes
+            for (std::multiset<unsigned int>::const_iterator it = set.begin();
+                 it != set.end(); ++it)
+                bt.insert(*it);
+
+            right.insert(42);
+            bt.split_at(k, right);
+
+            check_equal(bt, set.begin(), set.lower_bound(k));
+            check_equal(right, set.lower_bound(k), set.end());
+
+            bt.join(right);
+
+            ASSERT(right.empty());
+            check_equal(bt, set.begin(), set.end());
+        }
+    }
+
+    void test_split_join_all()
+    {
+        test_split_join_all_instance<false, 4>(300, 1000);
+        test_split_join_all_instance<true, 4>(300, 1000);
+        test_split_join_all_instance<false, 5>(400, 100);
+        test_split_join_all_instance<true, 8>(1000, 1000);
+    }
+
+    /// Joins trees of all combinations of sizes, which share their node
+    /// allocator only if they were split from one tree.
+    template <bool Special>
+    void test_join_sizes_instance(bool shared)
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, Special, 4> > btree_type;
+
+        static const unsigned int sizes[] = { 1, 2, 3, 7, 20, 100, 1000, 5000 };
+        static const unsigned int numsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+        for (unsigned int i = 0; i < numsizes; ++i)
+        {
+            for (unsigned int j = 0; j < numsizes; ++j)
+            {
+                std::vector<unsigned int> keys;
+                for (unsigned int k = 0; k < sizes[i] + sizes[j]; ++k)
+                    keys.push_back(2 * k);
+
+                btree_type left, right;
+
+                if (shared)
+                {
+                    // sequential inserts leave an underflowing tail leaf
+                    for (unsigned int k = 0; k < keys.size(); ++k)
+                        left.insert(keys[k]);
+
+                    left.split_at(keys[sizes[i]], right);
+                }
+                else
+                {
+                    for (unsigned int k = 0; k < sizes[i]; ++k)
+                        left.insert(keys[k]);
+
+                    right.bulk_load(keys.begin() + sizes[i], keys.end());
+                }
+
+                left.join(right);
+
+                ASSERT(right.empty());
+                check_equal(left, keys.begin(), keys.end());
+            }
+        }
+    }
+
+    void test_join_sizes()
+    {
+        test_join_sizes_instance<false>(true);
+        test_join_sizes_instance<false>(false);
+        test_join_sizes_instance<true>(true);
+        test_join_sizes_instance<true>(false);
+    }
+
+    /// Joins the part split off one tree into a third tree with a pool of
+    /// its own, which copies the pairs because the pool of the part is
+    /// shared, and destroys both source trees before reading the result.
+    template <typename BtreeType>
+    void test_join_foreign_instance()
+    {
+        std::vector<unsigned int> keys;
+        for (unsigned int k = 0; k < 3000; ++k)
+            keys.push_back(k);
+
+        BtreeType* a = new BtreeType;
+        BtreeType* b = new BtreeType;
+        BtreeType c;
+
+        a->bulk_load(keys.begin() + 1000, keys.end());
+        a->split_at(2000, *b);
+        c.bulk_load(keys.begin(), keys.begin() + 2000);
+
+        c.join(*b);
+        ASSERT(b->empty());
+
+        delete a;
+        delete b;
+
+        check_equal(c, keys.begin(), keys.end());
+    }
+
+    void test_join_foreign()
+    {
+        test_join_foreign_instance<
+            stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                traits_special<unsigned int, true, 4> > >();
+
+        test_join_foreign_instance<
+            stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                traits_special<unsigned int, false, 4>,
+                                stx::btree_pool_allocator<unsigned int> > >();
+    }
+
+    /// Equal keys all go to the right part.
+    void test_split_duplicates()
+    {
+        typedef stx::btree_multiset<unsigned int, std::less<unsigned int>,
+                                    traits_special<unsigned int, false, 4> > btree_type;
+
+        std::multiset<unsigned int> set;
+        btree_type bt, right;
+
+        for (unsigned int i = 0; i < 1000; i++)
+        {
+            set.insert(i / 100);
+            bt.insert(i / 100);
+        }
+
+        for (unsigned int k = 0; k <= 10; ++k)
+        {
+            bt.split_at(k, right);
+
+            check_equal(bt, set.begin(), set.lower_bound(k));
+            check_equal(right, set.lower_bound(k), set.end());
+
+            bt.join(right);
+            check_equal(bt, set.begin(), set.end());
+        }
+    }
+
+    /// Cuts a map into pieces and concatenates them in order.
+    void test_map()
+    {
+        typedef stx::btree_map<unsigned int, unsigned int, std::less<unsigned int>,
+                               traits_special<unsigned int, true, 8> > btree_type;
+
+        btree_type bt;
+        std::map<unsigned int, unsigned int> map;
+
+        for (unsigned int i = 0; i < 20000; i++)
+        {
+            bt.insert2(i, i * i);
+            map.insert(std::make_pair(i, i * i));
+        }
+
+        std::vector<btree_type> pieces(5);
+        for (unsigned int p = 4; p > 0; --p)
+            bt.split_at(p * 4000 + p, pieces[p]);
+        pieces[0].swap(bt);
+
+        ASSERT(bt.empty());
+        for (unsigned int p = 0; p < 5; ++p)
+            pieces[p].verify();
+
+        for (unsigned int p = 0; p < 5; ++p)
+            bt.join(pieces[p]);
+
+        bt.verify();
+        ASSERT(bt.size() == map.size());
+
+        btree_type::const_iterator bi = bt.begin();
+        for (std::map<unsigned int, unsigned int>::const_iterator mi = map.begin();
+             mi != map.end(); ++mi, ++bi)
+        {
+            ASSERT(bi.key() == mi->first && bi.data() == mi->second);
+        }
+    }
+} _SplitJoinTest;
+
+/******************************************************************************/
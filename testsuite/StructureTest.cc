@@ -19,15 +19,22 @@
  ******************************************************************************/
 
 #include <stx/btree_multiset.h>
+#include <stx/btree_map.h>
 
 #include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "tpunit.h"
 
 struct StructureTest : public tpunit::TestFixture
 {
     StructureTest() : tpunit::TestFixture(
-                          TEST(StructureTest::test_insert_erase)
+                          TEST(StructureTest::test_insert_erase),
+                          TEST(StructureTest::test_separator),
+                          TEST(StructureTest::test_truncate_separators)
                           )
     { }
 
@@ -70,6 +77,12 @@ struct StructureTest : public tpunit::TestFixture
         static const int  innerslots = 8;
     };
 
+    template <typename KeyType>
+    struct traits_truncate : traits_nodebug<KeyType>
+    {
+        static const bool truncate_separators = true;
+    };
+
     void test_insert_erase()
     {
         typedef stx::btree_multiset<struct testdata, struct testcomp,
@@ -93,6 +106,118 @@ struct StructureTest : public tpunit::TestFixture
             ASSERT(bt.size() == 320 - i - 1);
         }
     }
+
+    void test_separator()
+    {
+        typedef stx::btree_separator<std::string, std::less<std::string> > sep_type;
+        std::less<std::string> less;
+
+        ASSERT(sep_type::shortest(less, "http://a.org/abc", "http://b.org/") == "http://a/");
+        ASSERT(sep_type::shortest(less, "http://a.org/abc", "http://a.org/x") == "http://a.org/b");
+        ASSERT(sep_type::shortest(less, "http://a.org/abc", "http://a.org/abd") == "http://a.org/abc");
+        ASSERT(sep_type::shortest(less, "http://a.org/abc", "http://a.org/b") == "http://a.org/ac");
+        ASSERT(sep_type::shortest(less, "http://a.org", "http://a.org/") == "http://a.org");
+        ASSERT(sep_type::shortest(less, "ab\xfez", "ab\xffz") == "ab\xfez");
+        ASSERT(sep_type::shortest(less, "a\xff\xffz\x01", "b") == "a\xff\xff{");
+        ASSERT(sep_type::shortest(less, "a\x01", "\xf0") == "b");
+    }
+
+    /// Generates a random URL-like string key with a long common prefix.
+    static std::string make_url(unsigned int v)
+    {
+        std::string key = "http://www.example.com/";
+        for (unsigned int i = 0; i < 4; ++i, v /= 7)
+            key += static_cast<char>('a' + (v % 7) * 3);
+        key += "/index.html";
+        return key;
+    }
+
+    /// Returns the iterator of the B+ tree pointing to the same item as mi.
+    template <typename BTreeType, typename MapType>
+    static typename BTreeType::iterator
+    find(BTreeType& bt, const MapType& map, typename MapType::const_iterator mi)
+    {
+        return (mi == map.end()) ? bt.end() : bt.find(mi->first);
+    }
+
+    void test_truncate_separators()
+    {
+        typedef stx::btree_map<std::string, unsigned int, std::less<std::string>,
+                               traits_truncate<std::string> > btree_type;
+
+        btree_type bt;
+        std::map<std::string, unsigned int> map;
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 3200; i++)
+        {
+            std::string k = make_url(rand() % 2401);
+            ASSERT(bt.insert2(k, i).second == map.insert(std::make_pair(k, i)).second);
+        }
+
+        ASSERT(bt.size() == map.size());
+
+        // search keys between the stored keys and the separators
+        for (unsigned int i = 0; i < 2401; i++)
+        {
+            std::string k = make_url(i);
+            k.resize(24 + i % 4);
+
+            ASSERT(bt.lower_bound(k) == find(bt, map, map.lower_bound(k)));
+            ASSERT(bt.upper_bound(k) == find(bt, map, map.upper_bound(k)));
+            ASSERT(bt.make_cursor().seek(k) == bt.lower_bound(k));
+        }
+
+        // insert the shortened keys using hints and erase half of the keys
+        for (unsigned int i = 0; i < 2401; i++)
+        {
+            std::string k = make_url(i);
+            k.resize(24 + i % 4);
+
+            bt.insert(bt.lower_bound(k), std::make_pair(k, i));
+            map.insert(std::make_pair(k, i));
+        }
+
+        srand(34234235);
+        for (unsigned int i = 0; i < 1600; i++)
+        {
+            std::string k = make_url(rand() % 2401);
+            ASSERT(bt.erase(k) == map.erase(k));
+        }
+
+        ASSERT(bt.size() == map.size());
+        std::vector<std::pair<std::string, unsigned int> > pairs(map.begin(), map.end());
+        ASSERT(std::equal(bt.begin(), bt.end(), pairs.begin()));
+
+        // bulk load the multiset of all keys
+        typedef stx::btree_multiset<std::string, std::less<std::string>,
+                                    traits_truncate<std::string> > multiset_type;
+
+        std::vector<std::string> keys;
+        for (std::map<std::string, unsigned int>::const_iterator mi = map.begin();
+             mi != map.end(); ++mi)
+        {
+            keys.push_back(mi->first);
+            keys.push_back(mi->first);
+        }
+
+        multiset_type ms;
+        ms.bulk_load(keys.begin(), keys.end());
+        ms.verify();
+
+        ASSERT(ms.size() == keys.size());
+        ASSERT(std::equal(ms.begin(), ms.end(), keys.begin()));
+
+        size_t erased = 0;
+        for (unsigned int i = 0; i < 2401; i++)
+        {
+            std::string k = make_url(i);
+            ASSERT(ms.count(k) == 2 * map.count(k));
+            erased += ms.erase(k);
+        }
+
+        ASSERT(ms.size() + erased == keys.size());
+    }
 } _StructureTest;
 
 inline std::ostream& operator << (std::ostream& o,
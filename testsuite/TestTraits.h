@@ -0,0 +1,65 @@
+/*******************************************************************************
+ * testsuite/TestTraits.h
+ *
+ * STX B+ Tree Test Suite v0.9
+ * Copyright (C) 2008-2013 Timo Bingmann
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+#ifndef STX_TESTSUITE_TESTTRAITS_H_HEADER
+#define STX_TESTSUITE_TESTTRAITS_H_HEADER
+
+#include <stx/btree.h>
+
+#include <string>
+
+/// Traits with Slots slots in each node and without self-verification, which
+/// is too slow for large tests. Special switches on the node options tested
+/// together: truncated separators, key heads and the node pool.
+template <typename KeyType, bool Special, int Slots>
+struct traits_special : stx::btree_default_set_traits<KeyType>
+{
+    static const bool selfverify = false;
+    static const bool debug = false;
+
+    static const int  leafslots = Slots;
+    static const int  innerslots = Slots;
+
+    static const bool truncate_separators = Special;
+    static const bool key_heads = Special;
+    static const bool node_pool = Special;
+};
+
+/// Generates the k-th test key. Numbers keep their order, strings share a
+/// prefix and differ in length.
+template <typename KeyType>
+KeyType make_test_key(unsigned int k);
+
+template <>
+inline unsigned int make_test_key<unsigned int>(unsigned int k)
+{
+    return k;
+}
+
+template <>
+inline std::string make_test_key<std::string>(unsigned int k)
+{
+    return std::string("key") + static_cast<char>('0' + k % 10) + std::string(k % 7, 'x')
+           + static_cast<char>('a' + k / 10 % 26) + static_cast<char>('a' + k / 260 % 26);
+}
+
+#endif // !STX_TESTSUITE_TESTTRAITS_H_HEADER
+
+/******************************************************************************/